@@ -0,0 +1,108 @@
+#!/bin/sh
+# Renders the benchmark scenes headless and compares the results with bench_baseline.csv.
+# `make bench` runs it with the optimized vlkBench binary.
+#
+#   ./bench.sh [--update-baseline] [BINARY]
+#
+# Results go to bench_results.csv and bench_results.json, the output of every run to
+# bench_log.txt. --update-baseline copies the results to the baseline instead, and without
+# a baseline the run fails. A metric that is more than BENCH_THRESHOLD percent (default 10)
+# worse than its baseline fails the run, and so does one missing from the results.
+# BENCH_SIZE (default 1280x720) and BENCH_FRAMES (default 300) change the scenes.
+# The Vulkan loader picks the ICD; VK_ICD_FILENAMES selects one, e.g. lavapipe.
+
+set -e
+
+update=0
+if [ "$1" = "--update-baseline" ]; then
+    update=1
+    shift
+fi
+binary=${1:-./vlkBench}
+threshold=${BENCH_THRESHOLD:-10}
+size=${BENCH_SIZE:-1280x720}
+frames=${BENCH_FRAMES:-300}
+results=bench_results.csv
+json=bench_results.json
+baseline=bench_baseline.csv
+log=bench_log.txt
+
+if [ "$update" = 0 ] && [ ! -f "$baseline" ]; then
+    echo "No $baseline to compare with, run make bench-baseline on a known good build first" >&2
+    exit 1
+fi
+
+echo "scene,metric,value,better" > "$results"
+: > "$log"
+
+run_scene() {
+    scene=$1
+    shift
+    echo "$scene: $*"
+    echo "== $scene: $*" >> "$log"
+    if ! "$binary" --headless "$size" --results "$results" --scene "$scene" "$@" >> "$log" 2>&1; then
+        echo "Scene $scene failed, see $log" >&2
+        exit 1
+    fi
+}
+
+# One instanced draw of many triangles
+run_scene triangles --frames "$frames" --instances 250000
+# The same with each frame's CPU work started just before the GPU needs it, compare the latencies
+run_scene low_latency --frames "$frames" --instances 250000 --low-latency
+# Many small draws, so the CPU side of recording dominates
+run_scene draws --frames "$frames" --draws 20000
+# A different pipeline bound before every draw
+run_scene pipelines --frames "$frames" --draws 4000 --pipeline-switches 32
+# The same draws sorted by the render queue
+run_scene queue --frames "$frames" --draws 4000 --pipeline-switches 32 --render-queue
+# Full screen layers with an expensive fragment shader
+run_scene fillrate --overdraw-bench 32
+# Streaming through the staging ring while rendering
+run_scene upload --frames "$frames" --upload 256
+
+awk -F, 'NR > 1 {
+    printf "%s\n  {\"scene\": \"%s\", \"metric\": \"%s\", \"value\": %s, \"better\": \"%s\"}", (NR > 2 ? "," : "["), $1, $2, $3, $4
+} END { print (NR > 1 ? "\n]" : "[]") }' "$results" > "$json"
+
+if [ "$update" = 1 ]; then
+    cp "$results" "$baseline"
+    echo "Wrote $baseline, later runs are compared against it"
+    exit 0
+fi
+
+# Positive changes are regressions, whichever direction the metric improves in
+awk -F, -v threshold="$threshold" '
+FNR == 1 { next }
+NR == FNR { base[$1 "," $2] = $3; next }
+{
+    key = $1 "," $2
+    seen[key] = 1
+    if(!(key in base)) {
+        printf "%-10s %-22s %12.3f   (not in baseline)\n", $1, $2, $3
+        next
+    }
+    if(base[key] == 0) {
+        printf "%-10s %-22s %12.3f   (baseline is 0)\n", $1, $2, $3
+        next
+    }
+    change = ($3 - base[key]) / base[key] * 100
+    worse = $4 == "higher" ? -change : change
+    status = worse > threshold ? "REGRESSION" : "ok"
+    if(worse > threshold)
+        failed = 1
+    printf "%-10s %-22s %12.3f %12.3f %+8.1f%%  %s\n", $1, $2, base[key], $3, change, status
+}
+END {
+    for(key in base) {
+        if(!(key in seen)) {
+            split(key, parts, ",")
+            printf "%-10s %-22s %12.3f   MISSING from the results\n", parts[1], parts[2], base[key]
+            failed = 1
+        }
+    }
+    if(failed) {
+        printf "Regressions of more than %s%% or missing metrics against the baseline\n", threshold
+        exit 1
+    }
+}' "$baseline" "$results"
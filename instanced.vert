@@ -0,0 +1,44 @@
+#version 450
+
+layout(constant_id = 2) const bool FEATURE_FLAT_COLOR = false;
+
+// One triangle per instance, transform and color come from storage buffers
+layout(std430, set = 0, binding = 0) readonly buffer InstanceTransforms {
+    vec4 transforms[]; // xy = position, z = scale, w = rotation
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer InstanceColors {
+    uint colors[];
+};
+
+// World to clip space, shared with cull.comp so both agree on what is on screen
+layout(push_constant) uniform View {
+    vec2 view_offset;
+    float view_zoom;
+};
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUV;
+
+// The depth pre-pass runs this shader too, its EQUAL test needs bit identical depth
+invariant gl_Position;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+void main() {
+    vec4 transform = transforms[gl_InstanceIndex];
+    vec2 position = positions[gl_VertexIndex] * transform.z;
+    fragUV = positions[gl_VertexIndex] + 0.5;
+    float s = sin(transform.w);
+    float c = cos(transform.w);
+    vec2 world = transform.xy + vec2(c * position.x - s * position.y, s * position.x + c * position.y);
+    // Scattered depths, so overlapping instances occlude each other rather than just draw in order
+    float depth = fract(float(gl_InstanceIndex) * 0.618034);
+    gl_Position = vec4((world - view_offset) * view_zoom, depth, 1.0);
+    // Flat color skips the color fetch altogether once the constant is folded
+    fragColor = FEATURE_FLAT_COLOR ? vec3(1.0) : unpackUnorm4x8(colors[gl_InstanceIndex]).rgb;
+}
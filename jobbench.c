@@ -0,0 +1,235 @@
+// Scaling benchmark of the job system (vlk_jobs.c) on a synthetic frame, doesn't need
+// Vulkan or SDL.
+//
+//   jobbench [INSTANCES] [MAX_WORKERS]
+//
+// Each frame builds the world matrices of the instances, then culls them and copies the
+// matrices into an upload buffer, and once culling is done "records" a draw per visible
+// instance. The frame runs with 1, 2, 4, ... workers up to one per core (or MAX_WORKERS)
+// and prints the frame time, the speedup and how busy every worker was.
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime, sysconf
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vlk_jobs.h"
+#include "vlk_math.h"
+
+#define DEFAULT_INSTANCES 200000
+#define WARMUP_FRAMES 10
+#define BENCH_FRAMES 100
+#define TRANSFORM_BATCH 1024
+// Culling, upload and recording split into this many jobs
+#define FRAME_BATCHES 64
+
+typedef struct DrawCommand {
+    uint32_t instance;
+    uint32_t lod;
+    float depth;
+    uint32_t sort_key;
+} DrawCommand;
+
+typedef struct FrameWork {
+    uint32_t count;
+    const MathKernels *math;
+    Quat *rotation;
+    float *position[3];
+    float *scale;
+    Aabb local_bounds;
+    Mat4 *world;
+    Aabb *bounds;
+    uint8_t *visible;
+    Mat4 *upload;
+    DrawCommand *draws;
+    uint32_t draw_counts[FRAME_BATCHES];
+} FrameWork;
+
+typedef struct FrameBatch {
+    FrameWork *work;
+    uint32_t index;
+    uint32_t begin;
+    uint32_t end;
+} FrameBatch;
+
+static void *alloc_or_die(size_t size) {
+    void *p = malloc(size);
+    if(!p) {
+        fprintf(stderr, "Failed to allocate benchmark data.\n");
+        exit(1);
+    }
+    return p;
+}
+
+static float random_float(uint32_t *state, float min, float max) {
+    *state = *state * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(*state >> 8) / (float)(1u << 24);
+}
+
+static double get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec * 1e-6;
+}
+
+static FrameWork frame_work_create(uint32_t count) {
+    FrameWork work = { 0 };
+    work.count = count;
+    work.math = math_kernels();
+    float *streams = alloc_or_die(sizeof(float) * count * 4);
+    for(int k = 0; k < 3; ++k)
+        work.position[k] = streams + count * k;
+    work.scale = streams + count * 3;
+    work.rotation = alloc_or_die(sizeof(Quat) * count);
+    work.world = alloc_or_die(sizeof(Mat4) * count);
+    work.bounds = alloc_or_die(sizeof(Aabb) * count);
+    work.visible = alloc_or_die(count);
+    work.upload = alloc_or_die(sizeof(Mat4) * count);
+    work.draws = alloc_or_die(sizeof(DrawCommand) * count);
+    work.local_bounds = (Aabb){ { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+
+    uint32_t state = 1;
+    for(uint32_t i = 0; i < count; ++i) {
+        float x = random_float(&state, -1.0f, 1.0f), y = random_float(&state, -1.0f, 1.0f);
+        float z = random_float(&state, -1.0f, 1.0f), w = random_float(&state, 0.1f, 1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        work.rotation[i] = (Quat){ x / length, y / length, z / length, w / length };
+        for(int k = 0; k < 3; ++k)
+            work.position[k][i] = random_float(&state, -200.0f, 200.0f);
+        work.scale[i] = random_float(&state, 0.5f, 3.0f);
+    }
+    return work;
+}
+
+static void frame_work_destroy(FrameWork *work) {
+    free(work->position[0]);
+    free(work->rotation);
+    free(work->world);
+    free(work->bounds);
+    free(work->visible);
+    free(work->upload);
+    free(work->draws);
+}
+
+// Rotation from the quaternion, then scale and translation
+static void transform_range(void *user_data, uint32_t begin, uint32_t end, uint32_t worker_index) {
+    FrameWork *work = user_data;
+    (void)worker_index;
+    work->math->quat_to_mat4_aos(work->world + begin, work->rotation + begin, end - begin);
+    for(uint32_t i = begin; i < end; ++i) {
+        float *m = work->world[i].m;
+        for(int k = 0; k < 12; ++k)
+            m[k] *= work->scale[i];
+        for(int k = 0; k < 3; ++k)
+            m[12 + k] = work->position[k][i];
+    }
+}
+
+static void cull_batch(void *user_data, uint32_t worker_index) {
+    FrameBatch *batch = user_data;
+    FrameWork *work = batch->work;
+    (void)worker_index;
+    for(uint32_t i = batch->begin; i < batch->end; ++i) {
+        work->math->aabb_transform_aos(&work->bounds[i], &work->world[i], &work->local_bounds, 1);
+        // A box around the view stands in for the frustum
+        const Aabb *b = &work->bounds[i];
+        work->visible[i] = b->max[0] > -150.0f && b->min[0] < 150.0f && b->max[1] > -100.0f && b->min[1] < 100.0f && b->max[2] > 0.0f;
+    }
+}
+
+static void upload_batch(void *user_data, uint32_t worker_index) {
+    FrameBatch *batch = user_data;
+    (void)worker_index;
+    memcpy(batch->work->upload + batch->begin, batch->work->world + batch->begin, sizeof(Mat4) * (batch->end - batch->begin));
+}
+
+static void record_batch(void *user_data, uint32_t worker_index) {
+    FrameBatch *batch = user_data;
+    FrameWork *work = batch->work;
+    (void)worker_index;
+    uint32_t draw_count = 0;
+    DrawCommand *draws = work->draws + batch->begin;
+    for(uint32_t i = batch->begin; i < batch->end; ++i) {
+        if(!work->visible[i])
+            continue;
+        float depth = work->world[i].m[14];
+        DrawCommand *draw = &draws[draw_count++];
+        draw->instance = i;
+        draw->lod = depth < 50.0f ? 0 : (depth < 120.0f ? 1 : 2);
+        draw->depth = depth;
+        draw->sort_key = (draw->lod << 30) | (uint32_t)(depth * 1024.0f);
+    }
+    work->draw_counts[batch->index] = draw_count;
+}
+
+static uint32_t run_frame(JobSystem *jobs, FrameWork *work) {
+    job_parallel_for(jobs, work->count, TRANSFORM_BATCH, transform_range, work);
+
+    FrameBatch batches[FRAME_BATCHES];
+    for(uint32_t i = 0; i < FRAME_BATCHES; ++i)
+        batches[i] = (FrameBatch){ work, i, (uint32_t)((uint64_t)work->count * i / FRAME_BATCHES), (uint32_t)((uint64_t)work->count * (i + 1) / FRAME_BATCHES) };
+    JobCounter culled = { 0 }, done = { 0 };
+    for(uint32_t i = 0; i < FRAME_BATCHES; ++i) {
+        job_run(jobs, cull_batch, &batches[i], &culled);
+        job_run(jobs, upload_batch, &batches[i], &done);
+    }
+    for(uint32_t i = 0; i < FRAME_BATCHES; ++i)
+        job_run_after(jobs, record_batch, &batches[i], &done, &culled);
+    job_wait(jobs, &done);
+
+    uint32_t draws = 0;
+    for(uint32_t i = 0; i < FRAME_BATCHES; ++i)
+        draws += work->draw_counts[i];
+    return draws;
+}
+
+int main(int argc, char **argv) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t instances = DEFAULT_INSTANCES;
+    uint32_t max_workers = cores > 0 ? (uint32_t)cores : 1;
+    if(argc > 3 || (argc > 1 && (sscanf(argv[1], "%u", &instances) != 1 || !instances)) || (argc > 2 && (sscanf(argv[2], "%u", &max_workers) != 1 || !max_workers || max_workers > JOB_MAX_WORKERS))) {
+        fprintf(stderr, "Usage: %s [INSTANCES] [MAX_WORKERS (1 to %u)]\n", argv[0], JOB_MAX_WORKERS);
+        return 1;
+    }
+
+    FrameWork work = frame_work_create(instances);
+    printf("%u instances, %ld cores, math kernels: %s\n", instances, cores, math_isa_name(work.math->isa));
+
+    double single_worker_time = 0.0;
+    uint32_t expected_draws = 0;
+    for(uint32_t workers = 1;; workers = workers * 2 > max_workers ? max_workers : workers * 2) {
+        JobSystem *jobs = job_system_create(workers);
+        for(uint32_t i = 0; i < WARMUP_FRAMES; ++i)
+            run_frame(jobs, &work);
+
+        job_system_reset_stats(jobs);
+        double begin = get_time_ms();
+        uint32_t draws = 0;
+        for(uint32_t i = 0; i < BENCH_FRAMES; ++i)
+            draws = run_frame(jobs, &work);
+        double frame_time = (get_time_ms() - begin) / BENCH_FRAMES;
+        if(workers == 1) {
+            single_worker_time = frame_time;
+            expected_draws = draws;
+        } else if(draws != expected_draws) {
+            fprintf(stderr, "%u workers drew %u instances instead of %u.\n", workers, draws, expected_draws);
+            return 1;
+        }
+
+        JobWorkerStats stats[JOB_MAX_WORKERS];
+        job_system_get_stats(jobs, stats);
+        printf("%2u worker(s): %.3f ms per frame, %.2fx, %u draws\n", workers, frame_time, single_worker_time / frame_time, draws);
+        for(uint32_t i = 0; i < workers; ++i)
+            printf("    worker %2u: %5.1f%% busy, %6llu jobs, %6llu stolen\n", i, stats[i].utilization * 100.0, (unsigned long long)stats[i].jobs_run, (unsigned long long)stats[i].jobs_stolen);
+        job_system_destroy(jobs);
+        if(workers == max_workers)
+            break;
+    }
+
+    frame_work_destroy(&work);
+    return 0;
+}
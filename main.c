@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <SDL2/SDL.h>
@@ -8,6 +9,24 @@
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
 
+#include "vlk_bindless.h"
+#include "vlk_compute.h"
+#include "vlk_frames.h"
+#include "vlk_graph.h"
+#include "vlk_instances.h"
+#include "vlk_jobs.h"
+#include "vlk_memory.h"
+#include "vlk_mesh.h"
+#include "vlk_pipelines.h"
+#include "vlk_post.h"
+#include "vlk_profiler.h"
+#include "vlk_queue.h"
+#include "vlk_shaders.h"
+#include "vlk_startup.h"
+#include "vlk_streaming.h"
+#include "vlk_threads.h"
+#include "vlk_upload.h"
+
 static VkInstance create_instance(SDL_Window *window) {
     VkApplicationInfo appInfo = { 0 };
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -23,24 +42,27 @@ static VkInstance create_instance(SDL_Window *window) {
     createInfo.pNext = NULL;
     createInfo.flags = 0;
     createInfo.pApplicationInfo = &appInfo;
+    // Headless runs have no window and therefore need no surface extensions
+    const char *instance_extensions[8];
+    uint32_t extension_count = 0;
+    if(window) {
+        unsigned int count;
+        SDL_Vulkan_GetInstanceExtensions(window, &count, NULL);
+        assert(count < 8);
+        SDL_Vulkan_GetInstanceExtensions(window, &count, instance_extensions);
+        extension_count = count;
+    }
 #ifdef _DEBUG
     const char* debug_layers[] = { "VK_LAYER_KHRONOS_validation" };
     createInfo.enabledLayerCount = sizeof(debug_layers) / sizeof(debug_layers[0]);
     createInfo.ppEnabledLayerNames = debug_layers;
-    const char *instance_extensions[] = { NULL, NULL, VK_EXT_DEBUG_REPORT_EXTENSION_NAME };
-    createInfo.enabledExtensionCount = sizeof(instance_extensions) / sizeof(instance_extensions[0]);
-    createInfo.ppEnabledExtensionNames = instance_extensions;
+    instance_extensions[extension_count++] = VK_EXT_DEBUG_REPORT_EXTENSION_NAME;
 #else // _DEBUG
     createInfo.enabledLayerCount = 0;
     createInfo.ppEnabledLayerNames = NULL;
-    const char *instance_extensions[] = { NULL, NULL };
-    createInfo.enabledExtensionCount = sizeof(instance_extensions) / sizeof(instance_extensions[0]);
-    createInfo.ppEnabledExtensionNames = instance_extensions;
 #endif // _DEBUG
-    unsigned int count;
-    SDL_Vulkan_GetInstanceExtensions(window, &count, NULL);
-    assert(count == 2);
-    SDL_Vulkan_GetInstanceExtensions(window, &count, instance_extensions);
+    createInfo.enabledExtensionCount = extension_count;
+    createInfo.ppEnabledExtensionNames = instance_extensions;
 
     VkInstance instance = VK_NULL_HANDLE;
     if(vkCreateInstance(&createInfo, NULL, &instance) != VK_SUCCESS) {
@@ -91,6 +113,10 @@ static VkDebugReportCallbackEXT register_debug_callback(VkInstance instance) {
 }
 #endif
 
+static double get_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
 static VkPhysicalDevice pick_physical_device(VkInstance instance) {
     uint32_t count;
     vkEnumeratePhysicalDevices(instance, &count, NULL);
@@ -129,6 +155,8 @@ typedef struct Queues
 {
     uint32_t graphics_queue;
     uint32_t present_queue;
+    uint32_t transfer_queue; // Same as graphics_queue when there is no separate transfer family
+    uint32_t compute_queue; // Same as graphics_queue when there is no separate compute family
 } Queues;
 
 static Queues get_queue_indices(VkPhysicalDevice physical_device, VkSurfaceKHR surface) {
@@ -137,9 +165,20 @@ static Queues get_queue_indices(VkPhysicalDevice physical_device, VkSurfaceKHR s
 	assert(queueCount);
 	VkQueueFamilyProperties* properties = malloc(sizeof(VkQueueFamilyProperties) * queueCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queueCount, properties);
-    Queues queues = { UINT32_MAX, UINT32_MAX };
+    Queues queues = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
 	for (uint32_t i = 0; i < queueCount; ++i)
 	{
+        // Without a surface there is nothing to present to, so any graphics family will do
+        if (surface == VK_NULL_HANDLE)
+        {
+            if (properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                queues.graphics_queue = i;
+                queues.present_queue = i;
+                break;
+            }
+            continue;
+        }
 		if (properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && supports_swapchain(physical_device, surface, i))
 		{
 			queues.graphics_queue = i;
@@ -153,34 +192,182 @@ static Queues get_queue_indices(VkPhysicalDevice physical_device, VkSurfaceKHR s
         if(queues.graphics_queue != UINT32_MAX && queues.present_queue != UINT32_MAX)
             break;
 	}
+    // A transfer only family is usually a DMA engine that copies alongside rendering,
+    // a compute family without graphics is the next best thing
+    for (uint32_t i = 0; i < queueCount; ++i)
+    {
+        VkQueueFlags flags = properties[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+            continue;
+        if (!(flags & VK_QUEUE_COMPUTE_BIT))
+        {
+            queues.transfer_queue = i;
+            break;
+        }
+        if (queues.transfer_queue == UINT32_MAX)
+            queues.transfer_queue = i;
+    }
+    if (queues.transfer_queue == UINT32_MAX)
+    {
+        queues.transfer_queue = queues.graphics_queue;
+    }
+    // Async compute wants a family without graphics, ideally not the one uploads go through
+    for (uint32_t i = 0; i < queueCount; ++i)
+    {
+        VkQueueFlags flags = properties[i].queueFlags;
+        if (!(flags & VK_QUEUE_COMPUTE_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+            continue;
+        if (i != queues.transfer_queue)
+        {
+            queues.compute_queue = i;
+            break;
+        }
+        if (queues.compute_queue == UINT32_MAX)
+            queues.compute_queue = i;
+    }
+    if (queues.compute_queue == UINT32_MAX)
+    {
+        queues.compute_queue = queues.graphics_queue;
+    }
 	free(properties);
 	return queues;
 }
 
-static VkDevice create_logical_device(VkPhysicalDevice physical_device, Queues queue_indices) {
+// Optional features, filled in with what was actually enabled
+typedef struct DeviceFeatures {
+    char draw_indirect_count;
+    char multi_draw_indirect;
+    char draw_indirect_first_instance;
+    char pipeline_statistics_query;
+    char descriptor_indexing;
+    char memory_budget; // VK_EXT_memory_budget
+    char synchronization2; // VK_KHR_synchronization2, for the render graph's barriers
+    char present_wait; // VK_KHR_present_id and VK_KHR_present_wait, for the present latency
+} DeviceFeatures;
+
+static char has_device_extension(VkPhysicalDevice physical_device, const char *name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, NULL);
+    VkExtensionProperties *extensions = malloc(sizeof(VkExtensionProperties) * count);
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, extensions);
+    char found = 0;
+    for(uint32_t i = 0; i < count && !found; ++i)
+        found = strcmp(extensions[i].extensionName, name) == 0;
+    free(extensions);
+    return found;
+}
+
+static VkDevice create_logical_device(VkPhysicalDevice physical_device, Queues queue_indices, char enable_swapchain, DeviceFeatures *enabled) {
     const float queue_priorities = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo[2] = { 0 };
-    queueCreateInfo[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo[0].queueFamilyIndex = queue_indices.graphics_queue;
-    queueCreateInfo[0].queueCount = 1;
-    queueCreateInfo[0].pQueuePriorities = &queue_priorities;
-    queueCreateInfo[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo[1].queueFamilyIndex = queue_indices.present_queue;
-    queueCreateInfo[1].queueCount = 1;
-    queueCreateInfo[1].pQueuePriorities = &queue_priorities;
+    // One queue per distinct family
+    uint32_t families[] = { queue_indices.graphics_queue, queue_indices.present_queue, queue_indices.transfer_queue, queue_indices.compute_queue };
+    VkDeviceQueueCreateInfo queueCreateInfo[4] = { 0 };
+    uint32_t queue_count = 0;
+    for(uint32_t i = 0; i < 4; ++i) {
+        char duplicate = 0;
+        for(uint32_t j = 0; j < queue_count; ++j)
+            duplicate |= queueCreateInfo[j].queueFamilyIndex == families[i];
+        if(duplicate)
+            continue;
+        queueCreateInfo[queue_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo[queue_count].queueFamilyIndex = families[i];
+        queueCreateInfo[queue_count].queueCount = 1;
+        queueCreateInfo[queue_count].pQueuePriorities = &queue_priorities;
+        ++queue_count;
+    }
+
+    VkPhysicalDeviceSynchronization2FeaturesKHR supported_sync2 = { 0 };
+    supported_sync2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    char has_sync2 = has_device_extension(physical_device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    VkPhysicalDeviceVulkan12Features supported12 = { 0 };
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported12.pNext = has_sync2 ? &supported_sync2 : NULL;
+    VkPhysicalDeviceFeatures2 supported = { 0 };
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    char has_present_wait = enable_swapchain && has_device_extension(physical_device, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+        && has_device_extension(physical_device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    VkPhysicalDevicePresentWaitFeaturesKHR supported_present_wait = { 0 };
+    supported_present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR supported_present_id = { 0 };
+    supported_present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    if(has_present_wait) {
+        supported_present_wait.pNext = supported.pNext;
+        supported_present_id.pNext = &supported_present_wait;
+        supported.pNext = &supported_present_id;
+    }
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported);
+
+    // Timeline semaphores track upload completion, the indirect features are for GPU culling
+    VkPhysicalDeviceVulkan12Features features12 = { 0 };
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    features12.drawIndirectCount = supported12.drawIndirectCount;
+    // Descriptor indexing for the bindless texture table
+    features12.runtimeDescriptorArray = supported12.runtimeDescriptorArray;
+    features12.descriptorBindingPartiallyBound = supported12.descriptorBindingPartiallyBound;
+    features12.descriptorBindingSampledImageUpdateAfterBind = supported12.descriptorBindingSampledImageUpdateAfterBind;
+    features12.descriptorBindingUpdateUnusedWhilePending = supported12.descriptorBindingUpdateUnusedWhilePending;
+    features12.shaderSampledImageArrayNonUniformIndexing = supported12.shaderSampledImageArrayNonUniformIndexing;
+    VkPhysicalDeviceFeatures2 features = { 0 };
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    features.features.multiDrawIndirect = supported.features.multiDrawIndirect;
+    features.features.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
+    features.features.pipelineStatisticsQuery = supported.features.pipelineStatisticsQuery; // For the profiler
+    // The render graph falls back to vkCmdPipelineBarrier without it
+    VkPhysicalDeviceSynchronization2FeaturesKHR sync2 = { 0 };
+    sync2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    sync2.synchronization2 = supported_sync2.synchronization2;
+    if(sync2.synchronization2)
+        features12.pNext = &sync2;
+    // Lets the frame scheduler time the presents
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait = { 0 };
+    present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR present_id = { 0 };
+    present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    if(supported_present_id.presentId && supported_present_wait.presentWait) {
+        present_id.presentId = VK_TRUE;
+        present_wait.presentWait = VK_TRUE;
+        present_wait.pNext = features.pNext;
+        present_id.pNext = &present_wait;
+        features.pNext = &present_id;
+    }
+
+    enabled->draw_indirect_count = features12.drawIndirectCount == VK_TRUE;
+    enabled->multi_draw_indirect = features.features.multiDrawIndirect == VK_TRUE;
+    enabled->draw_indirect_first_instance = features.features.drawIndirectFirstInstance == VK_TRUE;
+    enabled->pipeline_statistics_query = features.features.pipelineStatisticsQuery == VK_TRUE;
+    enabled->descriptor_indexing = features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound
+        && features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending;
+    enabled->synchronization2 = sync2.synchronization2 == VK_TRUE;
+    enabled->present_wait = present_wait.presentWait == VK_TRUE;
 
     VkDeviceCreateInfo createInfo = { 0 };
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pNext = NULL;
+    createInfo.pNext = &features;
     createInfo.flags = 0;
-    createInfo.queueCreateInfoCount = 1 + (queue_indices.graphics_queue != queue_indices.present_queue);
+    createInfo.queueCreateInfoCount = queue_count;
     createInfo.pQueueCreateInfos = queueCreateInfo;
     createInfo.enabledLayerCount = 0;
     createInfo.ppEnabledLayerNames = NULL;
-    const char* deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-	createInfo.enabledExtensionCount = sizeof(deviceExtensions) / sizeof(deviceExtensions[0]);
-	createInfo.ppEnabledExtensionNames = deviceExtensions;
-    createInfo.pEnabledFeatures = NULL;
+    const char* deviceExtensions[5];
+    uint32_t extension_count = 0;
+    if(enable_swapchain)
+        deviceExtensions[extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    // Lets texture streaming size itself to the VRAM that is actually free
+    enabled->memory_budget = has_device_extension(physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(enabled->memory_budget)
+        deviceExtensions[extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    if(enabled->synchronization2)
+        deviceExtensions[extension_count++] = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+    if(enabled->present_wait) {
+        deviceExtensions[extension_count++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+        deviceExtensions[extension_count++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+    }
+    createInfo.enabledExtensionCount = extension_count;
+    createInfo.ppEnabledExtensionNames = deviceExtensions;
+    createInfo.pEnabledFeatures = NULL; // Passed through VkPhysicalDeviceFeatures2 instead
 
     VkDevice device = VK_NULL_HANDLE;
     if(vkCreateDevice(physical_device, &createInfo, NULL, &device) != VK_SUCCESS) {
@@ -225,15 +412,69 @@ static VkPresentModeKHR get_present_mode(VkPhysicalDevice physical_device, VkSur
     return present_mode;
 }
 
+// Most precise format first, D32 or X8_D24 is always there
+static VkFormat get_depth_format(VkPhysicalDevice physical_device) {
+    const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM };
+    for(uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, candidates[i], &properties);
+        if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            return candidates[i];
+    }
+    fprintf(stderr, "Failed to find a supported depth format.\n");
+    exit(1);
+}
+
+static VkImageView create_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect) {
+    VkImageViewCreateInfo createView = { 0 };
+    createView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createView.pNext = NULL;
+    createView.flags = 0;
+    createView.image = image;
+    createView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    createView.format = format;
+    createView.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createView.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createView.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createView.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createView.subresourceRange.aspectMask = aspect;
+    createView.subresourceRange.baseMipLevel = 0;
+    createView.subresourceRange.levelCount = 1;
+    createView.subresourceRange.baseArrayLayer = 0;
+    createView.subresourceRange.layerCount = 1;
+
+    VkImageView image_view = VK_NULL_HANDLE;
+    if(vkCreateImageView(device, &createView, NULL, &image_view) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan image view.\n");
+        exit(1);
+    }
+    return image_view;
+}
+
 typedef struct SwapchainInfo {
     VkSwapchainKHR swapchain;
     uint32_t image_count;
     VkImage *images;
     VkImageView *image_views;
+    // Per image rather than per frame in flight, the present that waits on one may still be
+    // pending when its frame slot comes round again, until the image is acquired again
+    VkSemaphore *render_finished;
     VkExtent2D extent;
-    VkRenderPass render_pass;
 } SwapchainInfo;
 
+static VkSemaphore create_semaphore(VkDevice device) {
+    VkSemaphoreCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    if(vkCreateSemaphore(device, &createInfo, NULL, &semaphore) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan semaphore.\n");
+        exit(1);
+    }
+
+    return semaphore;
+}
+
 static SwapchainInfo create_swapchain(VkDevice device, VkPhysicalDevice physical_device , VkSurfaceKHR surface, VkSurfaceFormatKHR swapchain_format, VkPresentModeKHR present_mode, Queues queue_indices, VkSwapchainKHR old_swapchain) {    
     VkSurfaceCapabilitiesKHR capabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities);
@@ -254,7 +495,8 @@ static SwapchainInfo create_swapchain(VkDevice device, VkPhysicalDevice physical
     createInfo.imageColorSpace = swapchain_format.colorSpace;
     createInfo.imageExtent = capabilities.currentExtent;
     createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // --hdr blits the tonemapped image in
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
     if(queue_indices.graphics_queue == queue_indices.present_queue) {
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.queueFamilyIndexCount = 0;
@@ -283,62 +525,65 @@ static SwapchainInfo create_swapchain(VkDevice device, VkPhysicalDevice physical
     vkGetSwapchainImagesKHR(device, swapchain, &image_count, images);
 
     VkImageView *image_views = malloc(sizeof(VkImageView) * image_count);
-
+    VkSemaphore *render_finished = malloc(sizeof(VkSemaphore) * image_count);
     for (size_t i = 0; i < image_count; ++i) {
-        VkImageViewCreateInfo createView = { 0 };
-        createView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createView.pNext = NULL;
-        createView.flags = 0;
-        createView.image = images[i];
-        createView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        createView.format = swapchain_format.format;
-        createView.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createView.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createView.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createView.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        createView.subresourceRange.baseMipLevel = 0;
-        createView.subresourceRange.levelCount = 1;
-        createView.subresourceRange.baseArrayLayer = 0;
-        createView.subresourceRange.layerCount = 1;
-
-        if(vkCreateImageView(device, &createView, NULL, &image_views[i]) != VK_SUCCESS) {
-            fprintf(stderr, "Failed to create Vulkan swapchain image view.");
-            exit(1);
-        }
+        image_views[i] = create_image_view(device, images[i], swapchain_format.format, VK_IMAGE_ASPECT_COLOR_BIT);
+        render_finished[i] = create_semaphore(device);
     }
 
+    return (SwapchainInfo){ swapchain, image_count, images, image_views, render_finished, createInfo.imageExtent };
+}
+
+// The render pass only depends on the formats, so swapchain images and headless targets share it.
+// Depth is cleared and never stored, so tilers can keep it on chip.
+static VkRenderPass create_render_pass(VkDevice device, VkFormat format, VkFormat depth_format, VkAttachmentLoadOp color_load_op, VkImageLayout final_layout) {
     VkAttachmentDescription color_attachment = { 0 };
-    color_attachment.format = swapchain_format.format;
+    color_attachment.format = format;
     color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment.loadOp = color_load_op;
     color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    color_attachment.finalLayout = final_layout;
+
+    VkAttachmentDescription depth_attachment = { 0 };
+    depth_attachment.format = depth_format;
+    depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    VkAttachmentDescription attachments[2] = { color_attachment, depth_attachment };
 
     VkAttachmentReference color_attachment_ref = { 0 };
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depth_attachment_ref = { 0 };
+    depth_attachment_ref.attachment = 1;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkSubpassDescription subpass = { 0 };
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
+    subpass.pDepthStencilAttachment = &depth_attachment_ref;
 
+    // All frames in flight share one depth image, so the clear also waits for the previous frame's depth tests
     VkSubpassDependency dependency = { 0 };
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
     VkRenderPassCreateInfo render_pass_info = { 0 };
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.attachmentCount = 2;
+    render_pass_info.pAttachments = attachments;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
     render_pass_info.dependencyCount = 1;
@@ -350,36 +595,19 @@ static SwapchainInfo create_swapchain(VkDevice device, VkPhysicalDevice physical
         exit(1);
     }
 
-    return (SwapchainInfo){ swapchain, image_count, images, image_views, createInfo.imageExtent, render_pass };
+    return render_pass;
 }
 
-static char *read_file(const char *path, int *length) {
-    FILE* file;
-    file = fopen(path, "rb");
-    if(!file)
-    {
-        printf("Failed to open %s", path);
-        return NULL;
-    }
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    if(length)
-        *length = (int)fsize;
-    fseek(file, 0, SEEK_SET);
-    char* content = malloc(fsize + 1);
-    fread(content, 1, fsize, file);
-    fclose(file);
-    content[fsize] = 0;
-    return content;
-}
+// Color, then depth at the far plane
+static const VkClearValue render_pass_clear_values[2] = { { .color = {{ 0.0f, 0.0f, 0.0f, 1.0f }} }, { .depthStencil = { 1.0f, 0 } } };
 
-static VkShaderModule create_shader_module(VkDevice device, const char *code, int length) {
+static VkShaderModule create_shader_module(VkDevice device, const ShaderCode *code) {
     VkShaderModuleCreateInfo createInfo = { 0 };
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.pNext = NULL;
     createInfo.flags = 0;
-    createInfo.codeSize = length;
-    createInfo.pCode = (const uint32_t*)code;
+    createInfo.codeSize = code->size;
+    createInfo.pCode = code->code;
 
     VkShaderModule shader_module = VK_NULL_HANDLE;
     if(vkCreateShaderModule(device, &createInfo, NULL, &shader_module) != VK_SUCCESS) {
@@ -390,164 +618,242 @@ static VkShaderModule create_shader_module(VkDevice device, const char *code, in
     return shader_module;
 }
 
-typedef struct GraphicPipelineInfo {
-    VkPipeline graphics_pipeline;
-    VkPipelineLayout pipeline_layout;
-} GraphicPipelineInfo;
-
-static GraphicPipelineInfo create_graphics_pipeline(VkDevice device, VkExtent2D swapchain_extent, VkRenderPass render_pass) {
-    int vert_shader_code_length;
-    char *vert_shader_code = read_file("triangle.vert.spv", &vert_shader_code_length);
-    int frag_shader_code_length;
-    char *frag_shader_code = read_file("triangle.frag.spv", &frag_shader_code_length);
-    VkShaderModule vert_shader_module = create_shader_module(device, vert_shader_code, vert_shader_code_length);
-    VkShaderModule frag_shader_module = create_shader_module(device, frag_shader_code, frag_shader_code_length);
-    free(vert_shader_code);
-    free(frag_shader_code);
-
-    VkPipelineShaderStageCreateInfo vert_shader_stage_info = { 0 };
-    vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_shader_stage_info.module = vert_shader_module;
-    vert_shader_stage_info.pName = "main";
-    VkPipelineShaderStageCreateInfo frag_shader_stage_info = { 0 };
-    frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_shader_stage_info.module = frag_shader_module;
-    frag_shader_stage_info.pName = "main";
-    VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
-
-    VkPipelineVertexInputStateCreateInfo vertex_input_info = { 0 };
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 0;
-    vertex_input_info.pVertexBindingDescriptions = NULL;
-    vertex_input_info.vertexAttributeDescriptionCount = 0;
-    vertex_input_info.pVertexAttributeDescriptions = NULL;
-
-    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = { 0 };
-    input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly_info.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = { 0 };
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapchain_extent.width;
-    viewport.height = (float)swapchain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = { 0 };
-    scissor.offset.x = 0;
-    scissor.offset.y = 0;
-    scissor.extent = swapchain_extent;
-
-    VkPipelineViewportStateCreateInfo viewport_info = { 0 };
-    viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_info.viewportCount = 1;
-    viewport_info.pViewports = &viewport;
-    viewport_info.scissorCount = 1;
-    viewport_info.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer_info = { 0 };
-    rasterizer_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer_info.depthClampEnable = VK_FALSE;
-    rasterizer_info.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer_info.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer_info.lineWidth = 1.0f;
-    rasterizer_info.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer_info.depthBiasEnable = VK_FALSE;
-    rasterizer_info.depthBiasConstantFactor = 0.0f;
-    rasterizer_info.depthBiasClamp = 0.0f;
-    rasterizer_info.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling_info = { 0 };
-    multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling_info.sampleShadingEnable = VK_FALSE;
-    multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling_info.minSampleShading = 1.0f;
-    multisampling_info.pSampleMask = NULL;
-    multisampling_info.alphaToCoverageEnable = VK_FALSE;
-    multisampling_info.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState color_blend_attachment = { 0 };
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo color_blending = { 0 };
-    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending.logicOpEnable = VK_FALSE;
-    color_blending.logicOp = VK_LOGIC_OP_COPY;
-    color_blending.attachmentCount = 1;
-    color_blending.pAttachments = &color_blend_attachment;
-    color_blending.blendConstants[0] = 0.0f;
-    color_blending.blendConstants[1] = 0.0f;
-    color_blending.blendConstants[2] = 0.0f;
-    color_blending.blendConstants[3] = 0.0f;
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+#define PIPELINE_CACHE_MAGIC 0x434c4b56u // "VKLC"
+
+// Prefixed to the driver's cache blob on disk. The driver version is not part of the
+// Vulkan cache header, so we store it ourselves and drop the cache on driver updates.
+typedef struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t data_size;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+} PipelineCacheFileHeader;
+
+static char pipeline_cache_matches(const PipelineCacheFileHeader *header, const VkPhysicalDeviceProperties *properties) {
+    return header->magic == PIPELINE_CACHE_MAGIC
+        && header->vendor_id == properties->vendorID
+        && header->device_id == properties->deviceID
+        && header->driver_version == properties->driverVersion
+        && memcmp(header->pipeline_cache_uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Returns a cache seeded from path when the file was written by the same device and driver,
+// otherwise an empty one. warm is set to whether the file contents were used.
+static VkPipelineCache load_pipeline_cache(VkDevice device, const VkPhysicalDeviceProperties *properties, const char *path, char *warm) {
+    *warm = 0;
+    void *data = NULL;
+    size_t data_size = 0;
+
+    FILE *file = fopen(path, "rb");
+    if(file) {
+        long file_size = -1;
+        if(fseek(file, 0, SEEK_END) == 0)
+            file_size = ftell(file);
+        rewind(file);
+
+        PipelineCacheFileHeader header;
+        if(fread(&header, sizeof(header), 1, file) == 1 && pipeline_cache_matches(&header, properties)
+            && file_size >= (long)sizeof(header) && header.data_size <= (size_t)file_size - sizeof(header)
+            && (data = malloc(header.data_size))) {
+            if(fread(data, 1, header.data_size, file) == header.data_size) {
+                data_size = header.data_size;
+            } else {
+                free(data);
+                data = NULL;
+            }
+        } else {
+            printf("Pipeline cache %s is from another device or driver or is truncated, ignoring it\n", path);
+        }
+        fclose(file);
+    }
+
+    VkPipelineCacheCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data_size;
+    createInfo.pInitialData = data;
+
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+    if(vkCreatePipelineCache(device, &createInfo, NULL, &pipeline_cache) != VK_SUCCESS) {
+        // The driver rejected the blob, fall back to an empty cache
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = NULL;
+        data_size = 0;
+        if(vkCreatePipelineCache(device, &createInfo, NULL, &pipeline_cache) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan pipeline cache.\n");
+            exit(1);
+        }
+    }
+    free(data);
+    *warm = data_size != 0;
+    return pipeline_cache;
+}
+
+// Written to a temporary file first and renamed over path, so a crash never leaves a torn cache behind
+static void save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, const VkPhysicalDeviceProperties *properties, const char *path) {
+    size_t data_size = 0;
+    if(vkGetPipelineCacheData(device, pipeline_cache, &data_size, NULL) != VK_SUCCESS || !data_size)
+        return;
+    void *data = malloc(data_size);
+    if(vkGetPipelineCacheData(device, pipeline_cache, &data_size, data) != VK_SUCCESS) {
+        free(data);
+        return;
+    }
+
+    PipelineCacheFileHeader header = { 0 };
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.data_size = (uint32_t)data_size;
+    header.vendor_id = properties->vendorID;
+    header.device_id = properties->deviceID;
+    header.driver_version = properties->driverVersion;
+    memcpy(header.pipeline_cache_uuid, properties->pipelineCacheUUID, VK_UUID_SIZE);
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    if(!file) {
+        fprintf(stderr, "Failed to write pipeline cache %s\n", temp_path);
+        free(data);
+        return;
+    }
+    char ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, data_size, file) == data_size;
+    ok = (fclose(file) == 0) && ok;
+    free(data);
+    if(!ok || rename(temp_path, path) != 0) {
+        fprintf(stderr, "Failed to write pipeline cache %s\n", path);
+        remove(temp_path);
+    }
+}
+
+// Matches the View push constants of instanced.vert
+typedef struct ViewParams {
+    float offset[2];
+    float zoom;
+} ViewParams;
+
+// Bindless handle of the draw's texture, pushed right after ViewParams for the fragment shader
+#define TEXTURE_PUSH_OFFSET sizeof(ViewParams)
+
+// Per instance transforms and colors, read by instanced.vert
+static VkDescriptorSetLayout create_instance_set_layout(VkDevice device) {
+    VkDescriptorSetLayoutBinding bindings[2] = { 0 };
+    for(uint32_t i = 0; i < 2; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.bindingCount = 2;
+    createInfo.pBindings = bindings;
 
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+    if(vkCreateDescriptorSetLayout(device, &createInfo, NULL, &set_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor set layout.\n");
+        exit(1);
+    }
+    return set_layout;
+}
+
+// Set 0 is the instance data, set 1 the bindless textures
+static VkPipelineLayout create_graphics_pipeline_layout(VkDevice device, VkDescriptorSetLayout set_layout, VkDescriptorSetLayout texture_set_layout) {
+    VkDescriptorSetLayout set_layouts[2] = { set_layout, texture_set_layout };
     VkPipelineLayoutCreateInfo pipeline_layout_info = { 0 };
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount = 0;
-    pipeline_layout_info.pSetLayouts = NULL;
-    pipeline_layout_info.pushConstantRangeCount = 0;
-    pipeline_layout_info.pPushConstantRanges = NULL;
+    pipeline_layout_info.setLayoutCount = 2;
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    VkPushConstantRange push_constant_ranges[2] = {
+        { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ViewParams) },
+        { VK_SHADER_STAGE_FRAGMENT_BIT, TEXTURE_PUSH_OFFSET, sizeof(BindlessHandle) },
+    };
+    pipeline_layout_info.pushConstantRangeCount = 2;
+    pipeline_layout_info.pPushConstantRanges = push_constant_ranges;
 
     VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
     if(vkCreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
         fprintf(stderr, "Failed to create Vulkan pipeline layout\n");
         exit(1);  
     }
+    return pipeline_layout;
+}
 
-    VkGraphicsPipelineCreateInfo pipeline_info = { 0 };
-    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_info.stageCount = 2;
-    pipeline_info.pStages = shader_stages;
-    pipeline_info.pVertexInputState = &vertex_input_info;
-    pipeline_info.pInputAssemblyState = &input_assembly_info;
-    pipeline_info.pViewportState = &viewport_info;
-    pipeline_info.pRasterizationState = &rasterizer_info;
-    pipeline_info.pMultisampleState = &multisampling_info;
-    pipeline_info.pDepthStencilState = NULL; // We dont do this yets
-    pipeline_info.pColorBlendState = &color_blending;
-    pipeline_info.pDynamicState = NULL; // We dont have any buffers yet
-    pipeline_info.layout = pipeline_layout;
-    
-    pipeline_info.renderPass = render_pass;
-    pipeline_info.subpass = 0; // Index of subpass where render_pass is used
+// Cycles through cull mode, winding, blending, topology and then the shader features. Past
+// those 192 combinations the blend constants change, which only makes a new key since the
+// blend factors ignore them.
+static GraphicsPipelineDesc pipeline_variant_desc(const GraphicsPipelineDesc *base, uint32_t variant) {
+    static const VkCullModeFlags cull_modes[] = { VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT };
+    GraphicsPipelineDesc desc = *base;
+    desc.cull_mode = cull_modes[variant % 3];
+    desc.front_face = (variant / 3) % 2 ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE;
+    desc.blend_enable = (variant / 6) % 2 ? VK_TRUE : VK_FALSE;
+    desc.topology = (variant / 12) % 2 ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc.features = base->features ^ (variant / 24) % (1 << SHADER_FEATURE_COUNT);
+    desc.blend_constants[0] = (float)(variant / (24 << SHADER_FEATURE_COUNT)) / 256.0f;
+    return desc;
+}
+
+typedef struct ComputePipelineInfo {
+    VkPipeline pipeline;
+    VkPipelineLayout pipeline_layout;
+} ComputePipelineInfo;
+
+static ComputePipelineInfo create_compute_pipeline(VkDevice device, VkPipelineCache pipeline_cache, const char *shader_path, VkDescriptorSetLayout set_layout, uint32_t push_constant_size) {
+    ShaderCode shader_code = shader_code_load(shader_path);
+    VkShaderModule shader_module = create_shader_module(device, &shader_code);
+    shader_code_release(&shader_code);
+
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constant_size };
+    VkPipelineLayoutCreateInfo pipeline_layout_info = { 0 };
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &set_layout;
+    pipeline_layout_info.pushConstantRangeCount = push_constant_size ? 1 : 0;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    if(vkCreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan pipeline layout\n");
+        exit(1);
+    }
 
+    VkComputePipelineCreateInfo pipeline_info = { 0 };
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
 
-    VkPipeline graphics_pipeline = VK_NULL_HANDLE;
-    if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &graphics_pipeline) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create Vulkan graphics pipeline.\n");
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan compute pipeline.\n");
         exit(1);
     }
 
-    vkDestroyShaderModule(device, vert_shader_module, NULL);
-    vkDestroyShaderModule(device, frag_shader_module, NULL);
+    vkDestroyShaderModule(device, shader_module, NULL);
 
-    return (GraphicPipelineInfo){ graphics_pipeline, pipeline_layout };
+    return (ComputePipelineInfo){ pipeline, pipeline_layout };
 }
 
-static VkFramebuffer *create_framebuffers(VkDevice device, SwapchainInfo swapchain_info) {
-    VkFramebuffer *framebuffers = malloc(sizeof(VkFramebuffer) * swapchain_info.image_count);
+// Every framebuffer gets the same depth view
+static VkFramebuffer *create_framebuffers(VkDevice device, VkRenderPass render_pass, VkImageView *image_views, uint32_t count, VkImageView depth_view, VkExtent2D extent) {
+    VkFramebuffer *framebuffers = malloc(sizeof(VkFramebuffer) * count);
 
-    for(uint32_t i = 0; i < swapchain_info.image_count; ++i) {
+    for(uint32_t i = 0; i < count; ++i) {
+        VkImageView attachments[2] = { image_views[i], depth_view };
         VkFramebufferCreateInfo createInfo = { 0 };
         createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        createInfo.renderPass = swapchain_info.render_pass;
-        createInfo.attachmentCount = 1;
-        createInfo.pAttachments = &swapchain_info.image_views[i];
-        createInfo.width = swapchain_info.extent.width;
-        createInfo.height = swapchain_info.extent.height;
+        createInfo.renderPass = render_pass;
+        createInfo.attachmentCount = 2;
+        createInfo.pAttachments = attachments;
+        createInfo.width = extent.width;
+        createInfo.height = extent.height;
         createInfo.layers = 1;
 
         if(vkCreateFramebuffer(device, &createInfo, NULL, &framebuffers[i]) != VK_SUCCESS) {
@@ -559,11 +865,384 @@ static VkFramebuffer *create_framebuffers(VkDevice device, SwapchainInfo swapcha
     return framebuffers;
 }
 
-static VkCommandPool create_command_pool(VkDevice device, Queues queues) {
+typedef struct DepthTarget {
+    VkImage image;
+    MemoryAllocation allocation;
+    VkImageView view;
+} DepthTarget;
+
+// Only ever used within a render pass, so it is transient and may never get real memory on tilers
+static DepthTarget create_depth_target(VkDevice device, MemoryAllocator *allocator, VkFormat format, VkExtent2D extent) {
+    VkImageCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    createInfo.imageType = VK_IMAGE_TYPE_2D;
+    createInfo.format = format;
+    createInfo.extent.width = extent.width;
+    createInfo.extent.height = extent.height;
+    createInfo.extent.depth = 1;
+    createInfo.mipLevels = 1;
+    createInfo.arrayLayers = 1;
+    createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    createInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    DepthTarget target = { 0 };
+    target.image = memory_create_image(allocator, &createInfo, MEMORY_USAGE_GPU_LAZILY_ALLOCATED, &target.allocation);
+    target.view = create_image_view(device, target.image, format, VK_IMAGE_ASPECT_DEPTH_BIT);
+    return target;
+}
+
+static void destroy_depth_target(VkDevice device, MemoryAllocator *allocator, DepthTarget *target) {
+    vkDestroyImageView(device, target->view, NULL);
+    vkDestroyImage(device, target->image, NULL);
+    memory_free(allocator, &target->allocation);
+}
+
+typedef struct OffscreenTargets {
+    uint32_t image_count;
+    VkImage *images;
+    MemoryAllocation *allocations;
+    VkImageView *image_views;
+    VkExtent2D extent;
+} OffscreenTargets;
+
+// Stand-in for the swapchain when running headless, one image per frame in flight
+static OffscreenTargets create_offscreen_targets(VkDevice device, MemoryAllocator *allocator, VkFormat format, VkExtent2D extent, uint32_t image_count) {
+    OffscreenTargets targets = { 0 };
+    targets.image_count = image_count;
+    targets.images = malloc(sizeof(VkImage) * image_count);
+    targets.allocations = malloc(sizeof(MemoryAllocation) * image_count);
+    targets.image_views = malloc(sizeof(VkImageView) * image_count);
+    targets.extent = extent;
+
+    for(uint32_t i = 0; i < image_count; ++i) {
+        VkImageCreateInfo createInfo = { 0 };
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        createInfo.imageType = VK_IMAGE_TYPE_2D;
+        createInfo.format = format;
+        createInfo.extent.width = extent.width;
+        createInfo.extent.height = extent.height;
+        createInfo.extent.depth = 1;
+        createInfo.mipLevels = 1;
+        createInfo.arrayLayers = 1;
+        createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        createInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        targets.images[i] = memory_create_image(allocator, &createInfo, MEMORY_USAGE_GPU_ONLY, &targets.allocations[i]);
+        targets.image_views[i] = create_image_view(device, targets.images[i], format, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    return targets;
+}
+
+static void destroy_offscreen_targets(VkDevice device, MemoryAllocator *allocator, OffscreenTargets *targets) {
+    for(uint32_t i = 0; i < targets->image_count; ++i) {
+        vkDestroyImageView(device, targets->image_views[i], NULL);
+        vkDestroyImage(device, targets->images[i], NULL);
+        memory_free(allocator, &targets->allocations[i]);
+    }
+    free(targets->images);
+    free(targets->allocations);
+    free(targets->image_views);
+}
+
+typedef struct InstanceBuffers {
+    uint32_t frame_count;
+    VkBuffer *transform_buffers;
+    MemoryAllocation *transform_allocations;
+    VkBuffer color_buffer;
+    MemoryAllocation color_allocation;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet *descriptor_sets;
+} InstanceBuffers;
+
+// Transforms are rewritten every frame, so each frame in flight gets its own mapped copy.
+// Colors never change and are uploaded to device local memory once.
+static InstanceBuffers create_instance_buffers(VkDevice device, MemoryAllocator *allocator, UploadQueue *uploads, VkDescriptorSetLayout set_layout, const InstanceData *instances, uint32_t frame_count) {
+    InstanceBuffers buffers = { 0 };
+    buffers.frame_count = frame_count;
+    buffers.transform_buffers = malloc(sizeof(VkBuffer) * frame_count);
+    buffers.transform_allocations = malloc(sizeof(MemoryAllocation) * frame_count);
+    buffers.descriptor_sets = malloc(sizeof(VkDescriptorSet) * frame_count);
+
+    VkDeviceSize transform_size = sizeof(float) * 4 * instances->count;
+    VkDeviceSize color_size = sizeof(uint32_t) * instances->count;
+    for(uint32_t i = 0; i < frame_count; ++i)
+        buffers.transform_buffers[i] = memory_create_buffer(allocator, transform_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMORY_USAGE_CPU_TO_GPU, &buffers.transform_allocations[i]);
+    buffers.color_buffer = memory_create_buffer(allocator, color_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEMORY_USAGE_GPU_ONLY, &buffers.color_allocation);
+    upload_buffer(uploads, buffers.color_buffer, 0, instances->color, color_size, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    upload_flush(uploads);
+
+    VkDescriptorPoolSize pool_size = { 0 };
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 2 * frame_count;
+    VkDescriptorPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = frame_count;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if(vkCreateDescriptorPool(device, &pool_info, NULL, &buffers.descriptor_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor pool.\n");
+        exit(1);
+    }
+
+    for(uint32_t i = 0; i < frame_count; ++i) {
+        VkDescriptorSetAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = buffers.descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &set_layout;
+        if(vkAllocateDescriptorSets(device, &alloc_info, &buffers.descriptor_sets[i]) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan descriptor set.\n");
+            exit(1);
+        }
+
+        VkDescriptorBufferInfo buffer_infos[2] = {
+            { buffers.transform_buffers[i], 0, transform_size },
+            { buffers.color_buffer, 0, color_size },
+        };
+        VkWriteDescriptorSet writes[2] = { 0 };
+        for(uint32_t j = 0; j < 2; ++j) {
+            writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[j].dstSet = buffers.descriptor_sets[i];
+            writes[j].dstBinding = j;
+            writes[j].descriptorCount = 1;
+            writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[j].pBufferInfo = &buffer_infos[j];
+        }
+        vkUpdateDescriptorSets(device, 2, writes, 0, NULL);
+    }
+    return buffers;
+}
+
+static void destroy_instance_buffers(VkDevice device, MemoryAllocator *allocator, InstanceBuffers *buffers) {
+    vkDestroyDescriptorPool(device, buffers->descriptor_pool, NULL);
+    for(uint32_t i = 0; i < buffers->frame_count; ++i) {
+        vkDestroyBuffer(device, buffers->transform_buffers[i], NULL);
+        memory_free(allocator, &buffers->transform_allocations[i]);
+    }
+    vkDestroyBuffer(device, buffers->color_buffer, NULL);
+    memory_free(allocator, &buffers->color_allocation);
+    free(buffers->transform_buffers);
+    free(buffers->transform_allocations);
+    free(buffers->descriptor_sets);
+}
+
+// Small enough that a few hundred thousand instances give every worker several batches
+#define INSTANCE_UPDATE_BATCH 4096
+
+typedef struct InstanceUpdate {
+    InstanceData *instances;
+    float dt;
+    float *transforms;
+} InstanceUpdate;
+
+// Each range is updated and written out in one go, while its streams are still in cache
+static void update_instances_range(void *user_data, uint32_t begin, uint32_t end, uint32_t worker_index) {
+    InstanceUpdate *update = user_data;
+    instance_data_update_range(update->instances, update->dt, begin, end);
+    instance_data_write_transforms_range(update->instances, update->transforms, begin, end);
+}
+
+#define CULL_GROUP_SIZE 64 // local_size_x of cull.comp
+
+// Matches the Cull push constants of cull.comp
+typedef struct CullParams {
+    ViewParams view;
+    float min_radius;
+    float viewport[2];
+    uint32_t object_count;
+    uint32_t compact;
+} CullParams;
+
+// Matches the Counters buffer of cull.comp
+typedef struct CullCounters {
+    uint32_t draw_count;
+    uint32_t frustum_culled;
+    uint32_t size_culled;
+} CullCounters;
+
+// Culls the instances on the GPU into an indirect draw list. Everything written by the GPU
+// is per frame in flight, the counters are copied to host memory for the stats. The draw
+// list only lives within the frame, so it is a transient of the frame's render graph and
+// binding 1 of the descriptor sets is written once the graph has placed it.
+typedef struct GpuCulling {
+    uint32_t object_count;
+    uint32_t frame_count;
+    char compact;
+    VkDeviceSize draw_size;
+    VkDescriptorSetLayout set_layout;
+    ComputePipelineInfo pipeline_info;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet *descriptor_sets;
+    VkBuffer *counter_buffers;
+    MemoryAllocation *counter_allocations;
+    VkBuffer *readback_buffers;
+    MemoryAllocation *readback_allocations;
+    VkBuffer index_buffer;
+    MemoryAllocation index_allocation;
+} GpuCulling;
+
+static GpuCulling create_gpu_culling(VkDevice device, MemoryAllocator *allocator, UploadQueue *uploads, VkPipelineCache pipeline_cache, const InstanceBuffers *instances, uint32_t object_count, const DeviceFeatures *features) {
+    // firstInstance picks the transform, so every path needs it
+    if(!features->draw_indirect_first_instance) {
+        fprintf(stderr, "GPU culling needs the drawIndirectFirstInstance feature.\n");
+        exit(1);
+    }
+    if(!features->draw_indirect_count && !features->multi_draw_indirect) {
+        fprintf(stderr, "GPU culling needs drawIndirectCount or multiDrawIndirect.\n");
+        exit(1);
+    }
+
+    GpuCulling culling = { 0 };
+    culling.object_count = object_count;
+    culling.frame_count = instances->frame_count;
+    culling.compact = features->draw_indirect_count;
+
+    VkDescriptorSetLayoutBinding bindings[3] = { 0 };
+    for(uint32_t i = 0; i < 3; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 3;
+    layout_info.pBindings = bindings;
+    if(vkCreateDescriptorSetLayout(device, &layout_info, NULL, &culling.set_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor set layout.\n");
+        exit(1);
+    }
+    culling.pipeline_info = create_compute_pipeline(device, pipeline_cache, "cull.comp.spv", culling.set_layout, sizeof(CullParams));
+
+    uint32_t frame_count = culling.frame_count;
+    culling.descriptor_sets = malloc(sizeof(VkDescriptorSet) * frame_count);
+    culling.counter_buffers = malloc(sizeof(VkBuffer) * frame_count);
+    culling.counter_allocations = malloc(sizeof(MemoryAllocation) * frame_count);
+    culling.readback_buffers = malloc(sizeof(VkBuffer) * frame_count);
+    culling.readback_allocations = malloc(sizeof(MemoryAllocation) * frame_count);
+
+    culling.draw_size = sizeof(VkDrawIndexedIndirectCommand) * object_count;
+    for(uint32_t i = 0; i < frame_count; ++i) {
+        culling.counter_buffers[i] = memory_create_buffer(allocator, sizeof(CullCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            MEMORY_USAGE_GPU_ONLY, &culling.counter_allocations[i]);
+        culling.readback_buffers[i] = memory_create_buffer(allocator, sizeof(CullCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEMORY_USAGE_GPU_TO_CPU, &culling.readback_allocations[i]);
+    }
+
+    const uint16_t indices[] = { 0, 1, 2 };
+    culling.index_buffer = memory_create_buffer(allocator, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEMORY_USAGE_GPU_ONLY, &culling.index_allocation);
+    upload_buffer(uploads, culling.index_buffer, 0, indices, sizeof(indices), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    upload_flush(uploads);
+
+    VkDescriptorPoolSize pool_size = { 0 };
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 3 * frame_count;
+    VkDescriptorPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = frame_count;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if(vkCreateDescriptorPool(device, &pool_info, NULL, &culling.descriptor_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor pool.\n");
+        exit(1);
+    }
+
+    for(uint32_t i = 0; i < frame_count; ++i) {
+        VkDescriptorSetAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = culling.descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &culling.set_layout;
+        if(vkAllocateDescriptorSets(device, &alloc_info, &culling.descriptor_sets[i]) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan descriptor set.\n");
+            exit(1);
+        }
+
+        // The draw list in binding 1 comes from the render graph, see update_cull_draws
+        VkDescriptorBufferInfo buffer_infos[2] = {
+            { instances->transform_buffers[i], 0, VK_WHOLE_SIZE },
+            { culling.counter_buffers[i], 0, VK_WHOLE_SIZE },
+        };
+        const uint32_t set_bindings[2] = { 0, 2 };
+        VkWriteDescriptorSet writes[2] = { 0 };
+        for(uint32_t j = 0; j < 2; ++j) {
+            writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[j].dstSet = culling.descriptor_sets[i];
+            writes[j].dstBinding = set_bindings[j];
+            writes[j].descriptorCount = 1;
+            writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[j].pBufferInfo = &buffer_infos[j];
+        }
+        vkUpdateDescriptorSets(device, 2, writes, 0, NULL);
+    }
+    return culling;
+}
+
+static void destroy_gpu_culling(VkDevice device, MemoryAllocator *allocator, GpuCulling *culling) {
+    vkDestroyDescriptorPool(device, culling->descriptor_pool, NULL);
+    for(uint32_t i = 0; i < culling->frame_count; ++i) {
+        vkDestroyBuffer(device, culling->counter_buffers[i], NULL);
+        memory_free(allocator, &culling->counter_allocations[i]);
+        vkDestroyBuffer(device, culling->readback_buffers[i], NULL);
+        memory_free(allocator, &culling->readback_allocations[i]);
+    }
+    vkDestroyBuffer(device, culling->index_buffer, NULL);
+    memory_free(allocator, &culling->index_allocation);
+    vkDestroyPipeline(device, culling->pipeline_info.pipeline, NULL);
+    vkDestroyPipelineLayout(device, culling->pipeline_info.pipeline_layout, NULL);
+    vkDestroyDescriptorSetLayout(device, culling->set_layout, NULL);
+    free(culling->descriptor_sets);
+    free(culling->counter_buffers);
+    free(culling->counter_allocations);
+    free(culling->readback_buffers);
+    free(culling->readback_allocations);
+}
+
+static void record_clear_cull_counters(VkCommandBuffer command_buffer, const GpuCulling *culling, uint32_t frame) {
+    vkCmdFillBuffer(command_buffer, culling->counter_buffers[frame], 0, VK_WHOLE_SIZE, 0);
+}
+
+// Has to be recorded outside the render pass. The frame's render graph puts the barriers
+// around it, see record_frame.
+static void record_gpu_culling(VkCommandBuffer command_buffer, const GpuCulling *culling, uint32_t frame, const CullParams *params) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->pipeline_info.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->pipeline_info.pipeline_layout, 0, 1, &culling->descriptor_sets[frame], 0, NULL);
+    vkCmdPushConstants(command_buffer, culling->pipeline_info.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), params);
+    vkCmdDispatch(command_buffer, (culling->object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+static void record_culled_draw(VkCommandBuffer command_buffer, const GpuCulling *culling, uint32_t frame, VkBuffer draws) {
+    vkCmdBindIndexBuffer(command_buffer, culling->index_buffer, 0, VK_INDEX_TYPE_UINT16);
+    if(culling->compact)
+        vkCmdDrawIndexedIndirectCount(command_buffer, draws, 0, culling->counter_buffers[frame], 0, culling->object_count, sizeof(VkDrawIndexedIndirectCommand));
+    else
+        vkCmdDrawIndexedIndirect(command_buffer, draws, 0, culling->object_count, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+static void record_culling_readback(VkCommandBuffer command_buffer, const GpuCulling *culling, uint32_t frame) {
+    VkBufferCopy region = { 0, 0, sizeof(CullCounters) };
+    vkCmdCopyBuffer(command_buffer, culling->counter_buffers[frame], culling->readback_buffers[frame], 1, &region);
+}
+
+// Only valid once the frame that last used this slot has finished
+static CullCounters read_culling_counters(MemoryAllocator *allocator, const GpuCulling *culling, uint32_t frame) {
+    memory_invalidate(allocator, &culling->readback_allocations[frame], 0, sizeof(CullCounters));
+    CullCounters counters;
+    memcpy(&counters, culling->readback_allocations[frame].mapped, sizeof(CullCounters));
+    return counters;
+}
+
+static VkCommandPool create_command_pool(VkDevice device, uint32_t queue_family, VkCommandPoolCreateFlags flags) {
     VkCommandPoolCreateInfo pool_info = { 0 };
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    pool_info.queueFamilyIndex = queues.graphics_queue;
-    pool_info.flags = 0;
+    pool_info.queueFamilyIndex = queue_family;
+    pool_info.flags = flags;
 
     VkCommandPool command_pool;
     if(vkCreateCommandPool(device, &pool_info, NULL, &command_pool) != VK_SUCCESS) {
@@ -574,13 +1253,13 @@ static VkCommandPool create_command_pool(VkDevice device, Queues queues) {
     return command_pool;
 }
 
-static VkCommandBuffer *create_command_buffers(VkDevice device, VkCommandPool command_pool, uint32_t count) {
+static VkCommandBuffer *create_command_buffers(VkDevice device, VkCommandPool command_pool, VkCommandBufferLevel level, uint32_t count) {
     VkCommandBuffer *command_buffers = malloc(sizeof(VkCommandBuffer) * count);
 
     VkCommandBufferAllocateInfo alloc_info = { 0 };
     alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     alloc_info.commandPool = command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.level = level;
     alloc_info.commandBufferCount = count;
 
     if(vkAllocateCommandBuffers(device, &alloc_info, command_buffers) != VK_SUCCESS) {
@@ -591,34 +1270,34 @@ static VkCommandBuffer *create_command_buffers(VkDevice device, VkCommandPool co
     return command_buffers;
 }
 
-static VkSemaphore create_semaphore(VkDevice device) {
+static VkSemaphore create_timeline_semaphore(VkDevice device) {
+    VkSemaphoreTypeCreateInfo typeInfo = { 0 };
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
     VkSemaphoreCreateInfo createInfo = { 0 };
     createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
 
     VkSemaphore semaphore = VK_NULL_HANDLE;
     if(vkCreateSemaphore(device, &createInfo, NULL, &semaphore) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create Vulkan semaphore.\n");
+        fprintf(stderr, "Failed to create Vulkan timeline semaphore.\n");
         exit(1);
     }
 
     return semaphore;
 }
 
-static VkFence create_fence(VkDevice device, char signaled) {
-    VkFenceCreateInfo createInfo = { 0 };
-    createInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    createInfo.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
-
-    VkFence fence = VK_NULL_HANDLE;
-    if(vkCreateFence(device, &createInfo, NULL, &fence) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create Vulkan fence.\n");
-        exit(1);
-    }
-
-    return fence;
+static void wait_timeline_semaphore(VkDevice device, VkSemaphore semaphore, uint64_t value) {
+    VkSemaphoreWaitInfo wait_info = { 0 };
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &semaphore;
+    wait_info.pValues = &value;
+    vkWaitSemaphores(device, &wait_info, UINT64_MAX);
 }
 
-static char window_run(SDL_Window *window) {
+static char window_run(SDL_Window *window, char *resized) {
     char running = 1;
     SDL_Event event;
     while (SDL_PollEvent(&event))
@@ -628,148 +1307,2470 @@ static char window_run(SDL_Window *window) {
         case SDL_QUIT:
             running = 0;
             break;
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                *resized = 1;
+            break;
         }
     }
     return running;
 }
 
-int main() {
-    if(volkInitialize() != VK_SUCCESS) {
-        fprintf(stderr, "Failed to initialize volk.\n");
-        exit(1);
+typedef void (*DeferredDestroyFn)(VkDevice device, void *user_data);
+
+typedef struct DeferredDeletion {
+    uint64_t frame;
+    DeferredDestroyFn destroy;
+    void *user_data;
+} DeferredDeletion;
+
+// Objects that may still be referenced by frames in flight. Each entry is tagged with
+// the number of frames submitted when it was retired and is destroyed once the frame
+// timeline shows that many frames have completed.
+typedef struct DeletionQueue {
+    DeferredDeletion *entries;
+    uint32_t count;
+    uint32_t capacity;
+} DeletionQueue;
+
+static void deletion_queue_push(DeletionQueue *queue, uint64_t frame, DeferredDestroyFn destroy, void *user_data) {
+    if(queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 8;
+        queue->entries = realloc(queue->entries, sizeof(DeferredDeletion) * queue->capacity);
     }
-    SDL_Window *window = SDL_CreateWindow("vlkTest", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, SDL_WINDOW_VULKAN);
-    VkInstance instance = create_instance(window);
-    volkLoadInstanceOnly(instance);
-#ifdef _DEBUG
-    VkDebugReportCallbackEXT clb = register_debug_callback(instance);
-#endif // _DEBUG
-    VkPhysicalDevice physical_device = pick_physical_device(instance);
-    VkSurfaceKHR surface = create_surface(instance, window);
-    Queues queue_indices = get_queue_indices(physical_device, surface);
-    VkDevice device = create_logical_device(physical_device, queue_indices);
-    volkLoadDevice(device);
-    VkQueue graphics_queue = VK_NULL_HANDLE;
-    vkGetDeviceQueue(device, queue_indices.graphics_queue, 0, &graphics_queue);
-    VkQueue present_queue = VK_NULL_HANDLE;
-    vkGetDeviceQueue(device, queue_indices.present_queue, 0, &present_queue);
-    VkSurfaceFormatKHR swapchain_format = get_swapchain_format(physical_device, surface);
-    VkPresentModeKHR present_mode = get_present_mode(physical_device, surface);
-    SwapchainInfo swapchain_info = create_swapchain(device, physical_device, surface, swapchain_format, present_mode, queue_indices, VK_NULL_HANDLE);
-    VkSwapchainKHR swapchain = swapchain_info.swapchain;
-    GraphicPipelineInfo graphics_pipeline_info = create_graphics_pipeline(device, swapchain_info.extent, swapchain_info.render_pass);
-    VkFramebuffer *framebuffers = create_framebuffers(device, swapchain_info);
-    VkCommandPool command_pool = create_command_pool(device, queue_indices);
-    VkCommandBuffer *command_buffers = create_command_buffers(device, command_pool, swapchain_info.image_count);
-    const int MAX_FRAMES_IN_FLIGHTS = 2;
-    VkSemaphore image_avaliable_semaphore[] = { create_semaphore(device), create_semaphore(device) };
-    VkSemaphore render_finsihed_semaphore[] = { create_semaphore(device), create_semaphore(device) };
-    VkFence in_flight_fence[] = { create_fence(device, 1), create_fence(device, 1) };
-
-    for(uint32_t i = 0; i < swapchain_info.image_count; ++i) {
-        VkCommandBufferBeginInfo begin_info = { 0 };
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.flags = 0;
-        begin_info.pInheritanceInfo = NULL;
+    queue->entries[queue->count++] = (DeferredDeletion){ frame, destroy, user_data };
+}
 
-        if(vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS) {
-            fprintf(stderr, "Failed to begin recording to Vulkan command buffer.\n");
-            exit(1);
-        }
+static void deletion_queue_flush(DeletionQueue *queue, VkDevice device, uint64_t completed_frames) {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < queue->count; ++i) {
+        if(queue->entries[i].frame <= completed_frames)
+            queue->entries[i].destroy(device, queue->entries[i].user_data);
+        else
+            queue->entries[kept++] = queue->entries[i];
+    }
+    queue->count = kept;
+}
 
-        VkRenderPassBeginInfo render_pass_info = { 0 };
-        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        render_pass_info.renderPass = swapchain_info.render_pass;
-        render_pass_info.framebuffer = framebuffers[i];
-        render_pass_info.renderArea.offset.x = 0;
-        render_pass_info.renderArea.offset.y = 0;
-        render_pass_info.renderArea.extent = swapchain_info.extent;
+static void deletion_queue_destroy(DeletionQueue *queue, VkDevice device) {
+    deletion_queue_flush(queue, device, UINT64_MAX);
+    free(queue->entries);
+    *queue = (DeletionQueue){ 0 };
+}
 
-        VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        render_pass_info.clearValueCount = 1;
-        render_pass_info.pClearValues = &clear_color;
+typedef struct RetiredSwapchain {
+    SwapchainInfo swapchain_info;
+    VkFramebuffer *framebuffers;
+    DepthTarget depth_target;
+    MemoryAllocator *allocator;
+} RetiredSwapchain;
 
-        vkCmdBeginRenderPass(command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+static void destroy_swapchain_resources(VkDevice device, SwapchainInfo *swapchain_info, VkFramebuffer *framebuffers) {
+    for(uint32_t i = 0; i < swapchain_info->image_count; ++i) {
+        vkDestroyFramebuffer(device, framebuffers[i], NULL);
+        vkDestroyImageView(device, swapchain_info->image_views[i], NULL);
+        vkDestroySemaphore(device, swapchain_info->render_finished[i], NULL);
+    }
+    free(framebuffers);
+    free(swapchain_info->images);
+    free(swapchain_info->image_views);
+    free(swapchain_info->render_finished);
+    vkDestroySwapchainKHR(device, swapchain_info->swapchain, NULL);
+}
 
-        vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_info.graphics_pipeline);
+static void destroy_retired_swapchain(VkDevice device, void *user_data) {
+    RetiredSwapchain *retired = user_data;
+    destroy_swapchain_resources(device, &retired->swapchain_info, retired->framebuffers);
+    destroy_depth_target(device, retired->allocator, &retired->depth_target);
+    free(retired);
+}
 
-        vkCmdDraw(command_buffers[i], 3, 1, 0, 0);
+// Builds a new swapchain from the old one and queues the old resources for deletion once
+// the frames using them have finished. Returns 0 while the surface has no area (minimized).
+static char recreate_swapchain(VkDevice device, VkPhysicalDevice physical_device, VkSurfaceKHR surface, VkSurfaceFormatKHR swapchain_format, VkPresentModeKHR present_mode, Queues queue_indices, VkRenderPass render_pass, MemoryAllocator *allocator, VkFormat depth_format, SwapchainInfo *swapchain_info, DepthTarget *depth_target, VkFramebuffer **framebuffers, DeletionQueue *deletion_queue, uint64_t frame_number) {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities);
+    if(capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+        return 0;
+
+    RetiredSwapchain *retired = malloc(sizeof(RetiredSwapchain));
+    retired->swapchain_info = *swapchain_info;
+    retired->framebuffers = *framebuffers;
+    retired->depth_target = *depth_target;
+    retired->allocator = allocator;
+
+    *swapchain_info = create_swapchain(device, physical_device, surface, swapchain_format, present_mode, queue_indices, retired->swapchain_info.swapchain);
+    *depth_target = create_depth_target(device, allocator, depth_format, swapchain_info->extent);
+    *framebuffers = create_framebuffers(device, render_pass, swapchain_info->image_views, swapchain_info->image_count, depth_target->view, swapchain_info->extent);
+    deletion_queue_push(deletion_queue, frame_number, destroy_retired_swapchain, retired);
+    return 1;
+}
 
-        vkCmdEndRenderPass(command_buffers[i]);
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
 
-        if(vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS) {
-            fprintf(stderr, "Failed to record to Vulkan command buffer.\n");
-            exit(1);
+// Sorts values in place
+static double percentile(double *values, uint32_t count, double p) {
+    if(!count)
+        return 0.0;
+    qsort(values, count, sizeof(double), compare_double);
+    uint32_t index = (uint32_t)(p * (double)(count - 1) + 0.5);
+    return values[index];
+}
+
+static uint32_t get_timestamp_valid_bits(VkPhysicalDevice physical_device, uint32_t queue_family) {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
+    assert(queue_family < count);
+    VkQueueFamilyProperties *properties = malloc(sizeof(VkQueueFamilyProperties) * count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, properties);
+    uint32_t valid_bits = properties[queue_family].timestampValidBits;
+    free(properties);
+    return valid_bits;
+}
+
+static VkQueryPool create_timestamp_query_pool(VkDevice device, uint32_t count) {
+    VkQueryPoolCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = count;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if(vkCreateQueryPool(device, &createInfo, NULL, &query_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan query pool.\n");
+        exit(1);
+    }
+    return query_pool;
+}
+
+#define MAX_RECORD_THREADS 64
+
+// Everything needed to record one frame. When query_pool is set, a begin/end
+// timestamp pair is written at query_index and query_index + 1.
+typedef struct FrameRecording {
+    VkRenderPass render_pass;
+    VkFramebuffer framebuffer;
+    VkImage color_image; // The framebuffer's attachments, for the render graph
+    VkImage depth_image;
+    VkImageView depth_view;
+    VkImageLayout final_layout; // Of the color attachment, from the render pass
+    PostChain *post; // Renders into an HDR transient instead, which the post chain blits into color_image
+    VkExtent2D extent;
+    VkPipeline pipeline;
+    VkPipeline depth_pipeline; // Depth pre-pass before pipeline, which then tests EQUAL. VK_NULL_HANDLE for a single pass.
+    const VkPipeline *switch_pipelines; // Draw i binds switch_pipelines[i % switch_pipeline_count] instead of pipeline
+    uint32_t switch_pipeline_count;
+    VkPipelineLayout pipeline_layout;
+    VkDescriptorSet descriptor_set; // Instance data, VK_NULL_HANDLE for the plain triangle
+    VkDescriptorSet texture_set; // Bindless table, bound once for all draws
+    const BindlessHandle *textures; // Draw i uses textures[i % texture_count]
+    uint32_t texture_count;
+    uint32_t draw_count;
+    uint32_t instance_count; // Per draw
+    const RenderQueue *render_queue; // Sorted draws that replace the draw_count identical ones
+    VkBuffer draw_buffer; // The queue's merged draws for vkCmdDrawIndirect, VK_NULL_HANDLE without multiDrawIndirect
+    ViewParams view;
+    const GpuCulling *culling; // Replaces the direct draws with the culled indirect ones
+    float cull_min_radius;
+    uint32_t frame_slot;
+    VkQueryPool query_pool;
+    uint32_t query_index;
+    UploadQueue *uploads;
+    Profiler *profiler; // GPU scopes around the passes, NULL when not profiling
+} FrameRecording;
+
+typedef struct RecordTask {
+    const FrameRecording *recording;
+    VkCommandBuffer command_buffer;
+    VkBuffer cull_draws;
+    uint32_t first_draw;
+    uint32_t draw_count;
+} RecordTask;
+
+// Command pools for one frame in flight. They are transient and reset in bulk once the
+// frame has finished. Each recording thread gets its own pool and secondary
+// command buffer since pools must not be used from two threads at once.
+typedef struct FrameCommands {
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    RenderGraph *graph;
+    VkFramebuffer hdr_framebuffer; // For --hdr, with what it was created from
+    uint64_t hdr_generation; // Of the graph that made the HDR view
+    VkImageView hdr_depth_view;
+    VkExtent2D hdr_extent;
+    uint64_t cull_generation; // Of the graph whose draw list the culling descriptor set of this slot holds
+    uint32_t worker_count;
+    VkCommandPool *worker_pools;
+    VkCommandBuffer *worker_command_buffers;
+    RecordTask *worker_tasks;
+} FrameCommands;
+
+static FrameCommands create_frame_commands(VkDevice device, MemoryAllocator *allocator, const DeviceFeatures *features, uint32_t queue_family, uint32_t worker_count) {
+    FrameCommands frame = { 0 };
+    frame.command_pool = create_command_pool(device, queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    frame.graph = render_graph_create(device, allocator, features->synchronization2);
+    VkCommandBuffer *command_buffers = create_command_buffers(device, frame.command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+    frame.command_buffer = command_buffers[0];
+    free(command_buffers);
+
+    // A single thread records straight into the primary command buffer
+    if(worker_count > 1) {
+        frame.worker_count = worker_count;
+        frame.worker_pools = malloc(sizeof(VkCommandPool) * worker_count);
+        frame.worker_command_buffers = malloc(sizeof(VkCommandBuffer) * worker_count);
+        frame.worker_tasks = malloc(sizeof(RecordTask) * worker_count);
+        for(uint32_t i = 0; i < worker_count; ++i) {
+            frame.worker_pools[i] = create_command_pool(device, queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            command_buffers = create_command_buffers(device, frame.worker_pools[i], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+            frame.worker_command_buffers[i] = command_buffers[0];
+            free(command_buffers);
         }
     }
+    return frame;
+}
 
-    uint32_t current_frame = 0;
-    while(window_run(window)) {
-        vkWaitForFences(device, 1, &in_flight_fence[current_frame], VK_TRUE, UINT64_MAX);
-        vkResetFences(device, 1, &in_flight_fence[current_frame]);
+static void destroy_frame_commands(VkDevice device, FrameCommands *frame) {
+    for(uint32_t i = 0; i < frame->worker_count; ++i)
+        vkDestroyCommandPool(device, frame->worker_pools[i], NULL);
+    vkDestroyCommandPool(device, frame->command_pool, NULL);
+    vkDestroyFramebuffer(device, frame->hdr_framebuffer, NULL);
+    render_graph_destroy(frame->graph);
+    free(frame->worker_pools);
+    free(frame->worker_command_buffers);
+    free(frame->worker_tasks);
+}
 
-        uint32_t image_index;
-        vkAcquireNextImageKHR(device, swapchain_info.swapchain, UINT64_MAX, image_avaliable_semaphore[current_frame], VK_NULL_HANDLE, &image_index);
+static void record_draw(VkCommandBuffer command_buffer, const FrameRecording *recording, VkBuffer cull_draws) {
+    if(recording->culling)
+        record_culled_draw(command_buffer, recording->culling, recording->frame_slot, cull_draws);
+    else
+        vkCmdDraw(command_buffer, 3, recording->instance_count, 0, 0);
+}
 
-        VkSubmitInfo submit_info = { 0 };
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        
-        VkSemaphore wait_semaphore[] = { image_avaliable_semaphore[current_frame] };
-        VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+// What record_draws takes ranges of, the queue's draw calls when there is one
+static uint32_t record_range_count(const FrameRecording *recording) {
+    return recording->render_queue ? render_queue_batch_count(recording->render_queue) : recording->draw_count;
+}
 
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = wait_semaphore;
-        submit_info.pWaitDstStageMask = wait_stages;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffers[image_index];
+// Without a render queue all draws are the same, so only draw_count matters. cull_draws is
+// the frame's draw list with GPU culling.
+static void record_draws(VkCommandBuffer command_buffer, const FrameRecording *recording, VkBuffer cull_draws, uint32_t first_draw, uint32_t draw_count) {
+    // The queue binds its own pipelines
+    if(!recording->render_queue)
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recording->depth_pipeline ? recording->depth_pipeline : recording->pipeline);
+
+    VkViewport viewport = { 0.0f, 0.0f, (float)recording->extent.width, (float)recording->extent.height, 0.0f, 1.0f };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    VkRect2D scissor = { { 0, 0 }, recording->extent };
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    if(recording->descriptor_set)
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recording->pipeline_layout, 0, 1, &recording->descriptor_set, 0, NULL);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recording->pipeline_layout, 1, 1, &recording->texture_set, 0, NULL);
+    vkCmdPushConstants(command_buffer, recording->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ViewParams), &recording->view);
+    BindlessHandle no_texture = BINDLESS_INVALID_HANDLE;
+    if(!recording->texture_count)
+        vkCmdPushConstants(command_buffer, recording->pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, TEXTURE_PUSH_OFFSET, sizeof(BindlessHandle), &no_texture);
+
+    if(recording->render_queue) {
+        RenderQueueBindings bindings = { 0 };
+        bindings.pipelines = recording->switch_pipeline_count ? recording->switch_pipelines : &recording->pipeline;
+        bindings.pipeline_layout = recording->pipeline_layout;
+        bindings.materials = recording->texture_count ? recording->textures : NULL;
+        bindings.material_stages = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings.material_offset = TEXTURE_PUSH_OFFSET;
+        bindings.draw_buffer = recording->draw_buffer;
+        render_queue_record(recording->render_queue, command_buffer, &bindings, first_draw, draw_count);
+        return;
+    }
 
-        VkSemaphore singal_semaphores[] = { render_finsihed_semaphore[current_frame] };
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = singal_semaphores;
+    // Same layout and dynamic state, so everything bound above carries over to the color pass
+    if(recording->depth_pipeline) {
+        for(uint32_t i = 0; i < draw_count; ++i)
+            record_draw(command_buffer, recording, cull_draws);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recording->pipeline);
+    }
 
-        if(vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fence[current_frame]) != VK_SUCCESS) { 
-            fprintf(stderr, "Failed to submit Vulkan queue.\n");
-            exit(1);
-        }
+    for(uint32_t i = 0; i < draw_count; ++i) {
+        if(recording->switch_pipeline_count)
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recording->switch_pipelines[i % recording->switch_pipeline_count]);
+        // Switching textures is a push constant, not a descriptor set bind
+        if(recording->texture_count)
+            vkCmdPushConstants(command_buffer, recording->pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, TEXTURE_PUSH_OFFSET, sizeof(BindlessHandle), &recording->textures[i % recording->texture_count]);
+        record_draw(command_buffer, recording, cull_draws);
+    }
+}
 
-        VkPresentInfoKHR present_info = { 0 };
-        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        present_info.waitSemaphoreCount = 1;
-        present_info.pWaitSemaphores = singal_semaphores;
-        present_info.swapchainCount = 1;
-        present_info.pSwapchains = &swapchain_info.swapchain;
-        present_info.pImageIndices = &image_index;
-        present_info.pResults = NULL;
-        
-        vkQueuePresentKHR(present_queue, &present_info);
+static void record_secondary_task(void *user_data, uint32_t worker_index) {
+    (void)worker_index;
+    RecordTask *task = user_data;
+
+    VkCommandBufferInheritanceInfo inheritance_info = { 0 };
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = task->recording->render_pass;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = task->recording->framebuffer;
 
-        current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHTS;
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+
+    if(vkBeginCommandBuffer(task->command_buffer, &begin_info) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to begin recording to Vulkan secondary command buffer.\n");
+        exit(1);
     }
-    vkDeviceWaitIdle(device);
+    record_draws(task->command_buffer, task->recording, task->cull_draws, task->first_draw, task->draw_count);
+    if(vkEndCommandBuffer(task->command_buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to record to Vulkan secondary command buffer.\n");
+        exit(1);
+    }
+}
 
-    for  (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHTS; ++i) {
-        vkDestroySemaphore(device, render_finsihed_semaphore[i], NULL);
-        vkDestroySemaphore(device, image_avaliable_semaphore[i], NULL);
-        vkDestroyFence(device, in_flight_fence[i], NULL);
+// What the passes of one frame record from, lives on record_frame's stack
+typedef struct FramePasses {
+    const FrameRecording *recording;
+    FrameCommands *frame;
+    ThreadPool *thread_pool;
+    char parallel;
+    VkFramebuffer framebuffer;
+    RenderGraphResource hdr;
+    RenderGraphResource cull_draws;
+} FramePasses;
+
+static void clear_cull_counters_pass(VkCommandBuffer command_buffer, void *user_data) {
+    const FrameRecording *recording = ((FramePasses*)user_data)->recording;
+    record_clear_cull_counters(command_buffer, recording->culling, recording->frame_slot);
+}
+
+static void cull_pass(VkCommandBuffer command_buffer, void *user_data) {
+    const FrameRecording *recording = ((FramePasses*)user_data)->recording;
+    CullParams params = { 0 };
+    params.view = recording->view;
+    params.min_radius = recording->cull_min_radius;
+    params.viewport[0] = (float)recording->extent.width;
+    params.viewport[1] = (float)recording->extent.height;
+    params.object_count = recording->culling->object_count;
+    params.compact = recording->culling->compact;
+    uint32_t cull_scope = profiler_gpu_begin(recording->profiler, command_buffer, "cull", 1);
+    record_gpu_culling(command_buffer, recording->culling, recording->frame_slot, &params);
+    profiler_gpu_end(recording->profiler, command_buffer, cull_scope);
+}
+
+static void main_pass(VkCommandBuffer command_buffer, void *user_data) {
+    FramePasses *passes = user_data;
+    const FrameRecording *recording = passes->recording;
+    VkRenderPassBeginInfo render_pass_info = { 0 };
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = recording->render_pass;
+    render_pass_info.framebuffer = passes->framebuffer;
+    render_pass_info.renderArea.offset.x = 0;
+    render_pass_info.renderArea.offset.y = 0;
+    render_pass_info.renderArea.extent = recording->extent;
+
+    render_pass_info.clearValueCount = 2;
+    render_pass_info.pClearValues = render_pass_clear_values;
+
+    // Statistics can't stay active across vkCmdExecuteCommands without inheritedQueries
+    uint32_t pass_scope = profiler_gpu_begin(recording->profiler, command_buffer, "main pass", !passes->parallel);
+    if(passes->parallel) {
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        thread_pool_wait(passes->thread_pool);
+        vkCmdExecuteCommands(command_buffer, passes->frame->worker_count, passes->frame->worker_command_buffers);
+    } else {
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        VkBuffer cull_draws = recording->culling ? render_graph_buffer(passes->frame->graph, passes->cull_draws) : VK_NULL_HANDLE;
+        record_draws(command_buffer, recording, cull_draws, 0, record_range_count(recording));
     }
-    vkDestroyCommandPool(device, command_pool, NULL);
-    for (uint32_t i = 0; i < swapchain_info.image_count; ++i)
-        vkDestroyFramebuffer(device, framebuffers[i], NULL);
+
+    vkCmdEndRenderPass(command_buffer);
+    profiler_gpu_end(recording->profiler, command_buffer, pass_scope);
+}
+
+static void cull_readback_pass(VkCommandBuffer command_buffer, void *user_data) {
+    const FrameRecording *recording = ((FramePasses*)user_data)->recording;
+    record_culling_readback(command_buffer, recording->culling, recording->frame_slot);
+}
+
+// Declared again every frame since the images and per frame buffers change. The scheduler
+// waited for the frame that last used this slot, so its buffers have nothing to wait for,
+// and the render pass orders the attachments against the previous frame itself.
+static void build_frame_graph(RenderGraph *graph, FramePasses *passes) {
+    const FrameRecording *recording = passes->recording;
+    const GpuCulling *culling = recording->culling;
+    uint32_t slot = recording->frame_slot;
+    const RenderGraphState unused = { 0 };
+    render_graph_reset(graph);
+
+    // The post chain's blit waits for the swapchain image like the render pass would
+    const RenderGraphState acquired = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+    RenderGraphResource color = render_graph_import_image(graph, "color", recording->color_image, VK_IMAGE_ASPECT_COLOR_BIT, recording->post ? acquired : unused);
+    RenderGraphResource depth = render_graph_import_image(graph, "depth", recording->depth_image, VK_IMAGE_ASPECT_DEPTH_BIT, unused);
+    render_graph_export(graph, color, (RenderGraphState){ 0, 0, recording->final_layout });
+
+    RenderGraphResource draws = 0;
+    RenderGraphResource counters = 0;
+    RenderGraphResource readback = 0;
+    if(culling) {
+        draws = passes->cull_draws = render_graph_create_buffer(graph, "draws", culling->draw_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        counters = render_graph_import_buffer(graph, "cull counters", culling->counter_buffers[slot], unused);
+        readback = render_graph_import_buffer(graph, "cull readback", culling->readback_buffers[slot], unused);
+        render_graph_export(graph, readback, (RenderGraphState){ VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED });
+
+        RenderGraphPass clear = render_graph_add_pass(graph, "clear cull counters", clear_cull_counters_pass, passes);
+        render_graph_write(graph, clear, counters, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+
+        RenderGraphPass cull = render_graph_add_pass(graph, "cull", cull_pass, passes);
+        render_graph_read(graph, cull, counters, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        render_graph_write(graph, cull, counters, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        render_graph_write(graph, cull, draws, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    RenderGraphResource target = color;
+    if(recording->post) {
+        VkImageCreateInfo hdr_info = { 0 };
+        hdr_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        hdr_info.imageType = VK_IMAGE_TYPE_2D;
+        hdr_info.format = POST_HDR_FORMAT;
+        hdr_info.extent.width = recording->extent.width;
+        hdr_info.extent.height = recording->extent.height;
+        hdr_info.extent.depth = 1;
+        hdr_info.mipLevels = 1;
+        hdr_info.arrayLayers = 1;
+        hdr_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        hdr_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        hdr_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        hdr_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        hdr_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        target = passes->hdr = render_graph_create_image(graph, "hdr", &hdr_info, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    RenderGraphPass scene = render_graph_add_pass(graph, "main", main_pass, passes);
+    render_graph_attachment(graph, scene, target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+        recording->post ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : recording->final_layout);
+    render_graph_attachment(graph, scene, depth, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    if(culling) {
+        render_graph_read(graph, scene, draws, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        if(culling->compact)
+            render_graph_read(graph, scene, counters, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+
+        RenderGraphPass copy = render_graph_add_pass(graph, "cull readback", cull_readback_pass, passes);
+        render_graph_read(graph, copy, counters, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        render_graph_write(graph, copy, readback, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+    if(recording->post)
+        post_chain_add_passes(recording->post, graph, slot, passes->hdr, color, recording->extent);
+    render_graph_compile(graph);
+}
+
+// The HDR target is a transient of the frame's graph. The framebuffer is made again when
+// the graph recreated it or the depth target changed with the swapchain.
+static VkFramebuffer get_hdr_framebuffer(VkDevice device, FrameCommands *frame, const FrameRecording *recording, VkImageView hdr_view) {
+    uint64_t generation = render_graph_generation(frame->graph);
+    if(frame->hdr_framebuffer && frame->hdr_generation == generation && frame->hdr_depth_view == recording->depth_view
+    && frame->hdr_extent.width == recording->extent.width && frame->hdr_extent.height == recording->extent.height)
+        return frame->hdr_framebuffer;
+
+    // The frame that last used it has finished
+    vkDestroyFramebuffer(device, frame->hdr_framebuffer, NULL);
+    VkFramebuffer *framebuffers = create_framebuffers(device, recording->render_pass, &hdr_view, 1, recording->depth_view, recording->extent);
+    frame->hdr_framebuffer = framebuffers[0];
     free(framebuffers);
-    vkDestroyPipeline(device, graphics_pipeline_info.graphics_pipeline, NULL);
-    vkDestroyPipelineLayout(device, graphics_pipeline_info.pipeline_layout, NULL);
-    vkDestroyRenderPass(device, swapchain_info.render_pass, NULL);
-    for(uint32_t i = 0; i < swapchain_info.image_count; ++i)
-        vkDestroyImageView(device, swapchain_info.image_views[i], NULL);
-    free(swapchain_info.images);
-    free(swapchain_info.image_views);
-    vkDestroySwapchainKHR(device, swapchain, NULL);
+    frame->hdr_generation = generation;
+    frame->hdr_depth_view = recording->depth_view;
+    frame->hdr_extent = recording->extent;
+    return frame->hdr_framebuffer;
+}
+
+// Points the cull shader of this slot at the draw list the graph placed, whenever the
+// graph created its transients again
+static void update_cull_draws(VkDevice device, FrameCommands *frame, const FrameRecording *recording, VkBuffer draws) {
+    uint64_t generation = render_graph_generation(frame->graph);
+    if(frame->cull_generation == generation)
+        return;
+
+    // The frame that last used the set has finished
+    VkDescriptorBufferInfo buffer_info = { draws, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet write = { 0 };
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = recording->culling->descriptor_sets[recording->frame_slot];
+    write.dstBinding = 1;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    frame->cull_generation = generation;
+}
+
+// Resets the frame's pools and records it into frame->command_buffer. With worker threads
+// the draws, or the render queue's draw calls, are split evenly into one secondary command
+// buffer per worker.
+// Returns what the submit has to wait for before the frame may use freshly uploaded data
+static UploadWait record_frame(VkDevice device, FrameCommands *frame, const FrameRecording *recording, ThreadPool *thread_pool) {
+    vkResetCommandPool(device, frame->command_pool, 0);
+    char parallel = thread_pool && frame->worker_count > 1;
+
+    // Built before the workers start, the culled draws they record read the graph's draw list
+    FramePasses passes = { recording, frame, thread_pool, parallel, recording->framebuffer, 0, 0 };
+    build_frame_graph(frame->graph, &passes);
+    VkBuffer cull_draws = VK_NULL_HANDLE;
+    if(recording->culling) {
+        cull_draws = render_graph_buffer(frame->graph, passes.cull_draws);
+        update_cull_draws(device, frame, recording, cull_draws);
+    }
+
+    if(parallel) {
+        uint32_t first = 0, count = record_range_count(recording);
+        for(uint32_t i = 0; i < frame->worker_count; ++i) {
+            vkResetCommandPool(device, frame->worker_pools[i], 0);
+            uint32_t end = (uint32_t)((uint64_t)count * (i + 1) / frame->worker_count);
+            frame->worker_tasks[i] = (RecordTask){ recording, frame->worker_command_buffers[i], cull_draws, first, end - first };
+            first = end;
+            thread_pool_submit(thread_pool, record_secondary_task, &frame->worker_tasks[i]);
+        }
+    }
+
+    if(recording->post)
+        passes.framebuffer = get_hdr_framebuffer(device, frame, recording, render_graph_image_view(frame->graph, passes.hdr));
+
+    VkCommandBuffer command_buffer = frame->command_buffer;
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
+
+    if(vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to begin recording to Vulkan command buffer.\n");
+        exit(1);
+    }
+
+    UploadWait upload_wait = { 0 };
+    if(recording->uploads)
+        upload_wait = upload_record_acquire(recording->uploads, command_buffer);
+    profiler_record_reset(recording->profiler, command_buffer);
+    uint32_t frame_scope = profiler_gpu_begin(recording->profiler, command_buffer, "frame", 0);
+
+    if(recording->query_pool) {
+        vkCmdResetQueryPool(command_buffer, recording->query_pool, recording->query_index, 2);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, recording->query_pool, recording->query_index);
+    }
+
+    render_graph_execute(frame->graph, command_buffer);
+    profiler_gpu_end(recording->profiler, command_buffer, frame_scope);
+
+    if(recording->query_pool)
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, recording->query_pool, recording->query_index + 1);
+
+    if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to record to Vulkan command buffer.\n");
+        exit(1);
+    }
+    return upload_wait;
+}
+
+// Records the same frame repeatedly with 1, 2, 4 and 8 threads. Nothing is submitted,
+// so the pools can be reset right away and only CPU recording cost is measured.
+static void run_record_scaling_benchmark(VkDevice device, MemoryAllocator *allocator, const DeviceFeatures *features, uint32_t queue_family, const FrameRecording *recording) {
+    const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+    const uint32_t warmup_iterations = 10;
+    const uint32_t iterations = 100;
+    double single_thread_time = 0.0;
+
+    printf("Recording %u draws per frame\n", recording->draw_count);
+    for(uint32_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t) {
+        uint32_t threads = thread_counts[t];
+        FrameCommands frame = create_frame_commands(device, allocator, features, queue_family, threads);
+        ThreadPool *thread_pool = threads > 1 ? thread_pool_create(threads) : NULL;
+
+        for(uint32_t i = 0; i < warmup_iterations; ++i)
+            record_frame(device, &frame, recording, thread_pool);
+        double begin = get_time_ms();
+        for(uint32_t i = 0; i < iterations; ++i)
+            record_frame(device, &frame, recording, thread_pool);
+        double frame_time = (get_time_ms() - begin) / iterations;
+        if(threads == 1)
+            single_thread_time = frame_time;
+
+        printf("%u thread(s): %.3f ms per frame, %.2fx\n", threads, frame_time, single_thread_time / frame_time);
+
+        if(thread_pool)
+            thread_pool_destroy(thread_pool);
+        destroy_frame_commands(device, &frame);
+    }
+}
+
+#define PARTICLE_GROUP_SIZE 64 // local_size_x of particles.comp
+#define PARTICLE_ITERATIONS 64
+#define ASYNC_COMPUTE_WARMUP_FRAMES 20
+#define ASYNC_COMPUTE_BENCH_FRAMES 300
+
+// Matches the push constants in particles.comp
+typedef struct ParticleParams {
+    uint32_t particle_count;
+    uint32_t iterations;
+    float dt;
+} ParticleParams;
+
+// Double buffered so the simulation of the next frame can run while this frame draws the last result
+typedef struct ParticleSim {
+    uint32_t particle_count;
+    VkDescriptorSetLayout set_layout;
+    ComputePipelineInfo pipeline_info;
+    VkPipelineLayout draw_layout;
+    VkPipeline draw_pipeline; // Owned by the pipeline manager
+    VkDescriptorPool descriptor_pool;
+    VkBuffer buffers[2];
+    MemoryAllocation allocations[2];
+    VkDescriptorSet descriptor_sets[2];
+} ParticleSim;
+
+static ParticleSim create_particle_sim(VkDevice device, MemoryAllocator *allocator, VkPipelineCache pipeline_cache, PipelineManager *pipelines, VkRenderPass render_pass, uint32_t particle_count, Queues queue_indices) {
+    ParticleSim sim = { 0 };
+    sim.particle_count = particle_count;
+
+    VkDescriptorSetLayoutBinding binding = { 0 };
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+    VkDescriptorSetLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+    if(vkCreateDescriptorSetLayout(device, &layout_info, NULL, &sim.set_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor set layout.\n");
+        exit(1);
+    }
+    sim.pipeline_info = create_compute_pipeline(device, pipeline_cache, "particles.comp.spv", sim.set_layout, sizeof(ParticleParams));
+
+    VkPipelineLayoutCreateInfo draw_layout_info = { 0 };
+    draw_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    draw_layout_info.setLayoutCount = 1;
+    draw_layout_info.pSetLayouts = &sim.set_layout;
+    if(vkCreatePipelineLayout(device, &draw_layout_info, NULL, &sim.draw_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan pipeline layout\n");
+        exit(1);
+    }
+    GraphicsPipelineDesc desc = { 0 };
+    desc.vert_shader = pipeline_manager_shader(pipelines, "particles.vert.spv");
+    desc.frag_shader = pipeline_manager_shader(pipelines, "particles.frag.spv");
+    desc.layout = sim.draw_layout;
+    desc.render_pass = render_pass;
+    desc.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    desc.cull_mode = VK_CULL_MODE_NONE;
+    desc.front_face = VK_FRONT_FACE_CLOCKWISE;
+    desc.depth_test = VK_TRUE;
+    desc.depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+    sim.draw_pipeline = pipeline_manager_wait(pipelines, pipeline_manager_request(pipelines, &desc));
+    if(!sim.draw_pipeline)
+        exit(1);
+
+    VkDescriptorPoolSize pool_size = { 0 };
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 2;
+    VkDescriptorPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 2;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if(vkCreateDescriptorPool(device, &pool_info, NULL, &sim.descriptor_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor pool.\n");
+        exit(1);
+    }
+
+    // Shared concurrently between the graphics and compute families, which saves ownership
+    // transfers on every frame. Buffers lose nothing from it, unlike compressed images.
+    uint32_t families[] = { queue_indices.graphics_queue, queue_indices.compute_queue };
+    VkDeviceSize size = sizeof(float) * 4 * particle_count;
+    for(uint32_t i = 0; i < 2; ++i) {
+        VkBufferCreateInfo buffer_info = { 0 };
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = size;
+        buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if(families[0] != families[1]) {
+            buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            buffer_info.queueFamilyIndexCount = 2;
+            buffer_info.pQueueFamilyIndices = families;
+        } else {
+            buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+        if(vkCreateBuffer(device, &buffer_info, NULL, &sim.buffers[i]) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan buffer.\n");
+            exit(1);
+        }
+        sim.allocations[i] = memory_allocate_buffer(allocator, sim.buffers[i], MEMORY_USAGE_GPU_ONLY);
+
+        VkDescriptorSetAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = sim.descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &sim.set_layout;
+        if(vkAllocateDescriptorSets(device, &alloc_info, &sim.descriptor_sets[i]) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan descriptor set.\n");
+            exit(1);
+        }
+        VkDescriptorBufferInfo buffer_descriptor = { sim.buffers[i], 0, size };
+        VkWriteDescriptorSet write = { 0 };
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = sim.descriptor_sets[i];
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &buffer_descriptor;
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    }
+    return sim;
+}
+
+static void destroy_particle_sim(VkDevice device, MemoryAllocator *allocator, ParticleSim *sim) {
+    for(uint32_t i = 0; i < 2; ++i) {
+        vkDestroyBuffer(device, sim->buffers[i], NULL);
+        memory_free(allocator, &sim->allocations[i]);
+    }
+    vkDestroyDescriptorPool(device, sim->descriptor_pool, NULL);
+    vkDestroyPipeline(device, sim->pipeline_info.pipeline, NULL);
+    vkDestroyPipelineLayout(device, sim->pipeline_info.pipeline_layout, NULL);
+    vkDestroyPipelineLayout(device, sim->draw_layout, NULL);
+    vkDestroyDescriptorSetLayout(device, sim->set_layout, NULL);
+}
+
+static void record_particle_sim(VkCommandBuffer command_buffer, const ParticleSim *sim, uint32_t slot) {
+    ParticleParams params = { sim->particle_count, PARTICLE_ITERATIONS, 1.0f / 60.0f };
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sim->pipeline_info.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sim->pipeline_info.pipeline_layout, 0, 1, &sim->descriptor_sets[slot], 0, NULL);
+    vkCmdPushConstants(command_buffer, sim->pipeline_info.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(command_buffer, (sim->particle_count + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+}
+
+// A point per particle, inside the render pass
+static void record_particle_draw(VkCommandBuffer command_buffer, const ParticleSim *sim, uint32_t slot) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sim->draw_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sim->draw_layout, 0, 1, &sim->descriptor_sets[slot], 0, NULL);
+    vkCmdDraw(command_buffer, sim->particle_count, 1, 0, 0);
+}
+
+// Renders frames that also simulate particles and draw the previous simulation's result.
+// Serial records the simulation into the graphics command buffer ahead of the render pass.
+// Async submits it to the compute queue, where frame N + 1's simulation runs while frame N
+// rasterizes. Returns ms per frame.
+static double time_async_compute_frames(VkDevice device, VkQueue graphics_queue, AsyncCompute *compute, VkCommandBuffer *command_buffers, const ParticleSim *sim, const FrameRecording *recording, char async) {
+    VkSemaphore graphics_timeline = create_timeline_semaphore(device);
+    uint64_t compute_value = 0;
+    double begin = 0.0;
+    uint32_t frame_count = ASYNC_COMPUTE_WARMUP_FRAMES + ASYNC_COMPUTE_BENCH_FRAMES;
+    for(uint32_t frame = 0; frame < frame_count; ++frame) {
+        if(frame == ASYNC_COMPUTE_WARMUP_FRAMES)
+            begin = get_time_ms();
+        uint32_t slot = frame % 2;
+
+        // Graphics frame N signals N + 1, so this waits for the frame that last used the slot
+        if(frame >= 2)
+            wait_timeline_semaphore(device, graphics_timeline, frame - 1);
+
+        // The simulation writes buffers[slot], which the previous graphics frame drew, and
+        // async_compute_submit waits for that frame. This frame draws buffers[slot ^ 1] from
+        // the previous simulation, so it waits on the value before this submit.
+        uint64_t wait_value = compute_value;
+        if(async) {
+            VkCommandBuffer compute_commands = async_compute_begin(compute, slot);
+            record_particle_sim(compute_commands, sim, slot);
+            compute_value = async_compute_submit(compute, slot, graphics_timeline, frame);
+        }
+
+        VkCommandBuffer command_buffer = command_buffers[slot];
+        VkCommandBufferBeginInfo begin_info = { 0 };
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if(vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to begin recording to Vulkan command buffer.\n");
+            exit(1);
+        }
+        if(!async) {
+            // The previous frame's particle draw has to finish reading buffers[slot] first
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+            record_particle_sim(command_buffer, sim, slot);
+            // Makes the previous frame's simulation, which came before this one, visible to the draw
+            VkMemoryBarrier barrier = { 0 };
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+        }
+
+        VkRenderPassBeginInfo render_pass_info = { 0 };
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = recording->render_pass;
+        render_pass_info.framebuffer = recording->framebuffer;
+        render_pass_info.renderArea.extent = recording->extent;
+        render_pass_info.clearValueCount = 2;
+        render_pass_info.pClearValues = render_pass_clear_values;
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        record_draws(command_buffer, recording, VK_NULL_HANDLE, 0, recording->draw_count);
+        record_particle_draw(command_buffer, sim, slot ^ 1);
+        vkCmdEndRenderPass(command_buffer);
+        if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to record to Vulkan command buffer.\n");
+            exit(1);
+        }
+
+        VkSemaphore wait_semaphore = async ? async_compute_timeline(compute) : VK_NULL_HANDLE;
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+        uint64_t signal_value = frame + 1;
+        VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = async && wait_value ? 1 : 0;
+        timeline_info.pWaitSemaphoreValues = &wait_value;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &signal_value;
+        VkSubmitInfo submit_info = { 0 };
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = &timeline_info;
+        submit_info.waitSemaphoreCount = timeline_info.waitSemaphoreValueCount;
+        submit_info.pWaitSemaphores = &wait_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &graphics_timeline;
+        if(vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to submit Vulkan command buffer.\n");
+            exit(1);
+        }
+    }
+    wait_timeline_semaphore(device, graphics_timeline, frame_count);
+    if(async)
+        async_compute_wait(compute, compute_value);
+    double frame_time = (get_time_ms() - begin) / ASYNC_COMPUTE_BENCH_FRAMES;
+    vkDestroySemaphore(device, graphics_timeline, NULL);
+    return frame_time;
+}
+
+static void run_async_compute_benchmark(VkDevice device, VkQueue graphics_queue, VkQueue compute_queue, Queues queue_indices, MemoryAllocator *allocator, UploadQueue *uploads,
+    VkPipelineCache pipeline_cache, PipelineManager *pipelines, const FrameRecording *recording, uint32_t particle_count) {
+    // Culling would need its own dispatch per frame, the benchmark draws directly
+    FrameRecording bench_recording = *recording;
+    bench_recording.culling = NULL;
+    ParticleSim sim = create_particle_sim(device, allocator, pipeline_cache, pipelines, recording->render_pass, particle_count, queue_indices);
+    AsyncCompute *compute = async_compute_create(device, compute_queue, queue_indices.compute_queue, 2);
+    VkCommandPool command_pool = create_command_pool(device, queue_indices.graphics_queue, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VkCommandBuffer *command_buffers = create_command_buffers(device, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2);
+
+    // Start every particle from the same place rather than whatever the memory held, and
+    // take ownership of the pending instance uploads the draws read
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffers[0], &begin_info);
+    UploadWait upload_wait = upload_record_acquire(uploads, command_buffers[0]);
+    for(uint32_t i = 0; i < 2; ++i)
+        vkCmdFillBuffer(command_buffers[0], sim.buffers[i], 0, VK_WHOLE_SIZE, 0x3e800000); // 0.25f
+    vkEndCommandBuffer(command_buffers[0]);
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = upload_wait.value ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = &upload_wait.value;
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = timeline_info.waitSemaphoreValueCount;
+    submit_info.pWaitSemaphores = &upload_wait.semaphore;
+    submit_info.pWaitDstStageMask = &upload_wait.stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffers[0];
+    vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphics_queue);
+
+    printf("Async compute: %u particles x %u iterations, drawn the next frame alongside %u draws\n", particle_count, PARTICLE_ITERATIONS, recording->draw_count);
+    double serial_time = time_async_compute_frames(device, graphics_queue, compute, command_buffers, &sim, &bench_recording, 0);
+    double async_time = time_async_compute_frames(device, graphics_queue, compute, command_buffers, &sim, &bench_recording, 1);
+    printf("Graphics queue only: %.3f ms per frame\n", serial_time);
+    if(queue_indices.compute_queue != queue_indices.graphics_queue)
+        printf("Compute family %u overlapped: %.3f ms per frame, %.1f%% faster\n", queue_indices.compute_queue, async_time, 100.0 * (serial_time / async_time - 1.0));
+    else
+        printf("No separate compute family, split submits on the graphics queue: %.3f ms per frame\n", async_time);
+
+    free(command_buffers);
+    vkDestroyCommandPool(device, command_pool, NULL);
+    async_compute_destroy(compute);
+    destroy_particle_sim(device, allocator, &sim);
+}
+
+#define MESH_BENCH_LOADS 5
+#define MESH_BENCH_WARMUP_FRAMES 10
+#define MESH_BENCH_FRAMES 100
+#define MESH_BENCH_DRAWS 16 // Rotated copies of the mesh per frame
+
+// mesh.vert's MeshView block
+typedef struct MeshView {
+    float scale_rotation[4];
+    float offset[4];
+    float fit[4];
+} MeshView;
+
+typedef struct MeshBenchResult {
+    double load_ms; // Average, from opening the file until the GPU has the data
+    double gpu_ms;  // Per frame
+    uint64_t vertex_invocations; // Per frame, 0 without pipelineStatisticsQuery
+} MeshBenchResult;
+
+// Takes graphics queue ownership of everything uploaded so far and waits for it
+static void acquire_uploads(VkDevice device, VkQueue graphics_queue, VkCommandBuffer command_buffer, UploadQueue *uploads) {
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    UploadWait upload_wait = upload_record_acquire(uploads, command_buffer);
+    vkEndCommandBuffer(command_buffer);
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = upload_wait.value ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = &upload_wait.value;
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = timeline_info.waitSemaphoreValueCount;
+    submit_info.pWaitSemaphores = &upload_wait.semaphore;
+    submit_info.pWaitDstStageMask = &upload_wait.stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphics_queue);
+}
+
+// Loads the mesh a few times, then draws it MESH_BENCH_DRAWS times a frame
+static MeshBenchResult bench_mesh(VkDevice device, VkQueue graphics_queue, VkCommandBuffer command_buffer, MemoryAllocator *allocator, UploadQueue *uploads,
+    PipelineManager *pipelines, const GraphicsPipelineDesc *base_desc, const FrameRecording *recording, VkQueryPool timestamps, VkQueryPool statistics,
+    float timestamp_period, const char *path, char baked) {
+    MeshBenchResult result = { 0 };
+    Mesh mesh = { 0 };
+    for(uint32_t i = 0; i < MESH_BENCH_LOADS; ++i) {
+        if(i)
+            mesh_destroy(device, allocator, &mesh);
+        double begin = get_time_ms();
+        mesh = baked ? mesh_load_baked(allocator, uploads, path) : mesh_load_obj(allocator, uploads, path);
+        upload_flush(uploads);
+        upload_wait_idle(uploads);
+        result.load_ms += get_time_ms() - begin;
+        acquire_uploads(device, graphics_queue, command_buffer, uploads);
+    }
+    result.load_ms /= MESH_BENCH_LOADS;
+
+    GraphicsPipelineDesc desc = *base_desc;
+    desc.vertex_format = mesh.format;
+    VkPipeline pipeline = pipeline_manager_wait(pipelines, pipeline_manager_request(pipelines, &desc));
+    if(!pipeline)
+        exit(1);
+
+    // Fit the bounds into the view, the same for both formats of a mesh
+    MeshView view = { 0 };
+    float radius_squared = 0.0f;
+    for(uint32_t k = 0; k < 3; ++k) {
+        view.scale_rotation[k] = mesh.position_scale[k];
+        view.offset[k] = mesh.position_offset[k];
+        view.fit[k] = (mesh.bounds_min[k] + mesh.bounds_max[k]) * 0.5f;
+        radius_squared += (mesh.bounds_max[k] - view.fit[k]) * (mesh.bounds_max[k] - view.fit[k]);
+    }
+    view.fit[3] = radius_squared > 0.0f ? 1.0f / SDL_sqrtf(radius_squared) : 1.0f;
+
+    for(uint32_t frame = 0; frame < MESH_BENCH_WARMUP_FRAMES + MESH_BENCH_FRAMES; ++frame) {
+        VkCommandBufferBeginInfo begin_info = { 0 };
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if(vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to begin recording to Vulkan command buffer.\n");
+            exit(1);
+        }
+        vkCmdResetQueryPool(command_buffer, timestamps, 0, 2);
+        if(statistics)
+            vkCmdResetQueryPool(command_buffer, statistics, 0, 1);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamps, 0);
+        if(statistics)
+            vkCmdBeginQuery(command_buffer, statistics, 0, 0);
+
+        VkRenderPassBeginInfo render_pass_info = { 0 };
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = recording->render_pass;
+        render_pass_info.framebuffer = recording->framebuffer;
+        render_pass_info.renderArea.extent = recording->extent;
+        render_pass_info.clearValueCount = 2;
+        render_pass_info.pClearValues = render_pass_clear_values;
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkViewport viewport = { 0.0f, 0.0f, (float)recording->extent.width, (float)recording->extent.height, 0.0f, 1.0f };
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        VkRect2D scissor = { { 0, 0 }, recording->extent };
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        VkDeviceSize vertex_offset = 0;
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &mesh.vertex_buffer, &vertex_offset);
+        vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer, 0, mesh.index_type);
+        for(uint32_t i = 0; i < MESH_BENCH_DRAWS; ++i) {
+            view.scale_rotation[3] = (float)frame * 0.01f + (float)i * (6.2831853f / MESH_BENCH_DRAWS);
+            vkCmdPushConstants(command_buffer, desc.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(view), &view);
+            vkCmdDrawIndexed(command_buffer, mesh.index_count, 1, 0, 0, 0);
+        }
+        vkCmdEndRenderPass(command_buffer);
+
+        if(statistics)
+            vkCmdEndQuery(command_buffer, statistics, 0);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamps, 1);
+        if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to record to Vulkan command buffer.\n");
+            exit(1);
+        }
+        VkSubmitInfo submit_info = { 0 };
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        if(vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to submit Vulkan command buffer.\n");
+            exit(1);
+        }
+        vkQueueWaitIdle(graphics_queue);
+        if(frame < MESH_BENCH_WARMUP_FRAMES)
+            continue;
+
+        uint64_t times[2];
+        vkGetQueryPoolResults(device, timestamps, 0, 2, sizeof(times), times, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        result.gpu_ms += (double)(times[1] - times[0]) * timestamp_period * 1e-6;
+        if(statistics) {
+            uint64_t invocations = 0;
+            vkGetQueryPoolResults(device, statistics, 0, 1, sizeof(invocations), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            result.vertex_invocations += invocations;
+        }
+    }
+    result.gpu_ms /= MESH_BENCH_FRAMES;
+    result.vertex_invocations /= MESH_BENCH_FRAMES;
+
+    printf("%-5s %s: %u vertices, %u triangles, %.1f KB of buffers\n", baked ? "Baked" : "Raw", path, mesh.vertex_count, mesh.index_count / 3,
+        (mesh.vertex_allocation.size + mesh.index_allocation.size) / 1024.0);
+    printf("      load %.2f ms, GPU %.3f ms per frame, %.1f M triangles/s", result.load_ms, result.gpu_ms,
+        (double)mesh.index_count / 3 * MESH_BENCH_DRAWS / (result.gpu_ms * 1e3));
+    if(statistics)
+        printf(", %.3f vertex shader invocations per triangle", (double)result.vertex_invocations / ((double)mesh.index_count / 3 * MESH_BENCH_DRAWS));
+    printf("\n");
+    mesh_destroy(device, allocator, &mesh);
+    return result;
+}
+
+// paths is "raw.obj,baked.mesh", both should come from the same source mesh
+static void run_mesh_benchmark(VkDevice device, VkQueue graphics_queue, uint32_t graphics_family, MemoryAllocator *allocator, UploadQueue *uploads, PipelineManager *pipelines,
+    const FrameRecording *recording, const VkPhysicalDeviceProperties *device_properties, char pipeline_statistics, const char *paths) {
+    const char *comma = strchr(paths, ',');
+    if(!comma || comma == paths || !comma[1]) {
+        fprintf(stderr, "--mesh-bench expects RAW.obj,BAKED.mesh.\n");
+        exit(1);
+    }
+    char *raw_path = malloc((size_t)(comma - paths) + 1);
+    memcpy(raw_path, paths, (size_t)(comma - paths));
+    raw_path[comma - paths] = 0;
+
+    VkPipelineLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshView) };
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    if(vkCreatePipelineLayout(device, &layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan pipeline layout\n");
+        exit(1);
+    }
+    GraphicsPipelineDesc desc = { 0 };
+    desc.vert_shader = pipeline_manager_shader(pipelines, "mesh.vert.spv");
+    desc.frag_shader = pipeline_manager_shader(pipelines, "mesh.frag.spv");
+    desc.layout = pipeline_layout;
+    desc.render_pass = recording->render_pass;
+    desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc.cull_mode = VK_CULL_MODE_NONE; // OBJ files don't agree on winding
+    desc.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    desc.depth_test = VK_TRUE;
+    desc.depth_write = VK_TRUE;
+    desc.depth_compare = VK_COMPARE_OP_LESS;
+
+    VkQueryPool timestamps = create_timestamp_query_pool(device, 2);
+    VkQueryPool statistics = VK_NULL_HANDLE;
+    if(pipeline_statistics) {
+        VkQueryPoolCreateInfo query_info = { 0 };
+        query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_info.queryCount = 1;
+        query_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT;
+        if(vkCreateQueryPool(device, &query_info, NULL, &statistics) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan query pool.\n");
+            exit(1);
+        }
+    }
+    VkCommandPool command_pool = create_command_pool(device, graphics_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VkCommandBuffer *command_buffers = create_command_buffers(device, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+
+    printf("Mesh benchmark: %u loads, %u frames of %u draws\n", MESH_BENCH_LOADS, MESH_BENCH_FRAMES, MESH_BENCH_DRAWS);
+    MeshBenchResult raw = bench_mesh(device, graphics_queue, command_buffers[0], allocator, uploads, pipelines, &desc, recording, timestamps, statistics,
+        device_properties->limits.timestampPeriod, raw_path, 0);
+    MeshBenchResult baked = bench_mesh(device, graphics_queue, command_buffers[0], allocator, uploads, pipelines, &desc, recording, timestamps, statistics,
+        device_properties->limits.timestampPeriod, comma + 1, 1);
+    printf("Baked loads %.1fx faster and draws %.1f%% faster\n", raw.load_ms / baked.load_ms, 100.0 * (raw.gpu_ms / baked.gpu_ms - 1.0));
+
+    free(command_buffers);
+    vkDestroyCommandPool(device, command_pool, NULL);
+    if(statistics)
+        vkDestroyQueryPool(device, statistics, NULL);
+    vkDestroyQueryPool(device, timestamps, NULL);
+    vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+    free(raw_path);
+}
+
+#define OVERDRAW_WARMUP_FRAMES 10
+#define OVERDRAW_FRAMES 100
+#define OVERDRAW_ITERATIONS 64
+
+// overdraw.vert's Overdraw block, shared by both stages
+typedef struct OverdrawParams {
+    uint32_t layer_count;
+    uint32_t front_to_back;
+    uint32_t iterations;
+} OverdrawParams;
+
+// Draws the layers with depth_pipeline first when it is set. Returns GPU ms per frame and
+// the fragment shader invocations per pixel when statistics is set.
+static double time_overdraw_frames(VkDevice device, VkQueue graphics_queue, VkCommandBuffer command_buffer, const FrameRecording *recording, VkPipelineLayout pipeline_layout,
+    VkPipeline pipeline, VkPipeline depth_pipeline, const OverdrawParams *params, VkQueryPool timestamps, VkQueryPool statistics, float timestamp_period, double *invocations_per_pixel) {
+    double gpu_ms = 0.0;
+    uint64_t invocations = 0;
+    for(uint32_t frame = 0; frame < OVERDRAW_WARMUP_FRAMES + OVERDRAW_FRAMES; ++frame) {
+        VkCommandBufferBeginInfo begin_info = { 0 };
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if(vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to begin recording to Vulkan command buffer.\n");
+            exit(1);
+        }
+        vkCmdResetQueryPool(command_buffer, timestamps, 0, 2);
+        if(statistics)
+            vkCmdResetQueryPool(command_buffer, statistics, 0, 1);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamps, 0);
+        if(statistics)
+            vkCmdBeginQuery(command_buffer, statistics, 0, 0);
+
+        VkRenderPassBeginInfo render_pass_info = { 0 };
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = recording->render_pass;
+        render_pass_info.framebuffer = recording->framebuffer;
+        render_pass_info.renderArea.extent = recording->extent;
+        render_pass_info.clearValueCount = 2;
+        render_pass_info.pClearValues = render_pass_clear_values;
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        VkViewport viewport = { 0.0f, 0.0f, (float)recording->extent.width, (float)recording->extent.height, 0.0f, 1.0f };
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        VkRect2D scissor = { { 0, 0 }, recording->extent };
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(*params), params);
+        if(depth_pipeline) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depth_pipeline);
+            vkCmdDraw(command_buffer, 3, params->layer_count, 0, 0);
+        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        vkCmdDraw(command_buffer, 3, params->layer_count, 0, 0);
+        vkCmdEndRenderPass(command_buffer);
+
+        if(statistics)
+            vkCmdEndQuery(command_buffer, statistics, 0);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamps, 1);
+        if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to record to Vulkan command buffer.\n");
+            exit(1);
+        }
+        VkSubmitInfo submit_info = { 0 };
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        if(vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to submit Vulkan command buffer.\n");
+            exit(1);
+        }
+        vkQueueWaitIdle(graphics_queue);
+        if(frame < OVERDRAW_WARMUP_FRAMES)
+            continue;
+
+        uint64_t times[2];
+        vkGetQueryPoolResults(device, timestamps, 0, 2, sizeof(times), times, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        gpu_ms += (double)(times[1] - times[0]) * timestamp_period * 1e-6;
+        if(statistics) {
+            uint64_t frame_invocations = 0;
+            vkGetQueryPoolResults(device, statistics, 0, 1, sizeof(frame_invocations), &frame_invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            invocations += frame_invocations;
+        }
+    }
+    *invocations_per_pixel = (double)invocations / OVERDRAW_FRAMES / ((double)recording->extent.width * recording->extent.height);
+    return gpu_ms / OVERDRAW_FRAMES;
+}
+
+// Full screen layers with an expensive fragment shader. Back to front without a pre-pass
+// shades every layer, front to back is what early depth testing can do at best, and the
+// pre-pass gets there regardless of draw order.
+static void run_overdraw_benchmark(VkDevice device, VkQueue graphics_queue, uint32_t graphics_family, PipelineManager *pipelines, const FrameRecording *recording,
+    const VkPhysicalDeviceProperties *device_properties, char pipeline_statistics, uint32_t layer_count, double *case_ms) {
+    VkPipelineLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(OverdrawParams) };
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    if(vkCreatePipelineLayout(device, &layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan pipeline layout\n");
+        exit(1);
+    }
+
+    GraphicsPipelineDesc desc = { 0 };
+    desc.vert_shader = pipeline_manager_shader(pipelines, "overdraw.vert.spv");
+    desc.frag_shader = pipeline_manager_shader(pipelines, "overdraw.frag.spv");
+    desc.layout = pipeline_layout;
+    desc.render_pass = recording->render_pass;
+    desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc.cull_mode = VK_CULL_MODE_NONE;
+    desc.front_face = VK_FRONT_FACE_CLOCKWISE;
+    desc.depth_test = VK_TRUE;
+    desc.depth_write = VK_TRUE;
+    desc.depth_compare = VK_COMPARE_OP_LESS;
+    GraphicsPipelineDesc depth_desc = desc;
+    depth_desc.frag_shader = NULL;
+    GraphicsPipelineDesc equal_desc = desc;
+    equal_desc.depth_write = VK_FALSE;
+    equal_desc.depth_compare = VK_COMPARE_OP_EQUAL;
+    PipelineHandle handles[3] = {
+        pipeline_manager_request(pipelines, &desc),
+        pipeline_manager_request(pipelines, &depth_desc),
+        pipeline_manager_request(pipelines, &equal_desc),
+    };
+    VkPipeline pipeline = pipeline_manager_wait(pipelines, handles[0]);
+    VkPipeline depth_pipeline = pipeline_manager_wait(pipelines, handles[1]);
+    VkPipeline equal_pipeline = pipeline_manager_wait(pipelines, handles[2]);
+    if(!pipeline || !depth_pipeline || !equal_pipeline)
+        exit(1);
+
+    VkQueryPool timestamps = create_timestamp_query_pool(device, 2);
+    VkQueryPool statistics = VK_NULL_HANDLE;
+    if(pipeline_statistics) {
+        VkQueryPoolCreateInfo query_info = { 0 };
+        query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_info.queryCount = 1;
+        query_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        if(vkCreateQueryPool(device, &query_info, NULL, &statistics) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan query pool.\n");
+            exit(1);
+        }
+    }
+    VkCommandPool command_pool = create_command_pool(device, graphics_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VkCommandBuffer *command_buffers = create_command_buffers(device, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+
+    static const char *names[3] = { "back to front", "front to back", "back to front, depth pre-pass" };
+    printf("Overdraw: %u full screen layers at %ux%u, %u iterations per fragment\n", layer_count, recording->extent.width, recording->extent.height, OVERDRAW_ITERATIONS);
+    for(uint32_t i = 0; i < 3; ++i) {
+        OverdrawParams params = { layer_count, i == 1, OVERDRAW_ITERATIONS };
+        double invocations_per_pixel = 0.0;
+        double gpu_ms = time_overdraw_frames(device, graphics_queue, command_buffers[0], recording, pipeline_layout, i == 2 ? equal_pipeline : pipeline, i == 2 ? depth_pipeline : VK_NULL_HANDLE,
+            &params, timestamps, statistics, device_properties->limits.timestampPeriod, &invocations_per_pixel);
+        case_ms[i] = gpu_ms;
+        printf("%-30s %.3f ms GPU per frame", names[i], gpu_ms);
+        if(statistics)
+            printf(", %.2f fragment shader invocations per pixel", invocations_per_pixel);
+        printf("\n");
+    }
+
+    free(command_buffers);
+    vkDestroyCommandPool(device, command_pool, NULL);
+    if(statistics)
+        vkDestroyQueryPool(device, statistics, NULL);
+    vkDestroyQueryPool(device, timestamps, NULL);
+    vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+}
+
+#define RESIZE_STORM_INTERVAL 8
+#define STEADY_STATE_WARMUP_FRAMES 30 // Skipped when reporting steady state throughput
+#define UPLOAD_RING_SIZE (32ull * 1024 * 1024)
+#define PIPELINE_COMPILE_THREADS 2
+#define PIPELINE_VARIANT_INTERVAL 4 // Frames between switching to the next variant
+#define MAX_PIPELINE_SWITCHES 64
+#define UPLOAD_STREAM_CHUNK (4u * 1024 * 1024)
+#define UPLOAD_STREAM_BUFFER_SIZE (64ull * 1024 * 1024)
+
+// The draws as separate objects for --render-queue, pushed in the order a scene would list
+// them, which alternates between the pipelines and textures. Each draws its own slice of
+// the instances. Their depth comes from the vertex shader, so the key leaves it at 0.
+static void push_render_queue(RenderQueue *queue, const FrameRecording *recording, uint32_t instance_count) {
+    render_queue_reset(queue);
+    for(uint32_t i = 0; i < recording->draw_count; ++i) {
+        uint32_t pipeline = recording->switch_pipeline_count ? i % recording->switch_pipeline_count : 0;
+        uint32_t material = recording->texture_count ? i % recording->texture_count : 0;
+        uint32_t first = instance_count ? (uint32_t)((uint64_t)instance_count * i / recording->draw_count) : i;
+        uint32_t end = instance_count ? (uint32_t)((uint64_t)instance_count * (i + 1) / recording->draw_count) : i + 1;
+        render_queue_push(queue, render_queue_key(0, pipeline, material, 0.0f, 0), 3, end - first, 0, first);
+    }
+    render_queue_sort(queue);
+}
+
+typedef struct Options {
+    char headless;
+    VkExtent2D headless_extent;
+    uint32_t frames; // 0 runs until the window is closed
+    uint32_t resize_storm; // Number of programmatic window resizes to time
+    uint32_t draw_count;
+    uint32_t record_threads;
+    char record_scaling;
+    uint32_t upload_mb; // Megabytes streamed through the transfer queue while rendering
+    uint32_t instances; // 0 draws the plain triangle
+    char gpu_cull;
+    float view_zoom;
+    float cull_min_radius; // Pixels
+    char async_compute_bench;
+    uint32_t particles; // Simulated by the async compute benchmark
+    const char *profile_path; // Chrome trace output, NULL disables the profiler
+    char pipeline_stats;
+    uint32_t frames_in_flight;
+    char low_latency;
+    uint32_t pipeline_variants; // Pipeline states cycled through while rendering
+    uint32_t shader_features; // ShaderFeature bits of the main pipeline
+    uint32_t textures; // Bindless textures the draws cycle through, 0 draws untextured
+    const char *stream_textures; // Comma separated KTX2 files, streamed instead of --textures
+    uint32_t texture_budget_mb; // Caps the streaming budget, 0 leaves it to VK_EXT_memory_budget
+    const char *mesh_bench; // "raw.obj,baked.mesh"
+    char depth_prepass;
+    uint32_t overdraw_bench; // Layers of the overdraw scene, 0 skips the benchmark
+    char hdr; // HDR target and the compute post chain
+    char post_scalar; // Shared memory reductions even where subgroups would do
+    uint32_t jobs; // Job system workers that split the instance updates, 1 keeps them on the main thread
+    uint32_t pipeline_switches; // Pipelines the draws of every frame alternate between, 0 keeps one
+    const char *results_path; // CSV that headless runs append their metrics to
+    const char *scene; // First column of those rows
+    char render_queue; // Sorts and merges the draws as separate objects every frame
+} Options;
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--headless WxH] [--frames N] [--resize-storm N] [--draws N] [--record-threads N] [--record-scaling] [--upload MB] [--instances N] [--gpu-cull] [--view-zoom Z] [--cull-min-radius PX] [--async-compute-bench] [--particles N] [--profile TRACE.json] [--pipeline-stats] [--frames-in-flight N] [--low-latency] [--pipeline-variants N] [--shader-features LIST] [--textures N] [--stream-textures LIST] [--texture-budget MB] [--mesh-bench RAW.obj,BAKED.mesh] [--depth-prepass] [--overdraw-bench LAYERS] [--hdr] [--post-scalar] [--jobs N] [--pipeline-switches N] [--results FILE.csv] [--scene NAME] [--render-queue]\n", program);
+}
+
+// Comma separated feature names, e.g. "desaturate,checker"
+static uint32_t parse_shader_features(const char *list) {
+    static const struct { const char *name; uint32_t bit; } features[] = {
+        { "desaturate", SHADER_FEATURE_DESATURATE },
+        { "checker", SHADER_FEATURE_CHECKER },
+        { "flat", SHADER_FEATURE_FLAT_COLOR },
+    };
+    uint32_t mask = 0;
+    while(*list) {
+        size_t length = strcspn(list, ",");
+        uint32_t i = 0;
+        for(; i < sizeof(features) / sizeof(features[0]); ++i) {
+            if(strlen(features[i].name) == length && strncmp(features[i].name, list, length) == 0)
+                break;
+        }
+        if(i == sizeof(features) / sizeof(features[0])) {
+            fprintf(stderr, "Unknown shader feature '%.*s', expected desaturate, checker or flat.\n", (int)length, list);
+            exit(1);
+        }
+        mask |= features[i].bit;
+        list += length;
+        if(*list == ',')
+            ++list;
+    }
+    return mask;
+}
+
+static Options parse_options(int argc, char **argv) {
+    Options options = { 0 };
+    options.draw_count = 1;
+    options.record_threads = 1;
+    options.view_zoom = 1.0f;
+    options.cull_min_radius = 1.0f;
+    options.particles = 1024 * 1024;
+    options.frames_in_flight = 2;
+    options.jobs = 1;
+    options.scene = "default";
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            options.headless = 1;
+            if(sscanf(argv[++i], "%ux%u", &options.headless_extent.width, &options.headless_extent.height) != 2
+            || !options.headless_extent.width || !options.headless_extent.height) {
+                fprintf(stderr, "Invalid headless size '%s', expected WxH.\n", argv[i]);
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--resize-storm") == 0 && i + 1 < argc) {
+            options.resize_storm = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            options.draw_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            options.record_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(options.record_threads < 1 || options.record_threads > MAX_RECORD_THREADS) {
+                fprintf(stderr, "--record-threads must be between 1 and %u.\n", MAX_RECORD_THREADS);
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--record-scaling") == 0) {
+            options.record_scaling = 1;
+        } else if(strcmp(argv[i], "--upload") == 0 && i + 1 < argc) {
+            options.upload_mb = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            options.instances = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--gpu-cull") == 0) {
+            options.gpu_cull = 1;
+        } else if(strcmp(argv[i], "--view-zoom") == 0 && i + 1 < argc) {
+            options.view_zoom = strtof(argv[++i], NULL);
+        } else if(strcmp(argv[i], "--cull-min-radius") == 0 && i + 1 < argc) {
+            options.cull_min_radius = strtof(argv[++i], NULL);
+        } else if(strcmp(argv[i], "--async-compute-bench") == 0) {
+            options.async_compute_bench = 1;
+        } else if(strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            options.particles = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            options.profile_path = argv[++i];
+        } else if(strcmp(argv[i], "--pipeline-stats") == 0) {
+            options.pipeline_stats = 1;
+        } else if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            options.frames_in_flight = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(options.frames_in_flight < 1 || options.frames_in_flight > FRAME_SCHEDULER_MAX_FRAMES) {
+                fprintf(stderr, "--frames-in-flight must be between 1 and %u.\n", FRAME_SCHEDULER_MAX_FRAMES);
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--low-latency") == 0) {
+            options.low_latency = 1;
+        } else if(strcmp(argv[i], "--pipeline-variants") == 0 && i + 1 < argc) {
+            options.pipeline_variants = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--shader-features") == 0 && i + 1 < argc) {
+            options.shader_features = parse_shader_features(argv[++i]);
+        } else if(strcmp(argv[i], "--textures") == 0 && i + 1 < argc) {
+            options.textures = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--stream-textures") == 0 && i + 1 < argc) {
+            options.stream_textures = argv[++i];
+        } else if(strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            options.texture_budget_mb = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--mesh-bench") == 0 && i + 1 < argc) {
+            options.mesh_bench = argv[++i];
+        } else if(strcmp(argv[i], "--depth-prepass") == 0) {
+            options.depth_prepass = 1;
+        } else if(strcmp(argv[i], "--overdraw-bench") == 0 && i + 1 < argc) {
+            options.overdraw_bench = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(!options.overdraw_bench) {
+                fprintf(stderr, "--overdraw-bench needs at least 1 layer.\n");
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--hdr") == 0) {
+            options.hdr = 1;
+        } else if(strcmp(argv[i], "--post-scalar") == 0) {
+            options.post_scalar = 1;
+        } else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(options.jobs < 1 || options.jobs > JOB_MAX_WORKERS) {
+                fprintf(stderr, "--jobs must be between 1 and %u.\n", JOB_MAX_WORKERS);
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--pipeline-switches") == 0 && i + 1 < argc) {
+            options.pipeline_switches = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(options.pipeline_switches < 2 || options.pipeline_switches > MAX_PIPELINE_SWITCHES) {
+                fprintf(stderr, "--pipeline-switches must be between 2 and %u.\n", MAX_PIPELINE_SWITCHES);
+                exit(1);
+            }
+        } else if(strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+            options.results_path = argv[++i];
+        } else if(strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            options.scene = argv[++i];
+        } else if(strcmp(argv[i], "--render-queue") == 0) {
+            options.render_queue = 1;
+        } else {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if(options.gpu_cull && !options.instances) {
+        fprintf(stderr, "--gpu-cull culls the instances of --instances N.\n");
+        exit(1);
+    }
+    if(options.headless && options.resize_storm) {
+        fprintf(stderr, "--resize-storm needs a window and cannot be combined with --headless.\n");
+        exit(1);
+    }
+    if(options.textures && options.stream_textures) {
+        fprintf(stderr, "--textures and --stream-textures both give the draws their textures, pick one.\n");
+        exit(1);
+    }
+    if(options.pipeline_stats && !options.profile_path) {
+        fprintf(stderr, "--pipeline-stats adds to the trace written by --profile.\n");
+        exit(1);
+    }
+    // Submitting frames needs an image that is not owned by a swapchain
+    if(options.async_compute_bench && !options.headless) {
+        fprintf(stderr, "--async-compute-bench renders offscreen and needs --headless.\n");
+        exit(1);
+    }
+    if(options.overdraw_bench && !options.headless) {
+        fprintf(stderr, "--overdraw-bench renders offscreen and needs --headless.\n");
+        exit(1);
+    }
+    // Variants change culling and topology, which the pre-pass would have to match exactly
+    if(options.depth_prepass && options.pipeline_variants) {
+        fprintf(stderr, "--depth-prepass cannot be combined with --pipeline-variants.\n");
+        exit(1);
+    }
+    if(options.mesh_bench && !options.headless) {
+        fprintf(stderr, "--mesh-bench renders offscreen and needs --headless.\n");
+        exit(1);
+    }
+    if(options.post_scalar && !options.hdr) {
+        fprintf(stderr, "--post-scalar picks the reductions of the --hdr post chain.\n");
+        exit(1);
+    }
+    if(options.results_path && !options.headless) {
+        fprintf(stderr, "--results records headless runs and needs --headless.\n");
+        exit(1);
+    }
+    if(options.pipeline_switches && (options.pipeline_variants || options.depth_prepass)) {
+        fprintf(stderr, "--pipeline-switches cannot be combined with --pipeline-variants or --depth-prepass.\n");
+        exit(1);
+    }
+    // Neither the culled indirect draws nor the pre-pass go through the queue
+    if(options.render_queue && (options.gpu_cull || options.depth_prepass)) {
+        fprintf(stderr, "--render-queue cannot be combined with --gpu-cull or --depth-prepass.\n");
+        exit(1);
+    }
+    if(options.jobs > 1 && !options.instances) {
+        fprintf(stderr, "--jobs splits the updates of --instances.\n");
+        exit(1);
+    }
+    // They render straight into the output image with its render pass
+    if(options.hdr && (options.record_scaling || options.async_compute_bench || options.mesh_bench || options.overdraw_bench)) {
+        fprintf(stderr, "--hdr cannot be combined with the benchmarks.\n");
+        exit(1);
+    }
+    if(options.async_compute_bench && !options.particles) {
+        fprintf(stderr, "--particles must be at least 1.\n");
+        exit(1);
+    }
+    // The benchmarks run before the frame loop, then a single frame is rendered
+    if(options.record_scaling || options.async_compute_bench || options.mesh_bench || options.overdraw_bench)
+        options.frames = 1;
+    if(options.headless && !options.frames)
+        options.frames = 1000;
+    if(options.resize_storm && !options.frames)
+        options.frames = (options.resize_storm + 1) * RESIZE_STORM_INTERVAL;
+    return options;
+}
+
+// Appends a "scene,metric,value,better" row for bench.sh, better is "higher" or "lower"
+static void write_result(const Options *options, const char *metric, double value, const char *better) {
+    if(!options->results_path)
+        return;
+    FILE *file = fopen(options->results_path, "a");
+    if(!file) {
+        fprintf(stderr, "Failed to open %s for the results.\n", options->results_path);
+        exit(1);
+    }
+    fprintf(file, "%s,%s,%.4f,%s\n", options->scene, metric, value, better);
+    fclose(file);
+}
+
+static void print_resize_storm_stats(double *frame_times, char *recreated, uint32_t frame_count) {
+    double *hitches = malloc(sizeof(double) * frame_count);
+    double *steady = malloc(sizeof(double) * frame_count);
+    uint32_t hitch_count = 0, steady_count = 0;
+    for(uint32_t i = 0; i < frame_count; ++i) {
+        if(recreated[i])
+            hitches[hitch_count++] = frame_times[i];
+        else
+            steady[steady_count++] = frame_times[i];
+    }
+    printf("Resize storm: %u swapchain recreations over %u frames\n", hitch_count, frame_count);
+    printf("Recreation frames: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", percentile(hitches, hitch_count, 0.50), percentile(hitches, hitch_count, 0.99), percentile(hitches, hitch_count, 1.0));
+    printf("Steady frames: p50 %.3f ms, p99 %.3f ms\n", percentile(steady, steady_count, 0.50), percentile(steady, steady_count, 0.99));
+    free(hitches);
+    free(steady);
+}
+
+#define STARTUP_THREADS 3
+#define BINDLESS_TEXTURE_CAPACITY 16384
+#define TEXTURE_SIZE 64
+#define TEXTURE_ROTATE_INTERVAL 60 // Frames before the draws move on to the next streamed texture
+
+// Filled in by the startup tasks, each writes only its own fields
+typedef struct StartupState {
+    const Options *options;
+    SDL_Window *window;
+    VkInstance instance;
+#ifdef _DEBUG
+    VkDebugReportCallbackEXT debug_callback;
+#endif // _DEBUG
+    VkPhysicalDevice physical_device;
+    VkPhysicalDeviceProperties device_properties;
+    VkSurfaceKHR surface;
+    Queues queue_indices;
+    DeviceFeatures device_features;
+    VkDevice device;
+    MemoryAllocator *allocator;
+    UploadQueue *uploads;
+    ShaderCode vert_code;
+    ShaderCode frag_code;
+    VkPipelineCache pipeline_cache;
+    char pipeline_cache_warm;
+    PipelineManager *pipelines;
+    VkSurfaceFormatKHR swapchain_format;
+    VkPresentModeKHR present_mode;
+    VkFormat depth_format;
+    VkRenderPass render_pass;
+    VkRenderPass hdr_render_pass; // Only for --hdr, the main pipeline then renders with it
+    VkDescriptorSetLayout instance_set_layout;
+    BindlessTable *bindless;
+    VkPipelineLayout graphics_pipeline_layout;
+    GraphicsPipelineDesc pipeline_desc;
+    PipelineHandle base_pipeline;
+    PipelineHandle depth_pipeline; // Only requested for --depth-prepass
+    // Headless renders into one offscreen image per frame in flight instead of swapchain images
+    SwapchainInfo swapchain_info;
+    OffscreenTargets offscreen_targets;
+    DepthTarget depth_target;
+    VkFramebuffer *framebuffers;
+} StartupState;
+
+static void startup_volk(void *user_data) {
+    if(volkInitialize() != VK_SUCCESS) {
+        fprintf(stderr, "Failed to initialize volk.\n");
+        exit(1);
+    }
+}
+
+static void startup_window(void *user_data) {
+    StartupState *startup = user_data;
+    if(!startup->options->headless)
+        startup->window = SDL_CreateWindow("vlkTest", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+}
+
+static void startup_shaders(void *user_data) {
+    StartupState *startup = user_data;
+    startup->vert_code = shader_code_load(startup->options->instances ? "instanced.vert.spv" : "triangle.vert.spv");
+    startup->frag_code = shader_code_load("triangle.frag.spv");
+}
+
+static void startup_instance(void *user_data) {
+    StartupState *startup = user_data;
+    startup->instance = create_instance(startup->window);
+    volkLoadInstanceOnly(startup->instance);
+#ifdef _DEBUG
+    startup->debug_callback = register_debug_callback(startup->instance);
+#endif // _DEBUG
+}
+
+static void startup_physical_device(void *user_data) {
+    StartupState *startup = user_data;
+    startup->physical_device = pick_physical_device(startup->instance);
+    vkGetPhysicalDeviceProperties(startup->physical_device, &startup->device_properties);
+}
+
+static void startup_surface(void *user_data) {
+    StartupState *startup = user_data;
+    if(!startup->options->headless)
+        startup->surface = create_surface(startup->instance, startup->window);
+}
+
+static void startup_device(void *user_data) {
+    StartupState *startup = user_data;
+    startup->queue_indices = get_queue_indices(startup->physical_device, startup->surface);
+    startup->device = create_logical_device(startup->physical_device, startup->queue_indices, !startup->options->headless, &startup->device_features);
+    volkLoadDevice(startup->device);
+}
+
+static void startup_memory(void *user_data) {
+    StartupState *startup = user_data;
+    VkQueue transfer_queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(startup->device, startup->queue_indices.transfer_queue, 0, &transfer_queue);
+    startup->allocator = memory_allocator_create(startup->device, startup->physical_device);
+    startup->uploads = upload_queue_create(startup->device, startup->allocator, transfer_queue, startup->queue_indices.transfer_queue, startup->queue_indices.graphics_queue, UPLOAD_RING_SIZE);
+}
+
+static void startup_pipeline_cache(void *user_data) {
+    StartupState *startup = user_data;
+    startup->pipeline_cache = load_pipeline_cache(startup->device, &startup->device_properties, PIPELINE_CACHE_PATH, &startup->pipeline_cache_warm);
+    startup->pipelines = pipeline_manager_create(startup->device, startup->pipeline_cache, PIPELINE_COMPILE_THREADS);
+}
+
+// Only needs the surface format, so the pipeline does not wait for the swapchain
+static void startup_render_pass(void *user_data) {
+    StartupState *startup = user_data;
+    startup->depth_format = get_depth_format(startup->physical_device);
+    if(startup->options->headless) {
+        startup->render_pass = create_render_pass(startup->device, VK_FORMAT_B8G8R8A8_SRGB, startup->depth_format, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    } else {
+        startup->swapchain_format = get_swapchain_format(startup->physical_device, startup->surface);
+        startup->present_mode = get_present_mode(startup->physical_device, startup->surface);
+        startup->render_pass = create_render_pass(startup->device, startup->swapchain_format.format, startup->depth_format, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
+    // The post chain samples it next, the render graph does that transition. It is cleared
+    // since undefined pixels would end up in the average luminance.
+    if(startup->options->hdr)
+        startup->hdr_render_pass = create_render_pass(startup->device, POST_HDR_FORMAT, startup->depth_format, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+}
+
+static void startup_descriptors(void *user_data) {
+    StartupState *startup = user_data;
+    // The fragment shader always declares the texture array, so there is no fallback without it
+    if(!startup->device_features.descriptor_indexing) {
+        fprintf(stderr, "Descriptor indexing (update after bind, partially bound) is not supported.\n");
+        exit(1);
+    }
+    startup->instance_set_layout = create_instance_set_layout(startup->device);
+    startup->bindless = bindless_table_create(startup->device, startup->physical_device, startup->allocator, startup->uploads, BINDLESS_TEXTURE_CAPACITY);
+    startup->graphics_pipeline_layout = create_graphics_pipeline_layout(startup->device, startup->instance_set_layout, bindless_table_layout(startup->bindless));
+}
+
+// The pipeline compiles in the background while the rest of startup runs
+static void startup_pipeline(void *user_data) {
+    StartupState *startup = user_data;
+    GraphicsPipelineDesc *desc = &startup->pipeline_desc;
+    desc->vert_shader = pipeline_manager_add_shader(startup->pipelines, startup->options->instances ? "instanced.vert.spv" : "triangle.vert.spv", startup->vert_code);
+    desc->frag_shader = pipeline_manager_add_shader(startup->pipelines, "triangle.frag.spv", startup->frag_code);
+    desc->features = startup->options->shader_features;
+    desc->layout = startup->graphics_pipeline_layout;
+    desc->render_pass = startup->options->hdr ? startup->hdr_render_pass : startup->render_pass;
+    desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc->cull_mode = VK_CULL_MODE_BACK_BIT;
+    desc->front_face = VK_FRONT_FACE_CLOCKWISE;
+    desc->depth_test = VK_TRUE;
+    desc->depth_write = VK_TRUE;
+    desc->depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL; // Draws at equal depth keep their submission order
+    if(startup->options->depth_prepass) {
+        GraphicsPipelineDesc depth_desc = *desc;
+        depth_desc.frag_shader = NULL;
+        startup->depth_pipeline = pipeline_manager_request(startup->pipelines, &depth_desc);
+        desc->depth_write = VK_FALSE;
+        desc->depth_compare = VK_COMPARE_OP_EQUAL;
+    }
+    startup->base_pipeline = pipeline_manager_request(startup->pipelines, desc);
+}
+
+static void startup_swapchain(void *user_data) {
+    StartupState *startup = user_data;
+    const Options *options = startup->options;
+    if(options->headless) {
+        startup->offscreen_targets = create_offscreen_targets(startup->device, startup->allocator, VK_FORMAT_B8G8R8A8_SRGB, options->headless_extent, options->frames_in_flight);
+        startup->depth_target = create_depth_target(startup->device, startup->allocator, startup->depth_format, startup->offscreen_targets.extent);
+        startup->framebuffers = create_framebuffers(startup->device, startup->render_pass, startup->offscreen_targets.image_views, startup->offscreen_targets.image_count, startup->depth_target.view, startup->offscreen_targets.extent);
+    } else {
+        startup->swapchain_info = create_swapchain(startup->device, startup->physical_device, startup->surface, startup->swapchain_format, startup->present_mode, startup->queue_indices, VK_NULL_HANDLE);
+        startup->depth_target = create_depth_target(startup->device, startup->allocator, startup->depth_format, startup->swapchain_info.extent);
+        startup->framebuffers = create_framebuffers(startup->device, startup->render_pass, startup->swapchain_info.image_views, startup->swapchain_info.image_count, startup->depth_target.view, startup->swapchain_info.extent);
+    }
+}
+
+static void run_startup(StartupState *startup) {
+    StartupGraph *graph = startup_graph_create();
+    // SDL wants windows (and their surfaces) created on the main thread
+    uint32_t volk = startup_graph_add(graph, "volk", startup_volk, startup, 0);
+    uint32_t window = startup_graph_add(graph, "window", startup_window, startup, 1);
+    uint32_t shaders = startup_graph_add(graph, "shaders", startup_shaders, startup, 0);
+    uint32_t instance = startup_graph_add(graph, "instance", startup_instance, startup, 0);
+    startup_graph_depend(graph, instance, volk);
+    startup_graph_depend(graph, instance, window);
+    uint32_t physical_device = startup_graph_add(graph, "physical device", startup_physical_device, startup, 0);
+    startup_graph_depend(graph, physical_device, instance);
+    uint32_t surface = startup_graph_add(graph, "surface", startup_surface, startup, 1);
+    startup_graph_depend(graph, surface, instance);
+    uint32_t device = startup_graph_add(graph, "device", startup_device, startup, 0);
+    startup_graph_depend(graph, device, physical_device);
+    startup_graph_depend(graph, device, surface);
+    uint32_t memory = startup_graph_add(graph, "memory", startup_memory, startup, 0);
+    startup_graph_depend(graph, memory, device);
+    uint32_t pipeline_cache = startup_graph_add(graph, "pipeline cache", startup_pipeline_cache, startup, 0);
+    startup_graph_depend(graph, pipeline_cache, device);
+    uint32_t render_pass = startup_graph_add(graph, "render pass", startup_render_pass, startup, 0);
+    startup_graph_depend(graph, render_pass, device);
+    uint32_t descriptors = startup_graph_add(graph, "descriptors", startup_descriptors, startup, 0);
+    startup_graph_depend(graph, descriptors, memory);
+    uint32_t pipeline = startup_graph_add(graph, "pipeline", startup_pipeline, startup, 0);
+    startup_graph_depend(graph, pipeline, shaders);
+    startup_graph_depend(graph, pipeline, pipeline_cache);
+    startup_graph_depend(graph, pipeline, render_pass);
+    startup_graph_depend(graph, pipeline, descriptors);
+    uint32_t swapchain = startup_graph_add(graph, "swapchain", startup_swapchain, startup, 0);
+    startup_graph_depend(graph, swapchain, render_pass);
+    startup_graph_depend(graph, swapchain, memory);
+
+    ThreadPool *pool = thread_pool_create(STARTUP_THREADS);
+    startup_graph_run(graph, pool);
+    thread_pool_destroy(pool);
+    startup_graph_print_trace(graph);
+    startup_graph_destroy(graph);
+}
+
+// Stripes in a different color per texture, so draws show which handle they sampled
+static BindlessHandle *create_test_textures(BindlessTable *bindless, UploadQueue *uploads, uint32_t count) {
+    if(count > bindless_table_capacity(bindless)) {
+        fprintf(stderr, "--textures %u exceeds the bindless table capacity of %u.\n", count, bindless_table_capacity(bindless));
+        exit(1);
+    }
+    BindlessHandle *handles = malloc(sizeof(BindlessHandle) * count);
+    uint32_t *pixels = malloc(sizeof(uint32_t) * TEXTURE_SIZE * TEXTURE_SIZE);
+    for(uint32_t i = 0; i < count; ++i) {
+        uint32_t color = 0xff000000u | ((i * 0x9e3779b9u) & 0x00ffffffu);
+        for(uint32_t y = 0; y < TEXTURE_SIZE; ++y) {
+            for(uint32_t x = 0; x < TEXTURE_SIZE; ++x)
+                pixels[y * TEXTURE_SIZE + x] = ((x + y) / 8) % 2 ? color : 0xffffffffu;
+        }
+        handles[i] = bindless_create_texture(bindless, TEXTURE_SIZE, TEXTURE_SIZE, pixels);
+    }
+    upload_flush(uploads);
+    free(pixels);
+    return handles;
+}
+
+// Loads every file in the comma separated list, the textures are numbered in list order
+static uint32_t load_streamed_textures(TextureStreamer *streamer, const char *list) {
+    uint32_t count = 0;
+    char path[1024];
+    while(*list) {
+        size_t length = strcspn(list, ",");
+        if(length >= sizeof(path)) {
+            fprintf(stderr, "Texture path '%.*s' is too long.\n", (int)length, list);
+            exit(1);
+        }
+        memcpy(path, list, length);
+        path[length] = 0;
+        texture_streamer_load(streamer, path);
+        ++count;
+        list += length;
+        if(*list == ',')
+            ++list;
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+    double startup_begin = get_time_ms();
+    Options options = parse_options(argc, argv);
+    // Independent init steps overlap, e.g. the pipeline compiles while the swapchain is created
+    StartupState startup = { 0 };
+    startup.options = &options;
+    run_startup(&startup);
+    SDL_Window *window = startup.window;
+    VkInstance instance = startup.instance;
+#ifdef _DEBUG
+    VkDebugReportCallbackEXT clb = startup.debug_callback;
+#endif // _DEBUG
+    VkPhysicalDevice physical_device = startup.physical_device;
+    VkSurfaceKHR surface = startup.surface;
+    Queues queue_indices = startup.queue_indices;
+    DeviceFeatures device_features = startup.device_features;
+    VkDevice device = startup.device;
+    VkQueue graphics_queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(device, queue_indices.graphics_queue, 0, &graphics_queue);
+    VkQueue present_queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(device, queue_indices.present_queue, 0, &present_queue);
+    VkQueue compute_queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(device, queue_indices.compute_queue, 0, &compute_queue);
+    MemoryAllocator *allocator = startup.allocator;
+    UploadQueue *uploads = startup.uploads;
+    const uint32_t frames_in_flight = options.frames_in_flight;
+
+    SwapchainInfo swapchain_info = startup.swapchain_info;
+    OffscreenTargets offscreen_targets = startup.offscreen_targets;
+    VkFormat depth_format = startup.depth_format;
+    DepthTarget depth_target = startup.depth_target;
+    VkSurfaceFormatKHR swapchain_format = startup.swapchain_format;
+    VkPresentModeKHR present_mode = startup.present_mode;
+    VkRenderPass render_pass = startup.render_pass;
+    VkRenderPass hdr_render_pass = startup.hdr_render_pass;
+    VkFramebuffer *framebuffers = startup.framebuffers;
+    VkPhysicalDeviceProperties device_properties = startup.device_properties;
+    char pipeline_cache_warm = startup.pipeline_cache_warm;
+    VkPipelineCache pipeline_cache = startup.pipeline_cache;
+    PipelineManager *pipelines = startup.pipelines;
+    VkDescriptorSetLayout instance_set_layout = startup.instance_set_layout;
+    BindlessTable *bindless = startup.bindless;
+    VkPipelineLayout graphics_pipeline_layout = startup.graphics_pipeline_layout;
+    GraphicsPipelineDesc pipeline_desc = startup.pipeline_desc;
+    PipelineHandle base_pipeline = startup.base_pipeline;
+    PipelineHandle depth_pipeline = startup.depth_pipeline;
+    // Recorded every frame, so one set of pools per frame in flight rather than a command buffer per swapchain image
+    FrameCommands frame_commands[FRAME_SCHEDULER_MAX_FRAMES];
+    // The binary semaphores are only for acquire and present, frame completion is on the scheduler's timeline.
+    // The ones present waits on belong to the swapchain.
+    VkSemaphore image_avaliable_semaphore[FRAME_SCHEDULER_MAX_FRAMES];
+    for(uint32_t i = 0; i < frames_in_flight; ++i) {
+        frame_commands[i] = create_frame_commands(device, allocator, &device_features, queue_indices.graphics_queue, options.record_threads);
+        image_avaliable_semaphore[i] = create_semaphore(device);
+    }
+    ThreadPool *record_thread_pool = options.record_threads > 1 ? thread_pool_create(options.record_threads) : NULL;
+    FrameScheduler *scheduler = frame_scheduler_create(device, frames_in_flight, options.low_latency, device_features.present_wait);
+    if(!options.headless && !device_features.present_wait)
+        printf("No VK_KHR_present_wait, frame latency is measured up to GPU completion only\n");
+    if(!options.headless)
+        frame_scheduler_reset_images(scheduler, swapchain_info.image_count);
+    DeletionQueue deletion_queue = { 0 };
+    char swapchain_dirty = 0;
+
+    // GPU frame times come from a timestamp pair per frame in flight
+    uint32_t timestamp_valid_bits = get_timestamp_valid_bits(physical_device, queue_indices.graphics_queue);
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if(options.headless && timestamp_valid_bits)
+        query_pool = create_timestamp_query_pool(device, frames_in_flight * 2);
+
+    double *cpu_frame_times = NULL;
+    double *gpu_frame_times = NULL;
+    char *recreated_frames = NULL;
+    uint32_t gpu_frame_count = 0;
+    if(options.frames) {
+        cpu_frame_times = malloc(sizeof(double) * options.frames);
+        gpu_frame_times = malloc(sizeof(double) * options.frames);
+        recreated_frames = calloc(options.frames, 1);
+    }
+    const uint64_t timestamp_mask = timestamp_valid_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << timestamp_valid_bits) - 1;
+
+    InstanceData instances = { 0 };
+    InstanceBuffers instance_buffers = { 0 };
+    double instance_update_time = 0.0;
+    if(options.instances) {
+        if((VkDeviceSize)options.instances * sizeof(float) * 4 > device_properties.limits.maxStorageBufferRange) {
+            fprintf(stderr, "%u instances exceed maxStorageBufferRange (%u bytes).\n", options.instances, device_properties.limits.maxStorageBufferRange);
+            exit(1);
+        }
+        instances = instance_data_create(options.instances, 1);
+        instance_buffers = create_instance_buffers(device, allocator, uploads, instance_set_layout, &instances, frames_in_flight);
+    }
+    JobSystem *jobs = options.jobs > 1 ? job_system_create(options.jobs) : NULL;
+    GpuCulling culling = { 0 };
+    char cull_slot_pending[FRAME_SCHEDULER_MAX_FRAMES] = { 0 };
+    uint64_t cull_visible = 0, cull_frustum_culled = 0, cull_size_culled = 0;
+    uint32_t cull_samples = 0;
+    if(options.gpu_cull)
+        culling = create_gpu_culling(device, allocator, uploads, pipeline_cache, &instance_buffers, options.instances, &device_features);
+    BindlessHandle *textures = NULL;
+    uint32_t texture_count = options.textures;
+    if(options.textures)
+        textures = create_test_textures(bindless, uploads, options.textures);
+    TextureStreamer *streamer = NULL;
+    if(options.stream_textures) {
+        streamer = texture_streamer_create(device, physical_device, allocator, uploads, bindless, device_features.memory_budget, (VkDeviceSize)options.texture_budget_mb * 1024 * 1024);
+        texture_count = load_streamed_textures(streamer, options.stream_textures);
+        textures = malloc(sizeof(BindlessHandle) * texture_count);
+        for(uint32_t i = 0; i < texture_count; ++i)
+            textures[i] = texture_streamer_handle(streamer, i);
+    }
+
+    PostChain *post = NULL;
+    if(options.hdr) {
+        if(!options.headless) {
+            VkSurfaceCapabilitiesKHR capabilities;
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities);
+            if(!(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+                fprintf(stderr, "--hdr blits into the swapchain images, which the surface does not support.\n");
+                exit(1);
+            }
+        }
+        post = post_chain_create(device, physical_device, allocator, pipeline_cache, frames_in_flight, timestamp_valid_bits, options.post_scalar);
+    }
+
+    FrameRecording recording = { 0 };
+    recording.render_pass = post ? hdr_render_pass : render_pass;
+    recording.post = post;
+    recording.final_layout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    recording.depth_image = depth_target.image;
+    // Every frame draws, so this one pipeline is worth blocking for
+    double pipeline_wait_begin = get_time_ms();
+    VkPipeline graphics_pipeline = pipeline_manager_wait(pipelines, base_pipeline);
+    double pipeline_wait = get_time_ms() - pipeline_wait_begin;
+    if(!graphics_pipeline)
+        exit(1);
+    recording.pipeline = graphics_pipeline;
+    if(options.depth_prepass) {
+        recording.depth_pipeline = pipeline_manager_wait(pipelines, depth_pipeline);
+        if(!recording.depth_pipeline)
+            exit(1);
+    }
+    recording.pipeline_layout = graphics_pipeline_layout;
+    recording.draw_count = options.draw_count;
+    recording.instance_count = options.instances ? options.instances : 1;
+    if(options.instances)
+        recording.descriptor_set = instance_buffers.descriptor_sets[0];
+    recording.view.zoom = options.view_zoom;
+    recording.culling = options.gpu_cull ? &culling : NULL;
+    recording.cull_min_radius = options.cull_min_radius;
+    recording.texture_set = bindless_table_set(bindless);
+    recording.textures = textures;
+    recording.texture_count = texture_count;
+    // Every draw binds the next one, they are all compiled up front so none draws with a fallback
+    VkPipeline switch_pipelines[MAX_PIPELINE_SWITCHES];
+    for(uint32_t i = 0; i < options.pipeline_switches; ++i) {
+        GraphicsPipelineDesc variant_desc = pipeline_variant_desc(&pipeline_desc, i);
+        switch_pipelines[i] = pipeline_manager_wait(pipelines, pipeline_manager_request(pipelines, &variant_desc));
+        if(!switch_pipelines[i])
+            exit(1);
+    }
+    recording.switch_pipelines = switch_pipelines;
+    recording.switch_pipeline_count = options.pipeline_switches;
+    double record_time = 0.0;
+
+    // Firsts other than 0 in indirect draws need drawIndirectFirstInstance
+    RenderQueue *render_queue = NULL;
+    VkBuffer draw_buffers[FRAME_SCHEDULER_MAX_FRAMES] = { 0 };
+    MemoryAllocation draw_allocations[FRAME_SCHEDULER_MAX_FRAMES] = { 0 };
+    double queue_time = 0.0;
+    if(options.render_queue) {
+        char multi_draw = device_features.multi_draw_indirect && device_features.draw_indirect_first_instance;
+        render_queue = render_queue_create(multi_draw ? device_properties.limits.maxDrawIndirectCount : 0);
+        for(uint32_t i = 0; multi_draw && i < frames_in_flight; ++i)
+            draw_buffers[i] = memory_create_buffer(allocator, sizeof(VkDrawIndirectCommand) * options.draw_count, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MEMORY_USAGE_CPU_TO_GPU, &draw_allocations[i]);
+    }
+
+    if(options.record_scaling) {
+        recording.framebuffer = framebuffers[0];
+        recording.color_image = options.headless ? offscreen_targets.images[0] : swapchain_info.images[0];
+        recording.extent = options.headless ? offscreen_targets.extent : swapchain_info.extent;
+        run_record_scaling_benchmark(device, allocator, &device_features, queue_indices.graphics_queue, &recording);
+    }
+    if(options.async_compute_bench) {
+        recording.framebuffer = framebuffers[0];
+        recording.extent = offscreen_targets.extent;
+        run_async_compute_benchmark(device, graphics_queue, compute_queue, queue_indices, allocator, uploads, pipeline_cache, pipelines, &recording, options.particles);
+    }
+    if(options.mesh_bench) {
+        recording.framebuffer = framebuffers[0];
+        recording.extent = offscreen_targets.extent;
+        run_mesh_benchmark(device, graphics_queue, queue_indices.graphics_queue, allocator, uploads, pipelines, &recording, &device_properties,
+            device_features.pipeline_statistics_query, options.mesh_bench);
+    }
+    if(options.overdraw_bench) {
+        recording.framebuffer = framebuffers[0];
+        recording.extent = offscreen_targets.extent;
+        double case_ms[3];
+        run_overdraw_benchmark(device, graphics_queue, queue_indices.graphics_queue, pipelines, &recording, &device_properties, device_features.pipeline_statistics_query, options.overdraw_bench, case_ms);
+        write_result(&options, "back_to_front_gpu_ms", case_ms[0], "lower");
+        write_result(&options, "front_to_back_gpu_ms", case_ms[1], "lower");
+        write_result(&options, "prepass_gpu_ms", case_ms[2], "lower");
+    }
+    recording.uploads = uploads;
+
+    Profiler *profiler = NULL;
+    if(options.profile_path) {
+        if(options.pipeline_stats && !device_features.pipeline_statistics_query)
+            fprintf(stderr, "pipelineStatisticsQuery is not supported, tracing timestamps only.\n");
+        profiler = profiler_create(device, physical_device, graphics_queue, queue_indices.graphics_queue, frames_in_flight, options.pipeline_stats && device_features.pipeline_statistics_query);
+    }
+    recording.profiler = profiler;
+
+    // --upload streams into a device local buffer that stands in for mesh data
+    VkBuffer stream_buffer = VK_NULL_HANDLE;
+    MemoryAllocation stream_allocation = { 0 };
+    char *stream_data = NULL;
+    uint64_t stream_bytes_left = (uint64_t)options.upload_mb * 1024 * 1024;
+    VkDeviceSize stream_offset = 0;
+    uint64_t stream_last_value = 0;
+    double stream_start = 0.0, stream_end = 0.0, stream_cpu_time = 0.0;
+    if(stream_bytes_left) {
+        stream_buffer = memory_create_buffer(allocator, UPLOAD_STREAM_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MEMORY_USAGE_GPU_ONLY, &stream_allocation);
+        stream_data = malloc(UPLOAD_STREAM_CHUNK);
+        for(uint32_t i = 0; i < UPLOAD_STREAM_CHUNK; ++i)
+            stream_data[i] = (char)(i * 31);
+    }
+
+    uint32_t frame_number = 0;
+    uint32_t pipeline_fallback_frames = 0;
+    double start_time = get_time_ms();
+    printf("Startup: %.2f ms, pipeline creation %.2f ms with %s pipeline cache, %.2f ms of it blocking startup\n", start_time - startup_begin,
+        pipeline_manager_compile_ms(pipelines, base_pipeline), pipeline_cache_warm ? "warm" : "cold", pipeline_wait);
+    shader_code_print_stats();
+    double steady_start = 0.0;
+    while(options.headless ? frame_number < options.frames : window_run(window, &swapchain_dirty)) {
+        double frame_start = get_time_ms();
+        if(frame_number == STEADY_STATE_WARMUP_FRAMES)
+            steady_start = frame_start;
+        uint32_t wait_scope = profiler_cpu_begin(profiler, "wait");
+        uint32_t current_frame = frame_scheduler_begin(scheduler);
+        profiler_cpu_end(profiler, wait_scope);
+        profiler_begin_frame(profiler, current_frame);
+        deletion_queue_flush(&deletion_queue, device, frame_scheduler_completed(scheduler));
+
+        if(options.resize_storm && frame_number % RESIZE_STORM_INTERVAL == RESIZE_STORM_INTERVAL - 1 && frame_number / RESIZE_STORM_INTERVAL < options.resize_storm) {
+            uint32_t step = frame_number / RESIZE_STORM_INTERVAL;
+            SDL_SetWindowSize(window, 640 + (step * 97) % 640, 360 + (step * 53) % 360);
+        }
+
+        VkFramebuffer framebuffer;
+        VkExtent2D extent;
+        uint32_t image_index = current_frame;
+        char recreated = 0;
+        if(options.headless) {
+            // The scheduler waited for the frame that last used this slot, so its timestamps are available
+            if(query_pool && frame_number >= frames_in_flight) {
+                uint64_t timestamps[2];
+                vkGetQueryPoolResults(device, query_pool, current_frame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+                gpu_frame_times[gpu_frame_count++] = (double)((timestamps[1] - timestamps[0]) & timestamp_mask) * device_properties.limits.timestampPeriod * 1e-6;
+            }
+            framebuffer = framebuffers[current_frame];
+            extent = offscreen_targets.extent;
+        } else {
+            if(swapchain_dirty) {
+                if(!recreate_swapchain(device, physical_device, surface, swapchain_format, present_mode, queue_indices, render_pass, allocator, depth_format, &swapchain_info, &depth_target, &framebuffers, &deletion_queue, frame_number)) {
+                    SDL_Delay(10); // Minimized, nothing to render into
+                    continue;
+                }
+                swapchain_dirty = 0;
+                recreated = 1;
+                frame_scheduler_reset_images(scheduler, swapchain_info.image_count);
+            }
+
+            uint32_t acquire_scope = profiler_cpu_begin(profiler, "acquire");
+            VkResult result = vkAcquireNextImageKHR(device, swapchain_info.swapchain, UINT64_MAX, image_avaliable_semaphore[current_frame], VK_NULL_HANDLE, &image_index);
+            profiler_cpu_end(profiler, acquire_scope);
+            if(result == VK_ERROR_OUT_OF_DATE_KHR) {
+                // Nothing was submitted, so the same frame starts over with a new swapchain
+                swapchain_dirty = 1;
+                continue;
+            }
+            if(result == VK_SUBOPTIMAL_KHR) {
+                swapchain_dirty = 1;
+            } else if(result != VK_SUCCESS) {
+                fprintf(stderr, "Failed to acquire Vulkan swapchain image.\n");
+                exit(1);
+            }
+            // With more images than frames in flight an earlier frame may still be drawing to it
+            frame_scheduler_wait_image(scheduler, image_index);
+            framebuffer = framebuffers[image_index];
+            extent = swapchain_info.extent;
+        }
+
+        // Counters of the frame that last used this slot, which the scheduler waited for
+        if(cull_slot_pending[current_frame]) {
+            CullCounters counters = read_culling_counters(allocator, &culling, current_frame);
+            cull_visible += counters.draw_count;
+            cull_frustum_culled += counters.frustum_culled;
+            cull_size_culled += counters.size_culled;
+            ++cull_samples;
+        }
+        if(post)
+            post_chain_collect(post, current_frame);
+
+        // The scheduler wait above means the GPU is done with this slot's transforms
+        if(options.instances) {
+            double update_start = get_time_ms();
+            if(jobs) {
+                InstanceUpdate update = { &instances, 1.0f / 60.0f, instance_buffers.transform_allocations[current_frame].mapped };
+                job_parallel_for(jobs, instances.count, INSTANCE_UPDATE_BATCH, update_instances_range, &update);
+            } else {
+                instance_data_update(&instances, 1.0f / 60.0f);
+                instance_data_write_transforms(&instances, instance_buffers.transform_allocations[current_frame].mapped);
+            }
+            instance_update_time += get_time_ms() - update_start;
+            recording.descriptor_set = instance_buffers.descriptor_sets[current_frame];
+        }
+
+        // The draws move through the streamed textures over time, so the ones left behind
+        // become the least recently used. Each draw's triangle covers an eighth of the screen.
+        if(streamer) {
+            uint32_t first = frame_number / TEXTURE_ROTATE_INTERVAL;
+            float coverage = (float)extent.width * (float)extent.height / 8.0f;
+            for(uint32_t i = 0; i < texture_count && i < options.draw_count; ++i)
+                texture_streamer_request(streamer, (first + i) % texture_count, coverage);
+            texture_streamer_update(streamer, frame_number, frame_scheduler_completed(scheduler));
+            for(uint32_t i = 0; i < texture_count; ++i)
+                textures[i] = texture_streamer_handle(streamer, (first + i) % texture_count);
+        }
+
+        recording.framebuffer = post ? VK_NULL_HANDLE : framebuffer; // The HDR one comes from the frame's graph
+        recording.depth_view = depth_target.view;
+        recording.color_image = options.headless ? offscreen_targets.images[current_frame] : swapchain_info.images[image_index];
+        recording.depth_image = depth_target.image; // Recreated with the swapchain
+        recording.extent = extent;
+        recording.query_pool = query_pool;
+        recording.query_index = current_frame * 2;
+
+        // One chunk per frame, the copy itself runs on the transfer queue next to rendering
+        if(stream_bytes_left) {
+            double upload_start = get_time_ms();
+            if(!stream_start)
+                stream_start = upload_start;
+            uint32_t chunk = stream_bytes_left < UPLOAD_STREAM_CHUNK ? (uint32_t)stream_bytes_left : UPLOAD_STREAM_CHUNK;
+            upload_buffer(uploads, stream_buffer, stream_offset, stream_data, chunk, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+            stream_last_value = upload_flush(uploads);
+            stream_offset = (stream_offset + chunk) % UPLOAD_STREAM_BUFFER_SIZE;
+            stream_bytes_left -= chunk;
+            stream_cpu_time += get_time_ms() - upload_start;
+        } else if(stream_last_value && !stream_end && upload_is_complete(uploads, stream_last_value)) {
+            stream_end = get_time_ms();
+        }
+
+        // Switch to a new variant every few frames. Ones that are still compiling fall back to
+        // the base pipeline, and earlier variants come back around as cache hits.
+        if(options.pipeline_variants) {
+            uint32_t variant = (frame_number / PIPELINE_VARIANT_INTERVAL) % options.pipeline_variants;
+            GraphicsPipelineDesc variant_desc = pipeline_variant_desc(&pipeline_desc, variant);
+            VkPipeline pipeline = pipeline_manager_get(pipelines, pipeline_manager_request(pipelines, &variant_desc));
+            recording.pipeline = pipeline ? pipeline : graphics_pipeline;
+            pipeline_fallback_frames += !pipeline;
+        }
+
+        // Built again every frame like a real scene's would be. The slot's previous frame is done with its draws.
+        if(render_queue) {
+            double queue_start = get_time_ms();
+            push_render_queue(render_queue, &recording, options.instances);
+            if(draw_buffers[current_frame]) {
+                uint32_t queue_draw_count;
+                const VkDrawIndirectCommand *queue_draws = render_queue_draws(render_queue, &queue_draw_count);
+                memcpy(draw_allocations[current_frame].mapped, queue_draws, sizeof(VkDrawIndirectCommand) * queue_draw_count);
+            }
+            recording.render_queue = render_queue;
+            recording.draw_buffer = draw_buffers[current_frame];
+            queue_time += get_time_ms() - queue_start;
+        }
+
+        recording.frame_slot = current_frame;
+        double record_start = get_time_ms();
+        uint32_t record_scope = profiler_cpu_begin(profiler, "record");
+        UploadWait upload_wait = record_frame(device, &frame_commands[current_frame], &recording, record_thread_pool);
+        profiler_cpu_end(profiler, record_scope);
+        record_time += get_time_ms() - record_start;
+        cull_slot_pending[current_frame] = options.gpu_cull;
+
+        VkSubmitInfo submit_info = { 0 };
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        
+        VkSemaphore wait_semaphore[2];
+        VkPipelineStageFlags wait_stages[2];
+        uint64_t wait_values[2] = { 0 }; // Ignored for the binary acquire semaphore
+        uint32_t wait_count = 0;
+        // The frame's timeline value, plus the binary semaphore present waits on
+        VkSemaphore singal_semaphores[] = { frame_scheduler_timeline(scheduler), options.headless ? VK_NULL_HANDLE : swapchain_info.render_finished[image_index] };
+        uint64_t signal_values[] = { frame_scheduler_signal_value(scheduler), 0 };
+        submit_info.signalSemaphoreCount = options.headless ? 1 : 2;
+        submit_info.pSignalSemaphores = singal_semaphores;
+
+        if(!options.headless) {
+            wait_semaphore[wait_count] = image_avaliable_semaphore[current_frame];
+            wait_stages[wait_count++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        if(upload_wait.value) {
+            wait_semaphore[wait_count] = upload_wait.semaphore;
+            wait_values[wait_count] = upload_wait.value;
+            wait_stages[wait_count++] = upload_wait.stages;
+        }
+        VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = wait_count;
+        timeline_info.pWaitSemaphoreValues = wait_values;
+        timeline_info.signalSemaphoreValueCount = submit_info.signalSemaphoreCount;
+        timeline_info.pSignalSemaphoreValues = signal_values;
+        submit_info.pNext = &timeline_info;
+        submit_info.waitSemaphoreCount = wait_count;
+        submit_info.pWaitSemaphores = wait_semaphore;
+        submit_info.pWaitDstStageMask = wait_stages;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &frame_commands[current_frame].command_buffer;
+
+        uint32_t submit_scope = profiler_cpu_begin(profiler, "submit");
+        if(vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) { 
+            fprintf(stderr, "Failed to submit Vulkan queue.\n");
+            exit(1);
+        }
+        profiler_cpu_end(profiler, submit_scope);
+        frame_scheduler_submitted(scheduler, options.headless ? UINT32_MAX : image_index);
+
+        if(!options.headless) {
+            VkPresentInfoKHR present_info = { 0 };
+            present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            present_info.waitSemaphoreCount = 1;
+            present_info.pWaitSemaphores = &swapchain_info.render_finished[image_index];
+            present_info.swapchainCount = 1;
+            present_info.pSwapchains = &swapchain_info.swapchain;
+            present_info.pImageIndices = &image_index;
+            present_info.pResults = NULL;
+            // Tagged with the frame's timeline value, the scheduler waits for it to be displayed
+            uint64_t present_id = frame_scheduler_present_id(scheduler);
+            VkPresentIdKHR present_id_info = { 0 };
+            present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+            present_id_info.swapchainCount = 1;
+            present_id_info.pPresentIds = &present_id;
+            if(device_features.present_wait)
+                present_info.pNext = &present_id_info;
+            
+            uint32_t present_scope = profiler_cpu_begin(profiler, "present");
+            VkResult result = vkQueuePresentKHR(present_queue, &present_info);
+            profiler_cpu_end(profiler, present_scope);
+            if(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+                frame_scheduler_presented(scheduler, swapchain_info.swapchain);
+            if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                swapchain_dirty = 1;
+            } else if(result != VK_SUCCESS) {
+                fprintf(stderr, "Failed to present Vulkan swapchain image.\n");
+                exit(1);
+            }
+        }
+
+        if(cpu_frame_times) {
+            cpu_frame_times[frame_number] = get_time_ms() - frame_start;
+            recreated_frames[frame_number] = recreated;
+        }
+        if(frame_number == 0)
+            printf("First frame submitted %.2f ms after launch\n", get_time_ms() - startup_begin);
+        ++frame_number;
+        if(options.frames && frame_number >= options.frames)
+            break;
+    }
+    vkDeviceWaitIdle(device);
+    save_pipeline_cache(device, pipeline_cache, &device_properties, PIPELINE_CACHE_PATH);
+    if(profiler)
+        profiler_write_trace(profiler, options.profile_path);
+
+    if(options.headless) {
+        double total_time = get_time_ms() - start_time;
+        // Collect the frames still in flight when the loop ended
+        for(uint32_t i = 0; query_pool && i < frames_in_flight && i < frame_number; ++i) {
+            uint32_t slot = (frame_number - 1 - i) % frames_in_flight;
+            uint64_t timestamps[2];
+            vkGetQueryPoolResults(device, query_pool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            gpu_frame_times[gpu_frame_count++] = (double)((timestamps[1] - timestamps[0]) & timestamp_mask) * device_properties.limits.timestampPeriod * 1e-6;
+        }
+
+        printf("Headless %ux%u: %u frames in %.1f ms, %.1f frames/sec\n", offscreen_targets.extent.width, offscreen_targets.extent.height, frame_number, total_time, frame_number * 1000.0 / total_time);
+        printf("CPU frame time: p50 %.3f ms, p99 %.3f ms\n", percentile(cpu_frame_times, frame_number, 0.50), percentile(cpu_frame_times, frame_number, 0.99));
+        if(query_pool)
+            printf("GPU frame time: p50 %.3f ms, p99 %.3f ms\n", percentile(gpu_frame_times, gpu_frame_count, 0.50), percentile(gpu_frame_times, gpu_frame_count, 0.99));
+        else
+            printf("GPU frame time: timestamps not supported on this queue\n");
+        memory_allocator_print_stats(allocator);
+        if(frame_number)
+            render_graph_print_stats(frame_commands[0].graph);
+
+        // The benchmarks that run before the loop leave it a single frame, which says nothing
+        if(options.frames > 1) {
+            write_result(&options, "frames_per_sec", frame_number * 1000.0 / total_time, "higher");
+            write_result(&options, "cpu_p50_ms", percentile(cpu_frame_times, frame_number, 0.50), "lower");
+            write_result(&options, "cpu_p99_ms", percentile(cpu_frame_times, frame_number, 0.99), "lower");
+            if(query_pool) {
+                write_result(&options, "gpu_p50_ms", percentile(gpu_frame_times, gpu_frame_count, 0.50), "lower");
+                write_result(&options, "gpu_p99_ms", percentile(gpu_frame_times, gpu_frame_count, 0.99), "lower");
+            }
+            FrameSchedulerStats pacing = frame_scheduler_stats(scheduler);
+            write_result(&options, "gpu_done_latency_p50_ms", pacing.latency_p50_ms, "lower");
+            write_result(&options, "gpu_done_latency_p99_ms", pacing.latency_p99_ms, "lower");
+        }
+    }
+    if(frame_number)
+        frame_scheduler_print_stats(scheduler);
+    if(streamer)
+        texture_streamer_print_stats(streamer);
+    if(post) {
+        for(uint32_t i = 0; i < frames_in_flight; ++i)
+            post_chain_collect(post, i);
+        post_chain_print_stats(post);
+    }
+    if(options.pipeline_variants) {
+        pipeline_manager_print_stats(pipelines);
+        printf("Pipeline variants: %u frames drew with the fallback while a variant compiled\n", pipeline_fallback_frames);
+    }
+    if(options.resize_storm)
+        print_resize_storm_stats(cpu_frame_times, recreated_frames, frame_number);
+    if(options.instances && frame_number > STEADY_STATE_WARMUP_FRAMES) {
+        double steady_time = get_time_ms() - steady_start;
+        uint32_t steady_frames = frame_number - STEADY_STATE_WARMUP_FRAMES;
+        printf("Instances: %u %s, %.2f million instances/sec at steady state, SoA update %.3f ms per frame\n", options.instances, options.render_queue ? "split over the draws" : "per draw",
+            (double)options.instances * (options.render_queue ? 1 : options.draw_count) * steady_frames / steady_time / 1000.0, instance_update_time / frame_number);
+    }
+    if(options.instances && frame_number)
+        printf("CPU record time: %.3f ms per frame\n", record_time / frame_number);
+    if(jobs) {
+        // Over the whole run, so it includes the frames' waits as idle time
+        JobWorkerStats job_stats[JOB_MAX_WORKERS];
+        job_system_get_stats(jobs, job_stats);
+        for(uint32_t i = 0; i < options.jobs; ++i)
+            printf("Job worker %u: %.1f%% busy, %llu jobs, %llu stolen\n", i, job_stats[i].utilization * 100.0, (unsigned long long)job_stats[i].jobs_run, (unsigned long long)job_stats[i].jobs_stolen);
+    }
+    if(render_queue && frame_number) {
+        render_queue_print_stats(render_queue);
+        printf("Render queue: %.3f ms per frame to push, sort and merge\n", queue_time / frame_number);
+        RenderQueueStats queue_stats = render_queue_stats(render_queue);
+        write_result(&options, "queue_ms", queue_time / frame_number, "lower");
+        write_result(&options, "draw_calls", queue_stats.draw_calls, "lower");
+    }
+    if(cull_samples) {
+        printf("GPU culling with %s: %u objects, per frame %.0f visible, %.0f frustum culled, %.0f size culled\n",
+            culling.compact ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect", options.instances,
+            (double)cull_visible / cull_samples, (double)cull_frustum_culled / cull_samples, (double)cull_size_culled / cull_samples);
+    }
+    if(options.upload_mb) {
+        if(!stream_end)
+            stream_end = get_time_ms(); // Still in flight when the loop ended, only done after the idle wait
+        double streamed_mb = options.upload_mb - stream_bytes_left / (1024.0 * 1024.0);
+        double stream_mb_per_sec = stream_end > stream_start ? streamed_mb * 1000.0 / (stream_end - stream_start) : 0.0;
+        printf("Streamed %.1f MB in %.1f ms, %.1f MB/s, %.3f ms CPU per frame spent queueing uploads\n", streamed_mb, stream_end - stream_start,
+            stream_mb_per_sec, frame_number ? stream_cpu_time / frame_number : 0.0);
+        write_result(&options, "upload_mb_per_sec", stream_mb_per_sec, "higher");
+        upload_print_stats(uploads);
+    }
+    free(cpu_frame_times);
+    free(gpu_frame_times);
+    free(recreated_frames);
+
+    if(options.gpu_cull)
+        destroy_gpu_culling(device, allocator, &culling);
+    if(render_queue) {
+        for(uint32_t i = 0; i < frames_in_flight; ++i) {
+            vkDestroyBuffer(device, draw_buffers[i], NULL);
+            if(draw_buffers[i])
+                memory_free(allocator, &draw_allocations[i]);
+        }
+        render_queue_destroy(render_queue);
+    }
+    if(post)
+        post_chain_destroy(post);
+    if(jobs)
+        job_system_destroy(jobs);
+    if(options.instances) {
+        destroy_instance_buffers(device, allocator, &instance_buffers);
+        instance_data_destroy(&instances);
+    }
+    if(stream_buffer) {
+        vkDestroyBuffer(device, stream_buffer, NULL);
+        memory_free(allocator, &stream_allocation);
+    }
+    free(stream_data);
+    upload_queue_destroy(uploads);
+    profiler_destroy(profiler);
+    if(query_pool)
+        vkDestroyQueryPool(device, query_pool, NULL);
+    frame_scheduler_destroy(scheduler);
+    for  (uint32_t i = 0; i < frames_in_flight; ++i)
+        vkDestroySemaphore(device, image_avaliable_semaphore[i], NULL);
+    if(record_thread_pool)
+        thread_pool_destroy(record_thread_pool);
+    for(uint32_t i = 0; i < frames_in_flight; ++i)
+        destroy_frame_commands(device, &frame_commands[i]);
+    deletion_queue_destroy(&deletion_queue, device);
+    pipeline_manager_destroy(pipelines);
+    vkDestroyPipelineLayout(device, graphics_pipeline_layout, NULL);
+    vkDestroyDescriptorSetLayout(device, instance_set_layout, NULL);
+    if(streamer)
+        texture_streamer_destroy(streamer);
+    bindless_table_destroy(bindless);
+    free(textures);
+    vkDestroyPipelineCache(device, pipeline_cache, NULL);
+    if(options.headless) {
+        for (uint32_t i = 0; i < offscreen_targets.image_count; ++i)
+            vkDestroyFramebuffer(device, framebuffers[i], NULL);
+        free(framebuffers);
+        destroy_offscreen_targets(device, allocator, &offscreen_targets);
+    } else {
+        destroy_swapchain_resources(device, &swapchain_info, framebuffers);
+    }
+    destroy_depth_target(device, allocator, &depth_target);
+    vkDestroyRenderPass(device, render_pass, NULL);
+    if(hdr_render_pass)
+        vkDestroyRenderPass(device, hdr_render_pass, NULL);
+    memory_allocator_destroy(allocator);
 #ifdef _DEBUG
     vkDestroyDebugReportCallbackEXT(instance, clb, NULL);
 #endif // _DEBUG
     vkDestroyDevice(device, NULL);
-    vkDestroySurfaceKHR(instance, surface, VK_NULL_HANDLE);
-    SDL_DestroyWindow(window);
+    if(surface)
+        vkDestroySurfaceKHR(instance, surface, VK_NULL_HANDLE);
+    if(window)
+        SDL_DestroyWindow(window);
     vkDestroyInstance(instance, NULL);
     
     return 0;
@@ -0,0 +1,272 @@
+// Microbenchmark of the vlk_math kernels, doesn't need Vulkan or SDL.
+//
+//   mathbench [COUNT]
+//
+// Runs every operation in both layouts with each ISA this CPU supports and prints
+// transforms/sec. Every result is compared with the scalar kernels, and it exits with 1
+// when one is off by more than rounding.
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vlk_math.h"
+
+#define DEFAULT_COUNT 65536
+#define MIN_SECONDS 0.2
+#define MIN_RUNS 5
+// Relative, the SIMD kernels round the same as the scalar ones unless FMAs get involved
+#define TOLERANCE 1e-5f
+
+typedef enum BenchOp {
+    BENCH_MAT4_MUL_AOS,
+    BENCH_MAT4_MUL_SOA,
+    BENCH_MAT4_MUL_VEC4_AOS,
+    BENCH_MAT4_MUL_VEC4_SOA,
+    BENCH_QUAT_TO_MAT4_AOS,
+    BENCH_QUAT_TO_MAT4_SOA,
+    BENCH_AABB_TRANSFORM_AOS,
+    BENCH_AABB_TRANSFORM_SOA,
+    BENCH_OP_COUNT
+} BenchOp;
+
+static const char *op_names[BENCH_OP_COUNT] = {
+    "mat4 * mat4", "mat4 * mat4", "mat4 * vec4", "mat4 * vec4", "quat -> mat4", "quat -> mat4", "aabb transform", "aabb transform",
+};
+// Floats written per element
+static const uint32_t op_floats[BENCH_OP_COUNT] = { 16, 16, 4, 4, 16, 16, 6, 6 };
+
+typedef struct Inputs {
+    uint32_t count;
+    Mat4 *a;
+    Mat4 *b;
+    Vec4 *v;
+    Quat *q;
+    Aabb *boxes;
+    Mat4Soa a_soa;
+    Mat4Soa b_soa;
+    Vec4Soa v_soa;
+    QuatSoa q_soa;
+    AabbSoa boxes_soa;
+    Mat4 transform;
+} Inputs;
+
+static void *alloc_or_die(size_t size) {
+    void *p = malloc(size);
+    if(!p) {
+        fprintf(stderr, "Failed to allocate benchmark data.\n");
+        exit(1);
+    }
+    return p;
+}
+
+static float random_float(uint32_t *state, float min, float max) {
+    *state = *state * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(*state >> 8) / (float)(1u << 24);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// SoA views of the same elements, the streams are one block so they can be freed at once
+static void make_soa(float **streams, uint32_t stream_count, const float *aos, uint32_t count) {
+    float *block = alloc_or_die(sizeof(float) * stream_count * count);
+    for(uint32_t k = 0; k < stream_count; ++k) {
+        streams[k] = block + k * count;
+        for(uint32_t i = 0; i < count; ++i)
+            streams[k][i] = aos[i * stream_count + k];
+    }
+}
+
+static Inputs inputs_create(uint32_t count) {
+    Inputs in = { 0 };
+    in.count = count;
+    in.a = alloc_or_die(sizeof(Mat4) * count);
+    in.b = alloc_or_die(sizeof(Mat4) * count);
+    in.v = alloc_or_die(sizeof(Vec4) * count);
+    in.q = alloc_or_die(sizeof(Quat) * count);
+    in.boxes = alloc_or_die(sizeof(Aabb) * count);
+
+    uint32_t state = 1;
+    for(uint32_t i = 0; i < count; ++i) {
+        for(int k = 0; k < 16; ++k) {
+            in.a[i].m[k] = random_float(&state, -2.0f, 2.0f);
+            in.b[i].m[k] = random_float(&state, -2.0f, 2.0f);
+        }
+        in.v[i].x = random_float(&state, -10.0f, 10.0f);
+        in.v[i].y = random_float(&state, -10.0f, 10.0f);
+        in.v[i].z = random_float(&state, -10.0f, 10.0f);
+        in.v[i].w = 1.0f;
+
+        float x = random_float(&state, -1.0f, 1.0f), y = random_float(&state, -1.0f, 1.0f);
+        float z = random_float(&state, -1.0f, 1.0f), w = random_float(&state, -1.0f, 1.0f);
+        float length = sqrtf(x * x + y * y + z * z + w * w);
+        if(length < 1e-3f) {
+            x = y = z = 0.0f;
+            w = length = 1.0f;
+        }
+        in.q[i] = (Quat){ x / length, y / length, z / length, w / length };
+
+        for(int k = 0; k < 3; ++k) {
+            float center = random_float(&state, -100.0f, 100.0f);
+            float extent = random_float(&state, 0.1f, 5.0f);
+            in.boxes[i].min[k] = center - extent;
+            in.boxes[i].max[k] = center + extent;
+        }
+    }
+    make_soa(in.a_soa.m, 16, (const float *)in.a, count);
+    make_soa(in.b_soa.m, 16, (const float *)in.b, count);
+    float *v_streams[4], *q_streams[4], *box_streams[6];
+    make_soa(v_streams, 4, (const float *)in.v, count);
+    make_soa(q_streams, 4, (const float *)in.q, count);
+    make_soa(box_streams, 6, (const float *)in.boxes, count);
+    in.v_soa = (Vec4Soa){ v_streams[0], v_streams[1], v_streams[2], v_streams[3] };
+    in.q_soa = (QuatSoa){ q_streams[0], q_streams[1], q_streams[2], q_streams[3] };
+    for(int k = 0; k < 3; ++k) {
+        in.boxes_soa.min[k] = box_streams[k];
+        in.boxes_soa.max[k] = box_streams[3 + k];
+    }
+
+    // Rotation, scale and translation, the AABB transform needs an affine matrix
+    Quat rotation = { 0.2f, -0.4f, 0.1f, 0.0f };
+    rotation.w = sqrtf(1.0f - rotation.x * rotation.x - rotation.y * rotation.y - rotation.z * rotation.z);
+    math_kernels_for(MATH_ISA_SCALAR)->quat_to_mat4_aos(&in.transform, &rotation, 1);
+    for(int k = 0; k < 12; ++k)
+        in.transform.m[k] *= 1.5f;
+    in.transform.m[12] = 3.0f;
+    in.transform.m[13] = -7.0f;
+    in.transform.m[14] = 12.0f;
+    return in;
+}
+
+static void inputs_destroy(Inputs *in) {
+    free(in->a);
+    free(in->b);
+    free(in->v);
+    free(in->q);
+    free(in->boxes);
+    free(in->a_soa.m[0]);
+    free(in->b_soa.m[0]);
+    free(in->v_soa.x);
+    free(in->q_soa.x);
+    free(in->boxes_soa.min[0]);
+}
+
+// out holds op_floats elements per input, SoA outputs get one stream of count floats each
+static void run_op(const MathKernels *kernels, BenchOp op, const Inputs *in, float *out) {
+    uint32_t count = in->count;
+    float *streams[16];
+    for(uint32_t k = 0; k < op_floats[op]; ++k)
+        streams[k] = out + k * count;
+
+    switch(op) {
+    case BENCH_MAT4_MUL_AOS:
+        kernels->mat4_mul_aos((Mat4 *)out, in->a, in->b, count);
+        break;
+    case BENCH_MAT4_MUL_SOA: {
+        Mat4Soa dst;
+        memcpy(dst.m, streams, sizeof(dst.m));
+        kernels->mat4_mul_soa(&dst, &in->a_soa, &in->b_soa, count);
+        break;
+    }
+    case BENCH_MAT4_MUL_VEC4_AOS:
+        kernels->mat4_mul_vec4_aos((Vec4 *)out, &in->transform, in->v, count);
+        break;
+    case BENCH_MAT4_MUL_VEC4_SOA: {
+        Vec4Soa dst = { streams[0], streams[1], streams[2], streams[3] };
+        kernels->mat4_mul_vec4_soa(&dst, &in->transform, &in->v_soa, count);
+        break;
+    }
+    case BENCH_QUAT_TO_MAT4_AOS:
+        kernels->quat_to_mat4_aos((Mat4 *)out, in->q, count);
+        break;
+    case BENCH_QUAT_TO_MAT4_SOA: {
+        Mat4Soa dst;
+        memcpy(dst.m, streams, sizeof(dst.m));
+        kernels->quat_to_mat4_soa(&dst, &in->q_soa, count);
+        break;
+    }
+    case BENCH_AABB_TRANSFORM_AOS:
+        kernels->aabb_transform_aos((Aabb *)out, &in->transform, in->boxes, count);
+        break;
+    case BENCH_AABB_TRANSFORM_SOA: {
+        AabbSoa dst = { { streams[0], streams[1], streams[2] }, { streams[3], streams[4], streams[5] } };
+        kernels->aabb_transform_soa(&dst, &in->transform, &in->boxes_soa, count);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static float max_error(const float *result, const float *reference, size_t n) {
+    float worst = 0.0f;
+    for(size_t i = 0; i < n; ++i) {
+        float error = fabsf(result[i] - reference[i]) / fmaxf(1.0f, fabsf(reference[i]));
+        // NaN compares false, so check for it explicitly
+        if(!(error <= worst))
+            worst = error;
+    }
+    return worst;
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = DEFAULT_COUNT;
+    if(argc > 2 || (argc == 2 && (sscanf(argv[1], "%u", &count) != 1 || count == 0))) {
+        fprintf(stderr, "Usage: %s [COUNT]\n", argv[0]);
+        return 1;
+    }
+
+    Inputs in = inputs_create(count);
+    size_t out_floats = (size_t)count * 16;
+    float *reference = alloc_or_die(sizeof(float) * out_floats);
+    float *out = alloc_or_die(sizeof(float) * out_floats);
+
+    printf("%u elements, math_kernels() picks %s\n", count, math_isa_name(math_kernels()->isa));
+    printf("%-15s %-6s %-7s %14s %10s\n", "op", "layout", "ISA", "Mtransforms/s", "max error");
+    char failed = 0;
+    for(int op = 0; op < BENCH_OP_COUNT; ++op) {
+        size_t n = (size_t)count * op_floats[op];
+        run_op(math_kernels_for(MATH_ISA_SCALAR), (BenchOp)op, &in, reference);
+        for(int isa = 0; isa < MATH_ISA_COUNT; ++isa) {
+            const MathKernels *kernels = math_kernels_for((MathIsa)isa);
+            if(!kernels)
+                continue;
+
+            // NaNs so nothing a kernel forgot to write can match
+            memset(out, 0xff, sizeof(float) * n);
+            run_op(kernels, (BenchOp)op, &in, out);
+            float error = max_error(out, reference, n);
+
+            double best = 1e30, total = 0.0;
+            for(uint32_t runs = 0; runs < MIN_RUNS || total < MIN_SECONDS; ++runs) {
+                double start = now_seconds();
+                run_op(kernels, (BenchOp)op, &in, out);
+                double seconds = now_seconds() - start;
+                total += seconds;
+                if(seconds < best)
+                    best = seconds;
+            }
+
+            char ok = error <= TOLERANCE;
+            failed |= !ok;
+            printf("%-15s %-6s %-7s %14.1f %10.2g%s\n", op_names[op], op % 2 ? "SoA" : "AoS", math_isa_name((MathIsa)isa), count / best * 1e-6, error, ok ? "" : "  MISMATCH");
+        }
+    }
+
+    free(reference);
+    free(out);
+    inputs_destroy(&in);
+    if(failed) {
+        fprintf(stderr, "Some kernels don't match the scalar results.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 color = normalize(fragNormal) * 0.5 + 0.5;
+    // Faint uv grid, so the uvs are fetched and interpolated like a textured mesh would
+    vec2 grid = step(0.95, fract(fragUV * 16.0));
+    color *= 1.0 - 0.25 * max(grid.x, grid.y);
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450
+
+// Either float attributes or the quantized ones of a baked mesh, see vlk_mesh.h.
+// Unorm positions come in as [0, 1] and are scaled back into the mesh bounds.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+layout(push_constant) uniform MeshView {
+    vec4 scale_rotation; // xyz dequantization scale, w rotation around y
+    vec4 offset;         // xyz dequantization offset
+    vec4 fit;            // xyz bounds center, w 1 / bounds radius
+};
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragUV;
+
+void main() {
+    float s = sin(scale_rotation.w);
+    float c = cos(scale_rotation.w);
+    mat3 rotation = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    vec3 p = rotation * ((position * scale_rotation.xyz + offset.xyz - fit.xyz) * fit.w);
+    gl_Position = vec4(p.x, -p.y, p.z * 0.5 + 0.5, 1.0);
+    // Raw normals may be unnormalized sums of face normals
+    fragNormal = normalize(rotation * normal);
+    fragUV = uv;
+}
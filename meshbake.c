@@ -0,0 +1,481 @@
+// Converts an OBJ into the baked mesh format of vlk_mesh_format.h.
+//
+//   meshbake input.obj output.mesh
+//
+// The triangles are reordered for the post-transform vertex cache, then clustered and
+// the clusters sorted to cut overdraw, then the vertices are renumbered in the order
+// they're first used. Attributes are quantized and the triangles grouped into meshlets.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vlk_mesh_format.h"
+#include "vlk_obj.h"
+
+#define FORSYTH_CACHE_SIZE 32
+// Clusters may have this much worse ACMR than their hard boundary run
+#define OVERDRAW_THRESHOLD 1.05f
+// FIFO size for the ACMR that gets reported, close to what current GPUs reuse
+#define SIMULATED_CACHE_SIZE 16
+
+typedef struct Cluster {
+    uint32_t first_triangle;
+    uint32_t triangle_count;
+    float sort_key;
+} Cluster;
+
+static float forsyth_vertex_score(int32_t cache_position, uint32_t remaining) {
+    if(!remaining)
+        return -1.0f;
+    float score = 0.0f;
+    if(cache_position >= 0) {
+        // The last triangle's vertices score the same, so the order within it doesn't matter
+        if(cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cache_position - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+// Average cache misses per triangle for a FIFO cache
+static float simulate_acmr(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count) {
+    uint32_t *timestamps = calloc(vertex_count, sizeof(uint32_t));
+    uint32_t time = SIMULATED_CACHE_SIZE + 1, misses = 0;
+    for(uint32_t i = 0; i < index_count; ++i) {
+        if(time - timestamps[indices[i]] > SIMULATED_CACHE_SIZE) {
+            timestamps[indices[i]] = time++;
+            ++misses;
+        }
+    }
+    free(timestamps);
+    return (float)misses / (float)(index_count / 3);
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation
+static void optimize_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count) {
+    uint32_t triangle_count = index_count / 3;
+    uint32_t *offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t *remaining = calloc(vertex_count, sizeof(uint32_t));
+    for(uint32_t i = 0; i < index_count; ++i)
+        ++remaining[indices[i]];
+    for(uint32_t v = 0; v < vertex_count; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    uint32_t *adjacency = malloc(sizeof(uint32_t) * index_count);
+    uint32_t *fill = calloc(vertex_count, sizeof(uint32_t));
+    for(uint32_t i = 0; i < index_count; ++i)
+        adjacency[offsets[indices[i]] + fill[indices[i]]++] = i / 3;
+    free(fill);
+
+    int32_t *cache_positions = malloc(sizeof(int32_t) * vertex_count);
+    float *vertex_scores = malloc(sizeof(float) * vertex_count);
+    for(uint32_t v = 0; v < vertex_count; ++v) {
+        cache_positions[v] = -1;
+        vertex_scores[v] = forsyth_vertex_score(-1, remaining[v]);
+    }
+    float *triangle_scores = malloc(sizeof(float) * triangle_count);
+    char *emitted = calloc(triangle_count, 1);
+    for(uint32_t t = 0; t < triangle_count; ++t)
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+
+    uint32_t *output = malloc(sizeof(uint32_t) * index_count);
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3], cache_count = 0, next_cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t input_cursor = 0;
+    int64_t best = -1;
+    for(uint32_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+        // Nothing in the cache has triangles left, carry on with the input order
+        if(best < 0) {
+            while(emitted[input_cursor])
+                ++input_cursor;
+            best = input_cursor;
+        }
+        uint32_t triangle = (uint32_t)best;
+        emitted[triangle] = 1;
+        memcpy(&output[emitted_count * 3], &indices[triangle * 3], sizeof(uint32_t) * 3);
+
+        uint32_t next_count = 0;
+        for(uint32_t i = 0; i < 3; ++i) {
+            uint32_t v = indices[triangle * 3 + i];
+            uint32_t *list = &adjacency[offsets[v]];
+            for(uint32_t j = 0; j < remaining[v]; ++j) {
+                if(list[j] == triangle) {
+                    list[j] = list[--remaining[v]];
+                    break;
+                }
+            }
+            next_cache[next_count++] = v;
+        }
+        for(uint32_t i = 0; i < cache_count; ++i) {
+            uint32_t v = cache[i];
+            if(v != next_cache[0] && v != next_cache[1] && v != next_cache[2])
+                next_cache[next_count++] = v;
+        }
+
+        for(uint32_t i = 0; i < next_count; ++i) {
+            uint32_t v = next_cache[i];
+            cache_positions[v] = i < FORSYTH_CACHE_SIZE ? (int32_t)i : -1;
+            vertex_scores[v] = forsyth_vertex_score(cache_positions[v], remaining[v]);
+        }
+        cache_count = next_count < FORSYTH_CACHE_SIZE ? next_count : FORSYTH_CACHE_SIZE;
+        memcpy(cache, next_cache, sizeof(uint32_t) * cache_count);
+
+        best = -1;
+        float best_score = -1.0f;
+        for(uint32_t i = 0; i < next_count; ++i) {
+            uint32_t v = next_cache[i];
+            for(uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = adjacency[offsets[v] + j];
+                triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+                if(triangle_scores[t] > best_score) {
+                    best_score = triangle_scores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    memcpy(indices, output, sizeof(uint32_t) * index_count);
+
+    free(output);
+    free(emitted);
+    free(triangle_scores);
+    free(vertex_scores);
+    free(cache_positions);
+    free(adjacency);
+    free(remaining);
+    free(offsets);
+}
+
+static int compare_clusters(const void *a, const void *b) {
+    float ka = ((const Cluster *)a)->sort_key, kb = ((const Cluster *)b)->sort_key;
+    return ka > kb ? -1 : ka < kb ? 1 : 0;
+}
+
+static void triangle_normal(const ObjMesh *mesh, const uint32_t *triangle, float normal[3]) {
+    const float *a = mesh->vertices[triangle[0]].position;
+    const float *b = mesh->vertices[triangle[1]].position;
+    const float *c = mesh->vertices[triangle[2]].position;
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Splits the cache optimized order into clusters where the cache starts over, and again
+// where a cluster's ACMR so far is close enough to that of its whole run. Clusters facing
+// away from the mesh center are drawn first, since they tend to occlude the others.
+static void optimize_overdraw(const ObjMesh *mesh, uint32_t *indices, uint32_t index_count) {
+    uint32_t triangle_count = index_count / 3;
+    Cluster *clusters = malloc(sizeof(Cluster) * triangle_count);
+    uint32_t cluster_count = 0;
+
+    uint32_t *timestamps = calloc(mesh->vertex_count, sizeof(uint32_t));
+    uint32_t time = SIMULATED_CACHE_SIZE + 1;
+    uint32_t *hard_starts = malloc(sizeof(uint32_t) * (triangle_count + 1));
+    uint32_t hard_count = 0;
+    for(uint32_t t = 0; t < triangle_count; ++t) {
+        uint32_t misses = 0;
+        for(uint32_t i = 0; i < 3; ++i) {
+            uint32_t v = indices[t * 3 + i];
+            if(time - timestamps[v] > SIMULATED_CACHE_SIZE) {
+                timestamps[v] = time++;
+                ++misses;
+            }
+        }
+        if(t == 0 || misses == 3)
+            hard_starts[hard_count++] = t;
+    }
+    hard_starts[hard_count] = triangle_count;
+
+    for(uint32_t h = 0; h < hard_count; ++h) {
+        uint32_t start = hard_starts[h], end = hard_starts[h + 1];
+        float run_acmr = simulate_acmr(&indices[start * 3], (end - start) * 3, mesh->vertex_count);
+        // Every cluster is simulated from a cold cache, as it may end up anywhere in the order
+        time += SIMULATED_CACHE_SIZE + 1;
+        uint32_t cluster_start = start, misses = 0;
+        for(uint32_t t = start; t < end; ++t) {
+            for(uint32_t i = 0; i < 3; ++i) {
+                uint32_t v = indices[t * 3 + i];
+                if(time - timestamps[v] > SIMULATED_CACHE_SIZE) {
+                    timestamps[v] = time++;
+                    ++misses;
+                }
+            }
+            uint32_t count = t + 1 - cluster_start;
+            if(t + 1 == end || (float)misses / (float)count <= run_acmr * OVERDRAW_THRESHOLD) {
+                clusters[cluster_count++] = (Cluster){ cluster_start, count, 0.0f };
+                cluster_start = t + 1;
+                misses = 0;
+                time += SIMULATED_CACHE_SIZE + 1;
+            }
+        }
+    }
+    free(hard_starts);
+    free(timestamps);
+
+    float mesh_center[3] = { 0 };
+    float mesh_area = 0.0f;
+    for(uint32_t t = 0; t < triangle_count; ++t) {
+        float normal[3];
+        triangle_normal(mesh, &indices[t * 3], normal);
+        float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for(uint32_t k = 0; k < 3; ++k)
+            mesh_center[k] += area * (mesh->vertices[indices[t * 3]].position[k] + mesh->vertices[indices[t * 3 + 1]].position[k] + mesh->vertices[indices[t * 3 + 2]].position[k]) / 3.0f;
+        mesh_area += area;
+    }
+    for(uint32_t k = 0; k < 3; ++k)
+        mesh_center[k] = mesh_area > 0.0f ? mesh_center[k] / mesh_area : 0.0f;
+
+    for(uint32_t c = 0; c < cluster_count; ++c) {
+        float center[3] = { 0 }, normal_sum[3] = { 0 }, area_sum = 0.0f;
+        for(uint32_t t = clusters[c].first_triangle; t < clusters[c].first_triangle + clusters[c].triangle_count; ++t) {
+            float normal[3];
+            triangle_normal(mesh, &indices[t * 3], normal);
+            float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            for(uint32_t k = 0; k < 3; ++k) {
+                center[k] += area * (mesh->vertices[indices[t * 3]].position[k] + mesh->vertices[indices[t * 3 + 1]].position[k] + mesh->vertices[indices[t * 3 + 2]].position[k]) / 3.0f;
+                normal_sum[k] += normal[k];
+            }
+            area_sum += area;
+        }
+        float length = sqrtf(normal_sum[0] * normal_sum[0] + normal_sum[1] * normal_sum[1] + normal_sum[2] * normal_sum[2]);
+        if(area_sum <= 0.0f || length <= 0.0f)
+            continue;
+        for(uint32_t k = 0; k < 3; ++k)
+            clusters[c].sort_key += (center[k] / area_sum - mesh_center[k]) * normal_sum[k] / length;
+    }
+
+    // qsort isn't stable, so ties could reorder. They're rare enough not to matter for overdraw.
+    qsort(clusters, cluster_count, sizeof(Cluster), compare_clusters);
+    uint32_t *output = malloc(sizeof(uint32_t) * index_count);
+    uint32_t written = 0;
+    for(uint32_t c = 0; c < cluster_count; ++c) {
+        memcpy(&output[written], &indices[clusters[c].first_triangle * 3], sizeof(uint32_t) * 3 * clusters[c].triangle_count);
+        written += 3 * clusters[c].triangle_count;
+    }
+    memcpy(indices, output, sizeof(uint32_t) * index_count);
+    free(output);
+    free(clusters);
+    printf("Overdraw: %u clusters\n", cluster_count);
+}
+
+// Renumbers vertices in the order the index buffer first uses them, dropping unused ones
+static void optimize_vertex_fetch(ObjMesh *mesh) {
+    uint32_t *remap = malloc(sizeof(uint32_t) * mesh->vertex_count);
+    memset(remap, 0xff, sizeof(uint32_t) * mesh->vertex_count);
+    ObjVertex *vertices = malloc(sizeof(ObjVertex) * mesh->vertex_count);
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < mesh->index_count; ++i) {
+        uint32_t v = mesh->indices[i];
+        if(remap[v] == UINT32_MAX) {
+            remap[v] = count;
+            vertices[count++] = mesh->vertices[v];
+        }
+        mesh->indices[i] = remap[v];
+    }
+    free(mesh->vertices);
+    free(remap);
+    mesh->vertices = vertices;
+    mesh->vertex_count = count;
+}
+
+static uint32_t build_meshlets(const ObjMesh *mesh, MeshFileMeshlet *meshlets) {
+    uint32_t *stamps = calloc(mesh->vertex_count, sizeof(uint32_t));
+    uint32_t meshlet_count = 0;
+    MeshFileMeshlet *meshlet = NULL;
+    for(uint32_t t = 0; t < mesh->index_count / 3; ++t) {
+        const uint32_t *triangle = &mesh->indices[t * 3];
+        uint32_t stamp = meshlet_count;
+        uint32_t new_vertices = 0;
+        for(uint32_t i = 0; i < 3; ++i)
+            new_vertices += meshlet && stamps[triangle[i]] != stamp;
+        if(!meshlet || meshlet->vertex_count + new_vertices > MESHLET_MAX_VERTICES || meshlet->triangle_count == MESHLET_MAX_TRIANGLES) {
+            meshlet = &meshlets[meshlet_count++];
+            *meshlet = (MeshFileMeshlet){ .first_index = t * 3 };
+            stamp = meshlet_count;
+        }
+        for(uint32_t i = 0; i < 3; ++i) {
+            if(stamps[triangle[i]] != stamp) {
+                stamps[triangle[i]] = stamp;
+                ++meshlet->vertex_count;
+            }
+        }
+        ++meshlet->triangle_count;
+    }
+    free(stamps);
+
+    for(uint32_t m = 0; m < meshlet_count; ++m) {
+        MeshFileMeshlet *meshlet = &meshlets[m];
+        const uint32_t *indices = &mesh->indices[meshlet->first_index];
+        uint32_t count = meshlet->triangle_count * 3;
+
+        float min[3], max[3];
+        memcpy(min, mesh->vertices[indices[0]].position, sizeof(min));
+        memcpy(max, min, sizeof(max));
+        for(uint32_t i = 1; i < count; ++i) {
+            for(uint32_t k = 0; k < 3; ++k) {
+                float value = mesh->vertices[indices[i]].position[k];
+                min[k] = fminf(min[k], value);
+                max[k] = fmaxf(max[k], value);
+            }
+        }
+        float radius = 0.0f;
+        for(uint32_t k = 0; k < 3; ++k)
+            meshlet->center[k] = (min[k] + max[k]) * 0.5f;
+        for(uint32_t i = 0; i < count; ++i) {
+            const float *p = mesh->vertices[indices[i]].position;
+            float d[3] = { p[0] - meshlet->center[0], p[1] - meshlet->center[1], p[2] - meshlet->center[2] };
+            radius = fmaxf(radius, sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+        }
+        meshlet->radius = radius;
+
+        float axis[3] = { 0 };
+        float (*normals)[3] = malloc(sizeof(float) * 3 * meshlet->triangle_count);
+        for(uint32_t t = 0; t < meshlet->triangle_count; ++t) {
+            triangle_normal(mesh, &indices[t * 3], normals[t]);
+            float length = sqrtf(normals[t][0] * normals[t][0] + normals[t][1] * normals[t][1] + normals[t][2] * normals[t][2]);
+            for(uint32_t k = 0; k < 3; ++k) {
+                normals[t][k] = length > 0.0f ? normals[t][k] / length : 0.0f;
+                axis[k] += normals[t][k];
+            }
+        }
+        float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        float min_dot = length > 0.0f ? 1.0f : -1.0f;
+        for(uint32_t k = 0; k < 3; ++k)
+            axis[k] = length > 0.0f ? axis[k] / length : 0.0f;
+        for(uint32_t t = 0; t < meshlet->triangle_count && min_dot > 0.0f; ++t)
+            min_dot = fminf(min_dot, normals[t][0] * axis[0] + normals[t][1] * axis[1] + normals[t][2] * axis[2]);
+        free(normals);
+
+        for(uint32_t k = 0; k < 3; ++k)
+            meshlet->cone_axis[k] = (int8_t)lroundf(axis[k] * 127.0f);
+        // Normals spread over more than a hemisphere can't be culled as a whole.
+        // Rounding the cutoff up keeps the test conservative.
+        float cutoff = min_dot > 0.0f ? sqrtf(1.0f - min_dot * min_dot) : 1.0f;
+        meshlet->cone_cutoff = (int8_t)fminf(ceilf(cutoff * 127.0f), 127.0f);
+    }
+    return meshlet_count;
+}
+
+static uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if(((bits >> 23) & 0xff) == 0xff)
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    if(exponent >= 31)
+        return (uint16_t)(sign | 0x7c00);
+    // Denormals are flushed, no UV is that close to 0 and not 0
+    if(exponent <= 0)
+        return (uint16_t)sign;
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    // Round to nearest, a carry into the exponent is still the right value
+    if(mantissa & 0x1000)
+        ++half;
+    return (uint16_t)half;
+}
+
+static void write_padding(FILE *file, uint64_t *offset) {
+    static const char zeros[MESH_FILE_ALIGNMENT] = { 0 };
+    uint64_t padding = (MESH_FILE_ALIGNMENT - *offset % MESH_FILE_ALIGNMENT) % MESH_FILE_ALIGNMENT;
+    fwrite(zeros, 1, padding, file);
+    *offset += padding;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s input.obj output.mesh\n", argv[0]);
+        return 1;
+    }
+
+    ObjMesh mesh = obj_load(argv[1]);
+    uint32_t triangle_count = mesh.index_count / 3;
+    printf("Loaded %s: %u vertices, %u triangles\n", argv[1], mesh.vertex_count, triangle_count);
+    printf("ACMR input:        %.3f\n", simulate_acmr(mesh.indices, mesh.index_count, mesh.vertex_count));
+    optimize_vertex_cache(mesh.indices, mesh.index_count, mesh.vertex_count);
+    printf("ACMR vertex cache: %.3f\n", simulate_acmr(mesh.indices, mesh.index_count, mesh.vertex_count));
+    optimize_overdraw(&mesh, mesh.indices, mesh.index_count);
+    float acmr = simulate_acmr(mesh.indices, mesh.index_count, mesh.vertex_count);
+    optimize_vertex_fetch(&mesh);
+    printf("ACMR overdraw:     %.3f, ATVR %.3f\n", acmr, acmr * triangle_count / mesh.vertex_count);
+
+    MeshFileMeshlet *meshlets = malloc(sizeof(MeshFileMeshlet) * triangle_count);
+    uint32_t meshlet_count = build_meshlets(&mesh, meshlets);
+
+    MeshFileHeader header = {
+        .magic = MESH_FILE_MAGIC,
+        .version = MESH_FILE_VERSION,
+        .vertex_count = mesh.vertex_count,
+        .index_count = mesh.index_count,
+        .index_size = mesh.vertex_count <= 65536 ? 2 : 4,
+        .meshlet_count = meshlet_count,
+    };
+    float extent[3];
+    for(uint32_t k = 0; k < 3; ++k) {
+        extent[k] = mesh.bounds_max[k] - mesh.bounds_min[k];
+        if(extent[k] <= 0.0f)
+            extent[k] = 1.0f;
+        header.position_offset[k] = mesh.bounds_min[k];
+        header.position_scale[k] = extent[k] / 65535.0f;
+    }
+    header.vertex_offset = align_offset(sizeof(MeshFileHeader));
+    header.index_offset = align_offset(header.vertex_offset + sizeof(MeshFileVertex) * (uint64_t)mesh.vertex_count);
+    header.meshlet_offset = align_offset(header.index_offset + (uint64_t)header.index_size * mesh.index_count);
+    header.file_size = header.meshlet_offset + sizeof(MeshFileMeshlet) * (uint64_t)meshlet_count;
+
+    FILE *file = fopen(argv[2], "wb");
+    if(!file) {
+        fprintf(stderr, "Failed to open %s for writing.\n", argv[2]);
+        return 1;
+    }
+    uint64_t offset = sizeof(MeshFileHeader);
+    fwrite(&header, sizeof(header), 1, file);
+    write_padding(file, &offset);
+
+    for(uint32_t i = 0; i < mesh.vertex_count; ++i) {
+        const ObjVertex *vertex = &mesh.vertices[i];
+        MeshFileVertex packed = { 0 };
+        for(uint32_t k = 0; k < 3; ++k)
+            packed.position[k] = (uint16_t)lroundf((vertex->position[k] - mesh.bounds_min[k]) / extent[k] * 65535.0f);
+        float length = sqrtf(vertex->normal[0] * vertex->normal[0] + vertex->normal[1] * vertex->normal[1] + vertex->normal[2] * vertex->normal[2]);
+        for(uint32_t k = 0; k < 3; ++k)
+            packed.normal[k] = length > 0.0f ? (int8_t)lroundf(vertex->normal[k] / length * 127.0f) : (k == 2 ? 127 : 0);
+        for(uint32_t k = 0; k < 2; ++k)
+            packed.uv[k] = float_to_half(vertex->uv[k]);
+        fwrite(&packed, sizeof(packed), 1, file);
+    }
+    offset += sizeof(MeshFileVertex) * (uint64_t)mesh.vertex_count;
+    write_padding(file, &offset);
+
+    for(uint32_t i = 0; i < mesh.index_count; ++i) {
+        if(header.index_size == 2) {
+            uint16_t index = (uint16_t)mesh.indices[i];
+            fwrite(&index, sizeof(index), 1, file);
+        } else {
+            fwrite(&mesh.indices[i], sizeof(uint32_t), 1, file);
+        }
+    }
+    offset += (uint64_t)header.index_size * mesh.index_count;
+    write_padding(file, &offset);
+
+    fwrite(meshlets, sizeof(MeshFileMeshlet), meshlet_count, file);
+    if(fclose(file) != 0) {
+        fprintf(stderr, "Failed to write %s.\n", argv[2]);
+        return 1;
+    }
+
+    uint64_t raw_size = sizeof(ObjVertex) * (uint64_t)mesh.vertex_count + sizeof(uint32_t) * (uint64_t)mesh.index_count;
+    printf("Wrote %s: %u vertices, %u meshlets, %.1f KB (%.1f KB as float vertices and 32 bit indices)\n",
+        argv[2], mesh.vertex_count, meshlet_count, header.file_size / 1024.0, raw_size / 1024.0);
+    free(meshlets);
+    obj_destroy(&mesh);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#version 450
+
+layout(push_constant) uniform Overdraw {
+    uint layer_count;
+    uint front_to_back;
+    uint iterations;
+};
+
+layout(location = 0) flat in uint layer;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Stands in for an expensive material, so the cost of every shaded fragment shows
+    vec2 p = gl_FragCoord.xy * 0.01 + float(layer);
+    float value = 0.0;
+    for (uint i = 0; i < iterations; ++i) {
+        p = fract(p * 1.7 + sin(p.yx * 3.1));
+        value += p.x * p.y;
+    }
+    float shade = value / float(max(iterations, 1u));
+    vec3 tint = vec3(float(layer & 1u), float((layer >> 1) & 1u), float((layer >> 2) & 1u)) * 0.5 + 0.5;
+    outColor = vec4(tint * shade, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// Full screen layers, one per instance, layer 0 is the nearest
+layout(push_constant) uniform Overdraw {
+    uint layer_count;
+    uint front_to_back; // 0 draws the farthest layer first, the worst case for early depth tests
+    uint iterations;    // Fragment shader work per pixel
+};
+
+layout(location = 0) flat out uint layer;
+
+// The pre-pass runs without a fragment shader but must produce the same depth
+invariant gl_Position;
+
+void main() {
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    layer = front_to_back != 0 ? uint(gl_InstanceIndex) : layer_count - 1 - uint(gl_InstanceIndex);
+    float depth = (float(layer) + 1.0) / float(layer_count + 1);
+    gl_Position = vec4(uv * 2.0 - 1.0, depth, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// Draws the particles particles.comp simulated, one point each
+struct Particle {
+    vec2 position;
+    vec2 velocity;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    Particle particle = particles[gl_VertexIndex];
+    gl_Position = vec4(particle.position, 0.0, 1.0);
+    gl_PointSize = 1.0;
+    // Faster particles are brighter
+    fragColor = mix(vec3(0.2, 0.4, 1.0), vec3(1.0, 0.9, 0.6), clamp(length(particle.velocity), 0.0, 1.0));
+}
@@ -0,0 +1,40 @@
+// Workgroup sum for luminance.comp and exposure.comp, which define REDUCE_GROUP_SIZE and
+// run that many invocations. Built with -DSUBGROUP each subgroup adds up its values with
+// subgroupAdd and shared memory only combines one sum per subgroup. Otherwise it is a tree
+// in shared memory with a barrier per level.
+shared vec2 reduce_scratch[REDUCE_GROUP_SIZE];
+
+// The invocation that holds the sum
+bool reduce_leader() {
+#ifdef SUBGROUP
+    return gl_SubgroupID == 0 && subgroupElect();
+#else
+    return gl_LocalInvocationIndex == 0;
+#endif
+}
+
+vec2 workgroup_sum(vec2 value) {
+#ifdef SUBGROUP
+    vec2 sum = subgroupAdd(value);
+    if (subgroupElect())
+        reduce_scratch[gl_SubgroupID] = sum;
+    barrier();
+    sum = vec2(0.0);
+    if (gl_SubgroupID == 0) {
+        for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups; i += gl_SubgroupSize)
+            sum += reduce_scratch[i];
+        sum = subgroupAdd(sum);
+    }
+    return sum;
+#else
+    uint index = gl_LocalInvocationIndex;
+    reduce_scratch[index] = value;
+    barrier();
+    for (uint stride = REDUCE_GROUP_SIZE / 2; stride > 0; stride /= 2) {
+        if (index < stride)
+            reduce_scratch[index] += reduce_scratch[index + stride];
+        barrier();
+    }
+    return reduce_scratch[0];
+#endif
+}
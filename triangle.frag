@@ -1,9 +1,35 @@
 #version 450
 
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Feature bits, constant_id N is bit N of the mask the pipeline is requested with
+layout(constant_id = 0) const bool FEATURE_DESATURATE = false;
+layout(constant_id = 1) const bool FEATURE_CHECKER = false;
+
+// Bindless table, see vlk_bindless.h
+layout(set = 1, binding = 0) uniform sampler texture_sampler;
+layout(set = 1, binding = 1) uniform texture2D textures[];
+
+// Follows the vertex shader's View block, ~0u draws untextured
+layout(push_constant) uniform Draw {
+    layout(offset = 12) uint texture_index;
+};
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUV;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    // The index comes from a push constant, so it is uniform and needs no nonuniformEXT
+    if (texture_index != 0xffffffffu)
+        color *= texture(sampler2D(textures[texture_index], texture_sampler), fragUV).rgb;
+    if (FEATURE_CHECKER) {
+        ivec2 cell = ivec2(gl_FragCoord.xy) / 8;
+        color *= ((cell.x + cell.y) & 1) == 0 ? 1.0 : 0.5;
+    }
+    if (FEATURE_DESATURATE)
+        color = vec3(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 #version 450
 
+layout(constant_id = 2) const bool FEATURE_FLAT_COLOR = false;
+
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUV;
+
+// Same depth in the pre-pass and the EQUAL tested color pass
+invariant gl_Position;
 
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
@@ -16,5 +22,6 @@ vec3 colors[3] = vec3[](
 
 void main() {
     gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    fragUV = positions[gl_VertexIndex] + 0.5;
+    fragColor = FEATURE_FLAT_COLOR ? vec3(1.0) : colors[gl_VertexIndex];
 }
\ No newline at end of file
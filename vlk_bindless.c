@@ -0,0 +1,252 @@
+#include "vlk_bindless.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BINDLESS_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
+typedef struct BindlessTexture {
+    VkImage image; // VK_NULL_HANDLE for views registered by the caller
+    VkImageView view;
+    MemoryAllocation allocation;
+    char used;
+} BindlessTexture;
+
+struct BindlessTable {
+    VkDevice device;
+    MemoryAllocator *allocator;
+    UploadQueue *uploads;
+    VkSampler sampler;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    uint32_t capacity;
+    uint32_t count; // Live textures
+    uint32_t high_water; // Slots below this have been handed out at least once
+    BindlessTexture *textures;
+    uint32_t *free_slots;
+    uint32_t free_count;
+};
+
+static uint32_t clamp_capacity(VkPhysicalDevice physical_device, uint32_t capacity) {
+    VkPhysicalDeviceVulkan12Properties properties12 = { 0 };
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = { 0 };
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    if(capacity > properties12.maxDescriptorSetUpdateAfterBindSampledImages)
+        capacity = properties12.maxDescriptorSetUpdateAfterBindSampledImages;
+    if(capacity > properties12.maxPerStageDescriptorUpdateAfterBindSampledImages)
+        capacity = properties12.maxPerStageDescriptorUpdateAfterBindSampledImages;
+    return capacity;
+}
+
+static VkSampler create_sampler(VkDevice device) {
+    VkSamplerCreateInfo create_info = { 0 };
+    create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    create_info.magFilter = VK_FILTER_LINEAR;
+    create_info.minFilter = VK_FILTER_LINEAR;
+    create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    create_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    if(vkCreateSampler(device, &create_info, NULL, &sampler) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan sampler.\n");
+        exit(1);
+    }
+    return sampler;
+}
+
+BindlessTable *bindless_table_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, UploadQueue *uploads, uint32_t capacity) {
+    BindlessTable *table = calloc(1, sizeof(BindlessTable));
+    table->device = device;
+    table->allocator = allocator;
+    table->uploads = uploads;
+    table->capacity = clamp_capacity(physical_device, capacity);
+    table->textures = calloc(table->capacity, sizeof(BindlessTexture));
+    table->free_slots = malloc(sizeof(uint32_t) * table->capacity);
+    table->sampler = create_sampler(device);
+
+    VkDescriptorSetLayoutBinding bindings[2] = { 0 };
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[0].pImmutableSamplers = &table->sampler;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[1].descriptorCount = table->capacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorBindingFlags binding_flags[2] = {
+        0,
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = { 0 };
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = 2;
+    flags_info.pBindingFlags = binding_flags;
+    VkDescriptorSetLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+    if(vkCreateDescriptorSetLayout(device, &layout_info, NULL, &table->layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan bindless descriptor set layout.\n");
+        exit(1);
+    }
+
+    VkDescriptorPoolSize pool_sizes[2] = {
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, table->capacity },
+    };
+    VkDescriptorPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+    if(vkCreateDescriptorPool(device, &pool_info, NULL, &table->pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan bindless descriptor pool.\n");
+        exit(1);
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = { 0 };
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = table->pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &table->layout;
+    if(vkAllocateDescriptorSets(device, &alloc_info, &table->set) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate Vulkan bindless descriptor set.\n");
+        exit(1);
+    }
+    return table;
+}
+
+static void free_texture(BindlessTable *table, BindlessTexture *texture) {
+    vkDestroyImageView(table->device, texture->view, NULL);
+    vkDestroyImage(table->device, texture->image, NULL);
+    memory_free(table->allocator, &texture->allocation);
+    *texture = (BindlessTexture){ 0 };
+}
+
+void bindless_table_destroy(BindlessTable *table) {
+    // Registered views belong to the caller
+    for(uint32_t i = 0; i < table->high_water; ++i) {
+        if(table->textures[i].image)
+            free_texture(table, &table->textures[i]);
+    }
+    vkDestroyDescriptorPool(table->device, table->pool, NULL);
+    vkDestroyDescriptorSetLayout(table->device, table->layout, NULL);
+    vkDestroySampler(table->device, table->sampler, NULL);
+    free(table->free_slots);
+    free(table->textures);
+    free(table);
+}
+
+VkDescriptorSetLayout bindless_table_layout(const BindlessTable *table) {
+    return table->layout;
+}
+
+VkDescriptorSet bindless_table_set(const BindlessTable *table) {
+    return table->set;
+}
+
+uint32_t bindless_table_capacity(const BindlessTable *table) {
+    return table->capacity;
+}
+
+uint32_t bindless_table_count(const BindlessTable *table) {
+    return table->count;
+}
+
+static BindlessHandle allocate_slot(BindlessTable *table) {
+    BindlessHandle handle;
+    if(table->free_count) {
+        handle = table->free_slots[--table->free_count];
+    } else if(table->high_water < table->capacity) {
+        handle = table->high_water++;
+    } else {
+        fprintf(stderr, "Bindless texture table is full (%u textures).\n", table->capacity);
+        exit(1);
+    }
+    table->textures[handle].used = 1;
+    ++table->count;
+    return handle;
+}
+
+static void write_descriptor(BindlessTable *table, BindlessHandle handle, VkImageView view) {
+    VkDescriptorImageInfo image_descriptor = { VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet write = { 0 };
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = table->set;
+    write.dstBinding = 1;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &image_descriptor;
+    vkUpdateDescriptorSets(table->device, 1, &write, 0, NULL);
+}
+
+BindlessHandle bindless_create_texture(BindlessTable *table, uint32_t width, uint32_t height, const void *pixels) {
+    BindlessHandle handle = allocate_slot(table);
+    BindlessTexture *texture = &table->textures[handle];
+    VkImageCreateInfo image_info = { 0 };
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = BINDLESS_FORMAT;
+    image_info.extent.width = width;
+    image_info.extent.height = height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    texture->image = memory_create_image(table->allocator, &image_info, MEMORY_USAGE_GPU_ONLY, &texture->allocation);
+
+    VkImageViewCreateInfo view_info = { 0 };
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = BINDLESS_FORMAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(table->device, &view_info, NULL, &texture->view) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan image view.\n");
+        exit(1);
+    }
+
+    VkExtent3D extent = { width, height, 1 };
+    upload_image(table->uploads, texture->image, 0, extent, 1, pixels, (VkDeviceSize)width * height * 4, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    write_descriptor(table, handle, texture->view);
+    return handle;
+}
+
+BindlessHandle bindless_register_view(BindlessTable *table, VkImageView view) {
+    BindlessHandle handle = allocate_slot(table);
+    table->textures[handle].view = view;
+    write_descriptor(table, handle, view);
+    return handle;
+}
+
+void bindless_release(BindlessTable *table, BindlessHandle handle) {
+    if(handle >= table->high_water || !table->textures[handle].used)
+        return;
+    // The stale descriptor stays in the array, partially bound makes that legal while nothing indexes it
+    if(table->textures[handle].image)
+        free_texture(table, &table->textures[handle]);
+    table->textures[handle] = (BindlessTexture){ 0 };
+    table->free_slots[table->free_count++] = handle;
+    --table->count;
+}
@@ -0,0 +1,40 @@
+#ifndef VLK_BINDLESS_H
+#define VLK_BINDLESS_H
+
+#include <volk.h>
+
+#include "vlk_memory.h"
+#include "vlk_upload.h"
+
+// Every texture lives in one large descriptor array (descriptor indexing, core in 1.2).
+// The set is bound once per command buffer and shaders index the array with a handle
+// taken from per-draw data, so draws with different textures need no descriptor binds.
+// The array is UPDATE_AFTER_BIND and partially bound: textures can be added while the
+// set is bound in command buffers that are pending, as long as those don't use them.
+
+typedef uint32_t BindlessHandle;
+#define BINDLESS_INVALID_HANDLE UINT32_MAX
+
+typedef struct BindlessTable BindlessTable;
+
+// capacity is clamped to the device's update after bind limits
+BindlessTable *bindless_table_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, UploadQueue *uploads, uint32_t capacity);
+void bindless_table_destroy(BindlessTable *table);
+
+// Set 1 of the graphics pipeline layout. Binding 0 is an immutable linear sampler,
+// binding 1 the texture2D array.
+VkDescriptorSetLayout bindless_table_layout(const BindlessTable *table);
+VkDescriptorSet bindless_table_set(const BindlessTable *table);
+uint32_t bindless_table_capacity(const BindlessTable *table);
+uint32_t bindless_table_count(const BindlessTable *table);
+
+// Creates an RGBA8 sRGB texture and queues its upload. The handle stays the same for the
+// texture's lifetime. Not thread safe, the table is meant to be filled from one thread.
+BindlessHandle bindless_create_texture(BindlessTable *table, uint32_t width, uint32_t height, const void *pixels);
+// For images owned elsewhere, the view must be in SHADER_READ_ONLY_OPTIMAL when sampled
+BindlessHandle bindless_register_view(BindlessTable *table, VkImageView view);
+// The GPU must be done with the handle, which is reused by later textures. Destroys the
+// texture if the table created it.
+void bindless_release(BindlessTable *table, BindlessHandle handle);
+
+#endif // VLK_BINDLESS_H
@@ -0,0 +1,139 @@
+#include "vlk_compute.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct ComputeSlot {
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    uint64_t value; // Signaled when the last submit from this slot has finished
+} ComputeSlot;
+
+struct AsyncCompute {
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queue_family;
+    VkSemaphore timeline;
+    uint64_t submitted_value;
+    uint32_t slot_count;
+    ComputeSlot *slots;
+};
+
+AsyncCompute *async_compute_create(VkDevice device, VkQueue queue, uint32_t queue_family, uint32_t slot_count) {
+    AsyncCompute *compute = calloc(1, sizeof(AsyncCompute));
+    compute->device = device;
+    compute->queue = queue;
+    compute->queue_family = queue_family;
+    compute->slot_count = slot_count;
+    compute->slots = calloc(slot_count, sizeof(ComputeSlot));
+
+    VkSemaphoreTypeCreateInfo type_info = { 0 };
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo semaphore_info = { 0 };
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    if(vkCreateSemaphore(device, &semaphore_info, NULL, &compute->timeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan timeline semaphore.\n");
+        exit(1);
+    }
+
+    for(uint32_t i = 0; i < slot_count; ++i) {
+        VkCommandPoolCreateInfo pool_info = { 0 };
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = queue_family;
+        if(vkCreateCommandPool(device, &pool_info, NULL, &compute->slots[i].command_pool) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan compute command pool.\n");
+            exit(1);
+        }
+
+        VkCommandBufferAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = compute->slots[i].command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        if(vkAllocateCommandBuffers(device, &alloc_info, &compute->slots[i].command_buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan compute command buffer.\n");
+            exit(1);
+        }
+    }
+    return compute;
+}
+
+void async_compute_destroy(AsyncCompute *compute) {
+    async_compute_wait(compute, compute->submitted_value);
+    for(uint32_t i = 0; i < compute->slot_count; ++i)
+        vkDestroyCommandPool(compute->device, compute->slots[i].command_pool, NULL);
+    vkDestroySemaphore(compute->device, compute->timeline, NULL);
+    free(compute->slots);
+    free(compute);
+}
+
+VkCommandBuffer async_compute_begin(AsyncCompute *compute, uint32_t slot) {
+    ComputeSlot *compute_slot = &compute->slots[slot];
+    async_compute_wait(compute, compute_slot->value);
+    vkResetCommandPool(compute->device, compute_slot->command_pool, 0);
+
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if(vkBeginCommandBuffer(compute_slot->command_buffer, &begin_info) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to begin recording to Vulkan compute command buffer.\n");
+        exit(1);
+    }
+    return compute_slot->command_buffer;
+}
+
+uint64_t async_compute_submit(AsyncCompute *compute, uint32_t slot, VkSemaphore wait_semaphore, uint64_t wait_value) {
+    ComputeSlot *compute_slot = &compute->slots[slot];
+    if(vkEndCommandBuffer(compute_slot->command_buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to record to Vulkan compute command buffer.\n");
+        exit(1);
+    }
+    compute_slot->value = ++compute->submitted_value;
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = wait_semaphore ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = &wait_value;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &compute_slot->value;
+
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = wait_semaphore ? 1 : 0;
+    submit_info.pWaitSemaphores = &wait_semaphore;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &compute_slot->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &compute->timeline;
+    if(vkQueueSubmit(compute->queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to submit Vulkan compute work.\n");
+        exit(1);
+    }
+    return compute_slot->value;
+}
+
+VkSemaphore async_compute_timeline(const AsyncCompute *compute) {
+    return compute->timeline;
+}
+
+uint32_t async_compute_queue_family(const AsyncCompute *compute) {
+    return compute->queue_family;
+}
+
+void async_compute_wait(AsyncCompute *compute, uint64_t value) {
+    if(!value)
+        return;
+    VkSemaphoreWaitInfo wait_info = { 0 };
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &compute->timeline;
+    wait_info.pValues = &value;
+    vkWaitSemaphores(compute->device, &wait_info, UINT64_MAX);
+}
@@ -0,0 +1,24 @@
+#ifndef VLK_COMPUTE_H
+#define VLK_COMPUTE_H
+
+#include <volk.h>
+
+// Compute work submitted on its own queue so it can overlap rasterization. Each slot has
+// its own command pool, and every submit signals the next value of a timeline semaphore
+// that the graphics queue (or the CPU) can wait on.
+typedef struct AsyncCompute AsyncCompute;
+
+AsyncCompute *async_compute_create(VkDevice device, VkQueue queue, uint32_t queue_family, uint32_t slot_count);
+void async_compute_destroy(AsyncCompute *compute);
+
+// Waits until the slot's previous submit has finished, then starts recording into it
+VkCommandBuffer async_compute_begin(AsyncCompute *compute, uint32_t slot);
+// Submits the slot. When wait_semaphore is a timeline the dispatches wait for wait_value
+// on it first. Returns the value the compute timeline reaches once the work is done.
+uint64_t async_compute_submit(AsyncCompute *compute, uint32_t slot, VkSemaphore wait_semaphore, uint64_t wait_value);
+
+VkSemaphore async_compute_timeline(const AsyncCompute *compute);
+uint32_t async_compute_queue_family(const AsyncCompute *compute);
+void async_compute_wait(AsyncCompute *compute, uint64_t value);
+
+#endif // VLK_COMPUTE_H
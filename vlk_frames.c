@@ -0,0 +1,376 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime for pthread_cond_timedwait
+#include "vlk_frames.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#define FRAME_RECORD_RING 16 // Frames the waiter thread may lag behind the submits
+#define FRAME_PACING_SMOOTHING 0.1 // Weight of the newest frame in the CPU and GPU averages
+#define FRAME_PACING_SLACK_MS 0.25 // Low latency frames wake this early, oversleeping idles the GPU
+#define FRAME_PRESENT_TIMEOUT_NS 100000000ull // Presents that never show up, e.g. on a retired swapchain
+
+typedef struct FrameRecord {
+    uint64_t value;
+    double start_ms; // CPU work started
+    double submit_ms;
+    double predicted_done_ms;
+} FrameRecord;
+
+typedef struct PresentRecord {
+    VkSwapchainKHR swapchain;
+    uint64_t present_id;
+    double start_ms;
+} PresentRecord;
+
+struct FrameScheduler {
+    VkDevice device;
+    VkSemaphore timeline;
+    uint32_t frames_in_flight;
+    char low_latency;
+    uint64_t frame_number; // Frames submitted
+    double frame_start_ms;
+
+    uint64_t *image_values; // Timeline value of the last frame rendering to each image
+    uint32_t image_count;
+
+    // Shared with the waiter thread
+    pthread_mutex_t mutex;
+    pthread_cond_t submitted;
+    pthread_cond_t stamped;
+    pthread_t waiter;
+    char stopping;
+    uint64_t submitted_value;
+    uint64_t stamped_value;
+    FrameRecord records[FRAME_RECORD_RING];
+    double *latencies; // CPU start to GPU done
+    double *submit_latencies; // Submit to GPU done
+    uint32_t latency_count, latency_capacity;
+    // Measured per frame, the GPU time runs from when the frame could start on the GPU to done
+    double cpu_ms;
+    double gpu_ms;
+    double gpu_free_ms; // When the GPU is predicted to finish everything submitted
+    double last_done_ms;
+    double held_ms; // Total time low latency mode held frames back
+
+    // Presents get their own thread, waiting for one can take until the next vblank and
+    // would hold up the frame stamps the pacing goes by
+    char present_wait;
+    pthread_t present_waiter;
+    pthread_cond_t presented;
+    pthread_cond_t present_stamped;
+    PresentRecord presents[FRAME_RECORD_RING];
+    uint64_t present_count, present_stamped_count;
+    double *present_latencies; // CPU start to present
+    uint32_t present_latency_count, present_latency_capacity;
+};
+
+static double get_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static double smooth(double average, double sample) {
+    return average > 0.0 ? average + (sample - average) * FRAME_PACING_SMOOTHING : sample;
+}
+
+static void wait_value(FrameScheduler *scheduler, uint64_t value) {
+    if(!value)
+        return;
+    VkSemaphoreWaitInfo wait_info = { 0 };
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &scheduler->timeline;
+    wait_info.pValues = &value;
+    vkWaitSemaphores(scheduler->device, &wait_info, UINT64_MAX);
+}
+
+// Stamps each frame as it completes. Only waits for values that were submitted, so it
+// never sits on a value that will not be signaled.
+static void *frame_waiter(void *arg) {
+    FrameScheduler *scheduler = arg;
+    uint64_t value = 1;
+    pthread_mutex_lock(&scheduler->mutex);
+    for(;;) {
+        while(scheduler->submitted_value < value && !scheduler->stopping)
+            pthread_cond_wait(&scheduler->submitted, &scheduler->mutex);
+        if(scheduler->submitted_value < value)
+            break;
+        pthread_mutex_unlock(&scheduler->mutex);
+
+        wait_value(scheduler, value);
+        double done_ms = get_time_ms();
+
+        pthread_mutex_lock(&scheduler->mutex);
+        FrameRecord *record = &scheduler->records[value % FRAME_RECORD_RING];
+        if(record->value == value) {
+            if(scheduler->latency_count == scheduler->latency_capacity) {
+                scheduler->latency_capacity = scheduler->latency_capacity ? scheduler->latency_capacity * 2 : 1024;
+                scheduler->latencies = realloc(scheduler->latencies, sizeof(double) * scheduler->latency_capacity);
+                scheduler->submit_latencies = realloc(scheduler->submit_latencies, sizeof(double) * scheduler->latency_capacity);
+            }
+            scheduler->latencies[scheduler->latency_count] = done_ms - record->start_ms;
+            scheduler->submit_latencies[scheduler->latency_count++] = done_ms - record->submit_ms;
+
+            double gpu_start_ms = record->submit_ms > scheduler->last_done_ms ? record->submit_ms : scheduler->last_done_ms;
+            scheduler->gpu_ms = smooth(scheduler->gpu_ms, done_ms - gpu_start_ms);
+            // The frames queued behind this one finish as much later or earlier
+            if(value == scheduler->submitted_value)
+                scheduler->gpu_free_ms = done_ms;
+            else
+                scheduler->gpu_free_ms += done_ms - record->predicted_done_ms;
+        }
+        scheduler->last_done_ms = done_ms;
+        scheduler->stamped_value = value++;
+        pthread_cond_broadcast(&scheduler->stamped);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return NULL;
+}
+
+// Stamps each present once it has reached the display, the present id is the frame's
+// timeline value
+static void *present_waiter(void *arg) {
+    FrameScheduler *scheduler = arg;
+    pthread_mutex_lock(&scheduler->mutex);
+    for(;;) {
+        while(scheduler->present_stamped_count == scheduler->present_count && !scheduler->stopping)
+            pthread_cond_wait(&scheduler->presented, &scheduler->mutex);
+        if(scheduler->present_stamped_count == scheduler->present_count)
+            break;
+        PresentRecord record = scheduler->presents[scheduler->present_stamped_count % FRAME_RECORD_RING];
+        pthread_mutex_unlock(&scheduler->mutex);
+
+        VkResult result = vkWaitForPresentKHR(scheduler->device, record.swapchain, record.present_id, FRAME_PRESENT_TIMEOUT_NS);
+        double present_ms = get_time_ms();
+
+        pthread_mutex_lock(&scheduler->mutex);
+        if(result == VK_SUCCESS) {
+            if(scheduler->present_latency_count == scheduler->present_latency_capacity) {
+                scheduler->present_latency_capacity = scheduler->present_latency_capacity ? scheduler->present_latency_capacity * 2 : 1024;
+                scheduler->present_latencies = realloc(scheduler->present_latencies, sizeof(double) * scheduler->present_latency_capacity);
+            }
+            scheduler->present_latencies[scheduler->present_latency_count++] = present_ms - record.start_ms;
+        }
+        ++scheduler->present_stamped_count;
+        pthread_cond_broadcast(&scheduler->present_stamped);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return NULL;
+}
+
+FrameScheduler *frame_scheduler_create(VkDevice device, uint32_t frames_in_flight, char low_latency, char present_wait) {
+    FrameScheduler *scheduler = calloc(1, sizeof(FrameScheduler));
+    scheduler->device = device;
+    scheduler->frames_in_flight = frames_in_flight;
+    scheduler->low_latency = low_latency;
+    scheduler->present_wait = present_wait;
+
+    VkSemaphoreTypeCreateInfo type_info = { 0 };
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo semaphore_info = { 0 };
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    if(vkCreateSemaphore(device, &semaphore_info, NULL, &scheduler->timeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan timeline semaphore.\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&scheduler->mutex, NULL);
+    pthread_cond_init(&scheduler->submitted, NULL);
+    pthread_cond_init(&scheduler->stamped, NULL);
+    pthread_cond_init(&scheduler->presented, NULL);
+    pthread_cond_init(&scheduler->present_stamped, NULL);
+    if(pthread_create(&scheduler->waiter, NULL, frame_waiter, scheduler) != 0) {
+        fprintf(stderr, "Failed to create frame waiter thread.\n");
+        exit(1);
+    }
+    if(present_wait && pthread_create(&scheduler->present_waiter, NULL, present_waiter, scheduler) != 0) {
+        fprintf(stderr, "Failed to create present waiter thread.\n");
+        exit(1);
+    }
+    return scheduler;
+}
+
+void frame_scheduler_destroy(FrameScheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->stopping = 1;
+    pthread_cond_broadcast(&scheduler->submitted);
+    pthread_cond_broadcast(&scheduler->presented);
+    pthread_mutex_unlock(&scheduler->mutex);
+    // The waiters drain every submitted frame and present before they exit
+    pthread_join(scheduler->waiter, NULL);
+    if(scheduler->present_wait)
+        pthread_join(scheduler->present_waiter, NULL);
+    pthread_cond_destroy(&scheduler->submitted);
+    pthread_cond_destroy(&scheduler->stamped);
+    pthread_cond_destroy(&scheduler->presented);
+    pthread_cond_destroy(&scheduler->present_stamped);
+    pthread_mutex_destroy(&scheduler->mutex);
+    vkDestroySemaphore(scheduler->device, scheduler->timeline, NULL);
+    free(scheduler->image_values);
+    free(scheduler->latencies);
+    free(scheduler->submit_latencies);
+    free(scheduler->present_latencies);
+    free(scheduler);
+}
+
+// Holds the frame back until the GPU is predicted to be free in about the time its CPU work
+// takes, so it samples its state as late as possible and still keeps the GPU busy. Starts
+// right away once the previous frame is done, the GPU is idle then.
+static void hold_until_needed(FrameScheduler *scheduler, uint64_t frame) {
+    double begin_ms = get_time_ms();
+    pthread_mutex_lock(&scheduler->mutex);
+    double wake_ms = scheduler->gpu_free_ms - scheduler->cpu_ms - FRAME_PACING_SLACK_MS;
+    // Frame N signals N + 1, so the previous frame is done once N is stamped
+    while(scheduler->stamped_value < frame) {
+        double now_ms = get_time_ms();
+        if(now_ms >= wake_ms)
+            break;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long nanoseconds = deadline.tv_nsec + (long long)((wake_ms - now_ms) * 1e6);
+        deadline.tv_sec += (time_t)(nanoseconds / 1000000000);
+        deadline.tv_nsec = (long)(nanoseconds % 1000000000);
+        pthread_cond_timedwait(&scheduler->stamped, &scheduler->mutex, &deadline);
+    }
+    scheduler->held_ms += get_time_ms() - begin_ms;
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+uint32_t frame_scheduler_begin(FrameScheduler *scheduler) {
+    uint64_t frame = scheduler->frame_number;
+    if(frame >= scheduler->frames_in_flight)
+        wait_value(scheduler, frame + 1 - scheduler->frames_in_flight);
+    if(scheduler->low_latency && frame)
+        hold_until_needed(scheduler, frame);
+    scheduler->frame_start_ms = get_time_ms();
+    return (uint32_t)(frame % scheduler->frames_in_flight);
+}
+
+void frame_scheduler_wait_image(FrameScheduler *scheduler, uint32_t image_index) {
+    if(image_index < scheduler->image_count)
+        wait_value(scheduler, scheduler->image_values[image_index]);
+}
+
+void frame_scheduler_reset_images(FrameScheduler *scheduler, uint32_t image_count) {
+    pthread_mutex_lock(&scheduler->mutex);
+    while(scheduler->present_stamped_count < scheduler->present_count)
+        pthread_cond_wait(&scheduler->present_stamped, &scheduler->mutex);
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    free(scheduler->image_values);
+    scheduler->image_values = calloc(image_count, sizeof(uint64_t));
+    scheduler->image_count = image_count;
+}
+
+VkSemaphore frame_scheduler_timeline(const FrameScheduler *scheduler) {
+    return scheduler->timeline;
+}
+
+uint64_t frame_scheduler_signal_value(const FrameScheduler *scheduler) {
+    return scheduler->frame_number + 1;
+}
+
+void frame_scheduler_submitted(FrameScheduler *scheduler, uint32_t image_index) {
+    uint64_t value = ++scheduler->frame_number;
+    if(image_index < scheduler->image_count)
+        scheduler->image_values[image_index] = value;
+
+    double submit_ms = get_time_ms();
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->cpu_ms = smooth(scheduler->cpu_ms, submit_ms - scheduler->frame_start_ms);
+    // Starts on the GPU once it is submitted and the frames before it are done
+    scheduler->gpu_free_ms = (submit_ms > scheduler->gpu_free_ms ? submit_ms : scheduler->gpu_free_ms) + scheduler->gpu_ms;
+    scheduler->records[value % FRAME_RECORD_RING] = (FrameRecord){ value, scheduler->frame_start_ms, submit_ms, scheduler->gpu_free_ms };
+    scheduler->submitted_value = value;
+    pthread_cond_signal(&scheduler->submitted);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+uint64_t frame_scheduler_present_id(const FrameScheduler *scheduler) {
+    return scheduler->frame_number;
+}
+
+void frame_scheduler_presented(FrameScheduler *scheduler, VkSwapchainKHR swapchain) {
+    if(!scheduler->present_wait)
+        return;
+    pthread_mutex_lock(&scheduler->mutex);
+    // Only when the present waiter lags far behind, the frame just goes untimed
+    if(scheduler->present_count - scheduler->present_stamped_count < FRAME_RECORD_RING) {
+        scheduler->presents[scheduler->present_count++ % FRAME_RECORD_RING] = (PresentRecord){ swapchain, scheduler->frame_number, scheduler->frame_start_ms };
+        pthread_cond_signal(&scheduler->presented);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+uint64_t frame_scheduler_completed(FrameScheduler *scheduler) {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(scheduler->device, scheduler->timeline, &value);
+    return value;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double sorted_percentile(const double *values, uint32_t count, double fraction) {
+    return values[(uint32_t)((count - 1) * fraction)];
+}
+
+// Waits for the waiter threads to stamp every submitted frame and present, call with the mutex held
+static void wait_stamped(FrameScheduler *scheduler) {
+    while(scheduler->stamped_value < scheduler->submitted_value)
+        pthread_cond_wait(&scheduler->stamped, &scheduler->mutex);
+    while(scheduler->present_stamped_count < scheduler->present_count)
+        pthread_cond_wait(&scheduler->present_stamped, &scheduler->mutex);
+}
+
+FrameSchedulerStats frame_scheduler_stats(FrameScheduler *scheduler) {
+    FrameSchedulerStats stats = { 0 };
+    pthread_mutex_lock(&scheduler->mutex);
+    wait_stamped(scheduler);
+    stats.frame_count = scheduler->latency_count;
+    if(stats.frame_count) {
+        qsort(scheduler->latencies, stats.frame_count, sizeof(double), compare_latency);
+        stats.latency_p50_ms = sorted_percentile(scheduler->latencies, stats.frame_count, 0.50);
+        stats.latency_p99_ms = sorted_percentile(scheduler->latencies, stats.frame_count, 0.99);
+    }
+    stats.cpu_ms = scheduler->cpu_ms;
+    stats.gpu_ms = scheduler->gpu_ms;
+    stats.held_ms = scheduler->frame_number ? scheduler->held_ms / scheduler->frame_number : 0.0;
+    pthread_mutex_unlock(&scheduler->mutex);
+    return stats;
+}
+
+static void print_latency(const char *label, double *values, uint32_t count) {
+    double sum = 0.0;
+    for(uint32_t i = 0; i < count; ++i)
+        sum += values[i];
+    qsort(values, count, sizeof(double), compare_latency);
+    printf("  %s: avg %.3f ms, p50 %.3f ms, p99 %.3f ms\n", label, sum / count, sorted_percentile(values, count, 0.50), sorted_percentile(values, count, 0.99));
+}
+
+void frame_scheduler_print_stats(FrameScheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+    wait_stamped(scheduler);
+    printf("Frame pacing: %u frame(s) in flight%s, %u frames timed\n", scheduler->frames_in_flight, scheduler->low_latency ? ", low latency" : "", scheduler->latency_count);
+    if(scheduler->latency_count) {
+        print_latency("CPU start to GPU done", scheduler->latencies, scheduler->latency_count);
+        print_latency("Submit to GPU done", scheduler->submit_latencies, scheduler->latency_count);
+    }
+    if(scheduler->present_latency_count)
+        print_latency("CPU start to present", scheduler->present_latencies, scheduler->present_latency_count);
+    else
+        printf("  No presents timed%s, the latencies stop at GPU completion\n", scheduler->present_wait ? "" : " (needs VK_KHR_present_wait)");
+    printf("  Per frame: CPU %.3f ms, GPU %.3f ms", scheduler->cpu_ms, scheduler->gpu_ms);
+    if(scheduler->low_latency)
+        printf(", held back %.3f ms", scheduler->frame_number ? scheduler->held_ms / scheduler->frame_number : 0.0);
+    printf("\n");
+    pthread_mutex_unlock(&scheduler->mutex);
+}
@@ -0,0 +1,65 @@
+#ifndef VLK_FRAMES_H
+#define VLK_FRAMES_H
+
+#include <volk.h>
+
+// Paces the frame loop with one timeline semaphore on the graphics queue. Frame N signals
+// N + 1 on submit, so a frame slot is free once the value of the frame that last used it
+// has been reached, and each swapchain image remembers the value of the frame that last
+// rendered to it. A waiter thread stamps when every frame completes, which gives the
+// CPU to GPU latency of the frames. With VK_KHR_present_id and VK_KHR_present_wait each
+// present is tagged with its frame's value and a second thread stamps when it reaches the
+// display, which gives the CPU to present latency. Without them the latency stops at the
+// GPU finishing the frame.
+//
+// The scheduler keeps smoothed CPU and GPU times per frame and predicts when the GPU will
+// be done with everything submitted. In low latency mode a frame starts its CPU work only
+// that long before the GPU frees up, so the state it samples is as fresh as possible and
+// the GPU still doesn't wait for it.
+
+#define FRAME_SCHEDULER_MAX_FRAMES 4
+
+typedef struct FrameScheduler FrameScheduler;
+
+// present_wait needs the presentId and presentWait features enabled
+FrameScheduler *frame_scheduler_create(VkDevice device, uint32_t frames_in_flight, char low_latency, char present_wait);
+// Waits for the GPU to finish everything submitted first
+void frame_scheduler_destroy(FrameScheduler *scheduler);
+
+// Blocks until the next frame may start and returns its slot, in [0, frames_in_flight)
+uint32_t frame_scheduler_begin(FrameScheduler *scheduler);
+// Blocks until no earlier frame still renders to the acquired image
+void frame_scheduler_wait_image(FrameScheduler *scheduler, uint32_t image_index);
+// Forget the images of a retired swapchain. Also waits until none of its presents is still
+// waited on, so it may be destroyed.
+void frame_scheduler_reset_images(FrameScheduler *scheduler, uint32_t image_count);
+
+// What the frame's submit has to signal
+VkSemaphore frame_scheduler_timeline(const FrameScheduler *scheduler);
+uint64_t frame_scheduler_signal_value(const FrameScheduler *scheduler);
+// Call right after the submit, image_index is UINT32_MAX when rendering offscreen
+void frame_scheduler_submitted(FrameScheduler *scheduler, uint32_t image_index);
+
+// The VkPresentIdKHR of the frame just submitted, and the call after presenting it.
+// Presents that failed aren't passed on.
+uint64_t frame_scheduler_present_id(const FrameScheduler *scheduler);
+void frame_scheduler_presented(FrameScheduler *scheduler, VkSwapchainKHR swapchain);
+
+// Frames the GPU has finished
+uint64_t frame_scheduler_completed(FrameScheduler *scheduler);
+
+// Latencies run from the start of a frame's CPU work
+typedef struct FrameSchedulerStats {
+    uint32_t frame_count;
+    double latency_p50_ms;
+    double latency_p99_ms;
+    double cpu_ms; // Smoothed, begin to submit
+    double gpu_ms; // Smoothed, from when the GPU could start the frame until it was done
+    double held_ms; // Per frame, how long low latency mode held it back
+} FrameSchedulerStats;
+
+// Waits for every submitted frame to be stamped
+FrameSchedulerStats frame_scheduler_stats(FrameScheduler *scheduler);
+void frame_scheduler_print_stats(FrameScheduler *scheduler);
+
+#endif // VLK_FRAMES_H
@@ -0,0 +1,807 @@
+#include "vlk_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRAPH_NONE UINT32_MAX
+#define GRAPH_LEGACY_MAX_IMAGES 16
+
+#define GRAPH_WRITE_ACCESS (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT \
+    | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+typedef struct GraphResource {
+    const char *name;
+    char is_image;
+    char transient;
+    char exported;
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+    VkImageAspectFlags aspect;
+    VkImageCreateInfo image_info; // Transient images
+    VkDeviceSize size; // Transient buffers
+    VkBufferUsageFlags usage;
+    RenderGraphState initial;
+    RenderGraphState final;
+
+    // Lifetime over the passes that survived culling
+    uint32_t first_pass;
+    uint32_t last_pass;
+    VkPipelineStageFlags2 used_stages;
+    VkAccessFlags2 written_access;
+    // Placement of transients
+    uint32_t heap;
+    VkDeviceSize offset;
+    VkMemoryRequirements requirements;
+
+    // State while the barriers are planned
+    VkImageLayout layout;
+    uint32_t write_pass; // GRAPH_NONE when written before the graph
+    VkPipelineStageFlags2 write_stages;
+    VkAccessFlags2 write_access;
+    VkPipelineStageFlags2 read_stages; // Since the last write
+    VkPipelineStageFlags2 visible_stages; // Already waited for the last write
+    VkAccessFlags2 visible_access;
+} GraphResource;
+
+// Everything one pass does with one resource
+typedef struct GraphAccess {
+    RenderGraphPass pass;
+    RenderGraphResource resource;
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout; // Needed when the pass starts, UNDEFINED if any will do
+    VkImageLayout final_layout; // What the pass leaves behind
+    char write;
+    char reads; // Depends on what was there before
+} GraphAccess;
+
+typedef struct GraphPass {
+    const char *name;
+    RenderGraphPassFn fn;
+    void *user_data;
+    char alive;
+} GraphPass;
+
+// The barriers recorded before a pass, or after the last one
+typedef struct GraphBatch {
+    char has_memory;
+    VkMemoryBarrier2 memory;
+    uint32_t first_image;
+    uint32_t image_count;
+} GraphBatch;
+
+typedef struct GraphImageBarrier {
+    uint32_t batch;
+    VkImageMemoryBarrier2 barrier;
+} GraphImageBarrier;
+
+typedef struct GraphHeap {
+    VkMemoryRequirements requirements;
+    char optimal;
+    MemoryAllocation allocation;
+} GraphHeap;
+
+// A realized transient. Reused while the frames declare the same ones with the same lifetimes.
+typedef struct GraphTransient {
+    char is_image;
+    VkImageCreateInfo image_info;
+    VkImageAspectFlags aspect;
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+    uint32_t first_pass;
+    uint32_t last_pass;
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+    uint32_t heap;
+    VkDeviceSize offset;
+    VkMemoryRequirements requirements;
+} GraphTransient;
+
+struct RenderGraph {
+    VkDevice device;
+    MemoryAllocator *allocator;
+    char synchronization2;
+
+    GraphResource *resources;
+    uint32_t resource_count;
+    uint32_t resource_capacity;
+    GraphAccess *accesses;
+    uint32_t access_count;
+    uint32_t access_capacity;
+    GraphPass *passes;
+    uint32_t pass_count;
+    uint32_t pass_capacity;
+
+    GraphBatch *batches; // pass_count + 1
+    uint32_t batch_capacity;
+    GraphImageBarrier *image_barriers;
+    VkImageMemoryBarrier2 *ordered_images; // Grouped by batch
+    uint32_t image_barrier_count;
+    uint32_t image_barrier_capacity;
+
+    GraphTransient *transients;
+    uint32_t transient_count;
+    uint32_t transient_capacity;
+    GraphHeap *heaps;
+    uint32_t heap_count;
+    uint32_t heap_capacity;
+
+    RenderGraphStats stats;
+    uint64_t generation; // Bumped whenever the transients are created again
+};
+
+static void *grow(void *array, uint32_t *capacity, uint32_t count, size_t element_size) {
+    if(count < *capacity)
+        return array;
+    *capacity = *capacity ? *capacity * 2 : 16;
+    return realloc(array, element_size * *capacity);
+}
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+RenderGraph *render_graph_create(VkDevice device, MemoryAllocator *allocator, char synchronization2) {
+    RenderGraph *graph = calloc(1, sizeof(RenderGraph));
+    graph->device = device;
+    graph->allocator = allocator;
+    graph->synchronization2 = synchronization2;
+    return graph;
+}
+
+static void destroy_transients(RenderGraph *graph) {
+    for(uint32_t i = 0; i < graph->transient_count; ++i) {
+        GraphTransient *transient = &graph->transients[i];
+        if(transient->is_image) {
+            vkDestroyImageView(graph->device, transient->view, NULL);
+            vkDestroyImage(graph->device, transient->image, NULL);
+        } else {
+            vkDestroyBuffer(graph->device, transient->buffer, NULL);
+        }
+    }
+    for(uint32_t i = 0; i < graph->heap_count; ++i)
+        memory_free(graph->allocator, &graph->heaps[i].allocation);
+    graph->transient_count = 0;
+    graph->heap_count = 0;
+}
+
+void render_graph_destroy(RenderGraph *graph) {
+    destroy_transients(graph);
+    free(graph->resources);
+    free(graph->accesses);
+    free(graph->passes);
+    free(graph->batches);
+    free(graph->image_barriers);
+    free(graph->ordered_images);
+    free(graph->transients);
+    free(graph->heaps);
+    free(graph);
+}
+
+void render_graph_reset(RenderGraph *graph) {
+    graph->resource_count = 0;
+    graph->access_count = 0;
+    graph->pass_count = 0;
+}
+
+static RenderGraphResource add_resource(RenderGraph *graph, const char *name, char is_image, char transient) {
+    graph->resources = grow(graph->resources, &graph->resource_capacity, graph->resource_count, sizeof(GraphResource));
+    GraphResource *resource = &graph->resources[graph->resource_count];
+    memset(resource, 0, sizeof(GraphResource));
+    resource->name = name;
+    resource->is_image = is_image;
+    resource->transient = transient;
+    resource->heap = GRAPH_NONE;
+    return graph->resource_count++;
+}
+
+RenderGraphResource render_graph_import_image(RenderGraph *graph, const char *name, VkImage image, VkImageAspectFlags aspect, RenderGraphState initial) {
+    RenderGraphResource handle = add_resource(graph, name, 1, 0);
+    graph->resources[handle].image = image;
+    graph->resources[handle].aspect = aspect;
+    graph->resources[handle].initial = initial;
+    return handle;
+}
+
+RenderGraphResource render_graph_import_buffer(RenderGraph *graph, const char *name, VkBuffer buffer, RenderGraphState initial) {
+    RenderGraphResource handle = add_resource(graph, name, 0, 0);
+    graph->resources[handle].buffer = buffer;
+    graph->resources[handle].initial = initial;
+    return handle;
+}
+
+RenderGraphResource render_graph_create_image(RenderGraph *graph, const char *name, const VkImageCreateInfo *create_info, VkImageAspectFlags aspect) {
+    RenderGraphResource handle = add_resource(graph, name, 1, 1);
+    GraphResource *resource = &graph->resources[handle];
+    resource->image_info = *create_info;
+    resource->image_info.pNext = NULL;
+    resource->image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource->aspect = aspect;
+    return handle;
+}
+
+RenderGraphResource render_graph_create_buffer(RenderGraph *graph, const char *name, VkDeviceSize size, VkBufferUsageFlags usage) {
+    RenderGraphResource handle = add_resource(graph, name, 0, 1);
+    graph->resources[handle].size = size;
+    graph->resources[handle].usage = usage;
+    return handle;
+}
+
+void render_graph_export(RenderGraph *graph, RenderGraphResource resource, RenderGraphState final) {
+    graph->resources[resource].exported = 1;
+    graph->resources[resource].final = final;
+}
+
+RenderGraphPass render_graph_add_pass(RenderGraph *graph, const char *name, RenderGraphPassFn fn, void *user_data) {
+    graph->passes = grow(graph->passes, &graph->pass_capacity, graph->pass_count, sizeof(GraphPass));
+    graph->passes[graph->pass_count] = (GraphPass){ name, fn, user_data, 0 };
+    return graph->pass_count++;
+}
+
+// A pass that touches a resource more than once gets one access covering all of it
+static void add_access(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access,
+    VkImageLayout layout, VkImageLayout final_layout, char write, char reads) {
+    for(uint32_t i = 0; i < graph->access_count; ++i) {
+        GraphAccess *existing = &graph->accesses[i];
+        if(existing->pass != pass || existing->resource != resource)
+            continue;
+        existing->stages |= stages;
+        existing->access |= access;
+        existing->write |= write;
+        existing->reads |= reads;
+        if(layout != VK_IMAGE_LAYOUT_UNDEFINED)
+            existing->layout = layout;
+        if(final_layout != VK_IMAGE_LAYOUT_UNDEFINED)
+            existing->final_layout = final_layout;
+        return;
+    }
+    graph->accesses = grow(graph->accesses, &graph->access_capacity, graph->access_count, sizeof(GraphAccess));
+    graph->accesses[graph->access_count++] = (GraphAccess){ pass, resource, stages, access, layout, final_layout, write, reads };
+}
+
+void render_graph_read(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout) {
+    add_access(graph, pass, resource, stages, access, layout, layout, 0, 1);
+}
+
+void render_graph_write(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout) {
+    add_access(graph, pass, resource, stages, access, layout, layout, 1, 0);
+}
+
+void render_graph_attachment(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout final_layout) {
+    add_access(graph, pass, resource, stages, access, VK_IMAGE_LAYOUT_UNDEFINED, final_layout, 1, 0);
+}
+
+// Walks back from the exported resources. A pass survives if something later reads what
+// it writes. Passes that declare no writes at all are kept, their effects are invisible here.
+static void cull_passes(RenderGraph *graph) {
+    char *needed = malloc(graph->resource_count ? graph->resource_count : 1);
+    for(uint32_t i = 0; i < graph->resource_count; ++i)
+        needed[i] = graph->resources[i].exported;
+
+    for(uint32_t p = graph->pass_count; p-- > 0;) {
+        char writes = 0;
+        char alive = 0;
+        for(uint32_t i = 0; i < graph->access_count; ++i) {
+            const GraphAccess *access = &graph->accesses[i];
+            if(access->pass != p || !access->write)
+                continue;
+            writes = 1;
+            alive |= needed[access->resource];
+        }
+        graph->passes[p].alive = alive || !writes;
+        if(!graph->passes[p].alive)
+            continue;
+        for(uint32_t i = 0; i < graph->access_count; ++i) {
+            const GraphAccess *access = &graph->accesses[i];
+            if(access->pass == p && access->reads)
+                needed[access->resource] = 1;
+        }
+    }
+    free(needed);
+}
+
+static void compute_lifetimes(RenderGraph *graph) {
+    for(uint32_t i = 0; i < graph->resource_count; ++i) {
+        graph->resources[i].first_pass = GRAPH_NONE;
+        graph->resources[i].last_pass = GRAPH_NONE;
+    }
+    for(uint32_t i = 0; i < graph->access_count; ++i) {
+        const GraphAccess *access = &graph->accesses[i];
+        if(!graph->passes[access->pass].alive)
+            continue;
+        GraphResource *resource = &graph->resources[access->resource];
+        if(resource->first_pass == GRAPH_NONE || access->pass < resource->first_pass)
+            resource->first_pass = access->pass;
+        if(resource->last_pass == GRAPH_NONE || access->pass > resource->last_pass)
+            resource->last_pass = access->pass;
+        resource->used_stages |= access->stages;
+        if(access->write)
+            resource->written_access |= access->access & GRAPH_WRITE_ACCESS ? access->access & GRAPH_WRITE_ACCESS : access->access;
+    }
+}
+
+static char transient_matches(const GraphTransient *transient, const GraphResource *resource) {
+    if(transient->is_image != resource->is_image || transient->first_pass != resource->first_pass || transient->last_pass != resource->last_pass)
+        return 0;
+    if(!resource->is_image)
+        return transient->size == resource->size && transient->usage == resource->usage;
+    const VkImageCreateInfo *a = &transient->image_info;
+    const VkImageCreateInfo *b = &resource->image_info;
+    return transient->aspect == resource->aspect && a->flags == b->flags && a->imageType == b->imageType && a->format == b->format
+        && a->extent.width == b->extent.width && a->extent.height == b->extent.height && a->extent.depth == b->extent.depth
+        && a->mipLevels == b->mipLevels && a->arrayLayers == b->arrayLayers && a->samples == b->samples && a->tiling == b->tiling && a->usage == b->usage;
+}
+
+static char lifetimes_overlap(const GraphResource *a, const GraphResource *b) {
+    return a->first_pass <= b->last_pass && b->first_pass <= a->last_pass;
+}
+
+static char ranges_overlap(const GraphResource *a, const GraphResource *b) {
+    return a->offset < b->offset + b->requirements.size && b->offset < a->offset + a->requirements.size;
+}
+
+typedef struct GraphPlacement {
+    VkDeviceSize size;
+    uint32_t resource;
+} GraphPlacement;
+
+static int compare_placement(const void *a, const void *b) {
+    const GraphPlacement *pa = a, *pb = b;
+    if(pa->size != pb->size)
+        return pa->size > pb->size ? -1 : 1;
+    return pa->resource < pb->resource ? -1 : 1;
+}
+
+// Largest first, each at the lowest offset of the first compatible heap where it doesn't
+// overlap anything alive at the same time. Images and buffers get separate heaps.
+static void place_transients(RenderGraph *graph, uint32_t *live, uint32_t live_count) {
+    GraphPlacement *order = malloc(sizeof(GraphPlacement) * live_count);
+    for(uint32_t i = 0; i < live_count; ++i)
+        order[i] = (GraphPlacement){ graph->resources[live[i]].requirements.size, live[i] };
+    qsort(order, live_count, sizeof(GraphPlacement), compare_placement);
+
+    for(uint32_t i = 0; i < live_count; ++i) {
+        GraphResource *resource = &graph->resources[order[i].resource];
+        const VkMemoryRequirements *requirements = &resource->requirements;
+        uint32_t heap = GRAPH_NONE;
+        for(uint32_t h = 0; h < graph->heap_count && heap == GRAPH_NONE; ++h) {
+            if(graph->heaps[h].optimal == resource->is_image && (graph->heaps[h].requirements.memoryTypeBits & requirements->memoryTypeBits))
+                heap = h;
+        }
+        if(heap == GRAPH_NONE) {
+            graph->heaps = grow(graph->heaps, &graph->heap_capacity, graph->heap_count, sizeof(GraphHeap));
+            heap = graph->heap_count++;
+            memset(&graph->heaps[heap], 0, sizeof(GraphHeap));
+            graph->heaps[heap].requirements.memoryTypeBits = requirements->memoryTypeBits;
+            graph->heaps[heap].requirements.alignment = 1;
+            graph->heaps[heap].optimal = resource->is_image;
+        }
+
+        // Bump past every conflict until there is none, only ever moves up so it terminates
+        resource->offset = 0;
+        char moved = 1;
+        while(moved) {
+            moved = 0;
+            for(uint32_t j = 0; j < i; ++j) {
+                const GraphResource *placed = &graph->resources[order[j].resource];
+                if(placed->heap != heap || !lifetimes_overlap(placed, resource) || !ranges_overlap(placed, resource))
+                    continue;
+                resource->offset = align_up(placed->offset + placed->requirements.size, requirements->alignment);
+                moved = 1;
+            }
+        }
+        resource->heap = heap;
+
+        VkMemoryRequirements *heap_requirements = &graph->heaps[heap].requirements;
+        if(resource->offset + requirements->size > heap_requirements->size)
+            heap_requirements->size = resource->offset + requirements->size;
+        if(requirements->alignment > heap_requirements->alignment)
+            heap_requirements->alignment = requirements->alignment;
+        heap_requirements->memoryTypeBits &= requirements->memoryTypeBits;
+    }
+    free(order);
+}
+
+static VkImageViewType view_type(const VkImageCreateInfo *info) {
+    if(info->imageType == VK_IMAGE_TYPE_3D)
+        return VK_IMAGE_VIEW_TYPE_3D;
+    if(info->imageType == VK_IMAGE_TYPE_1D)
+        return info->arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D;
+    return info->arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+}
+
+// Creates the transients of this frame and their aliased memory, unless the last frame
+// had the same ones. Their previous execution has finished, so the old ones can go right away.
+static void realize_transients(RenderGraph *graph) {
+    uint32_t *live = malloc(sizeof(uint32_t) * (graph->resource_count ? graph->resource_count : 1));
+    uint32_t live_count = 0;
+    for(uint32_t i = 0; i < graph->resource_count; ++i) {
+        if(graph->resources[i].transient && graph->resources[i].first_pass != GRAPH_NONE)
+            live[live_count++] = i;
+    }
+
+    char same = live_count == graph->transient_count;
+    for(uint32_t i = 0; i < live_count && same; ++i)
+        same = transient_matches(&graph->transients[i], &graph->resources[live[i]]);
+
+    if(!same) {
+        // New handles may have the same values as the destroyed ones, so caches of them go by this
+        ++graph->generation;
+        destroy_transients(graph);
+        for(uint32_t i = 0; i < live_count; ++i) {
+            GraphResource *resource = &graph->resources[live[i]];
+            if(resource->is_image) {
+                if(vkCreateImage(graph->device, &resource->image_info, NULL, &resource->image) != VK_SUCCESS) {
+                    fprintf(stderr, "Failed to create Vulkan image for render graph resource %s.\n", resource->name);
+                    exit(1);
+                }
+                vkGetImageMemoryRequirements(graph->device, resource->image, &resource->requirements);
+            } else {
+                VkBufferCreateInfo buffer_info = { 0 };
+                buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                buffer_info.size = resource->size;
+                buffer_info.usage = resource->usage;
+                buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                if(vkCreateBuffer(graph->device, &buffer_info, NULL, &resource->buffer) != VK_SUCCESS) {
+                    fprintf(stderr, "Failed to create Vulkan buffer for render graph resource %s.\n", resource->name);
+                    exit(1);
+                }
+                vkGetBufferMemoryRequirements(graph->device, resource->buffer, &resource->requirements);
+            }
+        }
+
+        place_transients(graph, live, live_count);
+        for(uint32_t h = 0; h < graph->heap_count; ++h)
+            graph->heaps[h].allocation = memory_allocate(graph->allocator, &graph->heaps[h].requirements, graph->heaps[h].optimal, MEMORY_USAGE_GPU_ONLY);
+
+        if(live_count > graph->transient_capacity) {
+            graph->transient_capacity = live_count;
+            graph->transients = realloc(graph->transients, sizeof(GraphTransient) * live_count);
+        }
+        for(uint32_t i = 0; i < live_count; ++i) {
+            GraphResource *resource = &graph->resources[live[i]];
+            const MemoryAllocation *allocation = &graph->heaps[resource->heap].allocation;
+            VkDeviceSize offset = allocation->offset + resource->offset;
+            if(resource->is_image) {
+                if(vkBindImageMemory(graph->device, resource->image, allocation->memory, offset) != VK_SUCCESS) {
+                    fprintf(stderr, "Failed to bind Vulkan image memory.\n");
+                    exit(1);
+                }
+                VkImageViewCreateInfo view_info = { 0 };
+                view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                view_info.image = resource->image;
+                view_info.viewType = view_type(&resource->image_info);
+                view_info.format = resource->image_info.format;
+                view_info.subresourceRange.aspectMask = resource->aspect;
+                view_info.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                view_info.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                if(vkCreateImageView(graph->device, &view_info, NULL, &resource->view) != VK_SUCCESS) {
+                    fprintf(stderr, "Failed to create Vulkan image view for render graph resource %s.\n", resource->name);
+                    exit(1);
+                }
+            } else if(vkBindBufferMemory(graph->device, resource->buffer, allocation->memory, offset) != VK_SUCCESS) {
+                fprintf(stderr, "Failed to bind Vulkan buffer memory.\n");
+                exit(1);
+            }
+
+            GraphTransient *transient = &graph->transients[i];
+            memset(transient, 0, sizeof(GraphTransient));
+            transient->is_image = resource->is_image;
+            transient->image_info = resource->image_info;
+            transient->aspect = resource->aspect;
+            transient->size = resource->size;
+            transient->usage = resource->usage;
+            transient->first_pass = resource->first_pass;
+            transient->last_pass = resource->last_pass;
+            transient->image = resource->image;
+            transient->view = resource->view;
+            transient->buffer = resource->buffer;
+            transient->heap = resource->heap;
+            transient->offset = resource->offset;
+            transient->requirements = resource->requirements;
+        }
+        graph->transient_count = live_count;
+    } else {
+        for(uint32_t i = 0; i < live_count; ++i) {
+            GraphResource *resource = &graph->resources[live[i]];
+            const GraphTransient *transient = &graph->transients[i];
+            resource->image = transient->image;
+            resource->view = transient->view;
+            resource->buffer = transient->buffer;
+            resource->heap = transient->heap;
+            resource->offset = transient->offset;
+            resource->requirements = transient->requirements;
+        }
+    }
+
+    graph->stats.transient_count = live_count;
+    graph->stats.transient_bytes = 0;
+    graph->stats.transient_allocated = 0;
+    for(uint32_t i = 0; i < live_count; ++i)
+        graph->stats.transient_bytes += graph->resources[live[i]].requirements.size;
+    for(uint32_t h = 0; h < graph->heap_count; ++h)
+        graph->stats.transient_allocated += graph->heaps[h].requirements.size;
+    free(live);
+}
+
+// Start of the barrier planning. A transient's memory may still be in use by the transients
+// it aliases, so its first use waits for everything they did.
+static void init_tracking(RenderGraph *graph) {
+    for(uint32_t i = 0; i < graph->resource_count; ++i) {
+        GraphResource *resource = &graph->resources[i];
+        resource->write_pass = GRAPH_NONE;
+        resource->read_stages = 0;
+        resource->visible_stages = 0;
+        resource->visible_access = 0;
+        if(!resource->transient) {
+            resource->layout = resource->initial.layout;
+            VkAccessFlags2 written = resource->initial.access & GRAPH_WRITE_ACCESS;
+            resource->write_stages = written ? resource->initial.stages : 0;
+            resource->write_access = written;
+            resource->read_stages = written ? 0 : resource->initial.stages;
+            continue;
+        }
+        resource->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        resource->write_stages = 0;
+        resource->write_access = 0;
+        if(resource->first_pass == GRAPH_NONE)
+            continue;
+        for(uint32_t j = 0; j < graph->resource_count; ++j) {
+            const GraphResource *other = &graph->resources[j];
+            if(j == i || !other->transient || other->heap != resource->heap || other->first_pass == GRAPH_NONE)
+                continue;
+            if(other->last_pass < resource->first_pass && ranges_overlap(other, resource)) {
+                resource->write_stages |= other->used_stages;
+                resource->write_access |= other->written_access;
+            }
+        }
+    }
+}
+
+static char batch_empty(const GraphBatch *batch) {
+    return !batch->has_memory && !batch->image_count;
+}
+
+static void add_memory_dependency(RenderGraph *graph, uint32_t batch, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+    VkMemoryBarrier2 *memory = &graph->batches[batch].memory;
+    memory->srcStageMask |= src_stages;
+    memory->srcAccessMask |= src_access;
+    memory->dstStageMask |= dst_stages;
+    memory->dstAccessMask |= dst_access;
+    graph->batches[batch].has_memory = 1;
+    ++graph->stats.memory_dependencies;
+}
+
+static void add_image_barrier(RenderGraph *graph, uint32_t batch, const GraphResource *resource, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+    VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access, VkImageLayout new_layout) {
+    graph->image_barriers = grow(graph->image_barriers, &graph->image_barrier_capacity, graph->image_barrier_count, sizeof(GraphImageBarrier));
+    GraphImageBarrier *entry = &graph->image_barriers[graph->image_barrier_count++];
+    memset(entry, 0, sizeof(GraphImageBarrier));
+    entry->batch = batch;
+    VkImageMemoryBarrier2 *barrier = &entry->barrier;
+    barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier->srcStageMask = src_stages;
+    barrier->srcAccessMask = src_access;
+    barrier->dstStageMask = dst_stages;
+    barrier->dstAccessMask = dst_access;
+    barrier->oldLayout = resource->layout;
+    barrier->newLayout = new_layout;
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->image = resource->image;
+    barrier->subresourceRange.aspectMask = resource->aspect;
+    barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    ++graph->batches[batch].image_count;
+}
+
+// A read only has to wait for the last write, so it can go in any batch after that write.
+// Joining one that is recorded anyway saves a barrier call.
+static uint32_t earliest_batch(const RenderGraph *graph, uint32_t write_pass, uint32_t batch) {
+    uint32_t first = write_pass == GRAPH_NONE ? 0 : write_pass + 1;
+    for(uint32_t b = first; b < batch; ++b) {
+        if(graph->passes[b].alive && !batch_empty(&graph->batches[b]))
+            return b;
+    }
+    return batch;
+}
+
+static void plan_access(RenderGraph *graph, uint32_t batch, const GraphAccess *access) {
+    GraphResource *resource = &graph->resources[access->resource];
+    char transition = resource->is_image && access->layout != VK_IMAGE_LAYOUT_UNDEFINED && access->layout != resource->layout;
+
+    if(!access->write && !transition) {
+        char waited = !(access->stages & ~resource->visible_stages) && !(access->access & ~resource->visible_access);
+        if(resource->write_stages && !waited) {
+            add_memory_dependency(graph, earliest_batch(graph, resource->write_pass, batch), resource->write_stages, resource->write_access, access->stages, access->access);
+            resource->visible_stages |= access->stages;
+            resource->visible_access |= access->access;
+        }
+        resource->read_stages |= access->stages;
+        return;
+    }
+
+    // Writes and layout changes have to wait for the reads since the last write as well
+    VkPipelineStageFlags2 src_stages = resource->write_stages | resource->read_stages;
+    if(transition)
+        add_image_barrier(graph, batch, resource, src_stages, resource->write_access, access->stages, access->access, access->layout);
+    else if(src_stages)
+        add_memory_dependency(graph, batch, src_stages, resource->write_access, access->stages, access->access);
+
+    // A layout change counts as a write, later readers in other stages have to wait for it
+    resource->write_pass = access->pass;
+    resource->write_stages = access->stages;
+    resource->write_access = access->write ? access->access & GRAPH_WRITE_ACCESS : 0;
+    resource->read_stages = access->write ? 0 : access->stages;
+    resource->visible_stages = access->write ? 0 : access->stages;
+    resource->visible_access = access->write ? 0 : access->access;
+    if(access->final_layout != VK_IMAGE_LAYOUT_UNDEFINED)
+        resource->layout = access->final_layout;
+}
+
+static void plan_final_state(RenderGraph *graph, uint32_t batch, GraphResource *resource) {
+    const RenderGraphState *final = &resource->final;
+    VkPipelineStageFlags2 src_stages = resource->write_stages | resource->read_stages;
+    if(final->layout != VK_IMAGE_LAYOUT_UNDEFINED && final->layout != resource->layout) {
+        add_image_barrier(graph, batch, resource, src_stages, resource->write_access, final->stages, final->access, final->layout);
+        resource->layout = final->layout;
+    } else if(final->access && resource->write_stages) {
+        char waited = !(final->stages & ~resource->visible_stages) && !(final->access & ~resource->visible_access);
+        if(!waited)
+            add_memory_dependency(graph, earliest_batch(graph, resource->write_pass, batch), resource->write_stages, resource->write_access, final->stages, final->access);
+    }
+}
+
+static void plan_barriers(RenderGraph *graph) {
+    uint32_t batch_count = graph->pass_count + 1;
+    if(batch_count > graph->batch_capacity) {
+        graph->batch_capacity = batch_count * 2;
+        graph->batches = realloc(graph->batches, sizeof(GraphBatch) * graph->batch_capacity);
+    }
+    memset(graph->batches, 0, sizeof(GraphBatch) * batch_count);
+    for(uint32_t b = 0; b < batch_count; ++b)
+        graph->batches[b].memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    graph->image_barrier_count = 0;
+
+    init_tracking(graph);
+    for(uint32_t p = 0; p < graph->pass_count; ++p) {
+        if(!graph->passes[p].alive)
+            continue;
+        for(uint32_t i = 0; i < graph->access_count; ++i) {
+            if(graph->accesses[i].pass == p)
+                plan_access(graph, p, &graph->accesses[i]);
+        }
+    }
+    for(uint32_t i = 0; i < graph->resource_count; ++i) {
+        GraphResource *resource = &graph->resources[i];
+        if(resource->exported && !resource->transient)
+            plan_final_state(graph, graph->pass_count, resource);
+    }
+
+    // Group the image barriers by batch so each call gets one contiguous array
+    graph->ordered_images = realloc(graph->ordered_images, sizeof(VkImageMemoryBarrier2) * (graph->image_barrier_capacity ? graph->image_barrier_capacity : 1));
+    uint32_t next = 0;
+    for(uint32_t b = 0; b < batch_count; ++b) {
+        graph->batches[b].first_image = next;
+        next += graph->batches[b].image_count;
+    }
+    uint32_t *cursor = malloc(sizeof(uint32_t) * batch_count);
+    for(uint32_t b = 0; b < batch_count; ++b)
+        cursor[b] = graph->batches[b].first_image;
+    for(uint32_t i = 0; i < graph->image_barrier_count; ++i)
+        graph->ordered_images[cursor[graph->image_barriers[i].batch]++] = graph->image_barriers[i].barrier;
+    free(cursor);
+
+    for(uint32_t b = 0; b < batch_count; ++b) {
+        const GraphBatch *batch = &graph->batches[b];
+        graph->stats.barrier_batches += !batch_empty(batch);
+        graph->stats.memory_barriers += batch->has_memory;
+        graph->stats.image_barriers += batch->image_count;
+    }
+}
+
+void render_graph_compile(RenderGraph *graph) {
+    RenderGraphStats stats = { 0 };
+    graph->stats = stats;
+    graph->stats.pass_count = graph->pass_count;
+
+    cull_passes(graph);
+    for(uint32_t p = 0; p < graph->pass_count; ++p)
+        graph->stats.culled_pass_count += !graph->passes[p].alive;
+    compute_lifetimes(graph);
+    realize_transients(graph);
+    plan_barriers(graph);
+}
+
+// Without synchronization2 everything in the batch shares one pair of stage masks
+static void record_batch_legacy(const RenderGraph *graph, VkCommandBuffer command_buffer, const GraphBatch *batch) {
+    VkPipelineStageFlags src_stages = 0;
+    VkPipelineStageFlags dst_stages = 0;
+    VkMemoryBarrier memory = { 0 };
+    memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if(batch->has_memory) {
+        memory.srcAccessMask = (VkAccessFlags)batch->memory.srcAccessMask;
+        memory.dstAccessMask = (VkAccessFlags)batch->memory.dstAccessMask;
+        src_stages |= (VkPipelineStageFlags)batch->memory.srcStageMask;
+        dst_stages |= (VkPipelineStageFlags)batch->memory.dstStageMask;
+    }
+    VkImageMemoryBarrier images[GRAPH_LEGACY_MAX_IMAGES];
+    if(batch->image_count > GRAPH_LEGACY_MAX_IMAGES) {
+        fprintf(stderr, "Render graph batch has more than %u image barriers.\n", GRAPH_LEGACY_MAX_IMAGES);
+        exit(1);
+    }
+    for(uint32_t i = 0; i < batch->image_count; ++i) {
+        const VkImageMemoryBarrier2 *barrier = &graph->ordered_images[batch->first_image + i];
+        images[i] = (VkImageMemoryBarrier){ 0 };
+        images[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        images[i].srcAccessMask = (VkAccessFlags)barrier->srcAccessMask;
+        images[i].dstAccessMask = (VkAccessFlags)barrier->dstAccessMask;
+        images[i].oldLayout = barrier->oldLayout;
+        images[i].newLayout = barrier->newLayout;
+        images[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        images[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        images[i].image = barrier->image;
+        images[i].subresourceRange = barrier->subresourceRange;
+        src_stages |= (VkPipelineStageFlags)barrier->srcStageMask;
+        dst_stages |= (VkPipelineStageFlags)barrier->dstStageMask;
+    }
+    vkCmdPipelineBarrier(command_buffer, src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stages ? dst_stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, batch->has_memory, &memory, 0, NULL, batch->image_count, images);
+}
+
+static void record_batch(const RenderGraph *graph, VkCommandBuffer command_buffer, const GraphBatch *batch) {
+    if(batch_empty(batch))
+        return;
+    if(!graph->synchronization2) {
+        record_batch_legacy(graph, command_buffer, batch);
+        return;
+    }
+    VkDependencyInfo dependency = { 0 };
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.memoryBarrierCount = batch->has_memory;
+    dependency.pMemoryBarriers = &batch->memory;
+    dependency.imageMemoryBarrierCount = batch->image_count;
+    dependency.pImageMemoryBarriers = &graph->ordered_images[batch->first_image];
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency);
+}
+
+void render_graph_execute(RenderGraph *graph, VkCommandBuffer command_buffer) {
+    for(uint32_t p = 0; p < graph->pass_count; ++p) {
+        if(!graph->passes[p].alive)
+            continue;
+        record_batch(graph, command_buffer, &graph->batches[p]);
+        graph->passes[p].fn(command_buffer, graph->passes[p].user_data);
+    }
+    record_batch(graph, command_buffer, &graph->batches[graph->pass_count]);
+}
+
+VkImage render_graph_image(const RenderGraph *graph, RenderGraphResource resource) {
+    return graph->resources[resource].image;
+}
+
+VkImageView render_graph_image_view(const RenderGraph *graph, RenderGraphResource resource) {
+    return graph->resources[resource].view;
+}
+
+VkBuffer render_graph_buffer(const RenderGraph *graph, RenderGraphResource resource) {
+    return graph->resources[resource].buffer;
+}
+
+uint64_t render_graph_generation(const RenderGraph *graph) {
+    return graph->generation;
+}
+
+RenderGraphStats render_graph_stats(const RenderGraph *graph) {
+    return graph->stats;
+}
+
+void render_graph_print_stats(const RenderGraph *graph) {
+    const RenderGraphStats *stats = &graph->stats;
+    printf("Render graph: %u passes, %u culled, %u barrier calls per frame (%u image barriers, %u memory barriers covering %u dependencies)\n",
+        stats->pass_count, stats->culled_pass_count, stats->barrier_batches, stats->image_barriers, stats->memory_barriers, stats->memory_dependencies);
+    printf("Render graph transients: %u, %.2f MB aliased into %.2f MB, %.2f MB saved\n", stats->transient_count,
+        stats->transient_bytes / (1024.0 * 1024.0), stats->transient_allocated / (1024.0 * 1024.0), (stats->transient_bytes - stats->transient_allocated) / (1024.0 * 1024.0));
+}
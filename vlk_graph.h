@@ -0,0 +1,87 @@
+#ifndef VLK_GRAPH_H
+#define VLK_GRAPH_H
+
+#include <volk.h>
+
+#include "vlk_memory.h"
+
+// A small render graph. Passes declare how they read and write images and buffers, and
+// compiling the graph derives the barriers between them: one vkCmdPipelineBarrier2 at
+// most before each pass. Only layout changes need image barriers, everything else is
+// merged into a single memory barrier. A dependency joins an earlier batch if one already
+// runs between the write and the pass.
+// Passes whose writes nothing ends up reading are dropped. Transient resources only live
+// within the graph and ones whose lifetimes don't overlap share memory.
+//
+// The graph is declared again every frame, which is cheap. Transients keep their memory
+// and handles for as long as every frame declares the same ones. Use one graph per frame
+// in flight, and only reset it once its previous execution has finished on the GPU.
+
+typedef struct RenderGraph RenderGraph;
+typedef uint32_t RenderGraphResource;
+typedef uint32_t RenderGraphPass;
+
+// How a resource is used before or after the graph. Stages 0 means nothing to wait for.
+typedef struct RenderGraphState {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+} RenderGraphState;
+
+typedef void (*RenderGraphPassFn)(VkCommandBuffer command_buffer, void *user_data);
+
+// Per frame, as of the last compile
+typedef struct RenderGraphStats {
+    uint32_t pass_count;
+    uint32_t culled_pass_count;
+    uint32_t barrier_batches; // vkCmdPipelineBarrier2 calls
+    uint32_t image_barriers;
+    uint32_t memory_barriers;
+    uint32_t memory_dependencies; // Dependencies without a layout change, merged into the memory barriers
+    uint32_t transient_count;
+    VkDeviceSize transient_bytes; // What the transients would take without aliasing
+    VkDeviceSize transient_allocated;
+} RenderGraphStats;
+
+// Without synchronization2 the barriers go through vkCmdPipelineBarrier, so only the
+// stage and access bits that exist there may be used
+RenderGraph *render_graph_create(VkDevice device, MemoryAllocator *allocator, char synchronization2);
+void render_graph_destroy(RenderGraph *graph);
+
+// Starts declaring a new frame
+void render_graph_reset(RenderGraph *graph);
+
+RenderGraphResource render_graph_import_image(RenderGraph *graph, const char *name, VkImage image, VkImageAspectFlags aspect, RenderGraphState initial);
+RenderGraphResource render_graph_import_buffer(RenderGraph *graph, const char *name, VkBuffer buffer, RenderGraphState initial);
+// Transients start out undefined every frame. Images get a view of the whole image.
+RenderGraphResource render_graph_create_image(RenderGraph *graph, const char *name, const VkImageCreateInfo *create_info, VkImageAspectFlags aspect);
+RenderGraphResource render_graph_create_buffer(RenderGraph *graph, const char *name, VkDeviceSize size, VkBufferUsageFlags usage);
+// The resource is used after the graph, so the passes writing it are kept. Imported
+// resources are left in final, a layout of UNDEFINED keeps the one they have.
+void render_graph_export(RenderGraph *graph, RenderGraphResource resource, RenderGraphState final);
+
+// Passes run in the order they are added
+RenderGraphPass render_graph_add_pass(RenderGraph *graph, const char *name, RenderGraphPassFn fn, void *user_data);
+void render_graph_read(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout);
+void render_graph_write(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout);
+// An attachment of a VkRenderPass that starts from UNDEFINED and ends in final_layout. The
+// render pass does the layout transitions, the graph only orders it against other passes.
+void render_graph_attachment(RenderGraph *graph, RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout final_layout);
+
+// Culls passes, places the transients and plans the barriers. Transient handles are valid
+// from here on.
+void render_graph_compile(RenderGraph *graph);
+void render_graph_execute(RenderGraph *graph, VkCommandBuffer command_buffer);
+
+VkImage render_graph_image(const RenderGraph *graph, RenderGraphResource resource);
+VkImageView render_graph_image_view(const RenderGraph *graph, RenderGraphResource resource);
+VkBuffer render_graph_buffer(const RenderGraph *graph, RenderGraphResource resource);
+
+// Changes whenever the transients were created again. Anything made from their handles,
+// like descriptor sets or framebuffers, is stale once it differs.
+uint64_t render_graph_generation(const RenderGraph *graph);
+
+RenderGraphStats render_graph_stats(const RenderGraph *graph);
+void render_graph_print_stats(const RenderGraph *graph);
+
+#endif // VLK_GRAPH_H
@@ -0,0 +1,109 @@
+#include "vlk_instances.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TWO_PI 6.28318530718f
+
+static float *alloc_stream(uint32_t count) {
+    float *stream = malloc(sizeof(float) * count);
+    if(!stream) {
+        fprintf(stderr, "Failed to allocate instance data.\n");
+        exit(1);
+    }
+    return stream;
+}
+
+// Small LCG so runs are reproducible for benchmarking
+static float random_float(uint32_t *state, float min, float max) {
+    *state = *state * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(*state >> 8) / (float)(1u << 24);
+}
+
+InstanceData instance_data_create(uint32_t count, uint32_t seed) {
+    InstanceData instances = { 0 };
+    instances.count = count;
+    instances.x = alloc_stream(count);
+    instances.y = alloc_stream(count);
+    instances.vx = alloc_stream(count);
+    instances.vy = alloc_stream(count);
+    instances.rotation = alloc_stream(count);
+    instances.spin = alloc_stream(count);
+    instances.scale = alloc_stream(count);
+    instances.color = malloc(sizeof(uint32_t) * count);
+    if(!instances.color) {
+        fprintf(stderr, "Failed to allocate instance data.\n");
+        exit(1);
+    }
+
+    // Smaller triangles the more there are, so the screen is covered but not buried
+    float scale = count > 1000 ? 0.05f : 0.2f;
+    if(count > 100000)
+        scale = 0.01f;
+    uint32_t state = seed;
+    for(uint32_t i = 0; i < count; ++i) {
+        instances.x[i] = random_float(&state, -1.0f, 1.0f);
+        instances.y[i] = random_float(&state, -1.0f, 1.0f);
+        instances.vx[i] = random_float(&state, -0.5f, 0.5f);
+        instances.vy[i] = random_float(&state, -0.5f, 0.5f);
+        instances.rotation[i] = random_float(&state, 0.0f, TWO_PI);
+        instances.spin[i] = random_float(&state, -3.0f, 3.0f);
+        instances.scale[i] = scale * random_float(&state, 0.5f, 1.5f);
+        state = state * 1664525u + 1013904223u;
+        instances.color[i] = (state >> 8) | 0xff000000u;
+    }
+    return instances;
+}
+
+void instance_data_destroy(InstanceData *instances) {
+    free(instances->x);
+    free(instances->y);
+    free(instances->vx);
+    free(instances->vy);
+    free(instances->rotation);
+    free(instances->spin);
+    free(instances->scale);
+    free(instances->color);
+    *instances = (InstanceData){ 0 };
+}
+
+void instance_data_update(InstanceData *instances, float dt) {
+    instance_data_update_range(instances, dt, 0, instances->count);
+}
+
+void instance_data_update_range(InstanceData *instances, float dt, uint32_t begin, uint32_t end) {
+    uint32_t count = end - begin;
+    float *restrict x = instances->x + begin;
+    float *restrict y = instances->y + begin;
+    float *restrict vx = instances->vx + begin;
+    float *restrict vy = instances->vy + begin;
+    float *restrict rotation = instances->rotation + begin;
+    const float *restrict spin = instances->spin + begin;
+
+    // Branch free loops over one or two streams each
+    for(uint32_t i = 0; i < count; ++i)
+        vx[i] = (x[i] < -1.0f && vx[i] < 0.0f) || (x[i] > 1.0f && vx[i] > 0.0f) ? -vx[i] : vx[i];
+    for(uint32_t i = 0; i < count; ++i)
+        vy[i] = (y[i] < -1.0f && vy[i] < 0.0f) || (y[i] > 1.0f && vy[i] > 0.0f) ? -vy[i] : vy[i];
+    for(uint32_t i = 0; i < count; ++i)
+        x[i] += vx[i] * dt;
+    for(uint32_t i = 0; i < count; ++i)
+        y[i] += vy[i] * dt;
+    for(uint32_t i = 0; i < count; ++i) {
+        float r = rotation[i] + spin[i] * dt;
+        rotation[i] = r > TWO_PI ? r - TWO_PI : (r < 0.0f ? r + TWO_PI : r);
+    }
+}
+
+void instance_data_write_transforms(const InstanceData *instances, float *dst) {
+    instance_data_write_transforms_range(instances, dst, 0, instances->count);
+}
+
+void instance_data_write_transforms_range(const InstanceData *instances, float *dst, uint32_t begin, uint32_t end) {
+    for(uint32_t i = begin; i < end; ++i) {
+        dst[i * 4 + 0] = instances->x[i];
+        dst[i * 4 + 1] = instances->y[i];
+        dst[i * 4 + 2] = instances->scale[i];
+        dst[i * 4 + 3] = instances->rotation[i];
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef VLK_INSTANCES_H
+#define VLK_INSTANCES_H
+
+#include <stdint.h>
+
+// Per instance state kept as structure of arrays, so the update loops touch only the
+// streams they need and vectorize. The GPU reads the packed layout written by
+// instance_data_write_transforms plus a static color per instance.
+typedef struct InstanceData {
+    uint32_t count;
+    float *x;
+    float *y;
+    float *vx;
+    float *vy;
+    float *rotation;
+    float *spin;
+    float *scale;
+    uint32_t *color; // RGBA8, unpacked with unpackUnorm4x8 in the shader
+} InstanceData;
+
+InstanceData instance_data_create(uint32_t count, uint32_t seed);
+void instance_data_destroy(InstanceData *instances);
+// Moves the instances across clip space, bouncing off the edges
+void instance_data_update(InstanceData *instances, float dt);
+// Writes a vec4(x, y, scale, rotation) per instance, dst is usually mapped GPU memory
+void instance_data_write_transforms(const InstanceData *instances, float *dst);
+// Both of the above for the instances in [begin, end), so ranges can go to different threads
+void instance_data_update_range(InstanceData *instances, float dt, uint32_t begin, uint32_t end);
+void instance_data_write_transforms_range(const InstanceData *instances, float *dst, uint32_t begin, uint32_t end);
+
+#endif // VLK_INSTANCES_H
@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, sched_yield
+
+#include "vlk_jobs.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Per worker, both powers of two. A full deque or pool runs the job right away instead.
+#define JOB_DEQUE_CAPACITY 4096
+#define JOB_POOL_CAPACITY 4096
+// Idle rounds spent spinning before a worker yields, and yielding before it sleeps
+#define JOB_SPIN_ROUNDS 64
+#define JOB_YIELD_ROUNDS 256
+#define JOB_MAX_BATCHES 256
+// Batches per worker in job_parallel_for, so uneven batches still balance out
+#define JOB_BATCHES_PER_WORKER 4
+
+typedef struct Job {
+    JobFn fn;
+    void *user_data;
+    JobCounter *counter;
+    struct Job *next; // In JobCounter.waiting
+    uint32_t in_use;
+} Job;
+
+#define CACHE_LINE 64
+
+// Chase-Lev deque, with the C11 memory orders of Le et al. 2013. It doesn't grow. Thieves
+// write top and the owner bottom, so they get a cache line each.
+typedef struct JobDeque {
+    int64_t top;
+    char top_line[CACHE_LINE - sizeof(int64_t)];
+    int64_t bottom;
+    char bottom_line[CACHE_LINE - sizeof(int64_t)];
+    Job *jobs[JOB_DEQUE_CAPACITY];
+} JobDeque;
+
+typedef struct JobWorker {
+    JobSystem *system;
+    uint32_t index;
+    pthread_t thread;
+    JobDeque deque;
+    Job pool[JOB_POOL_CAPACITY];
+    uint32_t pool_next;
+    uint32_t victim; // Where the next steal attempt starts
+    uint32_t depth; // Jobs running on this thread, nested through job_wait
+    uint64_t busy_start;
+    // Written by the worker, read by job_system_get_stats
+    uint64_t jobs_run;
+    uint64_t jobs_stolen;
+    uint64_t busy_ns;
+} JobWorker;
+
+struct JobSystem {
+    uint32_t worker_count;
+    JobWorker *workers;
+    // Jobs pushed and not yet taken, plus workers asleep waiting for them
+    int32_t queued;
+    uint32_t sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    char stopping;
+    // Counters at the last reset
+    uint64_t reset_ns;
+    JobWorkerStats *baseline;
+};
+
+static __thread JobWorker *current_worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Spins first, then gives the core to whoever holds the work being waited for
+static void backoff(uint32_t *rounds) {
+    if(*rounds < JOB_SPIN_ROUNDS)
+        cpu_relax();
+    else
+        sched_yield();
+    ++*rounds;
+}
+
+static char deque_push(JobDeque *deque, Job *job) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if(bottom - top >= JOB_DEQUE_CAPACITY)
+        return 0;
+    __atomic_store_n(&deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)], job, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Owner only
+static Job *deque_pop(JobDeque *deque) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    Job *job = NULL;
+    if(top <= bottom) {
+        job = __atomic_load_n(&deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+        if(top == bottom) {
+            // The last job, a thief may be taking it at the same time
+            if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                job = NULL;
+            __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static Job *deque_steal(JobDeque *deque) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if(top >= bottom)
+        return NULL;
+    Job *job = __atomic_load_n(&deque->jobs[top & (JOB_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return job;
+}
+
+static void counter_lock(JobCounter *counter) {
+    uint32_t rounds = 0;
+    while(__atomic_exchange_n(&counter->lock, 1, __ATOMIC_ACQUIRE))
+        backoff(&rounds);
+}
+
+static void counter_unlock(JobCounter *counter) {
+    __atomic_store_n(&counter->lock, 0, __ATOMIC_RELEASE);
+}
+
+static JobWorker *get_worker(JobSystem *jobs) {
+    JobWorker *worker = current_worker;
+    if(!worker || worker->system != jobs) {
+        fprintf(stderr, "Failed to queue job, the thread is not a worker of this job system.\n");
+        exit(1);
+    }
+    return worker;
+}
+
+// Slots are handed out in order. One that is still in use means the worker has more
+// jobs in flight than the pool holds, and the caller runs the job itself.
+static Job *alloc_job(JobWorker *worker, JobFn fn, void *user_data, JobCounter *counter) {
+    Job *job = &worker->pool[worker->pool_next & (JOB_POOL_CAPACITY - 1)];
+    if(__atomic_load_n(&job->in_use, __ATOMIC_ACQUIRE))
+        return NULL;
+    ++worker->pool_next;
+    job->fn = fn;
+    job->user_data = user_data;
+    job->counter = counter;
+    job->next = NULL;
+    job->in_use = 1;
+    return job;
+}
+
+static void run_job(JobWorker *worker, JobFn fn, void *user_data, JobCounter *counter);
+
+static void push_job(JobWorker *worker, Job *job) {
+    JobSystem *jobs = worker->system;
+    __atomic_add_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+    if(!deque_push(&worker->deque, job)) {
+        __atomic_sub_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+        JobFn fn = job->fn;
+        void *user_data = job->user_data;
+        JobCounter *counter = job->counter;
+        __atomic_store_n(&job->in_use, 0, __ATOMIC_RELEASE);
+        run_job(worker, fn, user_data, counter);
+        return;
+    }
+    // Pairs with the sleeping count a worker raises before it checks queued
+    if(__atomic_load_n(&jobs->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&jobs->mutex);
+        pthread_cond_signal(&jobs->wake);
+        pthread_mutex_unlock(&jobs->mutex);
+    }
+}
+
+static void finish_job(JobWorker *worker, JobCounter *counter) {
+    if(!counter)
+        return;
+    // Under the lock, so job_wait can't return and free the counter while it's still used
+    counter_lock(counter);
+    Job *waiting = NULL;
+    if(__atomic_sub_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        waiting = counter->waiting;
+        counter->waiting = NULL;
+    }
+    counter_unlock(counter);
+    while(waiting) {
+        Job *next = waiting->next;
+        push_job(worker, waiting);
+        waiting = next;
+    }
+}
+
+static void run_job(JobWorker *worker, JobFn fn, void *user_data, JobCounter *counter) {
+    // Time spent in nested jobs is already part of the outer one
+    if(worker->depth++ == 0)
+        worker->busy_start = now_ns();
+    fn(user_data, worker->index);
+    if(--worker->depth == 0)
+        __atomic_store_n(&worker->busy_ns, worker->busy_ns + (now_ns() - worker->busy_start), __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->jobs_run, worker->jobs_run + 1, __ATOMIC_RELAXED);
+    finish_job(worker, counter);
+}
+
+static char try_run_job(JobWorker *worker) {
+    JobSystem *jobs = worker->system;
+    Job *job = deque_pop(&worker->deque);
+    char stolen = 0;
+    for(uint32_t i = 1; !job && i < jobs->worker_count; ++i) {
+        uint32_t victim = (worker->victim + i) % jobs->worker_count;
+        if(victim == worker->index)
+            continue;
+        job = deque_steal(&jobs->workers[victim].deque);
+        if(job) {
+            // Come back to the same victim first, it probably has more
+            worker->victim = (victim + jobs->worker_count - 1) % jobs->worker_count;
+            stolen = 1;
+        }
+    }
+    if(!job)
+        return 0;
+
+    __atomic_sub_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+    if(stolen)
+        __atomic_store_n(&worker->jobs_stolen, worker->jobs_stolen + 1, __ATOMIC_RELAXED);
+    // Copied out first, the slot can be reused as soon as it's released
+    JobFn fn = job->fn;
+    void *user_data = job->user_data;
+    JobCounter *counter = job->counter;
+    __atomic_store_n(&job->in_use, 0, __ATOMIC_RELEASE);
+    run_job(worker, fn, user_data, counter);
+    return 1;
+}
+
+static void *job_worker_main(void *arg) {
+    JobWorker *worker = arg;
+    JobSystem *jobs = worker->system;
+    current_worker = worker;
+    uint32_t rounds = 0;
+    for(;;) {
+        if(try_run_job(worker)) {
+            rounds = 0;
+            continue;
+        }
+        if(rounds < JOB_SPIN_ROUNDS + JOB_YIELD_ROUNDS) {
+            backoff(&rounds);
+            continue;
+        }
+        rounds = 0;
+
+        pthread_mutex_lock(&jobs->mutex);
+        __atomic_add_fetch(&jobs->sleeping, 1, __ATOMIC_SEQ_CST);
+        while(!jobs->stopping && __atomic_load_n(&jobs->queued, __ATOMIC_SEQ_CST) <= 0)
+            pthread_cond_wait(&jobs->wake, &jobs->mutex);
+        __atomic_sub_fetch(&jobs->sleeping, 1, __ATOMIC_SEQ_CST);
+        char stopping = jobs->stopping;
+        pthread_mutex_unlock(&jobs->mutex);
+        if(stopping)
+            break;
+    }
+    return NULL;
+}
+
+JobSystem *job_system_create(uint32_t worker_count) {
+    if(worker_count < 1 || worker_count > JOB_MAX_WORKERS) {
+        fprintf(stderr, "Failed to create job system, worker count must be 1 to %u.\n", JOB_MAX_WORKERS);
+        exit(1);
+    }
+    if(current_worker) {
+        fprintf(stderr, "Failed to create job system, the thread already belongs to one.\n");
+        exit(1);
+    }
+    JobSystem *jobs = calloc(1, sizeof(JobSystem));
+    jobs->workers = calloc(worker_count, sizeof(JobWorker));
+    jobs->baseline = calloc(worker_count, sizeof(JobWorkerStats));
+    if(!jobs->workers || !jobs->baseline) {
+        fprintf(stderr, "Failed to allocate job system.\n");
+        exit(1);
+    }
+    jobs->worker_count = worker_count;
+    pthread_mutex_init(&jobs->mutex, NULL);
+    pthread_cond_init(&jobs->wake, NULL);
+    jobs->reset_ns = now_ns();
+
+    for(uint32_t i = 0; i < worker_count; ++i) {
+        jobs->workers[i].system = jobs;
+        jobs->workers[i].index = i;
+        jobs->workers[i].victim = i;
+    }
+    current_worker = &jobs->workers[0];
+    for(uint32_t i = 1; i < worker_count; ++i) {
+        if(pthread_create(&jobs->workers[i].thread, NULL, job_worker_main, &jobs->workers[i]) != 0) {
+            fprintf(stderr, "Failed to create job worker thread.\n");
+            exit(1);
+        }
+    }
+    return jobs;
+}
+
+void job_system_destroy(JobSystem *jobs) {
+    pthread_mutex_lock(&jobs->mutex);
+    jobs->stopping = 1;
+    pthread_cond_broadcast(&jobs->wake);
+    pthread_mutex_unlock(&jobs->mutex);
+    for(uint32_t i = 1; i < jobs->worker_count; ++i)
+        pthread_join(jobs->workers[i].thread, NULL);
+    if(current_worker == &jobs->workers[0])
+        current_worker = NULL;
+    pthread_cond_destroy(&jobs->wake);
+    pthread_mutex_destroy(&jobs->mutex);
+    free(jobs->baseline);
+    free(jobs->workers);
+    free(jobs);
+}
+
+uint32_t job_system_worker_count(const JobSystem *jobs) {
+    return jobs->worker_count;
+}
+
+void job_run(JobSystem *jobs, JobFn fn, void *user_data, JobCounter *counter) {
+    job_run_after(jobs, fn, user_data, counter, NULL);
+}
+
+void job_run_after(JobSystem *jobs, JobFn fn, void *user_data, JobCounter *counter, JobCounter *after) {
+    JobWorker *worker = get_worker(jobs);
+    if(counter)
+        __atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+
+    Job *job = alloc_job(worker, fn, user_data, counter);
+    if(!job) {
+        if(after)
+            job_wait(jobs, after);
+        run_job(worker, fn, user_data, counter);
+        return;
+    }
+    if(after) {
+        counter_lock(after);
+        if(__atomic_load_n(&after->pending, __ATOMIC_ACQUIRE)) {
+            job->next = after->waiting;
+            after->waiting = job;
+            counter_unlock(after);
+            return;
+        }
+        counter_unlock(after);
+    }
+    push_job(worker, job);
+}
+
+void job_wait(JobSystem *jobs, JobCounter *counter) {
+    JobWorker *worker = get_worker(jobs);
+    uint32_t rounds = 0;
+    // The lock is checked too, the last job may not be done with the counter yet
+    while(__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) || __atomic_load_n(&counter->lock, __ATOMIC_ACQUIRE)) {
+        if(try_run_job(worker))
+            rounds = 0;
+        else
+            backoff(&rounds);
+    }
+}
+
+typedef struct JobBatch {
+    JobRangeFn fn;
+    void *user_data;
+    uint32_t begin;
+    uint32_t end;
+} JobBatch;
+
+static void run_batch(void *user_data, uint32_t worker_index) {
+    JobBatch *batch = user_data;
+    batch->fn(batch->user_data, batch->begin, batch->end, worker_index);
+}
+
+void job_parallel_for(JobSystem *jobs, uint32_t count, uint32_t min_batch, JobRangeFn fn, void *user_data) {
+    if(!count)
+        return;
+    if(min_batch < 1)
+        min_batch = 1;
+    uint32_t batch_count = (count + min_batch - 1) / min_batch;
+    uint32_t max_batches = jobs->worker_count * JOB_BATCHES_PER_WORKER;
+    if(max_batches > JOB_MAX_BATCHES)
+        max_batches = JOB_MAX_BATCHES;
+    if(batch_count > max_batches)
+        batch_count = max_batches;
+
+    JobBatch batches[JOB_MAX_BATCHES];
+    uint32_t begin = 0;
+    for(uint32_t i = 0; i < batch_count; ++i) {
+        uint32_t end = (uint32_t)((uint64_t)count * (i + 1) / batch_count);
+        batches[i] = (JobBatch){ fn, user_data, begin, end };
+        begin = end;
+    }
+    // The caller takes the first batch itself instead of waiting for a thief
+    JobCounter counter = { 0 };
+    for(uint32_t i = 1; i < batch_count; ++i)
+        job_run(jobs, run_batch, &batches[i], &counter);
+    run_job(get_worker(jobs), run_batch, &batches[0], NULL);
+    job_wait(jobs, &counter);
+}
+
+static JobWorkerStats worker_stats(const JobWorker *worker) {
+    JobWorkerStats stats = { 0 };
+    stats.jobs_run = __atomic_load_n(&worker->jobs_run, __ATOMIC_RELAXED);
+    stats.jobs_stolen = __atomic_load_n(&worker->jobs_stolen, __ATOMIC_RELAXED);
+    stats.busy_ms = __atomic_load_n(&worker->busy_ns, __ATOMIC_RELAXED) * 1e-6;
+    return stats;
+}
+
+void job_system_get_stats(const JobSystem *jobs, JobWorkerStats *stats) {
+    double elapsed_ms = (now_ns() - jobs->reset_ns) * 1e-6;
+    for(uint32_t i = 0; i < jobs->worker_count; ++i) {
+        JobWorkerStats current = worker_stats(&jobs->workers[i]);
+        stats[i].jobs_run = current.jobs_run - jobs->baseline[i].jobs_run;
+        stats[i].jobs_stolen = current.jobs_stolen - jobs->baseline[i].jobs_stolen;
+        stats[i].busy_ms = current.busy_ms - jobs->baseline[i].busy_ms;
+        stats[i].utilization = elapsed_ms > 0.0 ? stats[i].busy_ms / elapsed_ms : 0.0;
+    }
+}
+
+void job_system_reset_stats(JobSystem *jobs) {
+    for(uint32_t i = 0; i < jobs->worker_count; ++i)
+        jobs->baseline[i] = worker_stats(&jobs->workers[i]);
+    jobs->reset_ns = now_ns();
+}
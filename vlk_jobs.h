@@ -0,0 +1,58 @@
+#ifndef VLK_JOBS_H
+#define VLK_JOBS_H
+
+#include <stdint.h>
+
+// Work stealing job scheduler. Every worker owns a Chase-Lev deque: it pushes and pops
+// jobs at the bottom while idle workers steal from the top of the others. The thread that
+// creates the system is worker 0 and runs jobs whenever it waits for some, so waiting
+// never idles a core. Jobs may queue more jobs and wait for them.
+//
+// Unlike ThreadPool (vlk_threads.h) there is no shared queue or lock on the hot path,
+// which is what frame work split into many small jobs needs.
+
+#define JOB_MAX_WORKERS 64
+
+typedef void (*JobFn)(void *user_data, uint32_t worker_index);
+// Runs [begin, end) of a job_parallel_for
+typedef void (*JobRangeFn)(void *user_data, uint32_t begin, uint32_t end, uint32_t worker_index);
+
+// Unfinished jobs of a group. Zero initialize it, pass it to job_run and wait on it. Jobs
+// can also be queued to start once a counter drops to zero.
+typedef struct JobCounter {
+    uint32_t pending;
+    uint32_t lock;
+    struct Job *waiting;
+} JobCounter;
+
+typedef struct JobWorkerStats {
+    uint64_t jobs_run;
+    uint64_t jobs_stolen; // Of jobs_run, the ones taken from another worker's deque
+    double busy_ms;
+    double utilization; // busy_ms over the time since the last reset
+} JobWorkerStats;
+
+typedef struct JobSystem JobSystem;
+
+// worker_count includes the calling thread, so 1 runs everything on it
+JobSystem *job_system_create(uint32_t worker_count);
+// No jobs may be left running
+void job_system_destroy(JobSystem *jobs);
+uint32_t job_system_worker_count(const JobSystem *jobs);
+
+// Can be called from worker 0 and from inside jobs. counter may be NULL.
+void job_run(JobSystem *jobs, JobFn fn, void *user_data, JobCounter *counter);
+// Same, but the job only starts once after reaches zero
+void job_run_after(JobSystem *jobs, JobFn fn, void *user_data, JobCounter *counter, JobCounter *after);
+// Runs jobs until counter reaches zero
+void job_wait(JobSystem *jobs, JobCounter *counter);
+
+// Splits [0, count) into batches of at least min_batch, runs them on all workers and
+// returns once they are all done
+void job_parallel_for(JobSystem *jobs, uint32_t count, uint32_t min_batch, JobRangeFn fn, void *user_data);
+
+// One entry per worker, counted since creation or the last reset. Call from worker 0.
+void job_system_get_stats(const JobSystem *jobs, JobWorkerStats *stats);
+void job_system_reset_stats(JobSystem *jobs);
+
+#endif // VLK_JOBS_H
@@ -0,0 +1,218 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "vlk_math.h"
+#include "vlk_math_isa.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+// Reference versions. The SIMD kernels do the same multiplies and adds in the same order,
+// so they only differ from these where a compiler fuses them into FMAs.
+
+static void mat4_mul_one(float *d, const float *a, const float *b) {
+    for(int c = 0; c < 4; ++c)
+        for(int r = 0; r < 4; ++r)
+            d[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+}
+
+static void mat4_mul_vec4_one(float *d, const float *m, const float *v) {
+    for(int r = 0; r < 4; ++r)
+        d[r] = m[r] * v[0] + m[4 + r] * v[1] + m[8 + r] * v[2] + m[12 + r] * v[3];
+}
+
+static void quat_to_mat4_one(float *d, float x, float y, float z, float w) {
+    float x2 = x + x, y2 = y + y, z2 = z + z;
+    float xx = x * x2, yy = y * y2, zz = z * z2;
+    float xy = x * y2, xz = x * z2, yz = y * z2;
+    float wx = w * x2, wy = w * y2, wz = w * z2;
+    d[0] = 1.0f - (yy + zz);
+    d[1] = xy + wz;
+    d[2] = xz - wy;
+    d[3] = 0.0f;
+    d[4] = xy - wz;
+    d[5] = 1.0f - (xx + zz);
+    d[6] = yz + wx;
+    d[7] = 0.0f;
+    d[8] = xz + wy;
+    d[9] = yz - wx;
+    d[10] = 1.0f - (xx + yy);
+    d[11] = 0.0f;
+    d[12] = 0.0f;
+    d[13] = 0.0f;
+    d[14] = 0.0f;
+    d[15] = 1.0f;
+}
+
+// Transforms the center and sums the extents along the absolute matrix, which gives the
+// tight bounds of the transformed box without touching its eight corners
+static void aabb_transform_one(float *dst_min, float *dst_max, const float *m, const float *min, const float *max) {
+    float center[3], extent[3];
+    for(int k = 0; k < 3; ++k) {
+        center[k] = (min[k] + max[k]) * 0.5f;
+        extent[k] = (max[k] - min[k]) * 0.5f;
+    }
+    for(int r = 0; r < 3; ++r) {
+        float c = m[r] * center[0] + m[4 + r] * center[1] + m[8 + r] * center[2] + m[12 + r];
+        float e = fabsf(m[r]) * extent[0] + fabsf(m[4 + r]) * extent[1] + fabsf(m[8 + r]) * extent[2];
+        dst_min[r] = c - e;
+        dst_max[r] = c + e;
+    }
+}
+
+static void scalar_mat4_mul_aos(Mat4 *dst, const Mat4 *a, const Mat4 *b, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i)
+        mat4_mul_one(dst[i].m, a[i].m, b[i].m);
+}
+
+static void scalar_mat4_mul_soa(const Mat4Soa *dst, const Mat4Soa *a, const Mat4Soa *b, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float x[16], y[16], d[16];
+        for(int k = 0; k < 16; ++k) {
+            x[k] = a->m[k][i];
+            y[k] = b->m[k][i];
+        }
+        mat4_mul_one(d, x, y);
+        for(int k = 0; k < 16; ++k)
+            dst->m[k][i] = d[k];
+    }
+}
+
+static void scalar_mat4_mul_vec4_aos(Vec4 *dst, const Mat4 *m, const Vec4 *v, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i)
+        mat4_mul_vec4_one(&dst[i].x, m->m, &v[i].x);
+}
+
+static void scalar_mat4_mul_vec4_soa(const Vec4Soa *dst, const Mat4 *m, const Vec4Soa *v, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float x[4] = { v->x[i], v->y[i], v->z[i], v->w[i] };
+        float d[4];
+        mat4_mul_vec4_one(d, m->m, x);
+        dst->x[i] = d[0];
+        dst->y[i] = d[1];
+        dst->z[i] = d[2];
+        dst->w[i] = d[3];
+    }
+}
+
+static void scalar_quat_to_mat4_aos(Mat4 *dst, const Quat *q, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i)
+        quat_to_mat4_one(dst[i].m, q[i].x, q[i].y, q[i].z, q[i].w);
+}
+
+static void scalar_quat_to_mat4_soa(const Mat4Soa *dst, const QuatSoa *q, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float d[16];
+        quat_to_mat4_one(d, q->x[i], q->y[i], q->z[i], q->w[i]);
+        for(int k = 0; k < 16; ++k)
+            dst->m[k][i] = d[k];
+    }
+}
+
+static void scalar_aabb_transform_aos(Aabb *dst, const Mat4 *m, const Aabb *src, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i)
+        aabb_transform_one(dst[i].min, dst[i].max, m->m, src[i].min, src[i].max);
+}
+
+static void scalar_aabb_transform_soa(const AabbSoa *dst, const Mat4 *m, const AabbSoa *src, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float min[3], max[3], dst_min[3], dst_max[3];
+        for(int k = 0; k < 3; ++k) {
+            min[k] = src->min[k][i];
+            max[k] = src->max[k][i];
+        }
+        aabb_transform_one(dst_min, dst_max, m->m, min, max);
+        for(int k = 0; k < 3; ++k) {
+            dst->min[k][i] = dst_min[k];
+            dst->max[k][i] = dst_max[k];
+        }
+    }
+}
+
+const MathKernels math_kernels_scalar = {
+    .isa = MATH_ISA_SCALAR,
+    .mat4_mul_aos = scalar_mat4_mul_aos,
+    .mat4_mul_soa = scalar_mat4_mul_soa,
+    .mat4_mul_vec4_aos = scalar_mat4_mul_vec4_aos,
+    .mat4_mul_vec4_soa = scalar_mat4_mul_vec4_soa,
+    .quat_to_mat4_aos = scalar_quat_to_mat4_aos,
+    .quat_to_mat4_soa = scalar_quat_to_mat4_soa,
+    .aabb_transform_aos = scalar_aabb_transform_aos,
+    .aabb_transform_soa = scalar_aabb_transform_soa,
+};
+
+#if defined(__x86_64__)
+static char cpu_has_sse2(void) {
+    unsigned eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx & bit_SSE2) != 0;
+}
+
+static char cpu_has_avx2(void) {
+    unsigned eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    if(!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+        return 0;
+    // The OS has to save the YMM registers on context switches, not just the XMM ones
+    unsigned xcr0, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    if((xcr0 & 6) != 6)
+        return 0;
+    if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (ebx & bit_AVX2) != 0;
+}
+#endif
+
+const MathKernels *math_kernels_for(MathIsa isa) {
+    switch(isa) {
+    case MATH_ISA_SCALAR:
+        return &math_kernels_scalar;
+#if defined(__x86_64__)
+    case MATH_ISA_SSE2:
+        return cpu_has_sse2() ? &math_kernels_sse2 : NULL;
+    case MATH_ISA_AVX2:
+        return cpu_has_avx2() ? &math_kernels_avx2 : NULL;
+#endif
+#if defined(__aarch64__)
+    // Advanced SIMD is part of every AArch64 CPU, 32-bit ARM uses the scalar kernels
+    case MATH_ISA_NEON:
+        return &math_kernels_neon;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const MathKernels *math_kernels(void) {
+    // Threads racing through the first call all store the same pointer
+    static const MathKernels *best;
+    if(!best) {
+        const MathKernels *found = &math_kernels_scalar;
+        for(int isa = MATH_ISA_SCALAR + 1; isa < MATH_ISA_COUNT; ++isa) {
+            const MathKernels *kernels = math_kernels_for((MathIsa)isa);
+            if(kernels)
+                found = kernels;
+        }
+        best = found;
+    }
+    return best;
+}
+
+const char *math_isa_name(MathIsa isa) {
+    switch(isa) {
+    case MATH_ISA_SCALAR:
+        return "scalar";
+    case MATH_ISA_SSE2:
+        return "SSE2";
+    case MATH_ISA_AVX2:
+        return "AVX2";
+    case MATH_ISA_NEON:
+        return "NEON";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef VLK_MATH_H
+#define VLK_MATH_H
+
+#include <stdint.h>
+
+// Batched transform math. Every operation has a scalar reference version plus SSE2, AVX2
+// and NEON versions, and math_kernels() picks the widest one the CPU supports at runtime.
+// The batches are plain arrays, so dst can point straight into mapped upload memory.
+// Nothing needs to be aligned, and dst must not overlap the inputs.
+//
+// Matrices are column major like in GLSL, m[column * 4 + row]. The AoS functions take
+// arrays of the structs below. The SoA ones take one array per component, so
+// Mat4Soa.m[5][i] is column 1, row 1 of matrix i.
+
+typedef struct Mat4 {
+    float m[16];
+} Mat4;
+
+typedef struct Vec4 {
+    float x, y, z, w;
+} Vec4;
+
+typedef struct Quat {
+    float x, y, z, w;
+} Quat;
+
+typedef struct Aabb {
+    float min[3];
+    float max[3];
+} Aabb;
+
+typedef struct Mat4Soa {
+    float *m[16];
+} Mat4Soa;
+
+typedef struct Vec4Soa {
+    float *x, *y, *z, *w;
+} Vec4Soa;
+
+typedef struct QuatSoa {
+    float *x, *y, *z, *w;
+} QuatSoa;
+
+typedef struct AabbSoa {
+    float *min[3];
+    float *max[3];
+} AabbSoa;
+
+// Narrowest first, math_kernels() takes the last one that is available
+typedef enum MathIsa {
+    MATH_ISA_SCALAR,
+    MATH_ISA_SSE2,
+    MATH_ISA_AVX2,
+    MATH_ISA_NEON,
+    MATH_ISA_COUNT
+} MathIsa;
+
+typedef struct MathKernels {
+    MathIsa isa;
+    // dst[i] = a[i] * b[i]
+    void (*mat4_mul_aos)(Mat4 *dst, const Mat4 *a, const Mat4 *b, uint32_t count);
+    void (*mat4_mul_soa)(const Mat4Soa *dst, const Mat4Soa *a, const Mat4Soa *b, uint32_t count);
+    // dst[i] = m * v[i]
+    void (*mat4_mul_vec4_aos)(Vec4 *dst, const Mat4 *m, const Vec4 *v, uint32_t count);
+    void (*mat4_mul_vec4_soa)(const Vec4Soa *dst, const Mat4 *m, const Vec4Soa *v, uint32_t count);
+    // Rotation matrices of unit quaternions
+    void (*quat_to_mat4_aos)(Mat4 *dst, const Quat *q, uint32_t count);
+    void (*quat_to_mat4_soa)(const Mat4Soa *dst, const QuatSoa *q, uint32_t count);
+    // Bounds of the boxes transformed by m, which has to be affine
+    void (*aabb_transform_aos)(Aabb *dst, const Mat4 *m, const Aabb *src, uint32_t count);
+    void (*aabb_transform_soa)(const AabbSoa *dst, const Mat4 *m, const AabbSoa *src, uint32_t count);
+} MathKernels;
+
+// The best kernels for this CPU, detected on the first call
+const MathKernels *math_kernels(void);
+// The kernels of one ISA, NULL when this build or CPU can't run them
+const MathKernels *math_kernels_for(MathIsa isa);
+const char *math_isa_name(MathIsa isa);
+
+#endif // VLK_MATH_H
@@ -0,0 +1,44 @@
+#ifndef VLK_MATH_ISA_H
+#define VLK_MATH_ISA_H
+
+#include "vlk_math.h"
+
+// Shared by the vlk_math*.c files. The SIMD kernels hand the elements left over after
+// their last full vector to the scalar ones.
+
+extern const MathKernels math_kernels_scalar;
+#if defined(__x86_64__)
+extern const MathKernels math_kernels_sse2;
+extern const MathKernels math_kernels_avx2;
+#endif
+#if defined(__aarch64__)
+extern const MathKernels math_kernels_neon;
+#endif
+
+static inline Mat4Soa mat4_soa_offset(const Mat4Soa *s, uint32_t first) {
+    Mat4Soa r;
+    for(int k = 0; k < 16; ++k)
+        r.m[k] = s->m[k] + first;
+    return r;
+}
+
+static inline Vec4Soa vec4_soa_offset(const Vec4Soa *s, uint32_t first) {
+    Vec4Soa r = { s->x + first, s->y + first, s->z + first, s->w + first };
+    return r;
+}
+
+static inline QuatSoa quat_soa_offset(const QuatSoa *s, uint32_t first) {
+    QuatSoa r = { s->x + first, s->y + first, s->z + first, s->w + first };
+    return r;
+}
+
+static inline AabbSoa aabb_soa_offset(const AabbSoa *s, uint32_t first) {
+    AabbSoa r;
+    for(int k = 0; k < 3; ++k) {
+        r.min[k] = s->min[k] + first;
+        r.max[k] = s->max[k] + first;
+    }
+    return r;
+}
+
+#endif // VLK_MATH_ISA_H
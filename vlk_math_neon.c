@@ -0,0 +1,247 @@
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#include "vlk_math.h"
+#include "vlk_math_isa.h"
+
+// Same structure as the SSE2 kernels. They don't use vfmaq either, so the results follow
+// the scalar order of multiplies and adds.
+
+static inline float32x4_t mul_lane(float32x4_t a, float32x4_t v, int lane) {
+    switch(lane) {
+    case 0:
+        return vmulq_lane_f32(a, vget_low_f32(v), 0);
+    case 1:
+        return vmulq_lane_f32(a, vget_low_f32(v), 1);
+    case 2:
+        return vmulq_lane_f32(a, vget_high_f32(v), 0);
+    default:
+        return vmulq_lane_f32(a, vget_high_f32(v), 1);
+    }
+}
+
+static inline void transpose4(float32x4_t *r) {
+    float32x4x2_t t01 = vtrnq_f32(r[0], r[1]);
+    float32x4x2_t t23 = vtrnq_f32(r[2], r[3]);
+    r[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+static void neon_mat4_mul_aos(Mat4 *dst, const Mat4 *a, const Mat4 *b, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        float32x4_t a0 = vld1q_f32(a[i].m);
+        float32x4_t a1 = vld1q_f32(a[i].m + 4);
+        float32x4_t a2 = vld1q_f32(a[i].m + 8);
+        float32x4_t a3 = vld1q_f32(a[i].m + 12);
+        for(int c = 0; c < 4; ++c) {
+            float32x4_t col = vld1q_f32(b[i].m + c * 4);
+            float32x4_t r = mul_lane(a0, col, 0);
+            r = vaddq_f32(r, mul_lane(a1, col, 1));
+            r = vaddq_f32(r, mul_lane(a2, col, 2));
+            r = vaddq_f32(r, mul_lane(a3, col, 3));
+            vst1q_f32(dst[i].m + c * 4, r);
+        }
+    }
+}
+
+static void neon_mat4_mul_soa(const Mat4Soa *dst, const Mat4Soa *a, const Mat4Soa *b, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        for(int c = 0; c < 4; ++c) {
+            float32x4_t b0 = vld1q_f32(b->m[c * 4] + i);
+            float32x4_t b1 = vld1q_f32(b->m[c * 4 + 1] + i);
+            float32x4_t b2 = vld1q_f32(b->m[c * 4 + 2] + i);
+            float32x4_t b3 = vld1q_f32(b->m[c * 4 + 3] + i);
+            for(int r = 0; r < 4; ++r) {
+                float32x4_t v = vmulq_f32(vld1q_f32(a->m[r] + i), b0);
+                v = vaddq_f32(v, vmulq_f32(vld1q_f32(a->m[4 + r] + i), b1));
+                v = vaddq_f32(v, vmulq_f32(vld1q_f32(a->m[8 + r] + i), b2));
+                v = vaddq_f32(v, vmulq_f32(vld1q_f32(a->m[12 + r] + i), b3));
+                vst1q_f32(dst->m[c * 4 + r] + i, v);
+            }
+        }
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i), x = mat4_soa_offset(a, i), y = mat4_soa_offset(b, i);
+        math_kernels_scalar.mat4_mul_soa(&d, &x, &y, count - i);
+    }
+}
+
+static void neon_mat4_mul_vec4_aos(Vec4 *dst, const Mat4 *m, const Vec4 *v, uint32_t count) {
+    float32x4_t c0 = vld1q_f32(m->m);
+    float32x4_t c1 = vld1q_f32(m->m + 4);
+    float32x4_t c2 = vld1q_f32(m->m + 8);
+    float32x4_t c3 = vld1q_f32(m->m + 12);
+    for(uint32_t i = 0; i < count; ++i) {
+        float32x4_t x = vld1q_f32(&v[i].x);
+        float32x4_t r = mul_lane(c0, x, 0);
+        r = vaddq_f32(r, mul_lane(c1, x, 1));
+        r = vaddq_f32(r, mul_lane(c2, x, 2));
+        r = vaddq_f32(r, mul_lane(c3, x, 3));
+        vst1q_f32(&dst[i].x, r);
+    }
+}
+
+static void neon_mat4_mul_vec4_soa(const Vec4Soa *dst, const Mat4 *m, const Vec4Soa *v, uint32_t count) {
+    float *out[4] = { dst->x, dst->y, dst->z, dst->w };
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(v->x + i);
+        float32x4_t y = vld1q_f32(v->y + i);
+        float32x4_t z = vld1q_f32(v->z + i);
+        float32x4_t w = vld1q_f32(v->w + i);
+        for(int r = 0; r < 4; ++r) {
+            float32x4_t o = vmulq_f32(vdupq_n_f32(m->m[r]), x);
+            o = vaddq_f32(o, vmulq_f32(vdupq_n_f32(m->m[4 + r]), y));
+            o = vaddq_f32(o, vmulq_f32(vdupq_n_f32(m->m[8 + r]), z));
+            o = vaddq_f32(o, vmulq_f32(vdupq_n_f32(m->m[12 + r]), w));
+            vst1q_f32(out[r] + i, o);
+        }
+    }
+    if(i < count) {
+        Vec4Soa d = vec4_soa_offset(dst, i), x = vec4_soa_offset(v, i);
+        math_kernels_scalar.mat4_mul_vec4_soa(&d, m, &x, count - i);
+    }
+}
+
+typedef struct QuatRotation4 {
+    float32x4_t m[3][3];
+} QuatRotation4;
+
+static inline QuatRotation4 neon_quat_rotation(float32x4_t x, float32x4_t y, float32x4_t z, float32x4_t w) {
+    float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t x2 = vaddq_f32(x, x), y2 = vaddq_f32(y, y), z2 = vaddq_f32(z, z);
+    float32x4_t xx = vmulq_f32(x, x2), yy = vmulq_f32(y, y2), zz = vmulq_f32(z, z2);
+    float32x4_t xy = vmulq_f32(x, y2), xz = vmulq_f32(x, z2), yz = vmulq_f32(y, z2);
+    float32x4_t wx = vmulq_f32(w, x2), wy = vmulq_f32(w, y2), wz = vmulq_f32(w, z2);
+    QuatRotation4 r;
+    r.m[0][0] = vsubq_f32(one, vaddq_f32(yy, zz));
+    r.m[0][1] = vaddq_f32(xy, wz);
+    r.m[0][2] = vsubq_f32(xz, wy);
+    r.m[1][0] = vsubq_f32(xy, wz);
+    r.m[1][1] = vsubq_f32(one, vaddq_f32(xx, zz));
+    r.m[1][2] = vaddq_f32(yz, wx);
+    r.m[2][0] = vaddq_f32(xz, wy);
+    r.m[2][1] = vsubq_f32(yz, wx);
+    r.m[2][2] = vsubq_f32(one, vaddq_f32(xx, yy));
+    return r;
+}
+
+static void neon_quat_to_mat4_aos(Mat4 *dst, const Quat *q, uint32_t count) {
+    const float last_values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float32x4_t last = vld1q_f32(last_values);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        // vld4 deinterleaves the four quaternions into x, y, z and w
+        float32x4x4_t v = vld4q_f32(&q[i].x);
+        QuatRotation4 r = neon_quat_rotation(v.val[0], v.val[1], v.val[2], v.val[3]);
+        for(int c = 0; c < 3; ++c) {
+            float32x4_t col[4] = { r.m[c][0], r.m[c][1], r.m[c][2], vdupq_n_f32(0.0f) };
+            transpose4(col);
+            for(int k = 0; k < 4; ++k)
+                vst1q_f32(dst[i + k].m + c * 4, col[k]);
+        }
+        for(int k = 0; k < 4; ++k)
+            vst1q_f32(dst[i + k].m + 12, last);
+    }
+    if(i < count)
+        math_kernels_scalar.quat_to_mat4_aos(dst + i, q + i, count - i);
+}
+
+static void neon_quat_to_mat4_soa(const Mat4Soa *dst, const QuatSoa *q, uint32_t count) {
+    float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        QuatRotation4 r = neon_quat_rotation(vld1q_f32(q->x + i), vld1q_f32(q->y + i), vld1q_f32(q->z + i), vld1q_f32(q->w + i));
+        for(int c = 0; c < 3; ++c) {
+            for(int k = 0; k < 3; ++k)
+                vst1q_f32(dst->m[c * 4 + k] + i, r.m[c][k]);
+            vst1q_f32(dst->m[c * 4 + 3] + i, zero);
+        }
+        vst1q_f32(dst->m[12] + i, zero);
+        vst1q_f32(dst->m[13] + i, zero);
+        vst1q_f32(dst->m[14] + i, zero);
+        vst1q_f32(dst->m[15] + i, one);
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i);
+        QuatSoa x = quat_soa_offset(q, i);
+        math_kernels_scalar.quat_to_mat4_soa(&d, &x, count - i);
+    }
+}
+
+static void neon_aabb_transform_aos(Aabb *dst, const Mat4 *m, const Aabb *src, uint32_t count) {
+    float32x4_t c0 = vld1q_f32(m->m);
+    float32x4_t c1 = vld1q_f32(m->m + 4);
+    float32x4_t c2 = vld1q_f32(m->m + 8);
+    float32x4_t c3 = vld1q_f32(m->m + 12);
+    float32x4_t a0 = vabsq_f32(c0), a1 = vabsq_f32(c1), a2 = vabsq_f32(c2);
+    float32x4_t half = vdupq_n_f32(0.5f);
+    for(uint32_t i = 0; i < count; ++i) {
+        const float *s = (const float *)(src + i);
+        float *d = (float *)(dst + i);
+        // Both loads stay inside the box: min0 min1 min2 max0 and min2 max0 max1 max2
+        float32x4_t min = vld1q_f32(s);
+        float32x4_t max = vld1q_f32(s + 2);
+        max = vextq_f32(max, max, 1);
+        float32x4_t center = vmulq_f32(vaddq_f32(min, max), half);
+        float32x4_t extent = vmulq_f32(vsubq_f32(max, min), half);
+        float32x4_t c = mul_lane(c0, center, 0);
+        c = vaddq_f32(c, mul_lane(c1, center, 1));
+        c = vaddq_f32(c, mul_lane(c2, center, 2));
+        c = vaddq_f32(c, c3);
+        float32x4_t e = mul_lane(a0, extent, 0);
+        e = vaddq_f32(e, mul_lane(a1, extent, 1));
+        e = vaddq_f32(e, mul_lane(a2, extent, 2));
+        float32x4_t lo = vsubq_f32(c, e);
+        float32x4_t hi = vaddq_f32(c, e);
+        vst1q_f32(d, vsetq_lane_f32(vgetq_lane_f32(hi, 0), lo, 3));
+        vst1_f32(d + 4, vget_low_f32(vextq_f32(hi, hi, 1)));
+    }
+}
+
+static void neon_aabb_transform_soa(const AabbSoa *dst, const Mat4 *m, const AabbSoa *src, uint32_t count) {
+    float32x4_t half = vdupq_n_f32(0.5f);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        float32x4_t center[3], extent[3];
+        for(int k = 0; k < 3; ++k) {
+            float32x4_t min = vld1q_f32(src->min[k] + i);
+            float32x4_t max = vld1q_f32(src->max[k] + i);
+            center[k] = vmulq_f32(vaddq_f32(min, max), half);
+            extent[k] = vmulq_f32(vsubq_f32(max, min), half);
+        }
+        for(int r = 0; r < 3; ++r) {
+            float32x4_t c = vmulq_f32(vdupq_n_f32(m->m[r]), center[0]);
+            c = vaddq_f32(c, vmulq_f32(vdupq_n_f32(m->m[4 + r]), center[1]));
+            c = vaddq_f32(c, vmulq_f32(vdupq_n_f32(m->m[8 + r]), center[2]));
+            c = vaddq_f32(c, vdupq_n_f32(m->m[12 + r]));
+            float32x4_t e = vmulq_f32(vabsq_f32(vdupq_n_f32(m->m[r])), extent[0]);
+            e = vaddq_f32(e, vmulq_f32(vabsq_f32(vdupq_n_f32(m->m[4 + r])), extent[1]));
+            e = vaddq_f32(e, vmulq_f32(vabsq_f32(vdupq_n_f32(m->m[8 + r])), extent[2]));
+            vst1q_f32(dst->min[r] + i, vsubq_f32(c, e));
+            vst1q_f32(dst->max[r] + i, vaddq_f32(c, e));
+        }
+    }
+    if(i < count) {
+        AabbSoa d = aabb_soa_offset(dst, i), s = aabb_soa_offset(src, i);
+        math_kernels_scalar.aabb_transform_soa(&d, m, &s, count - i);
+    }
+}
+
+const MathKernels math_kernels_neon = {
+    .isa = MATH_ISA_NEON,
+    .mat4_mul_aos = neon_mat4_mul_aos,
+    .mat4_mul_soa = neon_mat4_mul_soa,
+    .mat4_mul_vec4_aos = neon_mat4_mul_vec4_aos,
+    .mat4_mul_vec4_soa = neon_mat4_mul_vec4_soa,
+    .quat_to_mat4_aos = neon_quat_to_mat4_aos,
+    .quat_to_mat4_soa = neon_quat_to_mat4_soa,
+    .aabb_transform_aos = neon_aabb_transform_aos,
+    .aabb_transform_soa = neon_aabb_transform_soa,
+};
+
+#endif // __aarch64__
@@ -0,0 +1,452 @@
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+#include "vlk_math.h"
+#include "vlk_math_isa.h"
+
+// SSE2 is part of x86-64. The AVX2 kernels are compiled for it with a target attribute, so
+// the rest of the program still runs on CPUs without it and math_kernels_for() decides.
+#define AVX2 __attribute__((target("avx2")))
+
+#define SPLAT(v, i) _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+#define SPLAT8(v, i) _mm256_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+
+static void sse2_mat4_mul_aos(Mat4 *dst, const Mat4 *a, const Mat4 *b, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        __m128 a0 = _mm_loadu_ps(a[i].m);
+        __m128 a1 = _mm_loadu_ps(a[i].m + 4);
+        __m128 a2 = _mm_loadu_ps(a[i].m + 8);
+        __m128 a3 = _mm_loadu_ps(a[i].m + 12);
+        for(int c = 0; c < 4; ++c) {
+            __m128 col = _mm_loadu_ps(b[i].m + c * 4);
+            __m128 r = _mm_mul_ps(a0, SPLAT(col, 0));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, SPLAT(col, 1)));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, SPLAT(col, 2)));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, SPLAT(col, 3)));
+            _mm_storeu_ps(dst[i].m + c * 4, r);
+        }
+    }
+}
+
+static void sse2_mat4_mul_soa(const Mat4Soa *dst, const Mat4Soa *a, const Mat4Soa *b, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        for(int c = 0; c < 4; ++c) {
+            __m128 b0 = _mm_loadu_ps(b->m[c * 4] + i);
+            __m128 b1 = _mm_loadu_ps(b->m[c * 4 + 1] + i);
+            __m128 b2 = _mm_loadu_ps(b->m[c * 4 + 2] + i);
+            __m128 b3 = _mm_loadu_ps(b->m[c * 4 + 3] + i);
+            for(int r = 0; r < 4; ++r) {
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(a->m[r] + i), b0);
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(a->m[4 + r] + i), b1));
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(a->m[8 + r] + i), b2));
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(a->m[12 + r] + i), b3));
+                _mm_storeu_ps(dst->m[c * 4 + r] + i, v);
+            }
+        }
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i), x = mat4_soa_offset(a, i), y = mat4_soa_offset(b, i);
+        math_kernels_scalar.mat4_mul_soa(&d, &x, &y, count - i);
+    }
+}
+
+static void sse2_mat4_mul_vec4_aos(Vec4 *dst, const Mat4 *m, const Vec4 *v, uint32_t count) {
+    __m128 c0 = _mm_loadu_ps(m->m);
+    __m128 c1 = _mm_loadu_ps(m->m + 4);
+    __m128 c2 = _mm_loadu_ps(m->m + 8);
+    __m128 c3 = _mm_loadu_ps(m->m + 12);
+    for(uint32_t i = 0; i < count; ++i) {
+        __m128 x = _mm_loadu_ps(&v[i].x);
+        __m128 r = _mm_mul_ps(c0, SPLAT(x, 0));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, SPLAT(x, 1)));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, SPLAT(x, 2)));
+        r = _mm_add_ps(r, _mm_mul_ps(c3, SPLAT(x, 3)));
+        _mm_storeu_ps(&dst[i].x, r);
+    }
+}
+
+static void sse2_mat4_mul_vec4_soa(const Vec4Soa *dst, const Mat4 *m, const Vec4Soa *v, uint32_t count) {
+    float *out[4] = { dst->x, dst->y, dst->z, dst->w };
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(v->x + i);
+        __m128 y = _mm_loadu_ps(v->y + i);
+        __m128 z = _mm_loadu_ps(v->z + i);
+        __m128 w = _mm_loadu_ps(v->w + i);
+        for(int r = 0; r < 4; ++r) {
+            __m128 o = _mm_mul_ps(_mm_set1_ps(m->m[r]), x);
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(m->m[4 + r]), y));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(m->m[8 + r]), z));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(m->m[12 + r]), w));
+            _mm_storeu_ps(out[r] + i, o);
+        }
+    }
+    if(i < count) {
+        Vec4Soa d = vec4_soa_offset(dst, i), x = vec4_soa_offset(v, i);
+        math_kernels_scalar.mat4_mul_vec4_soa(&d, m, &x, count - i);
+    }
+}
+
+// The upper 3x3 of four rotation matrices, one register per element
+typedef struct QuatRotation4 {
+    __m128 m[3][3];
+} QuatRotation4;
+
+static inline QuatRotation4 sse2_quat_rotation(__m128 x, __m128 y, __m128 z, __m128 w) {
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+    __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+    QuatRotation4 r;
+    r.m[0][0] = _mm_sub_ps(one, _mm_add_ps(yy, zz));
+    r.m[0][1] = _mm_add_ps(xy, wz);
+    r.m[0][2] = _mm_sub_ps(xz, wy);
+    r.m[1][0] = _mm_sub_ps(xy, wz);
+    r.m[1][1] = _mm_sub_ps(one, _mm_add_ps(xx, zz));
+    r.m[1][2] = _mm_add_ps(yz, wx);
+    r.m[2][0] = _mm_add_ps(xz, wy);
+    r.m[2][1] = _mm_sub_ps(yz, wx);
+    r.m[2][2] = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+    return r;
+}
+
+static void sse2_quat_to_mat4_aos(Mat4 *dst, const Quat *q, uint32_t count) {
+    __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&q[i].x);
+        __m128 y = _mm_loadu_ps(&q[i + 1].x);
+        __m128 z = _mm_loadu_ps(&q[i + 2].x);
+        __m128 w = _mm_loadu_ps(&q[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        QuatRotation4 r = sse2_quat_rotation(x, y, z, w);
+        // Transposing a column's rows back gives that column of each matrix
+        for(int c = 0; c < 3; ++c) {
+            __m128 c0 = r.m[c][0], c1 = r.m[c][1], c2 = r.m[c][2], c3 = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _mm_storeu_ps(dst[i].m + c * 4, c0);
+            _mm_storeu_ps(dst[i + 1].m + c * 4, c1);
+            _mm_storeu_ps(dst[i + 2].m + c * 4, c2);
+            _mm_storeu_ps(dst[i + 3].m + c * 4, c3);
+        }
+        for(int k = 0; k < 4; ++k)
+            _mm_storeu_ps(dst[i + k].m + 12, last);
+    }
+    if(i < count)
+        math_kernels_scalar.quat_to_mat4_aos(dst + i, q + i, count - i);
+}
+
+static void sse2_quat_to_mat4_soa(const Mat4Soa *dst, const QuatSoa *q, uint32_t count) {
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        QuatRotation4 r = sse2_quat_rotation(_mm_loadu_ps(q->x + i), _mm_loadu_ps(q->y + i), _mm_loadu_ps(q->z + i), _mm_loadu_ps(q->w + i));
+        for(int c = 0; c < 3; ++c) {
+            for(int k = 0; k < 3; ++k)
+                _mm_storeu_ps(dst->m[c * 4 + k] + i, r.m[c][k]);
+            _mm_storeu_ps(dst->m[c * 4 + 3] + i, zero);
+        }
+        _mm_storeu_ps(dst->m[12] + i, zero);
+        _mm_storeu_ps(dst->m[13] + i, zero);
+        _mm_storeu_ps(dst->m[14] + i, zero);
+        _mm_storeu_ps(dst->m[15] + i, one);
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i);
+        QuatSoa x = quat_soa_offset(q, i);
+        math_kernels_scalar.quat_to_mat4_soa(&d, &x, count - i);
+    }
+}
+
+static inline __m128 sse2_abs(__m128 v) {
+    return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+}
+
+// One box per iteration. The boxes are 24 bytes, so wider registers wouldn't line up with
+// them, and AVX2 uses this as well. The SoA version is the one that scales.
+static void sse2_aabb_transform_aos(Aabb *dst, const Mat4 *m, const Aabb *src, uint32_t count) {
+    __m128 c0 = _mm_loadu_ps(m->m);
+    __m128 c1 = _mm_loadu_ps(m->m + 4);
+    __m128 c2 = _mm_loadu_ps(m->m + 8);
+    __m128 c3 = _mm_loadu_ps(m->m + 12);
+    __m128 a0 = sse2_abs(c0), a1 = sse2_abs(c1), a2 = sse2_abs(c2);
+    __m128 half = _mm_set1_ps(0.5f);
+    for(uint32_t i = 0; i < count; ++i) {
+        const float *s = (const float *)(src + i);
+        float *d = (float *)(dst + i);
+        // Both loads stay inside the box: min0 min1 min2 max0 and min2 max0 max1 max2
+        __m128 min = _mm_loadu_ps(s);
+        __m128 max = _mm_loadu_ps(s + 2);
+        max = _mm_shuffle_ps(max, max, _MM_SHUFFLE(3, 3, 2, 1));
+        __m128 center = _mm_mul_ps(_mm_add_ps(min, max), half);
+        __m128 extent = _mm_mul_ps(_mm_sub_ps(max, min), half);
+        __m128 c = _mm_mul_ps(c0, SPLAT(center, 0));
+        c = _mm_add_ps(c, _mm_mul_ps(c1, SPLAT(center, 1)));
+        c = _mm_add_ps(c, _mm_mul_ps(c2, SPLAT(center, 2)));
+        c = _mm_add_ps(c, c3);
+        __m128 e = _mm_mul_ps(a0, SPLAT(extent, 0));
+        e = _mm_add_ps(e, _mm_mul_ps(a1, SPLAT(extent, 1)));
+        e = _mm_add_ps(e, _mm_mul_ps(a2, SPLAT(extent, 2)));
+        __m128 lo = _mm_sub_ps(c, e);
+        __m128 hi = _mm_add_ps(c, e);
+        __m128 mid = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(0, 0, 2, 2));
+        _mm_storeu_ps(d, _mm_shuffle_ps(lo, mid, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storel_pi((__m64 *)(d + 4), _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 1)));
+    }
+}
+
+static void sse2_aabb_transform_soa(const AabbSoa *dst, const Mat4 *m, const AabbSoa *src, uint32_t count) {
+    __m128 half = _mm_set1_ps(0.5f);
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 center[3], extent[3];
+        for(int k = 0; k < 3; ++k) {
+            __m128 min = _mm_loadu_ps(src->min[k] + i);
+            __m128 max = _mm_loadu_ps(src->max[k] + i);
+            center[k] = _mm_mul_ps(_mm_add_ps(min, max), half);
+            extent[k] = _mm_mul_ps(_mm_sub_ps(max, min), half);
+        }
+        for(int r = 0; r < 3; ++r) {
+            __m128 c = _mm_mul_ps(_mm_set1_ps(m->m[r]), center[0]);
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(m->m[4 + r]), center[1]));
+            c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(m->m[8 + r]), center[2]));
+            c = _mm_add_ps(c, _mm_set1_ps(m->m[12 + r]));
+            __m128 e = _mm_mul_ps(sse2_abs(_mm_set1_ps(m->m[r])), extent[0]);
+            e = _mm_add_ps(e, _mm_mul_ps(sse2_abs(_mm_set1_ps(m->m[4 + r])), extent[1]));
+            e = _mm_add_ps(e, _mm_mul_ps(sse2_abs(_mm_set1_ps(m->m[8 + r])), extent[2]));
+            _mm_storeu_ps(dst->min[r] + i, _mm_sub_ps(c, e));
+            _mm_storeu_ps(dst->max[r] + i, _mm_add_ps(c, e));
+        }
+    }
+    if(i < count) {
+        AabbSoa d = aabb_soa_offset(dst, i), s = aabb_soa_offset(src, i);
+        math_kernels_scalar.aabb_transform_soa(&d, m, &s, count - i);
+    }
+}
+
+const MathKernels math_kernels_sse2 = {
+    .isa = MATH_ISA_SSE2,
+    .mat4_mul_aos = sse2_mat4_mul_aos,
+    .mat4_mul_soa = sse2_mat4_mul_soa,
+    .mat4_mul_vec4_aos = sse2_mat4_mul_vec4_aos,
+    .mat4_mul_vec4_soa = sse2_mat4_mul_vec4_soa,
+    .quat_to_mat4_aos = sse2_quat_to_mat4_aos,
+    .quat_to_mat4_soa = sse2_quat_to_mat4_soa,
+    .aabb_transform_aos = sse2_aabb_transform_aos,
+    .aabb_transform_soa = sse2_aabb_transform_soa,
+};
+
+// Both halves of each product use the same a columns, b supplies two columns at a time
+AVX2 static void avx2_mat4_mul_aos(Mat4 *dst, const Mat4 *a, const Mat4 *b, uint32_t count) {
+    for(uint32_t i = 0; i < count; ++i) {
+        __m256 a0 = _mm256_broadcast_ps((const __m128 *)a[i].m);
+        __m256 a1 = _mm256_broadcast_ps((const __m128 *)(a[i].m + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128 *)(a[i].m + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128 *)(a[i].m + 12));
+        for(int c = 0; c < 4; c += 2) {
+            __m256 cols = _mm256_loadu_ps(b[i].m + c * 4);
+            __m256 r = _mm256_mul_ps(a0, SPLAT8(cols, 0));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a1, SPLAT8(cols, 1)));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a2, SPLAT8(cols, 2)));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a3, SPLAT8(cols, 3)));
+            _mm256_storeu_ps(dst[i].m + c * 4, r);
+        }
+    }
+}
+
+AVX2 static void avx2_mat4_mul_soa(const Mat4Soa *dst, const Mat4Soa *a, const Mat4Soa *b, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        for(int c = 0; c < 4; ++c) {
+            __m256 b0 = _mm256_loadu_ps(b->m[c * 4] + i);
+            __m256 b1 = _mm256_loadu_ps(b->m[c * 4 + 1] + i);
+            __m256 b2 = _mm256_loadu_ps(b->m[c * 4 + 2] + i);
+            __m256 b3 = _mm256_loadu_ps(b->m[c * 4 + 3] + i);
+            for(int r = 0; r < 4; ++r) {
+                __m256 v = _mm256_mul_ps(_mm256_loadu_ps(a->m[r] + i), b0);
+                v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(a->m[4 + r] + i), b1));
+                v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(a->m[8 + r] + i), b2));
+                v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(a->m[12 + r] + i), b3));
+                _mm256_storeu_ps(dst->m[c * 4 + r] + i, v);
+            }
+        }
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i), x = mat4_soa_offset(a, i), y = mat4_soa_offset(b, i);
+        math_kernels_scalar.mat4_mul_soa(&d, &x, &y, count - i);
+    }
+}
+
+// Two vectors per iteration, one in each 128-bit half
+AVX2 static void avx2_mat4_mul_vec4_aos(Vec4 *dst, const Mat4 *m, const Vec4 *v, uint32_t count) {
+    __m256 c0 = _mm256_broadcast_ps((const __m128 *)m->m);
+    __m256 c1 = _mm256_broadcast_ps((const __m128 *)(m->m + 4));
+    __m256 c2 = _mm256_broadcast_ps((const __m128 *)(m->m + 8));
+    __m256 c3 = _mm256_broadcast_ps((const __m128 *)(m->m + 12));
+    uint32_t i = 0;
+    for(; i + 2 <= count; i += 2) {
+        __m256 x = _mm256_loadu_ps(&v[i].x);
+        __m256 r = _mm256_mul_ps(c0, SPLAT8(x, 0));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c1, SPLAT8(x, 1)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c2, SPLAT8(x, 2)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c3, SPLAT8(x, 3)));
+        _mm256_storeu_ps(&dst[i].x, r);
+    }
+    if(i < count)
+        math_kernels_scalar.mat4_mul_vec4_aos(dst + i, m, v + i, count - i);
+}
+
+AVX2 static void avx2_mat4_mul_vec4_soa(const Vec4Soa *dst, const Mat4 *m, const Vec4Soa *v, uint32_t count) {
+    float *out[4] = { dst->x, dst->y, dst->z, dst->w };
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(v->x + i);
+        __m256 y = _mm256_loadu_ps(v->y + i);
+        __m256 z = _mm256_loadu_ps(v->z + i);
+        __m256 w = _mm256_loadu_ps(v->w + i);
+        for(int r = 0; r < 4; ++r) {
+            __m256 o = _mm256_mul_ps(_mm256_set1_ps(m->m[r]), x);
+            o = _mm256_add_ps(o, _mm256_mul_ps(_mm256_set1_ps(m->m[4 + r]), y));
+            o = _mm256_add_ps(o, _mm256_mul_ps(_mm256_set1_ps(m->m[8 + r]), z));
+            o = _mm256_add_ps(o, _mm256_mul_ps(_mm256_set1_ps(m->m[12 + r]), w));
+            _mm256_storeu_ps(out[r] + i, o);
+        }
+    }
+    if(i < count) {
+        Vec4Soa d = vec4_soa_offset(dst, i), x = vec4_soa_offset(v, i);
+        math_kernels_scalar.mat4_mul_vec4_soa(&d, m, &x, count - i);
+    }
+}
+
+typedef struct QuatRotation8 {
+    __m256 m[3][3];
+} QuatRotation8;
+
+AVX2 static inline QuatRotation8 avx2_quat_rotation(__m256 x, __m256 y, __m256 z, __m256 w) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+    __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+    __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+    __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+    QuatRotation8 r;
+    r.m[0][0] = _mm256_sub_ps(one, _mm256_add_ps(yy, zz));
+    r.m[0][1] = _mm256_add_ps(xy, wz);
+    r.m[0][2] = _mm256_sub_ps(xz, wy);
+    r.m[1][0] = _mm256_sub_ps(xy, wz);
+    r.m[1][1] = _mm256_sub_ps(one, _mm256_add_ps(xx, zz));
+    r.m[1][2] = _mm256_add_ps(yz, wx);
+    r.m[2][0] = _mm256_add_ps(xz, wy);
+    r.m[2][1] = _mm256_sub_ps(yz, wx);
+    r.m[2][2] = _mm256_sub_ps(one, _mm256_add_ps(xx, yy));
+    return r;
+}
+
+// _MM_TRANSPOSE4_PS within each 128-bit half
+AVX2 static inline void avx2_transpose4_halves(__m256 *r) {
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t2 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    r[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    r[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    r[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    r[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Eight quaternions per iteration. Each register loads two of them, so after the
+// transpose the low halves hold the even ones and the high halves the odd ones.
+AVX2 static void avx2_quat_to_mat4_aos(Mat4 *dst, const Quat *q, uint32_t count) {
+    __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 v[4];
+        for(int k = 0; k < 4; ++k)
+            v[k] = _mm256_loadu_ps(&q[i + k * 2].x);
+        avx2_transpose4_halves(v);
+        QuatRotation8 r = avx2_quat_rotation(v[0], v[1], v[2], v[3]);
+        for(int c = 0; c < 3; ++c) {
+            __m256 col[4] = { r.m[c][0], r.m[c][1], r.m[c][2], _mm256_setzero_ps() };
+            avx2_transpose4_halves(col);
+            for(int k = 0; k < 4; ++k) {
+                _mm_storeu_ps(dst[i + k * 2].m + c * 4, _mm256_castps256_ps128(col[k]));
+                _mm_storeu_ps(dst[i + k * 2 + 1].m + c * 4, _mm256_extractf128_ps(col[k], 1));
+            }
+        }
+        for(int k = 0; k < 8; ++k)
+            _mm_storeu_ps(dst[i + k].m + 12, last);
+    }
+    if(i < count)
+        math_kernels_scalar.quat_to_mat4_aos(dst + i, q + i, count - i);
+}
+
+AVX2 static void avx2_quat_to_mat4_soa(const Mat4Soa *dst, const QuatSoa *q, uint32_t count) {
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        QuatRotation8 r = avx2_quat_rotation(_mm256_loadu_ps(q->x + i), _mm256_loadu_ps(q->y + i), _mm256_loadu_ps(q->z + i), _mm256_loadu_ps(q->w + i));
+        for(int c = 0; c < 3; ++c) {
+            for(int k = 0; k < 3; ++k)
+                _mm256_storeu_ps(dst->m[c * 4 + k] + i, r.m[c][k]);
+            _mm256_storeu_ps(dst->m[c * 4 + 3] + i, zero);
+        }
+        _mm256_storeu_ps(dst->m[12] + i, zero);
+        _mm256_storeu_ps(dst->m[13] + i, zero);
+        _mm256_storeu_ps(dst->m[14] + i, zero);
+        _mm256_storeu_ps(dst->m[15] + i, one);
+    }
+    if(i < count) {
+        Mat4Soa d = mat4_soa_offset(dst, i);
+        QuatSoa x = quat_soa_offset(q, i);
+        math_kernels_scalar.quat_to_mat4_soa(&d, &x, count - i);
+    }
+}
+
+AVX2 static inline __m256 avx2_abs(__m256 v) {
+    return _mm256_and_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+}
+
+AVX2 static void avx2_aabb_transform_soa(const AabbSoa *dst, const Mat4 *m, const AabbSoa *src, uint32_t count) {
+    __m256 half = _mm256_set1_ps(0.5f);
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 center[3], extent[3];
+        for(int k = 0; k < 3; ++k) {
+            __m256 min = _mm256_loadu_ps(src->min[k] + i);
+            __m256 max = _mm256_loadu_ps(src->max[k] + i);
+            center[k] = _mm256_mul_ps(_mm256_add_ps(min, max), half);
+            extent[k] = _mm256_mul_ps(_mm256_sub_ps(max, min), half);
+        }
+        for(int r = 0; r < 3; ++r) {
+            __m256 c = _mm256_mul_ps(_mm256_set1_ps(m->m[r]), center[0]);
+            c = _mm256_add_ps(c, _mm256_mul_ps(_mm256_set1_ps(m->m[4 + r]), center[1]));
+            c = _mm256_add_ps(c, _mm256_mul_ps(_mm256_set1_ps(m->m[8 + r]), center[2]));
+            c = _mm256_add_ps(c, _mm256_set1_ps(m->m[12 + r]));
+            __m256 e = _mm256_mul_ps(avx2_abs(_mm256_set1_ps(m->m[r])), extent[0]);
+            e = _mm256_add_ps(e, _mm256_mul_ps(avx2_abs(_mm256_set1_ps(m->m[4 + r])), extent[1]));
+            e = _mm256_add_ps(e, _mm256_mul_ps(avx2_abs(_mm256_set1_ps(m->m[8 + r])), extent[2]));
+            _mm256_storeu_ps(dst->min[r] + i, _mm256_sub_ps(c, e));
+            _mm256_storeu_ps(dst->max[r] + i, _mm256_add_ps(c, e));
+        }
+    }
+    if(i < count) {
+        AabbSoa d = aabb_soa_offset(dst, i), s = aabb_soa_offset(src, i);
+        math_kernels_scalar.aabb_transform_soa(&d, m, &s, count - i);
+    }
+}
+
+const MathKernels math_kernels_avx2 = {
+    .isa = MATH_ISA_AVX2,
+    .mat4_mul_aos = avx2_mat4_mul_aos,
+    .mat4_mul_soa = avx2_mat4_mul_soa,
+    .mat4_mul_vec4_aos = avx2_mat4_mul_vec4_aos,
+    .mat4_mul_vec4_soa = avx2_mat4_mul_vec4_soa,
+    .quat_to_mat4_aos = avx2_quat_to_mat4_aos,
+    .quat_to_mat4_soa = avx2_quat_to_mat4_soa,
+    .aabb_transform_aos = sse2_aabb_transform_aos,
+    .aabb_transform_soa = avx2_aabb_transform_soa,
+};
+
+#endif // __x86_64__
@@ -0,0 +1,555 @@
+#include "vlk_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+// Two level segregated fit: the first level is the power of two of the size, the second
+// splits each power of two into TLSF_SL_COUNT linear classes. Every size is rounded up to
+// TLSF_MIN_SIZE, so node offsets stay multiples of it and fl is always >= TLSF_SL_LOG2.
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT 64
+#define TLSF_MIN_SIZE 256
+
+#define DEFAULT_BLOCK_SIZE (64ull * 1024 * 1024)
+
+struct TlsfNode {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    TlsfNode *prev_physical;
+    TlsfNode *next_physical;
+    TlsfNode *prev_free;
+    TlsfNode *next_free;
+    char free;
+};
+
+struct MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    void *mapped;
+    uint32_t memory_type;
+    // Optimal tiling images and linear resources live in separate blocks so neighbouring
+    // allocations can never violate bufferImageGranularity
+    char optimal;
+    uint32_t allocation_count;
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_COUNT];
+    TlsfNode *free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    TlsfNode *first_node;
+    MemoryBlock *next;
+};
+
+struct MemoryAllocator {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkDeviceSize buffer_image_granularity;
+    VkDeviceSize non_coherent_atom_size;
+    uint32_t max_allocation_count;
+    uint32_t device_allocation_count;
+    VkDeviceSize block_size[VK_MAX_MEMORY_HEAPS];
+    MemoryBlock *blocks[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize dedicated_bytes[VK_MAX_MEMORY_HEAPS];
+    uint32_t dedicated_count[VK_MAX_MEMORY_HEAPS];
+    pthread_mutex_t mutex;
+};
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void tlsf_mapping(VkDeviceSize size, uint32_t *fl, uint32_t *sl) {
+    uint32_t f = 63 - (uint32_t)__builtin_clzll(size);
+    *fl = f;
+    *sl = (uint32_t)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+}
+
+static void tlsf_insert_free(MemoryBlock *block, TlsfNode *node) {
+    uint32_t fl, sl;
+    tlsf_mapping(node->size, &fl, &sl);
+    node->free = 1;
+    node->prev_free = NULL;
+    node->next_free = block->free_lists[fl][sl];
+    if(node->next_free)
+        node->next_free->prev_free = node;
+    block->free_lists[fl][sl] = node;
+    block->fl_bitmap |= 1ull << fl;
+    block->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsf_remove_free(MemoryBlock *block, TlsfNode *node) {
+    uint32_t fl, sl;
+    tlsf_mapping(node->size, &fl, &sl);
+    if(node->prev_free)
+        node->prev_free->next_free = node->next_free;
+    else
+        block->free_lists[fl][sl] = node->next_free;
+    if(node->next_free)
+        node->next_free->prev_free = node->prev_free;
+    if(!block->free_lists[fl][sl]) {
+        block->sl_bitmap[fl] &= ~(1u << sl);
+        if(!block->sl_bitmap[fl])
+            block->fl_bitmap &= ~(1ull << fl);
+    }
+    node->free = 0;
+    node->prev_free = NULL;
+    node->next_free = NULL;
+}
+
+// Any node in the returned class is at least size bytes, so the head can be taken as is
+static TlsfNode *tlsf_find_free(MemoryBlock *block, VkDeviceSize size) {
+    uint32_t f = 63 - (uint32_t)__builtin_clzll(size);
+    VkDeviceSize rounded = size + ((VkDeviceSize)1 << (f - TLSF_SL_LOG2)) - 1;
+    uint32_t fl, sl;
+    tlsf_mapping(rounded, &fl, &sl);
+
+    uint32_t sl_map = block->sl_bitmap[fl] & (~0u << sl);
+    if(!sl_map) {
+        uint64_t fl_map = fl + 1 < TLSF_FL_COUNT ? block->fl_bitmap & (~0ull << (fl + 1)) : 0;
+        if(!fl_map)
+            return NULL;
+        fl = (uint32_t)__builtin_ctzll(fl_map);
+        sl_map = block->sl_bitmap[fl];
+    }
+    sl = (uint32_t)__builtin_ctz(sl_map);
+    return block->free_lists[fl][sl];
+}
+
+static TlsfNode *block_allocate(MemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment) {
+    // Offsets are already TLSF_MIN_SIZE aligned, only larger alignments need slack
+    VkDeviceSize slack = alignment > TLSF_MIN_SIZE ? alignment - TLSF_MIN_SIZE : 0;
+    TlsfNode *node = tlsf_find_free(block, size + slack);
+    if(!node)
+        return NULL;
+    tlsf_remove_free(block, node);
+
+    VkDeviceSize padding = align_up(node->offset, alignment) - node->offset;
+    if(padding) {
+        assert(padding % TLSF_MIN_SIZE == 0);
+        TlsfNode *front = calloc(1, sizeof(TlsfNode));
+        front->offset = node->offset;
+        front->size = padding;
+        front->prev_physical = node->prev_physical;
+        front->next_physical = node;
+        if(front->prev_physical)
+            front->prev_physical->next_physical = front;
+        else
+            block->first_node = front;
+        node->prev_physical = front;
+        node->offset += padding;
+        node->size -= padding;
+        tlsf_insert_free(block, front);
+    }
+
+    if(node->size - size >= TLSF_MIN_SIZE) {
+        TlsfNode *tail = calloc(1, sizeof(TlsfNode));
+        tail->offset = node->offset + size;
+        tail->size = node->size - size;
+        tail->prev_physical = node;
+        tail->next_physical = node->next_physical;
+        if(tail->next_physical)
+            tail->next_physical->prev_physical = tail;
+        node->next_physical = tail;
+        node->size = size;
+        tlsf_insert_free(block, tail);
+    }
+
+    block->used += node->size;
+    ++block->allocation_count;
+    return node;
+}
+
+static void block_free(MemoryBlock *block, TlsfNode *node) {
+    block->used -= node->size;
+    --block->allocation_count;
+
+    TlsfNode *next = node->next_physical;
+    if(next && next->free) {
+        tlsf_remove_free(block, next);
+        node->size += next->size;
+        node->next_physical = next->next_physical;
+        if(node->next_physical)
+            node->next_physical->prev_physical = node;
+        free(next);
+    }
+    TlsfNode *prev = node->prev_physical;
+    if(prev && prev->free) {
+        tlsf_remove_free(block, prev);
+        prev->size += node->size;
+        prev->next_physical = node->next_physical;
+        if(prev->next_physical)
+            prev->next_physical->prev_physical = prev;
+        free(node);
+        node = prev;
+    }
+    tlsf_insert_free(block, node);
+}
+
+static VkDeviceSize block_largest_free(const MemoryBlock *block) {
+    if(!block->fl_bitmap)
+        return 0;
+    uint32_t fl = 63 - (uint32_t)__builtin_clzll(block->fl_bitmap);
+    VkDeviceSize largest = 0;
+    for(uint32_t sl = 0; sl < TLSF_SL_COUNT; ++sl) {
+        for(const TlsfNode *node = block->free_lists[fl][sl]; node; node = node->next_free) {
+            if(node->size > largest)
+                largest = node->size;
+        }
+    }
+    return largest;
+}
+
+static VkDeviceMemory allocate_device_memory(MemoryAllocator *allocator, VkDeviceSize size, uint32_t memory_type, const void *next) {
+    if(allocator->device_allocation_count >= allocator->max_allocation_count) {
+        fprintf(stderr, "Exceeded maxMemoryAllocationCount (%u).\n", allocator->max_allocation_count);
+        exit(1);
+    }
+
+    VkMemoryAllocateInfo alloc_info = { 0 };
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = next;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if(vkAllocateMemory(allocator->device, &alloc_info, NULL, &memory) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate %llu bytes of Vulkan memory.\n", (unsigned long long)size);
+        exit(1);
+    }
+    ++allocator->device_allocation_count;
+    return memory;
+}
+
+static void *map_if_host_visible(MemoryAllocator *allocator, VkDeviceMemory memory, uint32_t memory_type) {
+    if(!(allocator->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+        return NULL;
+    void *mapped = NULL;
+    if(vkMapMemory(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to map Vulkan memory.\n");
+        exit(1);
+    }
+    return mapped;
+}
+
+static MemoryBlock *create_block(MemoryAllocator *allocator, uint32_t memory_type, VkDeviceSize size, char optimal) {
+    MemoryBlock *block = calloc(1, sizeof(MemoryBlock));
+    block->memory = allocate_device_memory(allocator, size, memory_type, NULL);
+    block->size = size;
+    block->mapped = map_if_host_visible(allocator, block->memory, memory_type);
+    block->memory_type = memory_type;
+    block->optimal = optimal;
+
+    TlsfNode *node = calloc(1, sizeof(TlsfNode));
+    node->offset = 0;
+    node->size = size;
+    tlsf_insert_free(block, node);
+    block->first_node = node;
+
+    block->next = allocator->blocks[memory_type];
+    allocator->blocks[memory_type] = block;
+    return block;
+}
+
+static void destroy_block(MemoryAllocator *allocator, MemoryBlock *block) {
+    TlsfNode *node = block->first_node;
+    while(node) {
+        TlsfNode *next = node->next_physical;
+        free(node);
+        node = next;
+    }
+    if(block->mapped)
+        vkUnmapMemory(allocator->device, block->memory);
+    vkFreeMemory(allocator->device, block->memory, NULL);
+    --allocator->device_allocation_count;
+    free(block);
+}
+
+MemoryAllocator *memory_allocator_create(VkDevice device, VkPhysicalDevice physical_device) {
+    MemoryAllocator *allocator = calloc(1, sizeof(MemoryAllocator));
+    allocator->device = device;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &allocator->memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    allocator->buffer_image_granularity = properties.limits.bufferImageGranularity;
+    allocator->non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+    allocator->max_allocation_count = properties.limits.maxMemoryAllocationCount;
+
+    // Small heaps (e.g. the 256MB BAR window) get smaller blocks so one block can't eat the heap
+    for(uint32_t i = 0; i < allocator->memory_properties.memoryHeapCount; ++i) {
+        VkDeviceSize heap_size = allocator->memory_properties.memoryHeaps[i].size;
+        allocator->block_size[i] = heap_size >= 1024ull * 1024 * 1024 ? DEFAULT_BLOCK_SIZE : align_up(heap_size / 8, TLSF_MIN_SIZE);
+    }
+    pthread_mutex_init(&allocator->mutex, NULL);
+    return allocator;
+}
+
+void memory_allocator_destroy(MemoryAllocator *allocator) {
+    for(uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i) {
+        MemoryBlock *block = allocator->blocks[i];
+        while(block) {
+            MemoryBlock *next = block->next;
+            if(block->allocation_count)
+                fprintf(stderr, "Leaked %u allocations in memory type %u.\n", block->allocation_count, i);
+            destroy_block(allocator, block);
+            block = next;
+        }
+    }
+    pthread_mutex_destroy(&allocator->mutex);
+    free(allocator);
+}
+
+static uint32_t find_memory_type(MemoryAllocator *allocator, uint32_t type_bits, MemoryUsage usage) {
+    VkMemoryPropertyFlags required = 0;
+    VkMemoryPropertyFlags preferred = 0;
+    switch(usage) {
+    case MEMORY_USAGE_GPU_ONLY:
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case MEMORY_USAGE_CPU_TO_GPU:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        break;
+    case MEMORY_USAGE_GPU_TO_CPU:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    case MEMORY_USAGE_GPU_LAZILY_ALLOCATED:
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        break;
+    }
+
+    uint32_t best = UINT32_MAX;
+    int best_score = -1;
+    for(uint32_t i = 0; i < allocator->memory_properties.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = allocator->memory_properties.memoryTypes[i].propertyFlags;
+        if(!(type_bits & (1u << i)) || (flags & required) != required)
+            continue;
+        int score = __builtin_popcount(flags & preferred);
+        if(score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    if(best == UINT32_MAX) {
+        fprintf(stderr, "Failed to find a suitable Vulkan memory type.\n");
+        exit(1);
+    }
+    return best;
+}
+
+static MemoryAllocation allocate(MemoryAllocator *allocator, VkMemoryRequirements requirements, char dedicated, char optimal, MemoryUsage usage, VkImage image, VkBuffer buffer) {
+    MemoryAllocation allocation = { 0 };
+    uint32_t memory_type = find_memory_type(allocator, requirements.memoryTypeBits, usage);
+    uint32_t heap = allocator->memory_properties.memoryTypes[memory_type].heapIndex;
+    VkDeviceSize size = align_up(requirements.size, TLSF_MIN_SIZE);
+    allocation.memory_type = memory_type;
+    allocation.size = requirements.size;
+
+    // Lazily allocated memory is only committed per VkDeviceMemory, a shared block would commit it all
+    if(usage == MEMORY_USAGE_GPU_LAZILY_ALLOCATED)
+        dedicated = 1;
+
+    pthread_mutex_lock(&allocator->mutex);
+    if(dedicated || size >= allocator->block_size[heap] / 2) {
+        VkMemoryDedicatedAllocateInfo dedicated_info = { 0 };
+        dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicated_info.image = image;
+        dedicated_info.buffer = buffer;
+        allocation.memory = allocate_device_memory(allocator, requirements.size, memory_type, &dedicated_info);
+        allocation.offset = 0;
+        allocation.mapped = map_if_host_visible(allocator, allocation.memory, memory_type);
+        allocator->dedicated_bytes[heap] += requirements.size;
+        ++allocator->dedicated_count[heap];
+        pthread_mutex_unlock(&allocator->mutex);
+        return allocation;
+    }
+
+    if(allocator->buffer_image_granularity <= 1)
+        optimal = 0; // No granularity constraint, linear and optimal resources can share blocks
+
+    TlsfNode *node = NULL;
+    MemoryBlock *block = allocator->blocks[memory_type];
+    for(; block; block = block->next) {
+        if(block->optimal != optimal)
+            continue;
+        node = block_allocate(block, size, requirements.alignment);
+        if(node)
+            break;
+    }
+    if(!node) {
+        block = create_block(allocator, memory_type, allocator->block_size[heap], optimal);
+        node = block_allocate(block, size, requirements.alignment);
+        assert(node);
+    }
+    pthread_mutex_unlock(&allocator->mutex);
+
+    allocation.memory = block->memory;
+    allocation.offset = node->offset;
+    allocation.mapped = block->mapped ? (char*)block->mapped + node->offset : NULL;
+    allocation.block = block;
+    allocation.node = node;
+    return allocation;
+}
+
+MemoryAllocation memory_allocate_buffer(MemoryAllocator *allocator, VkBuffer buffer, MemoryUsage usage) {
+    VkMemoryDedicatedRequirements dedicated_requirements = { 0 };
+    dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements = { 0 };
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated_requirements;
+    VkBufferMemoryRequirementsInfo2 info = { 0 };
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    info.buffer = buffer;
+    vkGetBufferMemoryRequirements2(allocator->device, &info, &requirements);
+
+    char dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+    MemoryAllocation allocation = allocate(allocator, requirements.memoryRequirements, dedicated, 0, usage, VK_NULL_HANDLE, buffer);
+    if(vkBindBufferMemory(allocator->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to bind Vulkan buffer memory.\n");
+        exit(1);
+    }
+    return allocation;
+}
+
+MemoryAllocation memory_allocate_image(MemoryAllocator *allocator, VkImage image, char optimal_tiling, MemoryUsage usage) {
+    VkMemoryDedicatedRequirements dedicated_requirements = { 0 };
+    dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements = { 0 };
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated_requirements;
+    VkImageMemoryRequirementsInfo2 info = { 0 };
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    info.image = image;
+    vkGetImageMemoryRequirements2(allocator->device, &info, &requirements);
+
+    char dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+    MemoryAllocation allocation = allocate(allocator, requirements.memoryRequirements, dedicated, optimal_tiling, usage, image, VK_NULL_HANDLE);
+    if(vkBindImageMemory(allocator->device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to bind Vulkan image memory.\n");
+        exit(1);
+    }
+    return allocation;
+}
+
+MemoryAllocation memory_allocate(MemoryAllocator *allocator, const VkMemoryRequirements *requirements, char optimal, MemoryUsage usage) {
+    return allocate(allocator, *requirements, 0, optimal, usage, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+void memory_free(MemoryAllocator *allocator, MemoryAllocation *allocation) {
+    if(!allocation->memory)
+        return;
+    pthread_mutex_lock(&allocator->mutex);
+    if(!allocation->block) {
+        uint32_t heap = allocator->memory_properties.memoryTypes[allocation->memory_type].heapIndex;
+        if(allocation->mapped)
+            vkUnmapMemory(allocator->device, allocation->memory);
+        vkFreeMemory(allocator->device, allocation->memory, NULL);
+        --allocator->device_allocation_count;
+        allocator->dedicated_bytes[heap] -= allocation->size;
+        --allocator->dedicated_count[heap];
+    } else {
+        MemoryBlock *block = allocation->block;
+        block_free(block, allocation->node);
+        // Give empty blocks back to the driver, but keep the last one of a type around to avoid churn
+        MemoryBlock **link = &allocator->blocks[block->memory_type];
+        if(!block->allocation_count && !(*link == block && !block->next)) {
+            while(*link != block)
+                link = &(*link)->next;
+            *link = block->next;
+            destroy_block(allocator, block);
+        }
+    }
+    pthread_mutex_unlock(&allocator->mutex);
+    *allocation = (MemoryAllocation){ 0 };
+}
+
+VkBuffer memory_create_buffer(MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags buffer_usage, MemoryUsage usage, MemoryAllocation *allocation) {
+    VkBufferCreateInfo createInfo = { 0 };
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = buffer_usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    if(vkCreateBuffer(allocator->device, &createInfo, NULL, &buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan buffer.\n");
+        exit(1);
+    }
+    *allocation = memory_allocate_buffer(allocator, buffer, usage);
+    return buffer;
+}
+
+VkImage memory_create_image(MemoryAllocator *allocator, const VkImageCreateInfo *create_info, MemoryUsage usage, MemoryAllocation *allocation) {
+    VkImage image = VK_NULL_HANDLE;
+    if(vkCreateImage(allocator->device, create_info, NULL, &image) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan image.\n");
+        exit(1);
+    }
+    *allocation = memory_allocate_image(allocator, image, create_info->tiling == VK_IMAGE_TILING_OPTIMAL, usage);
+    return image;
+}
+
+// Range covering [offset, offset + size) of the allocation, widened to nonCoherentAtomSize
+static VkMappedMemoryRange atom_aligned_range(MemoryAllocator *allocator, const MemoryAllocation *allocation, VkDeviceSize offset, VkDeviceSize size) {
+    VkDeviceSize atom = allocator->non_coherent_atom_size;
+    VkDeviceSize begin = (allocation->offset + offset) & ~(atom - 1);
+    VkDeviceSize end = align_up(allocation->offset + offset + size, atom);
+
+    VkMappedMemoryRange range = { 0 };
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation->memory;
+    range.offset = begin;
+    range.size = end - begin;
+    // Dedicated allocations may not be a multiple of the atom size
+    if(!allocation->block && end > allocation->size)
+        range.size = VK_WHOLE_SIZE;
+    return range;
+}
+
+void memory_flush(MemoryAllocator *allocator, const MemoryAllocation *allocation, VkDeviceSize offset, VkDeviceSize size) {
+    if(allocator->memory_properties.memoryTypes[allocation->memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+        return;
+    VkMappedMemoryRange range = atom_aligned_range(allocator, allocation, offset, size);
+    vkFlushMappedMemoryRanges(allocator->device, 1, &range);
+}
+
+void memory_invalidate(MemoryAllocator *allocator, const MemoryAllocation *allocation, VkDeviceSize offset, VkDeviceSize size) {
+    if(allocator->memory_properties.memoryTypes[allocation->memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+        return;
+    VkMappedMemoryRange range = atom_aligned_range(allocator, allocation, offset, size);
+    vkInvalidateMappedMemoryRanges(allocator->device, 1, &range);
+}
+
+void memory_allocator_print_stats(MemoryAllocator *allocator) {
+    pthread_mutex_lock(&allocator->mutex);
+    printf("Device memory: %u of %u allocations used\n", allocator->device_allocation_count, allocator->max_allocation_count);
+    for(uint32_t heap = 0; heap < allocator->memory_properties.memoryHeapCount; ++heap) {
+        uint32_t block_count = 0;
+        uint32_t allocation_count = 0;
+        VkDeviceSize block_bytes = 0, used_bytes = 0, largest_free = 0;
+        for(uint32_t type = 0; type < allocator->memory_properties.memoryTypeCount; ++type) {
+            if(allocator->memory_properties.memoryTypes[type].heapIndex != heap)
+                continue;
+            for(const MemoryBlock *block = allocator->blocks[type]; block; block = block->next) {
+                ++block_count;
+                allocation_count += block->allocation_count;
+                block_bytes += block->size;
+                used_bytes += block->used;
+                VkDeviceSize largest = block_largest_free(block);
+                if(largest > largest_free)
+                    largest_free = largest;
+            }
+        }
+        if(!block_count && !allocator->dedicated_count[heap])
+            continue;
+        VkDeviceSize free_bytes = block_bytes - used_bytes;
+        // 0% when all free space is one contiguous range, approaching 100% as it splinters
+        double fragmentation = free_bytes ? 100.0 * (1.0 - (double)largest_free / (double)free_bytes) : 0.0;
+        printf("Heap %u: %u blocks, %.2f of %.2f MiB used by %u allocations, %u dedicated allocations with %.2f MiB, %.1f%% fragmented\n",
+            heap, block_count, used_bytes / (1024.0 * 1024.0), block_bytes / (1024.0 * 1024.0), allocation_count,
+            allocator->dedicated_count[heap], allocator->dedicated_bytes[heap] / (1024.0 * 1024.0), fragmentation);
+    }
+    pthread_mutex_unlock(&allocator->mutex);
+}
@@ -0,0 +1,53 @@
+#ifndef VLK_MEMORY_H
+#define VLK_MEMORY_H
+
+#include <volk.h>
+
+// Device memory is allocated in large blocks per memory type and sub-allocated with a
+// TLSF allocator, so the renderer never comes near maxMemoryAllocationCount. Large
+// resources and ones the driver asks to be dedicated get their own VkDeviceMemory.
+
+typedef enum MemoryUsage {
+    MEMORY_USAGE_GPU_ONLY,   // Device local
+    MEMORY_USAGE_CPU_TO_GPU, // Host visible and coherent, persistently mapped
+    MEMORY_USAGE_GPU_TO_CPU, // Host visible, cached where possible, persistently mapped
+    MEMORY_USAGE_GPU_LAZILY_ALLOCATED, // Transient attachments, lazily allocated where the device has it, always dedicated
+} MemoryUsage;
+
+typedef struct MemoryBlock MemoryBlock;
+typedef struct TlsfNode TlsfNode;
+
+typedef struct MemoryAllocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *mapped; // Already offset, NULL unless host visible
+    uint32_t memory_type;
+    MemoryBlock *block; // NULL for dedicated allocations
+    TlsfNode *node;
+} MemoryAllocation;
+
+typedef struct MemoryAllocator MemoryAllocator;
+
+MemoryAllocator *memory_allocator_create(VkDevice device, VkPhysicalDevice physical_device);
+void memory_allocator_destroy(MemoryAllocator *allocator);
+
+// Allocate and bind memory for an existing resource
+MemoryAllocation memory_allocate_buffer(MemoryAllocator *allocator, VkBuffer buffer, MemoryUsage usage);
+MemoryAllocation memory_allocate_image(MemoryAllocator *allocator, VkImage image, char optimal_tiling, MemoryUsage usage);
+void memory_free(MemoryAllocator *allocator, MemoryAllocation *allocation);
+// Memory for several resources that the caller binds itself, e.g. ones that alias each other.
+// optimal says whether it holds optimal tiling images, which must not share a block with linear resources.
+MemoryAllocation memory_allocate(MemoryAllocator *allocator, const VkMemoryRequirements *requirements, char optimal, MemoryUsage usage);
+
+VkBuffer memory_create_buffer(MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags buffer_usage, MemoryUsage usage, MemoryAllocation *allocation);
+VkImage memory_create_image(MemoryAllocator *allocator, const VkImageCreateInfo *create_info, MemoryUsage usage, MemoryAllocation *allocation);
+// Needed for memory that is host visible but not coherent, a no-op otherwise
+void memory_flush(MemoryAllocator *allocator, const MemoryAllocation *allocation, VkDeviceSize offset, VkDeviceSize size);
+// Same for reading GPU writes back, e.g. from MEMORY_USAGE_GPU_TO_CPU memory that is only cached
+void memory_invalidate(MemoryAllocator *allocator, const MemoryAllocation *allocation, VkDeviceSize offset, VkDeviceSize size);
+
+// Per heap block usage, dedicated memory and fragmentation of the free space
+void memory_allocator_print_stats(MemoryAllocator *allocator);
+
+#endif // VLK_MEMORY_H
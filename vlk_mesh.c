@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L // mmap, fstat
+
+#include "vlk_mesh.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vlk_mesh_format.h"
+#include "vlk_obj.h"
+
+static VkBuffer create_mesh_buffer(MemoryAllocator *allocator, UploadQueue *uploads, const void *data, VkDeviceSize size, VkBufferUsageFlags usage,
+    VkPipelineStageFlags dst_stages, VkAccessFlags dst_access, MemoryAllocation *allocation) {
+    VkBuffer buffer = memory_create_buffer(allocator, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEMORY_USAGE_GPU_ONLY, allocation);
+    upload_buffer(uploads, buffer, 0, data, size, dst_stages, dst_access);
+    return buffer;
+}
+
+Mesh mesh_load_baked(MemoryAllocator *allocator, UploadQueue *uploads, const char *path) {
+    int file = open(path, O_RDONLY);
+    if(file < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        exit(1);
+    }
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size <= 0) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        exit(1);
+    }
+    size_t mapping_size = (size_t)info.st_size;
+    void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s.\n", path);
+        exit(1);
+    }
+
+    // Only the header is checked, the sections are copied as they are
+    const MeshFileHeader *header = mapping;
+    if(mapping_size < sizeof(MeshFileHeader) || header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION) {
+        fprintf(stderr, "%s is not a baked mesh of version %u, run meshbake on the source again.\n", path, MESH_FILE_VERSION);
+        exit(1);
+    }
+    VkDeviceSize vertex_size = sizeof(MeshFileVertex) * (VkDeviceSize)header->vertex_count;
+    VkDeviceSize index_size = (VkDeviceSize)header->index_size * header->index_count;
+    VkDeviceSize meshlet_size = sizeof(MeshFileMeshlet) * (VkDeviceSize)header->meshlet_count;
+    if(header->file_size != mapping_size || !header->vertex_count || !header->index_count || header->index_count % 3 != 0
+        || (header->index_size != 2 && header->index_size != 4)
+        || header->vertex_offset > mapping_size || vertex_size > mapping_size - header->vertex_offset
+        || header->index_offset > mapping_size || index_size > mapping_size - header->index_offset
+        || header->meshlet_offset > mapping_size || meshlet_size > mapping_size - header->meshlet_offset) {
+        fprintf(stderr, "%s is truncated or has sections outside the file.\n", path);
+        exit(1);
+    }
+
+    Mesh mesh = { 0 };
+    mesh.format = MESH_VERTEX_BAKED;
+    mesh.vertex_count = header->vertex_count;
+    mesh.index_count = header->index_count;
+    mesh.index_type = header->index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    mesh.meshlet_count = header->meshlet_count;
+    for(uint32_t k = 0; k < 3; ++k) {
+        // Positions are unorm16, which the vertex fetch already maps to [0, 1]
+        mesh.position_scale[k] = header->position_scale[k] * 65535.0f;
+        mesh.position_offset[k] = header->position_offset[k];
+        mesh.bounds_min[k] = mesh.position_offset[k];
+        mesh.bounds_max[k] = mesh.position_offset[k] + mesh.position_scale[k];
+    }
+
+    const char *data = mapping;
+    mesh.vertex_buffer = create_mesh_buffer(allocator, uploads, data + header->vertex_offset, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, &mesh.vertex_allocation);
+    mesh.index_buffer = create_mesh_buffer(allocator, uploads, data + header->index_offset, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, &mesh.index_allocation);
+    if(mesh.meshlet_count) {
+        mesh.meshlet_buffer = create_mesh_buffer(allocator, uploads, data + header->meshlet_offset, meshlet_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, &mesh.meshlet_allocation);
+    }
+    // upload_buffer has copied everything into the staging ring by now
+    munmap(mapping, mapping_size);
+    return mesh;
+}
+
+Mesh mesh_load_obj(MemoryAllocator *allocator, UploadQueue *uploads, const char *path) {
+    ObjMesh obj = obj_load(path);
+    Mesh mesh = { 0 };
+    mesh.format = MESH_VERTEX_RAW;
+    mesh.vertex_count = obj.vertex_count;
+    mesh.index_count = obj.index_count;
+    mesh.index_type = VK_INDEX_TYPE_UINT32;
+    for(uint32_t k = 0; k < 3; ++k) {
+        mesh.position_scale[k] = 1.0f;
+        mesh.bounds_min[k] = obj.bounds_min[k];
+        mesh.bounds_max[k] = obj.bounds_max[k];
+    }
+    mesh.vertex_buffer = create_mesh_buffer(allocator, uploads, obj.vertices, sizeof(ObjVertex) * (VkDeviceSize)obj.vertex_count, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, &mesh.vertex_allocation);
+    mesh.index_buffer = create_mesh_buffer(allocator, uploads, obj.indices, sizeof(uint32_t) * (VkDeviceSize)obj.index_count, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, &mesh.index_allocation);
+    obj_destroy(&obj);
+    return mesh;
+}
+
+void mesh_destroy(VkDevice device, MemoryAllocator *allocator, Mesh *mesh) {
+    vkDestroyBuffer(device, mesh->vertex_buffer, NULL);
+    memory_free(allocator, &mesh->vertex_allocation);
+    vkDestroyBuffer(device, mesh->index_buffer, NULL);
+    memory_free(allocator, &mesh->index_allocation);
+    if(mesh->meshlet_buffer) {
+        vkDestroyBuffer(device, mesh->meshlet_buffer, NULL);
+        memory_free(allocator, &mesh->meshlet_allocation);
+    }
+    *mesh = (Mesh){ 0 };
+}
+
+uint32_t mesh_vertex_input(MeshVertexFormat format, VkVertexInputBindingDescription *binding, VkVertexInputAttributeDescription attributes[3]) {
+    memset(binding, 0, sizeof(*binding));
+    memset(attributes, 0, sizeof(VkVertexInputAttributeDescription) * 3);
+    if(format == MESH_VERTEX_NONE)
+        return 0;
+
+    binding->binding = 0;
+    binding->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    for(uint32_t i = 0; i < 3; ++i)
+        attributes[i].location = i;
+    if(format == MESH_VERTEX_RAW) {
+        binding->stride = sizeof(ObjVertex);
+        attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributes[0].offset = offsetof(ObjVertex, position);
+        attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributes[1].offset = offsetof(ObjVertex, normal);
+        attributes[2].format = VK_FORMAT_R32G32_SFLOAT;
+        attributes[2].offset = offsetof(ObjVertex, uv);
+    } else {
+        binding->stride = sizeof(MeshFileVertex);
+        attributes[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributes[0].offset = offsetof(MeshFileVertex, position);
+        attributes[1].format = VK_FORMAT_R8G8B8A8_SNORM;
+        attributes[1].offset = offsetof(MeshFileVertex, normal);
+        attributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attributes[2].offset = offsetof(MeshFileVertex, uv);
+    }
+    return 3;
+}
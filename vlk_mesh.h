@@ -0,0 +1,47 @@
+#ifndef VLK_MESH_H
+#define VLK_MESH_H
+
+#include <volk.h>
+
+#include "vlk_memory.h"
+#include "vlk_upload.h"
+
+// Indexed meshes in device local buffers. Baked meshes (see meshbake.c) are mapped and
+// their sections handed to the upload queue as they are. OBJ files are parsed at load
+// time instead, which is what baking saves.
+
+typedef enum MeshVertexFormat {
+    MESH_VERTEX_NONE,  // No vertex buffer, shaders make their own positions
+    MESH_VERTEX_RAW,   // ObjVertex, 32 byte float attributes
+    MESH_VERTEX_BAKED, // MeshFileVertex, 16 byte quantized attributes
+} MeshVertexFormat;
+
+typedef struct Mesh {
+    MeshVertexFormat format;
+    VkBuffer vertex_buffer;
+    MemoryAllocation vertex_allocation;
+    VkBuffer index_buffer;
+    MemoryAllocation index_allocation;
+    VkIndexType index_type;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    // position = vertex position * position_scale + position_offset, identity for raw meshes
+    float position_scale[3];
+    float position_offset[3];
+    float bounds_min[3];
+    float bounds_max[3];
+    // MeshFileMeshlet array for cluster culling, VK_NULL_HANDLE for raw meshes
+    VkBuffer meshlet_buffer;
+    MemoryAllocation meshlet_allocation;
+    uint32_t meshlet_count;
+} Mesh;
+
+// Both exit on files they can't use. The uploads are queued, not flushed.
+Mesh mesh_load_baked(MemoryAllocator *allocator, UploadQueue *uploads, const char *path);
+Mesh mesh_load_obj(MemoryAllocator *allocator, UploadQueue *uploads, const char *path);
+void mesh_destroy(VkDevice device, MemoryAllocator *allocator, Mesh *mesh);
+
+// Binding 0 with position, normal and uv at locations 0 to 2. Returns the attribute count.
+uint32_t mesh_vertex_input(MeshVertexFormat format, VkVertexInputBindingDescription *binding, VkVertexInputAttributeDescription attributes[3]);
+
+#endif // VLK_MESH_H
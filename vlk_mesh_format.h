@@ -0,0 +1,52 @@
+#ifndef VLK_MESH_FORMAT_H
+#define VLK_MESH_FORMAT_H
+
+#include <stdint.h>
+
+// Baked mesh files as written by meshbake. The file is laid out exactly as the buffers
+// the renderer draws from: a header followed by the vertex, index and meshlet sections,
+// each starting 16 byte aligned. Everything is little endian.
+
+#define MESH_FILE_MAGIC 0x4853454du // "MESH"
+#define MESH_FILE_VERSION 1
+#define MESH_FILE_ALIGNMENT 16
+
+// Limits for the clusters meshbake splits the index buffer into
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_size; // 2 or 4
+    uint32_t meshlet_count;
+    // position = quantized position * position_scale + position_offset
+    float position_offset[3];
+    float position_scale[3];
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint64_t file_size;
+} MeshFileHeader;
+
+typedef struct MeshFileVertex {
+    uint16_t position[4]; // unorm16 across the bounds, w is 0
+    int8_t normal[4];     // snorm8, w is 0
+    uint16_t uv[2];       // half floats
+} MeshFileVertex;
+
+// A run of triangles in the index buffer. The cluster is backfacing from camera when
+// dot(center - camera, cone_axis) >= cone_cutoff * length(center - camera) + radius.
+typedef struct MeshFileMeshlet {
+    float center[3];
+    float radius;
+    int8_t cone_axis[3]; // snorm8
+    int8_t cone_cutoff;  // snorm8, 127 for clusters that are never culled
+    uint32_t first_index;
+    uint32_t triangle_count;
+    uint32_t vertex_count;
+} MeshFileMeshlet;
+
+#endif // VLK_MESH_FORMAT_H
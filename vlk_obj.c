@@ -0,0 +1,240 @@
+#include "vlk_obj.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ObjCorner {
+    int32_t position;
+    int32_t uv; // -1 when missing
+    int32_t normal;
+} ObjCorner;
+
+typedef struct ObjArrays {
+    float *data;
+    uint32_t count; // Elements of the given width
+    uint32_t capacity;
+} ObjArrays;
+
+// Corner triple to vertex index, open addressing with index + 1 so 0 is empty
+typedef struct ObjVertexMap {
+    uint32_t *slots;
+    uint32_t capacity;
+} ObjVertexMap;
+
+static void push_floats(ObjArrays *arrays, const float *values, uint32_t width) {
+    if(arrays->count == arrays->capacity) {
+        arrays->capacity = arrays->capacity ? arrays->capacity * 2 : 1024;
+        arrays->data = realloc(arrays->data, sizeof(float) * width * arrays->capacity);
+    }
+    memcpy(arrays->data + (size_t)arrays->count * width, values, sizeof(float) * width);
+    ++arrays->count;
+}
+
+static char *read_text(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc((size_t)size + 1);
+    if(size < 0 || fread(text, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        exit(1);
+    }
+    fclose(file);
+    text[size] = 0;
+    return text;
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element
+static int32_t resolve_index(long index, uint32_t count) {
+    if(index > 0)
+        return (int32_t)(index - 1);
+    if(index < 0)
+        return (int32_t)count + (int32_t)index;
+    return -1;
+}
+
+static uint32_t hash_corner(const ObjCorner *corner) {
+    uint32_t hash = (uint32_t)corner->position * 73856093u;
+    hash ^= (uint32_t)corner->uv * 19349663u;
+    hash ^= (uint32_t)corner->normal * 83492791u;
+    return hash;
+}
+
+static uint32_t add_vertex(ObjMesh *mesh, uint32_t *vertex_capacity, ObjVertexMap *map, ObjCorner *corners, const ObjCorner *corner,
+    const ObjArrays *positions, const ObjArrays *uvs, const ObjArrays *normals) {
+    if(mesh->vertex_count * 2 >= map->capacity) {
+        uint32_t capacity = map->capacity ? map->capacity * 2 : 4096;
+        uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+        for(uint32_t i = 0; i < map->capacity; ++i) {
+            if(!map->slots[i])
+                continue;
+            uint32_t slot = hash_corner(&corners[map->slots[i] - 1]) & (capacity - 1);
+            while(slots[slot])
+                slot = (slot + 1) & (capacity - 1);
+            slots[slot] = map->slots[i];
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->capacity = capacity;
+    }
+
+    uint32_t slot = hash_corner(corner) & (map->capacity - 1);
+    while(map->slots[slot]) {
+        const ObjCorner *existing = &corners[map->slots[slot] - 1];
+        if(existing->position == corner->position && existing->uv == corner->uv && existing->normal == corner->normal)
+            return map->slots[slot] - 1;
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    if(mesh->vertex_count == *vertex_capacity) {
+        *vertex_capacity = *vertex_capacity ? *vertex_capacity * 2 : 1024;
+        mesh->vertices = realloc(mesh->vertices, sizeof(ObjVertex) * *vertex_capacity);
+    }
+    uint32_t index = mesh->vertex_count++;
+    corners[index] = *corner;
+    ObjVertex *vertex = &mesh->vertices[index];
+    memset(vertex, 0, sizeof(ObjVertex));
+    memcpy(vertex->position, positions->data + (size_t)corner->position * 3, sizeof(float) * 3);
+    if(corner->uv >= 0)
+        memcpy(vertex->uv, uvs->data + (size_t)corner->uv * 2, sizeof(float) * 2);
+    if(corner->normal >= 0)
+        memcpy(vertex->normal, normals->data + (size_t)corner->normal * 3, sizeof(float) * 3);
+    map->slots[slot] = index + 1;
+    return index;
+}
+
+ObjMesh obj_load(const char *path) {
+    char *text = read_text(path);
+    ObjMesh mesh = { 0 };
+    ObjArrays positions = { 0 }, uvs = { 0 }, normals = { 0 };
+    ObjVertexMap map = { 0 };
+    ObjCorner *corners = NULL; // Per vertex, grows with mesh.vertices
+    uint32_t vertex_capacity = 0, index_capacity = 0;
+    char missing_normals = 0;
+
+    uint32_t line_number = 0;
+    for(char *line = text; *line; ) {
+        char *end = line + strcspn(line, "\n");
+        char *next = *end ? end + 1 : end;
+        *end = 0;
+        ++line_number;
+
+        if(line[0] == 'v' && line[1] == ' ') {
+            float values[3] = { 0 };
+            char *cursor = line + 2;
+            for(uint32_t i = 0; i < 3; ++i)
+                values[i] = strtof(cursor, &cursor);
+            push_floats(&positions, values, 3);
+        } else if(line[0] == 'v' && line[1] == 't' && line[2] == ' ') {
+            float values[2] = { 0 };
+            char *cursor = line + 3;
+            for(uint32_t i = 0; i < 2; ++i)
+                values[i] = strtof(cursor, &cursor);
+            push_floats(&uvs, values, 2);
+        } else if(line[0] == 'v' && line[1] == 'n' && line[2] == ' ') {
+            float values[3] = { 0 };
+            char *cursor = line + 3;
+            for(uint32_t i = 0; i < 3; ++i)
+                values[i] = strtof(cursor, &cursor);
+            push_floats(&normals, values, 3);
+        } else if(line[0] == 'f' && line[1] == ' ') {
+            uint32_t first = 0, previous = 0, corner_count = 0;
+            char *cursor = line + 2;
+            for(;;) {
+                while(*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+                    ++cursor;
+                if(!*cursor)
+                    break;
+                ObjCorner corner = { resolve_index(strtol(cursor, &cursor, 10), positions.count), -1, -1 };
+                if(*cursor == '/') {
+                    ++cursor;
+                    if(*cursor != '/')
+                        corner.uv = resolve_index(strtol(cursor, &cursor, 10), uvs.count);
+                    if(*cursor == '/') {
+                        ++cursor;
+                        corner.normal = resolve_index(strtol(cursor, &cursor, 10), normals.count);
+                    }
+                }
+                if(corner.position < 0 || corner.position >= (int32_t)positions.count || corner.uv >= (int32_t)uvs.count || corner.normal >= (int32_t)normals.count) {
+                    fprintf(stderr, "%s:%u: face references a missing vertex.\n", path, line_number);
+                    exit(1);
+                }
+                missing_normals |= corner.normal < 0;
+
+                if(mesh.vertex_count == vertex_capacity)
+                    corners = realloc(corners, sizeof(ObjCorner) * (vertex_capacity ? vertex_capacity * 2 : 1024));
+                uint32_t vertex = add_vertex(&mesh, &vertex_capacity, &map, corners, &corner, &positions, &uvs, &normals);
+                if(corner_count >= 2) {
+                    if(mesh.index_count + 3 > index_capacity) {
+                        index_capacity = index_capacity ? index_capacity * 2 : 3072;
+                        mesh.indices = realloc(mesh.indices, sizeof(uint32_t) * index_capacity);
+                    }
+                    mesh.indices[mesh.index_count++] = first;
+                    mesh.indices[mesh.index_count++] = previous;
+                    mesh.indices[mesh.index_count++] = vertex;
+                }
+                if(corner_count == 0)
+                    first = vertex;
+                previous = vertex;
+                ++corner_count;
+            }
+        }
+        line = next;
+    }
+    free(text);
+    free(positions.data);
+    free(uvs.data);
+    free(normals.data);
+    free(map.slots);
+
+    if(!mesh.index_count) {
+        fprintf(stderr, "%s has no faces.\n", path);
+        exit(1);
+    }
+
+    // Vertices without a normal get the sum of their faces' cross products. The ones that
+    // have one from the file keep it, corners tells them apart.
+    if(missing_normals) {
+        for(uint32_t i = 0; i < mesh.index_count; i += 3) {
+            float *a = mesh.vertices[mesh.indices[i]].position;
+            float *b = mesh.vertices[mesh.indices[i + 1]].position;
+            float *c = mesh.vertices[mesh.indices[i + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for(uint32_t j = 0; j < 3; ++j) {
+                if(corners[mesh.indices[i + j]].normal >= 0)
+                    continue;
+                float *normal = mesh.vertices[mesh.indices[i + j]].normal;
+                for(uint32_t k = 0; k < 3; ++k)
+                    normal[k] += n[k];
+            }
+        }
+    }
+    free(corners);
+
+    for(uint32_t k = 0; k < 3; ++k) {
+        mesh.bounds_min[k] = mesh.vertices[0].position[k];
+        mesh.bounds_max[k] = mesh.vertices[0].position[k];
+    }
+    for(uint32_t i = 1; i < mesh.vertex_count; ++i) {
+        for(uint32_t k = 0; k < 3; ++k) {
+            float value = mesh.vertices[i].position[k];
+            mesh.bounds_min[k] = value < mesh.bounds_min[k] ? value : mesh.bounds_min[k];
+            mesh.bounds_max[k] = value > mesh.bounds_max[k] ? value : mesh.bounds_max[k];
+        }
+    }
+    return mesh;
+}
+
+void obj_destroy(ObjMesh *mesh) {
+    free(mesh->vertices);
+    free(mesh->indices);
+    *mesh = (ObjMesh){ 0 };
+}
@@ -0,0 +1,29 @@
+#ifndef VLK_OBJ_H
+#define VLK_OBJ_H
+
+#include <stdint.h>
+
+// Wavefront OBJ as an indexed triangle list, shared by meshbake and the raw mesh path of
+// the renderer. Polygons are fan triangulated and vertices that repeat the same
+// position/uv/normal triple are merged.
+
+typedef struct ObjVertex {
+    float position[3];
+    float normal[3]; // Area weighted face normals when the file has none, not normalized
+    float uv[2];
+} ObjVertex;
+
+typedef struct ObjMesh {
+    ObjVertex *vertices;
+    uint32_t vertex_count;
+    uint32_t *indices;
+    uint32_t index_count;
+    float bounds_min[3];
+    float bounds_max[3];
+} ObjMesh;
+
+// Exits when the file can't be read or references vertices that don't exist
+ObjMesh obj_load(const char *path);
+void obj_destroy(ObjMesh *mesh);
+
+#endif // VLK_OBJ_H
@@ -0,0 +1,428 @@
+#include "vlk_pipelines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <SDL2/SDL.h>
+
+#include "vlk_threads.h"
+
+struct PipelineShader {
+    char *path;
+    ShaderCode code; // Mapped or embedded, never copied
+    uint64_t hash; // Of the code, so a rebuilt shader makes a new key
+};
+
+typedef struct PipelineEntry {
+    PipelineManager *manager;
+    GraphicsPipelineDesc desc;
+    uint64_t key;
+    PipelineState state;
+    VkPipeline pipeline;
+    double compile_ms;
+} PipelineEntry;
+
+struct PipelineManager {
+    VkDevice device;
+    VkPipelineCache pipeline_cache; // Internally synchronized, shared by the compile threads
+    ThreadPool *thread_pool;
+    pthread_mutex_t mutex;
+    pthread_cond_t compiled;
+
+    PipelineShader **shaders;
+    uint32_t shader_count, shader_capacity;
+
+    // Entries are allocated one by one so compile tasks can keep pointers while the array grows
+    PipelineEntry **entries;
+    uint32_t entry_count, entry_capacity;
+    // Open addressing map from key to entry index + 1, 0 marks an empty slot
+    uint32_t *map;
+    uint32_t map_capacity;
+
+    uint64_t requests;
+    uint64_t hits;
+    uint32_t queued; // Waiting or compiling
+    uint32_t max_queued;
+    uint32_t failed;
+    double compile_ms;
+    double max_compile_ms;
+};
+
+static double get_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t shader_hash(const PipelineShader *shader) {
+    return shader ? shader->hash : 0;
+}
+
+// Field by field, so padding never ends up in the key
+static uint64_t hash_desc(const GraphicsPipelineDesc *desc) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t vert_hash = shader_hash(desc->vert_shader), frag_hash = shader_hash(desc->frag_shader);
+    hash = hash_bytes(hash, &vert_hash, sizeof(uint64_t));
+    hash = hash_bytes(hash, &frag_hash, sizeof(uint64_t));
+    hash = hash_bytes(hash, &desc->features, sizeof(desc->features));
+    hash = hash_bytes(hash, &desc->vertex_format, sizeof(desc->vertex_format));
+    hash = hash_bytes(hash, &desc->layout, sizeof(desc->layout));
+    hash = hash_bytes(hash, &desc->render_pass, sizeof(desc->render_pass));
+    hash = hash_bytes(hash, &desc->subpass, sizeof(desc->subpass));
+    hash = hash_bytes(hash, &desc->topology, sizeof(desc->topology));
+    hash = hash_bytes(hash, &desc->cull_mode, sizeof(desc->cull_mode));
+    hash = hash_bytes(hash, &desc->front_face, sizeof(desc->front_face));
+    hash = hash_bytes(hash, &desc->blend_enable, sizeof(desc->blend_enable));
+    hash = hash_bytes(hash, desc->blend_constants, sizeof(desc->blend_constants));
+    hash = hash_bytes(hash, &desc->depth_test, sizeof(desc->depth_test));
+    hash = hash_bytes(hash, &desc->depth_write, sizeof(desc->depth_write));
+    hash = hash_bytes(hash, &desc->depth_compare, sizeof(desc->depth_compare));
+    return hash;
+}
+
+static char desc_equal(const GraphicsPipelineDesc *a, const GraphicsPipelineDesc *b) {
+    return shader_hash(a->vert_shader) == shader_hash(b->vert_shader) && shader_hash(a->frag_shader) == shader_hash(b->frag_shader) && a->features == b->features
+        && a->vertex_format == b->vertex_format && a->layout == b->layout && a->render_pass == b->render_pass && a->subpass == b->subpass
+        && a->topology == b->topology && a->cull_mode == b->cull_mode && a->front_face == b->front_face
+        && a->blend_enable == b->blend_enable && memcmp(a->blend_constants, b->blend_constants, sizeof(a->blend_constants)) == 0
+        && a->depth_test == b->depth_test && a->depth_write == b->depth_write && a->depth_compare == b->depth_compare;
+}
+
+static VkShaderModule create_module(VkDevice device, const PipelineShader *shader) {
+    VkShaderModuleCreateInfo create_info = { 0 };
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = shader->code.size;
+    create_info.pCode = shader->code.code;
+    VkShaderModule module = VK_NULL_HANDLE;
+    if(vkCreateShaderModule(device, &create_info, NULL, &module) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return module;
+}
+
+static VkPipeline build_pipeline(VkDevice device, VkPipelineCache pipeline_cache, const GraphicsPipelineDesc *desc, VkShaderModule vert_module, VkShaderModule frag_module) {
+    // Every feature goes to both stages, entries for constants a stage doesn't declare are ignored
+    VkSpecializationMapEntry feature_entries[SHADER_FEATURE_COUNT];
+    VkBool32 feature_values[SHADER_FEATURE_COUNT];
+    for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i) {
+        feature_entries[i].constantID = i;
+        feature_entries[i].offset = i * sizeof(VkBool32);
+        feature_entries[i].size = sizeof(VkBool32);
+        feature_values[i] = (desc->features >> i) & 1 ? VK_TRUE : VK_FALSE;
+    }
+    VkSpecializationInfo specialization = { 0 };
+    specialization.mapEntryCount = SHADER_FEATURE_COUNT;
+    specialization.pMapEntries = feature_entries;
+    specialization.dataSize = sizeof(feature_values);
+    specialization.pData = feature_values;
+
+    VkPipelineShaderStageCreateInfo stages[2] = { 0 };
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vert_module;
+    stages[0].pName = "main";
+    stages[0].pSpecializationInfo = &specialization;
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = frag_module;
+    stages[1].pName = "main";
+    stages[1].pSpecializationInfo = &specialization;
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info = { 0 };
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkVertexInputBindingDescription vertex_binding;
+    VkVertexInputAttributeDescription vertex_attributes[3];
+    vertex_input_info.vertexAttributeDescriptionCount = mesh_vertex_input(desc->vertex_format, &vertex_binding, vertex_attributes);
+    if(vertex_input_info.vertexAttributeDescriptionCount) {
+        vertex_input_info.vertexBindingDescriptionCount = 1;
+        vertex_input_info.pVertexBindingDescriptions = &vertex_binding;
+        vertex_input_info.pVertexAttributeDescriptions = vertex_attributes;
+    }
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = { 0 };
+    input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_info.topology = desc->topology;
+    input_assembly_info.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are dynamic so the pipeline survives swapchain recreation
+    VkPipelineViewportStateCreateInfo viewport_info = { 0 };
+    viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_info.viewportCount = 1;
+    viewport_info.scissorCount = 1;
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic_state_info = { 0 };
+    dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_info.dynamicStateCount = sizeof(dynamic_states) / sizeof(dynamic_states[0]);
+    dynamic_state_info.pDynamicStates = dynamic_states;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer_info = { 0 };
+    rasterizer_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer_info.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer_info.lineWidth = 1.0f;
+    rasterizer_info.cullMode = desc->cull_mode;
+    rasterizer_info.frontFace = desc->front_face;
+
+    VkPipelineMultisampleStateCreateInfo multisampling_info = { 0 };
+    multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling_info.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment = { 0 };
+    if(frag_module)
+        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = desc->blend_enable;
+    color_blend_attachment.srcColorBlendFactor = desc->blend_enable ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstColorBlendFactor = desc->blend_enable ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending = { 0 };
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOp = VK_LOGIC_OP_COPY;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+    memcpy(color_blending.blendConstants, desc->blend_constants, sizeof(desc->blend_constants));
+
+    // Render passes here always have a depth attachment, pipelines that ignore it just don't test
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info = { 0 };
+    depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_info.depthTestEnable = desc->depth_test;
+    depth_stencil_info.depthWriteEnable = desc->depth_write;
+    depth_stencil_info.depthCompareOp = desc->depth_test ? desc->depth_compare : VK_COMPARE_OP_ALWAYS;
+    depth_stencil_info.maxDepthBounds = 1.0f;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = { 0 };
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = frag_module ? 2 : 1;
+    pipeline_info.pStages = stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly_info;
+    pipeline_info.pViewportState = &viewport_info;
+    pipeline_info.pRasterizationState = &rasterizer_info;
+    pipeline_info.pMultisampleState = &multisampling_info;
+    pipeline_info.pDepthStencilState = &depth_stencil_info;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state_info;
+    pipeline_info.layout = desc->layout;
+    pipeline_info.renderPass = desc->render_pass;
+    pipeline_info.subpass = desc->subpass;
+    pipeline_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return pipeline;
+}
+
+static VkPipeline compile_pipeline(VkDevice device, VkPipelineCache pipeline_cache, const GraphicsPipelineDesc *desc) {
+    VkShaderModule vert_module = create_module(device, desc->vert_shader);
+    VkShaderModule frag_module = desc->frag_shader ? create_module(device, desc->frag_shader) : VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(vert_module && (frag_module || !desc->frag_shader))
+        pipeline = build_pipeline(device, pipeline_cache, desc, vert_module, frag_module);
+    if(vert_module)
+        vkDestroyShaderModule(device, vert_module, NULL);
+    if(frag_module)
+        vkDestroyShaderModule(device, frag_module, NULL);
+    return pipeline;
+}
+
+static void compile_task(void *user_data, uint32_t worker_index) {
+    (void)worker_index;
+    PipelineEntry *entry = user_data;
+    PipelineManager *manager = entry->manager;
+    double begin = get_time_ms();
+    VkPipeline pipeline = compile_pipeline(manager->device, manager->pipeline_cache, &entry->desc);
+    double compile_ms = get_time_ms() - begin;
+
+    pthread_mutex_lock(&manager->mutex);
+    entry->pipeline = pipeline;
+    entry->compile_ms = compile_ms;
+    entry->state = pipeline ? PIPELINE_READY : PIPELINE_FAILED;
+    --manager->queued;
+    manager->compile_ms += compile_ms;
+    if(compile_ms > manager->max_compile_ms)
+        manager->max_compile_ms = compile_ms;
+    if(!pipeline) {
+        ++manager->failed;
+        fprintf(stderr, "Failed to create Vulkan graphics pipeline %016llx.\n", (unsigned long long)entry->key);
+    }
+    pthread_cond_broadcast(&manager->compiled);
+    pthread_mutex_unlock(&manager->mutex);
+}
+
+PipelineManager *pipeline_manager_create(VkDevice device, VkPipelineCache pipeline_cache, uint32_t thread_count) {
+    PipelineManager *manager = calloc(1, sizeof(PipelineManager));
+    manager->device = device;
+    manager->pipeline_cache = pipeline_cache;
+    manager->thread_pool = thread_pool_create(thread_count);
+    pthread_mutex_init(&manager->mutex, NULL);
+    pthread_cond_init(&manager->compiled, NULL);
+    manager->map_capacity = 64;
+    manager->map = calloc(manager->map_capacity, sizeof(uint32_t));
+    return manager;
+}
+
+void pipeline_manager_destroy(PipelineManager *manager) {
+    thread_pool_wait(manager->thread_pool);
+    thread_pool_destroy(manager->thread_pool);
+    for(uint32_t i = 0; i < manager->entry_count; ++i) {
+        if(manager->entries[i]->pipeline)
+            vkDestroyPipeline(manager->device, manager->entries[i]->pipeline, NULL);
+        free(manager->entries[i]);
+    }
+    for(uint32_t i = 0; i < manager->shader_count; ++i) {
+        free(manager->shaders[i]->path);
+        shader_code_release(&manager->shaders[i]->code);
+        free(manager->shaders[i]);
+    }
+    pthread_cond_destroy(&manager->compiled);
+    pthread_mutex_destroy(&manager->mutex);
+    free(manager->entries);
+    free(manager->shaders);
+    free(manager->map);
+    free(manager);
+}
+
+static PipelineShader *find_shader(PipelineManager *manager, const char *path) {
+    for(uint32_t i = 0; i < manager->shader_count; ++i) {
+        if(strcmp(manager->shaders[i]->path, path) == 0)
+            return manager->shaders[i];
+    }
+    return NULL;
+}
+
+const PipelineShader *pipeline_manager_shader(PipelineManager *manager, const char *path) {
+    PipelineShader *shader = find_shader(manager, path);
+    if(shader)
+        return shader;
+    return pipeline_manager_add_shader(manager, path, shader_code_load(path));
+}
+
+const PipelineShader *pipeline_manager_add_shader(PipelineManager *manager, const char *path, ShaderCode code) {
+    PipelineShader *shader = find_shader(manager, path);
+    if(shader) {
+        shader_code_release(&code);
+        return shader;
+    }
+
+    shader = calloc(1, sizeof(PipelineShader));
+    shader->code = code;
+    shader->path = malloc(strlen(path) + 1);
+    strcpy(shader->path, path);
+    shader->hash = hash_bytes(0xcbf29ce484222325ull, shader->code.code, shader->code.size);
+
+    if(manager->shader_count == manager->shader_capacity) {
+        manager->shader_capacity = manager->shader_capacity ? manager->shader_capacity * 2 : 8;
+        manager->shaders = realloc(manager->shaders, sizeof(PipelineShader *) * manager->shader_capacity);
+    }
+    manager->shaders[manager->shader_count++] = shader;
+    return shader;
+}
+
+static void map_insert(uint32_t *map, uint32_t capacity, uint64_t key, uint32_t value) {
+    uint32_t slot = (uint32_t)key & (capacity - 1);
+    while(map[slot])
+        slot = (slot + 1) & (capacity - 1);
+    map[slot] = value;
+}
+
+PipelineHandle pipeline_manager_request(PipelineManager *manager, const GraphicsPipelineDesc *desc) {
+    uint64_t key = hash_desc(desc);
+    pthread_mutex_lock(&manager->mutex);
+    ++manager->requests;
+    uint32_t slot = (uint32_t)key & (manager->map_capacity - 1);
+    while(manager->map[slot]) {
+        PipelineHandle handle = manager->map[slot] - 1;
+        PipelineEntry *entry = manager->entries[handle];
+        if(entry->key == key && desc_equal(&entry->desc, desc)) {
+            ++manager->hits;
+            pthread_mutex_unlock(&manager->mutex);
+            return handle;
+        }
+        slot = (slot + 1) & (manager->map_capacity - 1);
+    }
+
+    // Miss, keep the map at most half full
+    if((manager->entry_count + 1) * 2 > manager->map_capacity) {
+        uint32_t capacity = manager->map_capacity * 2;
+        uint32_t *map = calloc(capacity, sizeof(uint32_t));
+        for(uint32_t i = 0; i < manager->entry_count; ++i)
+            map_insert(map, capacity, manager->entries[i]->key, i + 1);
+        free(manager->map);
+        manager->map = map;
+        manager->map_capacity = capacity;
+    }
+    if(manager->entry_count == manager->entry_capacity) {
+        manager->entry_capacity = manager->entry_capacity ? manager->entry_capacity * 2 : 16;
+        manager->entries = realloc(manager->entries, sizeof(PipelineEntry *) * manager->entry_capacity);
+    }
+    PipelineEntry *entry = calloc(1, sizeof(PipelineEntry));
+    entry->manager = manager;
+    entry->desc = *desc;
+    entry->key = key;
+    entry->state = PIPELINE_PENDING;
+    PipelineHandle handle = manager->entry_count++;
+    manager->entries[handle] = entry;
+    map_insert(manager->map, manager->map_capacity, key, handle + 1);
+    if(++manager->queued > manager->max_queued)
+        manager->max_queued = manager->queued;
+    pthread_mutex_unlock(&manager->mutex);
+
+    thread_pool_submit(manager->thread_pool, compile_task, entry);
+    return handle;
+}
+
+PipelineState pipeline_manager_state(PipelineManager *manager, PipelineHandle handle) {
+    pthread_mutex_lock(&manager->mutex);
+    PipelineState state = manager->entries[handle]->state;
+    pthread_mutex_unlock(&manager->mutex);
+    return state;
+}
+
+VkPipeline pipeline_manager_get(PipelineManager *manager, PipelineHandle handle) {
+    pthread_mutex_lock(&manager->mutex);
+    VkPipeline pipeline = manager->entries[handle]->pipeline;
+    pthread_mutex_unlock(&manager->mutex);
+    return pipeline;
+}
+
+VkPipeline pipeline_manager_wait(PipelineManager *manager, PipelineHandle handle) {
+    pthread_mutex_lock(&manager->mutex);
+    PipelineEntry *entry = manager->entries[handle];
+    while(entry->state == PIPELINE_PENDING)
+        pthread_cond_wait(&manager->compiled, &manager->mutex);
+    VkPipeline pipeline = entry->pipeline;
+    pthread_mutex_unlock(&manager->mutex);
+    return pipeline;
+}
+
+double pipeline_manager_compile_ms(PipelineManager *manager, PipelineHandle handle) {
+    pthread_mutex_lock(&manager->mutex);
+    double compile_ms = manager->entries[handle]->compile_ms;
+    pthread_mutex_unlock(&manager->mutex);
+    return compile_ms;
+}
+
+void pipeline_manager_print_stats(PipelineManager *manager) {
+    pthread_mutex_lock(&manager->mutex);
+    uint32_t compiled = manager->entry_count - manager->queued;
+    printf("Pipelines: %u compiled (%u failed), %llu requests, %.1f%% hit rate, max queue depth %u\n",
+        compiled, manager->failed, (unsigned long long)manager->requests,
+        manager->requests ? 100.0 * manager->hits / manager->requests : 0.0, manager->max_queued);
+    if(compiled)
+        printf("Pipeline compile time: avg %.2f ms, max %.2f ms\n", manager->compile_ms / compiled, manager->max_compile_ms);
+    pthread_mutex_unlock(&manager->mutex);
+}
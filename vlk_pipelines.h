@@ -0,0 +1,72 @@
+#ifndef VLK_PIPELINES_H
+#define VLK_PIPELINES_H
+
+#include <volk.h>
+
+#include "vlk_mesh.h"
+#include "vlk_shaders.h"
+
+// Graphics pipelines keyed by a hash of their state and the SPIR-V of their shaders.
+// A request that misses is compiled on a background thread, the caller gets a handle
+// right away and draws with a fallback (or not at all) until the pipeline is ready.
+// Requests for the same state share one pipeline.
+
+typedef struct PipelineManager PipelineManager;
+typedef struct PipelineShader PipelineShader;
+typedef uint32_t PipelineHandle;
+
+// Shader permutations are specialization constants rather than separate SPIR-V files.
+// Bit N of a feature mask is the bool with constant_id N, in every stage that declares it.
+typedef enum ShaderFeature {
+    SHADER_FEATURE_DESATURATE = 1 << 0, // triangle.frag
+    SHADER_FEATURE_CHECKER = 1 << 1,    // triangle.frag
+    SHADER_FEATURE_FLAT_COLOR = 1 << 2, // triangle.vert, instanced.vert
+} ShaderFeature;
+
+#define SHADER_FEATURE_COUNT 3
+
+typedef enum PipelineState {
+    PIPELINE_PENDING,
+    PIPELINE_READY,
+    PIPELINE_FAILED,
+} PipelineState;
+
+// Everything that is baked into a pipeline, the rest is fixed or dynamic (viewport, scissor)
+typedef struct GraphicsPipelineDesc {
+    const PipelineShader *vert_shader;
+    const PipelineShader *frag_shader; // NULL for depth only pipelines, which write no color
+    uint32_t features; // ShaderFeature bits
+    MeshVertexFormat vertex_format;
+    VkPipelineLayout layout;
+    VkRenderPass render_pass;
+    uint32_t subpass;
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    VkBool32 blend_enable;
+    float blend_constants[4];
+    VkBool32 depth_test;
+    VkBool32 depth_write;
+    VkCompareOp depth_compare;
+} GraphicsPipelineDesc;
+
+PipelineManager *pipeline_manager_create(VkDevice device, VkPipelineCache pipeline_cache, uint32_t thread_count);
+// Waits for compiles still running, then destroys every pipeline
+void pipeline_manager_destroy(PipelineManager *manager);
+
+// Loads and hashes a SPIR-V file once, later calls with the same path return the same shader
+const PipelineShader *pipeline_manager_shader(PipelineManager *manager, const char *path);
+// Same for code loaded elsewhere, e.g. before the manager existed. Takes ownership of code.
+const PipelineShader *pipeline_manager_add_shader(PipelineManager *manager, const char *path, ShaderCode code);
+
+PipelineHandle pipeline_manager_request(PipelineManager *manager, const GraphicsPipelineDesc *desc);
+PipelineState pipeline_manager_state(PipelineManager *manager, PipelineHandle handle);
+// VK_NULL_HANDLE until the pipeline is ready
+VkPipeline pipeline_manager_get(PipelineManager *manager, PipelineHandle handle);
+// Blocks until the pipeline is compiled, for pipelines the frame can't go without
+VkPipeline pipeline_manager_wait(PipelineManager *manager, PipelineHandle handle);
+double pipeline_manager_compile_ms(PipelineManager *manager, PipelineHandle handle);
+
+void pipeline_manager_print_stats(PipelineManager *manager);
+
+#endif // VLK_PIPELINES_H
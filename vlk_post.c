@@ -0,0 +1,548 @@
+#include "vlk_post.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vlk_shaders.h"
+
+// Luminance, exposure, the bloom levels down and back up, tonemap and the blit
+#define POST_PASS_COUNT (POST_BLOOM_LEVELS * 2 + 3)
+#define LUMINANCE_TILE 16 // luminance.comp reduces 16x16 pixels per workgroup
+#define POST_GROUP_SIZE 8
+
+#define EXPOSURE_KEY 0.18f // The average luminance is exposed to middle grey
+#define EXPOSURE_ADAPTATION 0.05f // Of the way to the target per frame
+#define BLOOM_THRESHOLD 0.8f
+#define BLOOM_KNEE 0.4f
+#define BLOOM_STRENGTH 0.05f
+
+typedef enum PostKernel {
+    POST_LUMINANCE,
+    POST_EXPOSURE,
+    POST_BLOOM_DOWN,
+    POST_BLOOM_UP,
+    POST_TONEMAP,
+    POST_BLIT, // A transfer, not a compute kernel
+    POST_KERNEL_COUNT,
+} PostKernel;
+
+static const char *kernel_names[POST_KERNEL_COUNT] = { "luminance", "exposure", "bloom down", "bloom up", "tonemap", "blit" };
+
+typedef struct ExposureParams {
+    uint32_t partial_count;
+    float adaptation;
+    float key;
+} ExposureParams;
+
+typedef struct BloomParams {
+    float threshold;
+    float knee;
+    uint32_t prefilter; // Only the first downsample keeps just the bright parts
+} BloomParams;
+
+typedef struct TonemapParams {
+    float bloom_strength;
+} TonemapParams;
+
+// Every kernel pushes its own struct at offset 0
+#define POST_PUSH_CONSTANT_SIZE 16
+
+// One pass of one frame, handed to the graph as its user data
+typedef struct PostPass {
+    PostChain *post;
+    const RenderGraph *graph;
+    PostKernel kernel;
+    uint32_t slot;
+    uint32_t index; // Within the frame, picks the descriptor set and timestamps
+    RenderGraphResource sources[2]; // Sampled
+    RenderGraphResource destination;
+    RenderGraphResource partials;
+    RenderGraphResource exposure;
+    VkExtent2D extent; // Of the destination, or of the source for luminance
+    uint32_t partial_count;
+    uint32_t prefilter;
+} PostPass;
+
+// What a descriptor set was last written with, so unchanged sets are not written again
+typedef struct PostSet {
+    VkDescriptorSet set;
+    uint64_t generation; // Of the graph, the handles below are only comparable within one
+    VkImageView views[3];
+    VkBuffer partials;
+} PostSet;
+
+struct PostChain {
+    VkDevice device;
+    MemoryAllocator *allocator;
+    uint32_t frame_count;
+    char subgroups; // Reductions use subgroup arithmetic, otherwise shared memory only
+    uint32_t subgroup_size;
+    VkSampler sampler;
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipelines[POST_BLIT];
+    VkDescriptorPool descriptor_pool;
+    PostSet *sets; // POST_PASS_COUNT per frame slot
+    PostPass *passes; // Same
+    // Exposure and average luminance. It carries over from frame to frame, so it is not a transient.
+    VkBuffer exposure_buffer;
+    MemoryAllocation exposure_allocation;
+    VkQueryPool query_pool; // A timestamp pair per pass and frame slot
+    double timestamp_period; // Nanoseconds per tick
+    uint64_t timestamp_mask;
+    char *slot_pending; // The slot's frame wrote timestamps that were not read yet
+    double kernel_ms[POST_KERNEL_COUNT];
+    uint32_t timed_frames;
+};
+
+static uint32_t source_count(PostKernel kernel) {
+    if(kernel == POST_EXPOSURE)
+        return 0;
+    return kernel == POST_BLOOM_UP || kernel == POST_TONEMAP ? 2 : 1;
+}
+
+static char writes_image(PostKernel kernel) {
+    return kernel == POST_BLOOM_DOWN || kernel == POST_BLOOM_UP || kernel == POST_TONEMAP;
+}
+
+static VkSampler create_sampler(VkDevice device) {
+    VkSamplerCreateInfo create_info = { 0 };
+    create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    create_info.magFilter = VK_FILTER_LINEAR;
+    create_info.minFilter = VK_FILTER_LINEAR;
+    create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    if(vkCreateSampler(device, &create_info, NULL, &sampler) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan sampler.\n");
+        exit(1);
+    }
+    return sampler;
+}
+
+static VkPipeline create_post_pipeline(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout layout, const char *path) {
+    ShaderCode code = shader_code_load(path);
+    VkShaderModuleCreateInfo module_info = { 0 };
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = code.size;
+    module_info.pCode = code.code;
+    VkShaderModule module = VK_NULL_HANDLE;
+    if(vkCreateShaderModule(device, &module_info, NULL, &module) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan shader module for %s.\n", path);
+        exit(1);
+    }
+    shader_code_release(&code);
+
+    VkComputePipelineCreateInfo pipeline_info = { 0 };
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = layout;
+    pipeline_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan compute pipeline for %s.\n", path);
+        exit(1);
+    }
+    vkDestroyShaderModule(device, module, NULL);
+    return pipeline;
+}
+
+// Subgroup arithmetic is a SPIR-V capability, so the two reduction paths are separate modules
+static char supports_subgroup_reductions(VkPhysicalDevice physical_device, uint32_t *subgroup_size) {
+    VkPhysicalDeviceSubgroupProperties subgroup = { 0 };
+    subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = { 0 };
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &subgroup;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+    *subgroup_size = subgroup.subgroupSize;
+
+    const VkSubgroupFeatureFlags needed = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    return (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && (subgroup.supportedOperations & needed) == needed;
+}
+
+PostChain *post_chain_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, VkPipelineCache pipeline_cache, uint32_t frame_count, uint32_t timestamp_valid_bits, char force_scalar) {
+    PostChain *post = calloc(1, sizeof(PostChain));
+    post->device = device;
+    post->allocator = allocator;
+    post->frame_count = frame_count;
+    post->subgroups = supports_subgroup_reductions(physical_device, &post->subgroup_size) && !force_scalar;
+    post->sampler = create_sampler(device);
+
+    // Sampled source, second sampled source, storage destination, luminance partials, exposure
+    VkSampler samplers[2] = { post->sampler, post->sampler };
+    VkDescriptorSetLayoutBinding bindings[5] = { 0 };
+    const VkDescriptorType types[5] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    for(uint32_t i = 0; i < 5; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = i < 2 ? &samplers[i] : NULL;
+    }
+    VkDescriptorSetLayoutCreateInfo layout_info = { 0 };
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 5;
+    layout_info.pBindings = bindings;
+    if(vkCreateDescriptorSetLayout(device, &layout_info, NULL, &post->set_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor set layout.\n");
+        exit(1);
+    }
+
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, POST_PUSH_CONSTANT_SIZE };
+    VkPipelineLayoutCreateInfo pipeline_layout_info = { 0 };
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &post->set_layout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    if(vkCreatePipelineLayout(device, &pipeline_layout_info, NULL, &post->pipeline_layout) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan pipeline layout.\n");
+        exit(1);
+    }
+
+    post->pipelines[POST_LUMINANCE] = create_post_pipeline(device, pipeline_cache, post->pipeline_layout, post->subgroups ? "luminance_subgroup.comp.spv" : "luminance.comp.spv");
+    post->pipelines[POST_EXPOSURE] = create_post_pipeline(device, pipeline_cache, post->pipeline_layout, post->subgroups ? "exposure_subgroup.comp.spv" : "exposure.comp.spv");
+    post->pipelines[POST_BLOOM_DOWN] = create_post_pipeline(device, pipeline_cache, post->pipeline_layout, "bloom_down.comp.spv");
+    post->pipelines[POST_BLOOM_UP] = create_post_pipeline(device, pipeline_cache, post->pipeline_layout, "bloom_up.comp.spv");
+    post->pipelines[POST_TONEMAP] = create_post_pipeline(device, pipeline_cache, post->pipeline_layout, "tonemap.comp.spv");
+
+    // Zero means no exposure yet, so the first frame starts at its target
+    post->exposure_buffer = memory_create_buffer(allocator, 2 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMORY_USAGE_CPU_TO_GPU, &post->exposure_allocation);
+    memset(post->exposure_allocation.mapped, 0, 2 * sizeof(float));
+
+    uint32_t set_count = frame_count * POST_PASS_COUNT;
+    VkDescriptorPoolSize pool_sizes[3] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * set_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, set_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * set_count },
+    };
+    VkDescriptorPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = set_count;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes = pool_sizes;
+    if(vkCreateDescriptorPool(device, &pool_info, NULL, &post->descriptor_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan descriptor pool.\n");
+        exit(1);
+    }
+
+    post->sets = calloc(set_count, sizeof(PostSet));
+    post->passes = calloc(set_count, sizeof(PostPass));
+    VkDescriptorBufferInfo exposure_info = { post->exposure_buffer, 0, VK_WHOLE_SIZE };
+    for(uint32_t i = 0; i < set_count; ++i) {
+        VkDescriptorSetAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = post->descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &post->set_layout;
+        if(vkAllocateDescriptorSets(device, &alloc_info, &post->sets[i].set) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan descriptor set.\n");
+            exit(1);
+        }
+
+        VkWriteDescriptorSet write = { 0 };
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = post->sets[i].set;
+        write.dstBinding = 4;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &exposure_info;
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    }
+
+    if(timestamp_valid_bits) {
+        VkQueryPoolCreateInfo query_info = { 0 };
+        query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_info.queryCount = set_count * 2;
+        if(vkCreateQueryPool(device, &query_info, NULL, &post->query_pool) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan query pool.\n");
+            exit(1);
+        }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        post->timestamp_period = properties.limits.timestampPeriod;
+        post->timestamp_mask = timestamp_valid_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << timestamp_valid_bits) - 1;
+    }
+    post->slot_pending = calloc(frame_count, 1);
+    return post;
+}
+
+void post_chain_destroy(PostChain *post) {
+    if(post->query_pool)
+        vkDestroyQueryPool(post->device, post->query_pool, NULL);
+    for(uint32_t i = 0; i < POST_BLIT; ++i)
+        vkDestroyPipeline(post->device, post->pipelines[i], NULL);
+    vkDestroyPipelineLayout(post->device, post->pipeline_layout, NULL);
+    vkDestroyDescriptorPool(post->device, post->descriptor_pool, NULL);
+    vkDestroyDescriptorSetLayout(post->device, post->set_layout, NULL);
+    vkDestroySampler(post->device, post->sampler, NULL);
+    vkDestroyBuffer(post->device, post->exposure_buffer, NULL);
+    memory_free(post->allocator, &post->exposure_allocation);
+    free(post->sets);
+    free(post->passes);
+    free(post->slot_pending);
+    free(post);
+}
+
+// Transient views come and go with the graph's transients, the set is only written when they did
+static VkDescriptorSet update_descriptor_set(const PostPass *pass) {
+    PostSet *set = &pass->post->sets[pass->slot * POST_PASS_COUNT + pass->index];
+    uint64_t generation = render_graph_generation(pass->graph);
+    if(set->generation != generation) {
+        memset(set->views, 0, sizeof(set->views));
+        set->partials = VK_NULL_HANDLE;
+        set->generation = generation;
+    }
+    VkDescriptorImageInfo image_infos[3] = { 0 };
+    VkDescriptorBufferInfo buffer_info = { 0 };
+    VkWriteDescriptorSet writes[4] = { 0 };
+    uint32_t write_count = 0;
+
+    uint32_t image_count = source_count(pass->kernel);
+    VkImageView views[3] = { 0 };
+    for(uint32_t i = 0; i < image_count; ++i)
+        views[i] = render_graph_image_view(pass->graph, pass->sources[i]);
+    if(writes_image(pass->kernel))
+        views[image_count++] = render_graph_image_view(pass->graph, pass->destination);
+    for(uint32_t i = 0; i < image_count; ++i) {
+        char storage = writes_image(pass->kernel) && i == image_count - 1;
+        uint32_t binding = storage ? 2 : i;
+        if(set->views[binding] == views[i])
+            continue;
+        set->views[binding] = views[i];
+        image_infos[i].imageView = views[i];
+        image_infos[i].imageLayout = storage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        writes[write_count].dstBinding = binding;
+        writes[write_count].descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[write_count++].pImageInfo = &image_infos[i];
+    }
+
+    if(pass->kernel == POST_LUMINANCE || pass->kernel == POST_EXPOSURE) {
+        VkBuffer partials = render_graph_buffer(pass->graph, pass->partials);
+        if(set->partials != partials) {
+            set->partials = partials;
+            buffer_info = (VkDescriptorBufferInfo){ partials, 0, VK_WHOLE_SIZE };
+            writes[write_count].dstBinding = 3;
+            writes[write_count].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[write_count++].pBufferInfo = &buffer_info;
+        }
+    }
+
+    for(uint32_t i = 0; i < write_count; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set->set;
+        writes[i].descriptorCount = 1;
+    }
+    if(write_count)
+        vkUpdateDescriptorSets(pass->post->device, write_count, writes, 0, NULL);
+    return set->set;
+}
+
+static void record_kernel(VkCommandBuffer command_buffer, const PostPass *pass) {
+    PostChain *post = pass->post;
+    VkDescriptorSet set = update_descriptor_set(pass);
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, post->pipelines[pass->kernel]);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, post->pipeline_layout, 0, 1, &set, 0, NULL);
+
+    uint32_t group_size = POST_GROUP_SIZE;
+    if(pass->kernel == POST_LUMINANCE) {
+        group_size = LUMINANCE_TILE;
+    } else if(pass->kernel == POST_EXPOSURE) {
+        ExposureParams params = { pass->partial_count, EXPOSURE_ADAPTATION, EXPOSURE_KEY };
+        vkCmdPushConstants(command_buffer, post->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        vkCmdDispatch(command_buffer, 1, 1, 1);
+        return;
+    } else if(pass->kernel == POST_BLOOM_DOWN) {
+        BloomParams params = { BLOOM_THRESHOLD, BLOOM_KNEE, pass->prefilter };
+        vkCmdPushConstants(command_buffer, post->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    } else if(pass->kernel == POST_TONEMAP) {
+        TonemapParams params = { BLOOM_STRENGTH };
+        vkCmdPushConstants(command_buffer, post->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    }
+    vkCmdDispatch(command_buffer, (pass->extent.width + group_size - 1) / group_size, (pass->extent.height + group_size - 1) / group_size, 1);
+}
+
+static void record_blit(VkCommandBuffer command_buffer, const PostPass *pass) {
+    VkImageBlit region = { 0 };
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffsets[1] = (VkOffset3D){ (int32_t)pass->extent.width, (int32_t)pass->extent.height, 1 };
+    region.dstSubresource = region.srcSubresource;
+    region.dstOffsets[1] = region.srcOffsets[1];
+    vkCmdBlitImage(command_buffer, render_graph_image(pass->graph, pass->sources[0]), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        render_graph_image(pass->graph, pass->destination), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+}
+
+static void post_pass(VkCommandBuffer command_buffer, void *user_data) {
+    const PostPass *pass = user_data;
+    PostChain *post = pass->post;
+    uint32_t query = (pass->slot * POST_PASS_COUNT + pass->index) * 2;
+    if(post->query_pool) {
+        // The first pass resets the whole frame's range
+        if(pass->index == 0)
+            vkCmdResetQueryPool(command_buffer, post->query_pool, pass->slot * POST_PASS_COUNT * 2, POST_PASS_COUNT * 2);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, post->query_pool, query);
+    }
+    if(pass->kernel == POST_BLIT)
+        record_blit(command_buffer, pass);
+    else
+        record_kernel(command_buffer, pass);
+    if(post->query_pool)
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, post->query_pool, query + 1);
+}
+
+// Declares what the kernel samples and writes, and the buffers it uses
+static void add_post_pass(RenderGraph *graph, PostPass *pass) {
+    const VkPipelineStageFlags2 compute = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    RenderGraphPass handle = render_graph_add_pass(graph, kernel_names[pass->kernel], post_pass, pass);
+    if(pass->kernel == POST_BLIT) {
+        render_graph_read(graph, handle, pass->sources[0], VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        render_graph_write(graph, handle, pass->destination, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        return;
+    }
+    for(uint32_t i = 0; i < source_count(pass->kernel); ++i)
+        render_graph_read(graph, handle, pass->sources[i], compute, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if(writes_image(pass->kernel))
+        render_graph_write(graph, handle, pass->destination, compute, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+    if(pass->kernel == POST_LUMINANCE)
+        render_graph_write(graph, handle, pass->partials, compute, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    if(pass->kernel == POST_EXPOSURE) {
+        render_graph_read(graph, handle, pass->partials, compute, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        render_graph_read(graph, handle, pass->exposure, compute, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        render_graph_write(graph, handle, pass->exposure, compute, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+    if(pass->kernel == POST_TONEMAP)
+        render_graph_read(graph, handle, pass->exposure, compute, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+static RenderGraphResource create_post_image(RenderGraph *graph, const char *name, VkExtent2D extent, VkImageUsageFlags usage) {
+    VkImageCreateInfo create_info = { 0 };
+    create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    create_info.imageType = VK_IMAGE_TYPE_2D;
+    create_info.format = POST_HDR_FORMAT;
+    create_info.extent.width = extent.width;
+    create_info.extent.height = extent.height;
+    create_info.extent.depth = 1;
+    create_info.mipLevels = 1;
+    create_info.arrayLayers = 1;
+    create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    create_info.usage = usage;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return render_graph_create_image(graph, name, &create_info, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+void post_chain_add_passes(PostChain *post, RenderGraph *graph, uint32_t frame_slot, RenderGraphResource hdr, RenderGraphResource output, VkExtent2D extent) {
+    PostPass *passes = &post->passes[frame_slot * POST_PASS_COUNT];
+    for(uint32_t i = 0; i < POST_PASS_COUNT; ++i)
+        passes[i] = (PostPass){ .post = post, .graph = graph, .slot = frame_slot, .index = i, .extent = extent };
+
+    // The previous frame's exposure pass wrote it and its tonemap read it, both on this queue
+    RenderGraphResource exposure = render_graph_import_buffer(graph, "exposure", post->exposure_buffer,
+        (RenderGraphState){ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED });
+    uint32_t partial_count = ((extent.width + LUMINANCE_TILE - 1) / LUMINANCE_TILE) * ((extent.height + LUMINANCE_TILE - 1) / LUMINANCE_TILE);
+    RenderGraphResource partials = render_graph_create_buffer(graph, "luminance partials", (VkDeviceSize)partial_count * 2 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    uint32_t index = 0;
+    PostPass *pass = &passes[index++];
+    pass->kernel = POST_LUMINANCE;
+    pass->sources[0] = hdr;
+    pass->partials = partials;
+    add_post_pass(graph, pass);
+
+    pass = &passes[index++];
+    pass->kernel = POST_EXPOSURE;
+    pass->partials = partials;
+    pass->exposure = exposure;
+    pass->partial_count = partial_count;
+    add_post_pass(graph, pass);
+
+    // Each level is half the size of the one before, the first half the size of the HDR target
+    RenderGraphResource down[POST_BLOOM_LEVELS];
+    VkExtent2D level_extents[POST_BLOOM_LEVELS];
+    for(uint32_t i = 0; i < POST_BLOOM_LEVELS; ++i) {
+        VkExtent2D previous = i ? level_extents[i - 1] : extent;
+        level_extents[i] = (VkExtent2D){ previous.width > 1 ? previous.width / 2 : 1, previous.height > 1 ? previous.height / 2 : 1 };
+        down[i] = create_post_image(graph, "bloom down", level_extents[i], VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        pass = &passes[index++];
+        pass->kernel = POST_BLOOM_DOWN;
+        pass->sources[0] = i ? down[i - 1] : hdr;
+        pass->destination = down[i];
+        pass->extent = level_extents[i];
+        pass->prefilter = i == 0;
+        add_post_pass(graph, pass);
+    }
+
+    // Back up, each level adds the blurred level below it to the downsampled one of its size.
+    // They go into new images, which can take the memory of the levels that are done.
+    RenderGraphResource smaller = down[POST_BLOOM_LEVELS - 1];
+    for(uint32_t i = POST_BLOOM_LEVELS - 1; i-- > 0;) {
+        RenderGraphResource up = create_post_image(graph, "bloom up", level_extents[i], VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        pass = &passes[index++];
+        pass->kernel = POST_BLOOM_UP;
+        pass->sources[0] = smaller;
+        pass->sources[1] = down[i];
+        pass->destination = up;
+        pass->extent = level_extents[i];
+        add_post_pass(graph, pass);
+        smaller = up;
+    }
+
+    RenderGraphResource tonemapped = create_post_image(graph, "tonemapped", extent, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    pass = &passes[index++];
+    pass->kernel = POST_TONEMAP;
+    pass->sources[0] = hdr;
+    pass->sources[1] = smaller;
+    pass->destination = tonemapped;
+    pass->exposure = exposure;
+    add_post_pass(graph, pass);
+
+    // The output is usually an sRGB swapchain image, which can't be a storage image
+    pass = &passes[index++];
+    pass->kernel = POST_BLIT;
+    pass->sources[0] = tonemapped;
+    pass->destination = output;
+    add_post_pass(graph, pass);
+
+    post->slot_pending[frame_slot] = post->query_pool != VK_NULL_HANDLE;
+}
+
+void post_chain_collect(PostChain *post, uint32_t frame_slot) {
+    if(!post->slot_pending[frame_slot])
+        return;
+    post->slot_pending[frame_slot] = 0;
+    uint64_t timestamps[POST_PASS_COUNT * 2];
+    if(vkGetQueryPoolResults(post->device, post->query_pool, frame_slot * POST_PASS_COUNT * 2, POST_PASS_COUNT * 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+    const PostPass *passes = &post->passes[frame_slot * POST_PASS_COUNT];
+    for(uint32_t i = 0; i < POST_PASS_COUNT; ++i)
+        post->kernel_ms[passes[i].kernel] += (double)((timestamps[i * 2 + 1] - timestamps[i * 2]) & post->timestamp_mask) * post->timestamp_period * 1e-6;
+    ++post->timed_frames;
+}
+
+void post_chain_print_stats(const PostChain *post) {
+    if(post->subgroups)
+        printf("Post chain: subgroup reductions, subgroup size %u\n", post->subgroup_size);
+    else
+        printf("Post chain: shared memory reductions\n");
+    if(post->timed_frames) {
+        printf("Post GPU time per frame over %u frames:", post->timed_frames);
+        for(uint32_t i = 0; i < POST_KERNEL_COUNT; ++i)
+            printf("%s %s %.3f ms", i ? "," : "", kernel_names[i], post->kernel_ms[i] / post->timed_frames);
+        printf("\n");
+    }
+    const float *exposure = post->exposure_allocation.mapped;
+    printf("Exposure %.3f for an average luminance of %.4f\n", exposure[0], exposure[1]);
+}
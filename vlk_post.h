@@ -0,0 +1,36 @@
+#ifndef VLK_POST_H
+#define VLK_POST_H
+
+#include <volk.h>
+
+#include "vlk_graph.h"
+#include "vlk_memory.h"
+
+// Compute post processing of an HDR target: the average log luminance drives an
+// auto-exposure that adapts over a few frames, a bloom chain is downsampled and upsampled
+// again, and tonemapping combines both. The result is blitted into the output image.
+//
+// The luminance reductions use subgroup arithmetic where the device supports it for compute
+// shaders, so shared memory only combines one partial sum per subgroup. Otherwise they fall
+// back to a tree reduction in shared memory.
+
+#define POST_HDR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+#define POST_BLOOM_LEVELS 5
+
+typedef struct PostChain PostChain;
+
+// timestamp_valid_bits of the graphics queue, 0 skips the kernel timings
+PostChain *post_chain_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, VkPipelineCache pipeline_cache, uint32_t frame_count, uint32_t timestamp_valid_bits, char force_scalar);
+void post_chain_destroy(PostChain *post);
+
+// Adds the passes after the ones that render hdr, which has to be a sampled
+// POST_HDR_FORMAT image. output is left for the caller to export.
+void post_chain_add_passes(PostChain *post, RenderGraph *graph, uint32_t frame_slot, RenderGraphResource hdr, RenderGraphResource output, VkExtent2D extent);
+
+// Reads the kernel timings of the frame that last used the slot, call once it has finished
+void post_chain_collect(PostChain *post, uint32_t frame_slot);
+
+// Average GPU time per kernel, plus which reduction path ran
+void post_chain_print_stats(const PostChain *post);
+
+#endif // VLK_POST_H
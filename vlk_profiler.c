@@ -0,0 +1,305 @@
+#include "vlk_profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#define PROFILER_MAX_SCOPES 64 // GPU scopes per frame
+#define PROFILER_STATISTIC_COUNT 5
+
+static const VkQueryPipelineStatisticFlags profiler_statistic_flags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+// Results come back in flag bit order
+static const char *profiler_statistic_names[PROFILER_STATISTIC_COUNT] = {
+    "input_assembly_vertices",
+    "vertex_shader_invocations",
+    "clipping_primitives",
+    "fragment_shader_invocations",
+    "compute_shader_invocations",
+};
+
+typedef struct ProfilerEvent {
+    const char *name;
+    double start_us;
+    double duration_us;
+    char gpu;
+    char has_statistics;
+    uint64_t statistics[PROFILER_STATISTIC_COUNT];
+} ProfilerEvent;
+
+typedef struct ProfilerScope {
+    const char *name;
+    char statistics;
+} ProfilerScope;
+
+typedef struct ProfilerSlot {
+    ProfilerScope scopes[PROFILER_MAX_SCOPES];
+    uint32_t scope_count;
+} ProfilerSlot;
+
+struct Profiler {
+    VkDevice device;
+    VkQueryPool timestamp_pool; // VK_NULL_HANDLE when the queue has no timestamps
+    VkQueryPool statistics_pool;
+    double tick_us;
+    uint64_t timestamp_mask;
+    // A GPU timestamp and the CPU time it was taken at, relative to cpu_origin
+    uint64_t gpu_reference;
+    double cpu_reference_us;
+    uint64_t cpu_origin;
+
+    uint32_t slot_count;
+    ProfilerSlot *slots;
+    uint32_t current;
+    char statistics_open;
+
+    ProfilerEvent *events;
+    uint32_t event_count, event_capacity;
+};
+
+static double cpu_time_us(const Profiler *profiler) {
+    return (double)(SDL_GetPerformanceCounter() - profiler->cpu_origin) * 1e6 / (double)SDL_GetPerformanceFrequency();
+}
+
+static ProfilerEvent *push_event(Profiler *profiler) {
+    if(profiler->event_count == profiler->event_capacity) {
+        profiler->event_capacity = profiler->event_capacity ? profiler->event_capacity * 2 : 1024;
+        profiler->events = realloc(profiler->events, sizeof(ProfilerEvent) * profiler->event_capacity);
+    }
+    ProfilerEvent *event = &profiler->events[profiler->event_count++];
+    *event = (ProfilerEvent){ 0 };
+    return event;
+}
+
+static double gpu_time_us(const Profiler *profiler, uint64_t timestamp) {
+    // Signed so scopes recorded before the reference still land in the right place
+    uint64_t delta = (timestamp - profiler->gpu_reference) & profiler->timestamp_mask;
+    int64_t ticks = delta > profiler->timestamp_mask / 2 ? -(int64_t)((profiler->gpu_reference - timestamp) & profiler->timestamp_mask) : (int64_t)delta;
+    return profiler->cpu_reference_us + (double)ticks * profiler->tick_us;
+}
+
+// Takes a timestamp in a submit of its own and pairs it with the CPU time halfway through
+// the submit and wait. That is only as exact as the submit latency, good enough to line up
+// the two timelines in a capture.
+static void calibrate(Profiler *profiler, VkQueue queue, uint32_t queue_family) {
+    VkCommandPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    if(vkCreateCommandPool(profiler->device, &pool_info, NULL, &command_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan command pool.\n");
+        exit(1);
+    }
+    VkCommandBufferAllocateInfo alloc_info = { 0 };
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    if(vkAllocateCommandBuffers(profiler->device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate Vulkan command buffer.\n");
+        exit(1);
+    }
+
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    vkCmdResetQueryPool(command_buffer, profiler->timestamp_pool, 0, 1);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->timestamp_pool, 0);
+    vkEndCommandBuffer(command_buffer);
+
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    double before = cpu_time_us(profiler);
+    if(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to submit Vulkan queue.\n");
+        exit(1);
+    }
+    vkQueueWaitIdle(queue);
+    double after = cpu_time_us(profiler);
+    vkGetQueryPoolResults(profiler->device, profiler->timestamp_pool, 0, 1, sizeof(uint64_t), &profiler->gpu_reference, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    profiler->cpu_reference_us = (before + after) * 0.5;
+    vkDestroyCommandPool(profiler->device, command_pool, NULL);
+}
+
+Profiler *profiler_create(VkDevice device, VkPhysicalDevice physical_device, VkQueue queue, uint32_t queue_family, uint32_t frame_count, char pipeline_statistics) {
+    Profiler *profiler = calloc(1, sizeof(Profiler));
+    profiler->device = device;
+    profiler->cpu_origin = SDL_GetPerformanceCounter();
+    profiler->slot_count = frame_count;
+    profiler->slots = calloc(frame_count, sizeof(ProfilerSlot));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, NULL);
+    VkQueueFamilyProperties *families = malloc(sizeof(VkQueueFamilyProperties) * family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families);
+    uint32_t valid_bits = families[queue_family].timestampValidBits;
+    free(families);
+    if(!valid_bits) {
+        fprintf(stderr, "Profiler: no timestamps on queue family %u, only CPU scopes are traced.\n", queue_family);
+        return profiler;
+    }
+    profiler->tick_us = properties.limits.timestampPeriod * 1e-3;
+    profiler->timestamp_mask = valid_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = frame_count * PROFILER_MAX_SCOPES * 2;
+    if(vkCreateQueryPool(device, &pool_info, NULL, &profiler->timestamp_pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan query pool.\n");
+        exit(1);
+    }
+    if(pipeline_statistics) {
+        pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        pool_info.queryCount = frame_count * PROFILER_MAX_SCOPES;
+        pool_info.pipelineStatistics = profiler_statistic_flags;
+        if(vkCreateQueryPool(device, &pool_info, NULL, &profiler->statistics_pool) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan query pool.\n");
+            exit(1);
+        }
+    }
+    calibrate(profiler, queue, queue_family);
+    return profiler;
+}
+
+void profiler_destroy(Profiler *profiler) {
+    if(!profiler)
+        return;
+    if(profiler->timestamp_pool)
+        vkDestroyQueryPool(profiler->device, profiler->timestamp_pool, NULL);
+    if(profiler->statistics_pool)
+        vkDestroyQueryPool(profiler->device, profiler->statistics_pool, NULL);
+    free(profiler->slots);
+    free(profiler->events);
+    free(profiler);
+}
+
+static void collect_slot(Profiler *profiler, uint32_t slot) {
+    ProfilerSlot *frame = &profiler->slots[slot];
+    if(!frame->scope_count)
+        return;
+    uint64_t timestamps[PROFILER_MAX_SCOPES * 2];
+    uint32_t first_timestamp = slot * PROFILER_MAX_SCOPES * 2;
+    // The caller made sure the frame finished, so this does not wait
+    if(vkGetQueryPoolResults(profiler->device, profiler->timestamp_pool, first_timestamp, frame->scope_count * 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        frame->scope_count = 0;
+        return;
+    }
+    for(uint32_t i = 0; i < frame->scope_count; ++i) {
+        ProfilerEvent *event = push_event(profiler);
+        event->name = frame->scopes[i].name;
+        event->gpu = 1;
+        event->start_us = gpu_time_us(profiler, timestamps[i * 2]);
+        event->duration_us = (double)((timestamps[i * 2 + 1] - timestamps[i * 2]) & profiler->timestamp_mask) * profiler->tick_us;
+        if(frame->scopes[i].statistics) {
+            uint32_t query = slot * PROFILER_MAX_SCOPES + i;
+            event->has_statistics = vkGetQueryPoolResults(profiler->device, profiler->statistics_pool, query, 1, sizeof(event->statistics), event->statistics, sizeof(event->statistics), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+        }
+    }
+    frame->scope_count = 0;
+}
+
+void profiler_begin_frame(Profiler *profiler, uint32_t slot) {
+    if(!profiler)
+        return;
+    if(profiler->timestamp_pool)
+        collect_slot(profiler, slot);
+    profiler->current = slot;
+    profiler->statistics_open = 0;
+}
+
+void profiler_record_reset(Profiler *profiler, VkCommandBuffer command_buffer) {
+    if(!profiler || !profiler->timestamp_pool)
+        return;
+    vkCmdResetQueryPool(command_buffer, profiler->timestamp_pool, profiler->current * PROFILER_MAX_SCOPES * 2, PROFILER_MAX_SCOPES * 2);
+    if(profiler->statistics_pool)
+        vkCmdResetQueryPool(command_buffer, profiler->statistics_pool, profiler->current * PROFILER_MAX_SCOPES, PROFILER_MAX_SCOPES);
+}
+
+uint32_t profiler_gpu_begin(Profiler *profiler, VkCommandBuffer command_buffer, const char *name, char statistics) {
+    if(!profiler || !profiler->timestamp_pool)
+        return UINT32_MAX;
+    ProfilerSlot *frame = &profiler->slots[profiler->current];
+    if(frame->scope_count == PROFILER_MAX_SCOPES)
+        return UINT32_MAX;
+    uint32_t scope = frame->scope_count++;
+    frame->scopes[scope].name = name;
+    frame->scopes[scope].statistics = statistics && profiler->statistics_pool && !profiler->statistics_open;
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->timestamp_pool, (profiler->current * PROFILER_MAX_SCOPES + scope) * 2);
+    if(frame->scopes[scope].statistics) {
+        vkCmdBeginQuery(command_buffer, profiler->statistics_pool, profiler->current * PROFILER_MAX_SCOPES + scope, 0);
+        profiler->statistics_open = 1;
+    }
+    return scope;
+}
+
+void profiler_gpu_end(Profiler *profiler, VkCommandBuffer command_buffer, uint32_t scope) {
+    if(!profiler || scope == UINT32_MAX)
+        return;
+    ProfilerSlot *frame = &profiler->slots[profiler->current];
+    if(frame->scopes[scope].statistics) {
+        vkCmdEndQuery(command_buffer, profiler->statistics_pool, profiler->current * PROFILER_MAX_SCOPES + scope);
+        profiler->statistics_open = 0;
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->timestamp_pool, (profiler->current * PROFILER_MAX_SCOPES + scope) * 2 + 1);
+}
+
+uint32_t profiler_cpu_begin(Profiler *profiler, const char *name) {
+    if(!profiler)
+        return UINT32_MAX;
+    ProfilerEvent *event = push_event(profiler);
+    event->name = name;
+    event->start_us = cpu_time_us(profiler);
+    return profiler->event_count - 1;
+}
+
+void profiler_cpu_end(Profiler *profiler, uint32_t scope) {
+    if(!profiler || scope == UINT32_MAX)
+        return;
+    ProfilerEvent *event = &profiler->events[scope];
+    event->duration_us = cpu_time_us(profiler) - event->start_us;
+}
+
+void profiler_write_trace(Profiler *profiler, const char *path) {
+    if(!profiler)
+        return;
+    // Oldest first so the trace stays roughly in order, the viewer sorts it anyway
+    for(uint32_t i = 1; profiler->timestamp_pool && i <= profiler->slot_count; ++i)
+        collect_slot(profiler, (profiler->current + i) % profiler->slot_count);
+
+    FILE *file = fopen(path, "w");
+    if(!file) {
+        fprintf(stderr, "Failed to open %s for writing.\n", path);
+        return;
+    }
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+    for(uint32_t i = 0; i < profiler->event_count; ++i) {
+        const ProfilerEvent *event = &profiler->events[i];
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", event->name, event->gpu ? 2 : 1, event->start_us, event->duration_us);
+        if(event->has_statistics) {
+            fprintf(file, ",\"args\":{");
+            for(uint32_t j = 0; j < PROFILER_STATISTIC_COUNT; ++j)
+                fprintf(file, "%s\"%s\":%llu", j ? "," : "", profiler_statistic_names[j], (unsigned long long)event->statistics[j]);
+            fprintf(file, "}");
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Profiler: wrote %u events to %s\n", profiler->event_count, path);
+}
@@ -0,0 +1,34 @@
+#ifndef VLK_PROFILER_H
+#define VLK_PROFILER_H
+
+#include <volk.h>
+
+// Named CPU and GPU scopes written out as a Chrome trace (chrome://tracing or Perfetto).
+// GPU scopes are timestamp pairs, optionally with pipeline statistics, kept per frame slot
+// and read back when the slot comes around again, so reading never stalls. Every function
+// accepts a NULL profiler and does nothing, which keeps call sites free of checks.
+
+typedef struct Profiler Profiler;
+
+// queue is used once to line the GPU clock up with the CPU one
+Profiler *profiler_create(VkDevice device, VkPhysicalDevice physical_device, VkQueue queue, uint32_t queue_family, uint32_t frame_count, char pipeline_statistics);
+void profiler_destroy(Profiler *profiler);
+
+// Call once the frame that last used the slot has finished on the GPU
+void profiler_begin_frame(Profiler *profiler, uint32_t slot);
+// Resets the slot's queries, must be recorded outside a render pass before any GPU scope
+void profiler_record_reset(Profiler *profiler, VkCommandBuffer command_buffer);
+
+// Scopes may nest. Statistics are only gathered when no other statistics scope is open, and
+// must not be asked for around vkCmdExecuteCommands since inherited queries are not enabled.
+uint32_t profiler_gpu_begin(Profiler *profiler, VkCommandBuffer command_buffer, const char *name, char statistics);
+void profiler_gpu_end(Profiler *profiler, VkCommandBuffer command_buffer, uint32_t scope);
+
+// CPU scopes are for the thread driving the frame loop only
+uint32_t profiler_cpu_begin(Profiler *profiler, const char *name);
+void profiler_cpu_end(Profiler *profiler, uint32_t scope);
+
+// Collects every frame still pending, so the device has to be idle
+void profiler_write_trace(Profiler *profiler, const char *path);
+
+#endif // VLK_PROFILER_H
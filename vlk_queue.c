@@ -0,0 +1,216 @@
+#include "vlk_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUE_STATE_SHIFT 32 // Above it pass, pipeline and material, what draws have to share to merge
+#define QUEUE_RADIX_PASSES 8 // A byte each
+
+typedef struct QueueItem {
+    uint64_t key;
+    uint32_t draw; // Index into the pushed draws
+} QueueItem;
+
+// One draw call, over draw_count of the merged draws
+typedef struct QueueBatch {
+    uint32_t state; // key >> QUEUE_STATE_SHIFT
+    uint32_t first_draw;
+    uint32_t draw_count;
+} QueueBatch;
+
+struct RenderQueue {
+    uint32_t multi_draw_limit;
+    uint32_t count;
+    uint32_t capacity;
+    QueueItem *items;
+    QueueItem *scratch;
+    VkDrawIndirectCommand *pushed;
+    // Built by the sort, never more than were pushed
+    VkDrawIndirectCommand *draws;
+    uint32_t draw_count;
+    QueueBatch *batches;
+    uint32_t batch_count;
+    RenderQueueStats stats;
+};
+
+static uint32_t state_pipeline(uint32_t state) {
+    return (state >> 16) & (RENDER_QUEUE_MAX_PIPELINES - 1);
+}
+
+static uint32_t state_material(uint32_t state) {
+    return state & (RENDER_QUEUE_MAX_MATERIALS - 1);
+}
+
+RenderQueue *render_queue_create(uint32_t multi_draw_limit) {
+    RenderQueue *queue = calloc(1, sizeof(RenderQueue));
+    queue->multi_draw_limit = multi_draw_limit;
+    return queue;
+}
+
+void render_queue_destroy(RenderQueue *queue) {
+    free(queue->items);
+    free(queue->scratch);
+    free(queue->pushed);
+    free(queue->draws);
+    free(queue->batches);
+    free(queue);
+}
+
+uint64_t render_queue_key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, char back_to_front) {
+    // Floats that aren't negative order the same as their bits
+    uint32_t depth_bits = 0;
+    if(depth > 0.0f)
+        memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    if(back_to_front)
+        depth_bits = ~depth_bits;
+    return (uint64_t)(pass & (RENDER_QUEUE_MAX_PASSES - 1)) << 60 | (uint64_t)(pipeline & (RENDER_QUEUE_MAX_PIPELINES - 1)) << 48
+        | (uint64_t)(material & (RENDER_QUEUE_MAX_MATERIALS - 1)) << 32 | depth_bits;
+}
+
+void render_queue_reset(RenderQueue *queue) {
+    queue->count = 0;
+}
+
+void render_queue_push(RenderQueue *queue, uint64_t key, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+    if(!vertex_count || !instance_count)
+        return;
+    if(queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+        queue->items = realloc(queue->items, sizeof(QueueItem) * queue->capacity);
+        queue->scratch = realloc(queue->scratch, sizeof(QueueItem) * queue->capacity);
+        queue->pushed = realloc(queue->pushed, sizeof(VkDrawIndirectCommand) * queue->capacity);
+        queue->draws = realloc(queue->draws, sizeof(VkDrawIndirectCommand) * queue->capacity);
+        queue->batches = realloc(queue->batches, sizeof(QueueBatch) * queue->capacity);
+        if(!queue->items || !queue->scratch || !queue->pushed || !queue->draws || !queue->batches) {
+            fprintf(stderr, "Failed to grow the render queue to %u draws.\n", queue->capacity);
+            exit(1);
+        }
+    }
+    queue->items[queue->count] = (QueueItem){ key, queue->count };
+    queue->pushed[queue->count] = (VkDrawIndirectCommand){ vertex_count, instance_count, first_vertex, first_instance };
+    ++queue->count;
+}
+
+// Stable, so draws with equal keys stay in the order they were pushed. Returns items or
+// scratch, whichever the last pass wrote.
+static QueueItem *radix_sort(QueueItem *items, QueueItem *scratch, uint32_t count) {
+    uint32_t histograms[QUEUE_RADIX_PASSES][256];
+    memset(histograms, 0, sizeof(histograms));
+    for(uint32_t i = 0; i < count; ++i) {
+        uint64_t key = items[i].key;
+        for(uint32_t pass = 0; pass < QUEUE_RADIX_PASSES; ++pass)
+            ++histograms[pass][(key >> (pass * 8)) & 0xff];
+    }
+
+    QueueItem *src = items, *dst = scratch;
+    for(uint32_t pass = 0; pass < QUEUE_RADIX_PASSES; ++pass) {
+        uint32_t *offsets = histograms[pass];
+        uint32_t shift = pass * 8;
+        // All keys share this byte, usually the high ones with only a few pipelines and
+        // materials, so nothing would move
+        if(offsets[(src[0].key >> shift) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for(uint32_t digit = 0; digit < 256; ++digit) {
+            uint32_t digit_count = offsets[digit];
+            offsets[digit] = offset;
+            offset += digit_count;
+        }
+        for(uint32_t i = 0; i < count; ++i)
+            dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+        QueueItem *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    return src;
+}
+
+void render_queue_sort(RenderQueue *queue) {
+    RenderQueueStats stats = { 0 };
+    stats.item_count = queue->count;
+    for(uint32_t i = 0; i < queue->count; ++i) {
+        uint32_t state = (uint32_t)(queue->items[i].key >> QUEUE_STATE_SHIFT);
+        uint32_t previous = i ? (uint32_t)(queue->items[i - 1].key >> QUEUE_STATE_SHIFT) : 0;
+        stats.unsorted_pipeline_binds += !i || state_pipeline(state) != state_pipeline(previous);
+        stats.unsorted_material_binds += !i || state_material(state) != state_material(previous);
+    }
+
+    queue->draw_count = 0;
+    queue->batch_count = 0;
+    const QueueItem *sorted = queue->count ? radix_sort(queue->items, queue->scratch, queue->count) : NULL;
+    for(uint32_t i = 0; i < queue->count; ++i) {
+        uint32_t state = (uint32_t)(sorted[i].key >> QUEUE_STATE_SHIFT);
+        const VkDrawIndirectCommand *draw = &queue->pushed[sorted[i].draw];
+        QueueBatch *batch = queue->batch_count ? &queue->batches[queue->batch_count - 1] : NULL;
+        if(batch && batch->state == state) {
+            // The next instances of the same vertices, one instanced draw covers both
+            VkDrawIndirectCommand *last = &queue->draws[queue->draw_count - 1];
+            if(last->vertexCount == draw->vertexCount && last->firstVertex == draw->firstVertex && last->firstInstance + last->instanceCount == draw->firstInstance) {
+                last->instanceCount += draw->instanceCount;
+                continue;
+            }
+            if(batch->draw_count < queue->multi_draw_limit) {
+                queue->draws[queue->draw_count++] = *draw;
+                ++batch->draw_count;
+                continue;
+            }
+        }
+        queue->draws[queue->draw_count] = *draw;
+        queue->batches[queue->batch_count++] = (QueueBatch){ state, queue->draw_count++, 1 };
+    }
+
+    for(uint32_t i = 0; i < queue->batch_count; ++i) {
+        uint32_t state = queue->batches[i].state;
+        uint32_t previous = i ? queue->batches[i - 1].state : 0;
+        stats.pipeline_binds += !i || state_pipeline(state) != state_pipeline(previous);
+        stats.material_binds += !i || state_material(state) != state_material(previous);
+    }
+    stats.draw_count = queue->draw_count;
+    stats.draw_calls = queue->batch_count;
+    queue->stats = stats;
+}
+
+const VkDrawIndirectCommand *render_queue_draws(const RenderQueue *queue, uint32_t *draw_count) {
+    *draw_count = queue->draw_count;
+    return queue->draws;
+}
+
+uint32_t render_queue_batch_count(const RenderQueue *queue) {
+    return queue->batch_count;
+}
+
+void render_queue_record(const RenderQueue *queue, VkCommandBuffer command_buffer, const RenderQueueBindings *bindings, uint32_t first_batch, uint32_t batch_count) {
+    uint32_t bound = 0;
+    for(uint32_t i = first_batch; i < first_batch + batch_count; ++i) {
+        const QueueBatch *batch = &queue->batches[i];
+        uint32_t pipeline = state_pipeline(batch->state), material = state_material(batch->state);
+        if(i == first_batch || pipeline != state_pipeline(bound))
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bindings->pipelines[pipeline]);
+        // Push constants stay across pipelines with compatible layouts
+        if(bindings->materials && (i == first_batch || material != state_material(bound)))
+            vkCmdPushConstants(command_buffer, bindings->pipeline_layout, bindings->material_stages, bindings->material_offset, sizeof(uint32_t), &bindings->materials[material]);
+        bound = batch->state;
+
+        if(batch->draw_count > 1) {
+            VkDeviceSize offset = bindings->draw_offset + sizeof(VkDrawIndirectCommand) * batch->first_draw;
+            vkCmdDrawIndirect(command_buffer, bindings->draw_buffer, offset, batch->draw_count, sizeof(VkDrawIndirectCommand));
+        } else {
+            const VkDrawIndirectCommand *draw = &queue->draws[batch->first_draw];
+            vkCmdDraw(command_buffer, draw->vertexCount, draw->instanceCount, draw->firstVertex, draw->firstInstance);
+        }
+    }
+}
+
+RenderQueueStats render_queue_stats(const RenderQueue *queue) {
+    return queue->stats;
+}
+
+void render_queue_print_stats(const RenderQueue *queue) {
+    const RenderQueueStats *stats = &queue->stats;
+    printf("Render queue: %u draws merged into %u, recorded with %u draw calls%s\n", stats->item_count, stats->draw_count, stats->draw_calls,
+        queue->multi_draw_limit ? "" : " (no multiDrawIndirect)");
+    printf("Render queue binds per frame: %u pipelines and %u materials in push order, %u and %u sorted\n",
+        stats->unsorted_pipeline_binds, stats->unsorted_material_binds, stats->pipeline_binds, stats->material_binds);
+}
@@ -0,0 +1,76 @@
+#ifndef VLK_QUEUE_H
+#define VLK_QUEUE_H
+
+#include <volk.h>
+
+#include <stdint.h>
+
+// A render queue. The draws of a frame are pushed in any order, each with a 64 bit
+// sort key of pass, pipeline, material and depth. Sorting is an LSD radix sort that
+// skips the bytes all keys share, so it costs a pass over the draws for each byte that
+// differs. Recording walks the sorted draws and only binds a pipeline or material when
+// it changes. Neighbouring draws with the same state, the same vertices and consecutive
+// instances become one instanced draw. The remaining draws of the same state become a
+// single vkCmdDrawIndirect where the device has multiDrawIndirect.
+//
+// Key, from the most significant bits:
+//   pass      4 bits, drawn in order
+//   pipeline 12 bits, index into RenderQueueBindings.pipelines
+//   material 16 bits, index into RenderQueueBindings.materials
+//   depth    32 bits, near to far, or far to near for passes that blend
+
+#define RENDER_QUEUE_MAX_PASSES 16
+#define RENDER_QUEUE_MAX_PIPELINES 4096
+#define RENDER_QUEUE_MAX_MATERIALS 65536
+
+typedef struct RenderQueue RenderQueue;
+
+// What recording the queue binds, shared by all draws. Materials are a push constant,
+// e.g. a BindlessHandle. materials may be NULL to push nothing.
+typedef struct RenderQueueBindings {
+    const VkPipeline *pipelines;
+    VkPipelineLayout pipeline_layout;
+    const uint32_t *materials;
+    VkShaderStageFlags material_stages;
+    uint32_t material_offset;
+    VkBuffer draw_buffer; // Holds render_queue_draws, needed once multi_draw_limit isn't 0
+    VkDeviceSize draw_offset;
+} RenderQueueBindings;
+
+// Per frame, as of the last sort. The unsorted counts are what recording the draws in the
+// order they were pushed would have taken.
+typedef struct RenderQueueStats {
+    uint32_t item_count;
+    uint32_t unsorted_pipeline_binds;
+    uint32_t unsorted_material_binds;
+    uint32_t pipeline_binds;
+    uint32_t material_binds;
+    uint32_t draw_count; // After merging consecutive instances
+    uint32_t draw_calls; // vkCmdDraw and vkCmdDrawIndirect calls
+} RenderQueueStats;
+
+// multi_draw_limit is the most draws one vkCmdDrawIndirect takes. 0 records each draw
+// with vkCmdDraw, for devices without multiDrawIndirect or drawIndirectFirstInstance.
+RenderQueue *render_queue_create(uint32_t multi_draw_limit);
+void render_queue_destroy(RenderQueue *queue);
+
+// Depth is the distance from the camera. back_to_front reverses it for blended passes.
+uint64_t render_queue_key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, char back_to_front);
+
+void render_queue_reset(RenderQueue *queue);
+// Same arguments as vkCmdDraw
+void render_queue_push(RenderQueue *queue, uint64_t key, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
+// Sorts and merges the draws pushed since the reset
+void render_queue_sort(RenderQueue *queue);
+
+// The merged draws in recording order, to be copied into the draw buffer
+const VkDrawIndirectCommand *render_queue_draws(const RenderQueue *queue, uint32_t *draw_count);
+// Draw calls, recording can be split into ranges of them, e.g. one per thread. Each range
+// binds its first state again.
+uint32_t render_queue_batch_count(const RenderQueue *queue);
+void render_queue_record(const RenderQueue *queue, VkCommandBuffer command_buffer, const RenderQueueBindings *bindings, uint32_t first_batch, uint32_t batch_count);
+
+RenderQueueStats render_queue_stats(const RenderQueue *queue);
+void render_queue_print_stats(const RenderQueue *queue);
+
+#endif // VLK_QUEUE_H
@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L // mmap, fstat
+
+#include "vlk_shaders.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>
+
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_HEADER_WORDS 5
+
+#ifdef VLK_EMBED_SHADERS
+// Generated by glslangValidator --vn, see the Makefile
+#include "triangle.vert.spv.h"
+#include "triangle.frag.spv.h"
+#include "instanced.vert.spv.h"
+#include "cull.comp.spv.h"
+#include "particles.comp.spv.h"
+#include "particles.vert.spv.h"
+#include "particles.frag.spv.h"
+#include "mesh.vert.spv.h"
+#include "mesh.frag.spv.h"
+#include "overdraw.vert.spv.h"
+#include "overdraw.frag.spv.h"
+#include "luminance.comp.spv.h"
+#include "luminance_subgroup.comp.spv.h"
+#include "exposure.comp.spv.h"
+#include "exposure_subgroup.comp.spv.h"
+#include "bloom_down.comp.spv.h"
+#include "bloom_up.comp.spv.h"
+#include "tonemap.comp.spv.h"
+
+typedef struct EmbeddedShader {
+    const char *path;
+    const uint32_t *code;
+    size_t size;
+} EmbeddedShader;
+
+static const EmbeddedShader embedded_shaders[] = {
+    { "triangle.vert.spv", triangle_vert_spv, sizeof(triangle_vert_spv) },
+    { "triangle.frag.spv", triangle_frag_spv, sizeof(triangle_frag_spv) },
+    { "instanced.vert.spv", instanced_vert_spv, sizeof(instanced_vert_spv) },
+    { "cull.comp.spv", cull_comp_spv, sizeof(cull_comp_spv) },
+    { "particles.comp.spv", particles_comp_spv, sizeof(particles_comp_spv) },
+    { "particles.vert.spv", particles_vert_spv, sizeof(particles_vert_spv) },
+    { "particles.frag.spv", particles_frag_spv, sizeof(particles_frag_spv) },
+    { "mesh.vert.spv", mesh_vert_spv, sizeof(mesh_vert_spv) },
+    { "mesh.frag.spv", mesh_frag_spv, sizeof(mesh_frag_spv) },
+    { "overdraw.vert.spv", overdraw_vert_spv, sizeof(overdraw_vert_spv) },
+    { "overdraw.frag.spv", overdraw_frag_spv, sizeof(overdraw_frag_spv) },
+    { "luminance.comp.spv", luminance_comp_spv, sizeof(luminance_comp_spv) },
+    { "luminance_subgroup.comp.spv", luminance_subgroup_comp_spv, sizeof(luminance_subgroup_comp_spv) },
+    { "exposure.comp.spv", exposure_comp_spv, sizeof(exposure_comp_spv) },
+    { "exposure_subgroup.comp.spv", exposure_subgroup_comp_spv, sizeof(exposure_subgroup_comp_spv) },
+    { "bloom_down.comp.spv", bloom_down_comp_spv, sizeof(bloom_down_comp_spv) },
+    { "bloom_up.comp.spv", bloom_up_comp_spv, sizeof(bloom_up_comp_spv) },
+    { "tonemap.comp.spv", tonemap_comp_spv, sizeof(tonemap_comp_spv) },
+};
+#endif // VLK_EMBED_SHADERS
+
+static uint32_t shaders_loaded;
+static size_t shader_bytes;
+static double shader_load_ms;
+
+static double get_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void validate(const char *path, const ShaderCode *code) {
+    if((uintptr_t)code->code % sizeof(uint32_t) != 0) {
+        fprintf(stderr, "%s is not 4 byte aligned.\n", path);
+        exit(1);
+    }
+    if(code->size % sizeof(uint32_t) != 0 || code->size < SPIRV_HEADER_WORDS * sizeof(uint32_t)) {
+        fprintf(stderr, "%s is not SPIR-V, %zu bytes is not a header and whole words.\n", path, code->size);
+        exit(1);
+    }
+    if(code->code[0] != SPIRV_MAGIC) {
+        fprintf(stderr, "%s is not SPIR-V, magic number %08x.\n", path, code->code[0]);
+        exit(1);
+    }
+}
+
+ShaderCode shader_code_load(const char *path) {
+    double begin = get_time_ms();
+    ShaderCode code = { 0 };
+#ifdef VLK_EMBED_SHADERS
+    for(uint32_t i = 0; i < sizeof(embedded_shaders) / sizeof(embedded_shaders[0]); ++i) {
+        if(strcmp(embedded_shaders[i].path, path) == 0) {
+            code.code = embedded_shaders[i].code;
+            code.size = embedded_shaders[i].size;
+            break;
+        }
+    }
+    if(!code.code) {
+        fprintf(stderr, "%s is not embedded in this build.\n", path);
+        exit(1);
+    }
+#else
+    int file = open(path, O_RDONLY);
+    if(file < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        exit(1);
+    }
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size <= 0) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        exit(1);
+    }
+    code.size = (size_t)info.st_size;
+    code.mapping = mmap(NULL, code.size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(code.mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s.\n", path);
+        exit(1);
+    }
+    code.code = code.mapping;
+#endif // VLK_EMBED_SHADERS
+    validate(path, &code);
+    ++shaders_loaded;
+    shader_bytes += code.size;
+    shader_load_ms += get_time_ms() - begin;
+    return code;
+}
+
+void shader_code_release(ShaderCode *code) {
+    if(code->mapping)
+        munmap(code->mapping, code->size);
+    *code = (ShaderCode){ 0 };
+}
+
+void shader_code_print_stats(void) {
+#ifdef VLK_EMBED_SHADERS
+    const char *source = "embedded";
+#else
+    const char *source = "mmap";
+#endif
+    printf("Shaders: %u loaded (%.1f KB) in %.3f ms from %s\n", shaders_loaded, shader_bytes / 1024.0, shader_load_ms, source);
+}
@@ -0,0 +1,24 @@
+#ifndef VLK_SHADERS_H
+#define VLK_SHADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SPIR-V is handed to vkCreateShaderModule straight from where it lives, without a copy.
+// Built with EMBED_SHADERS=1 the .spv files are compiled into the binary as uint32_t
+// arrays. Otherwise they are memory mapped, which keeps them page aligned.
+
+typedef struct ShaderCode {
+    const uint32_t *code;
+    size_t size; // Bytes
+    void *mapping; // NULL for embedded shaders
+} ShaderCode;
+
+// Exits when the file is missing, truncated or not SPIR-V
+ShaderCode shader_code_load(const char *path);
+void shader_code_release(ShaderCode *code);
+
+// How many shaders were loaded, how large they were and how long it took
+void shader_code_print_stats(void);
+
+#endif // VLK_SHADERS_H
@@ -0,0 +1,176 @@
+#include "vlk_startup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <SDL2/SDL.h>
+
+typedef enum StartupTaskState {
+    STARTUP_TASK_WAITING,
+    STARTUP_TASK_RUNNING,
+    STARTUP_TASK_DONE,
+} StartupTaskState;
+
+typedef struct StartupTask {
+    StartupGraph *graph;
+    const char *name;
+    StartupTaskFn fn;
+    void *user_data;
+    char main_thread;
+    uint32_t dependencies[STARTUP_MAX_DEPENDENCIES];
+    uint32_t dependency_count;
+    StartupTaskState state;
+    uint32_t thread; // 0 is the main thread, workers count from 1
+    double start_ms;
+    double end_ms;
+} StartupTask;
+
+struct StartupGraph {
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;
+    ThreadPool *pool;
+    StartupTask tasks[STARTUP_MAX_TASKS];
+    uint32_t task_count;
+    uint32_t done_count;
+    double origin_ms;
+    double end_ms;
+};
+
+static double get_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static char task_ready(const StartupGraph *graph, const StartupTask *task) {
+    if(task->state != STARTUP_TASK_WAITING)
+        return 0;
+    for(uint32_t i = 0; i < task->dependency_count; ++i) {
+        if(graph->tasks[task->dependencies[i]].state != STARTUP_TASK_DONE)
+            return 0;
+    }
+    return 1;
+}
+
+static void finish_task(StartupGraph *graph, StartupTask *task) {
+    task->end_ms = get_time_ms() - graph->origin_ms;
+    task->state = STARTUP_TASK_DONE;
+    ++graph->done_count;
+}
+
+static void dispatch_ready(StartupGraph *graph);
+
+static void run_worker_task(void *user_data, uint32_t worker_index) {
+    StartupTask *task = user_data;
+    StartupGraph *graph = task->graph;
+    task->thread = worker_index + 1;
+    task->start_ms = get_time_ms() - graph->origin_ms;
+    task->fn(task->user_data);
+
+    pthread_mutex_lock(&graph->mutex);
+    finish_task(graph, task);
+    // Successors go straight to the pool instead of waiting for the main thread to wake up
+    dispatch_ready(graph);
+    pthread_cond_broadcast(&graph->finished);
+    pthread_mutex_unlock(&graph->mutex);
+}
+
+// Called with the mutex held
+static void dispatch_ready(StartupGraph *graph) {
+    for(uint32_t i = 0; i < graph->task_count; ++i) {
+        StartupTask *task = &graph->tasks[i];
+        if(task->main_thread || !task_ready(graph, task))
+            continue;
+        task->state = STARTUP_TASK_RUNNING;
+        thread_pool_submit(graph->pool, run_worker_task, task);
+    }
+}
+
+StartupGraph *startup_graph_create(void) {
+    StartupGraph *graph = calloc(1, sizeof(StartupGraph));
+    pthread_mutex_init(&graph->mutex, NULL);
+    pthread_cond_init(&graph->finished, NULL);
+    return graph;
+}
+
+void startup_graph_destroy(StartupGraph *graph) {
+    pthread_cond_destroy(&graph->finished);
+    pthread_mutex_destroy(&graph->mutex);
+    free(graph);
+}
+
+uint32_t startup_graph_add(StartupGraph *graph, const char *name, StartupTaskFn fn, void *user_data, char main_thread) {
+    if(graph->task_count == STARTUP_MAX_TASKS) {
+        fprintf(stderr, "Too many startup tasks.\n");
+        exit(1);
+    }
+    StartupTask *task = &graph->tasks[graph->task_count];
+    task->graph = graph;
+    task->name = name;
+    task->fn = fn;
+    task->user_data = user_data;
+    task->main_thread = main_thread;
+    return graph->task_count++;
+}
+
+void startup_graph_depend(StartupGraph *graph, uint32_t task, uint32_t dependency) {
+    // Only earlier tasks, which rules out cycles
+    if(dependency >= task || graph->tasks[task].dependency_count == STARTUP_MAX_DEPENDENCIES) {
+        fprintf(stderr, "Invalid dependency of startup task %s.\n", graph->tasks[task].name);
+        exit(1);
+    }
+    graph->tasks[task].dependencies[graph->tasks[task].dependency_count++] = dependency;
+}
+
+void startup_graph_run(StartupGraph *graph, ThreadPool *pool) {
+    graph->pool = pool;
+    graph->origin_ms = get_time_ms();
+    pthread_mutex_lock(&graph->mutex);
+    dispatch_ready(graph);
+    while(graph->done_count < graph->task_count) {
+        StartupTask *main_task = NULL;
+        for(uint32_t i = 0; i < graph->task_count && !main_task; ++i) {
+            if(graph->tasks[i].main_thread && task_ready(graph, &graph->tasks[i]))
+                main_task = &graph->tasks[i];
+        }
+        if(!main_task) {
+            pthread_cond_wait(&graph->finished, &graph->mutex);
+            continue;
+        }
+        main_task->state = STARTUP_TASK_RUNNING;
+        pthread_mutex_unlock(&graph->mutex);
+        main_task->start_ms = get_time_ms() - graph->origin_ms;
+        main_task->fn(main_task->user_data);
+        pthread_mutex_lock(&graph->mutex);
+        finish_task(graph, main_task);
+        dispatch_ready(graph);
+    }
+    pthread_mutex_unlock(&graph->mutex);
+    graph->end_ms = get_time_ms() - graph->origin_ms;
+}
+
+static int compare_start(const void *a, const void *b) {
+    const StartupTask *x = *(const StartupTask *const *)a;
+    const StartupTask *y = *(const StartupTask *const *)b;
+    return (x->start_ms > y->start_ms) - (x->start_ms < y->start_ms);
+}
+
+void startup_graph_print_trace(const StartupGraph *graph) {
+    const StartupTask *order[STARTUP_MAX_TASKS];
+    double task_ms = 0.0;
+    for(uint32_t i = 0; i < graph->task_count; ++i) {
+        order[i] = &graph->tasks[i];
+        task_ms += graph->tasks[i].end_ms - graph->tasks[i].start_ms;
+    }
+    qsort(order, graph->task_count, sizeof(order[0]), compare_start);
+    printf("Startup trace:\n");
+    for(uint32_t i = 0; i < graph->task_count; ++i) {
+        const StartupTask *task = order[i];
+        char thread[24]; // "worker " and any %u
+        if(task->thread)
+            snprintf(thread, sizeof(thread), "worker %u", task->thread - 1);
+        else
+            snprintf(thread, sizeof(thread), "main");
+        printf("  %-16s %8.2f ms +%8.2f ms  %s\n", task->name, task->start_ms, task->end_ms - task->start_ms, thread);
+    }
+    printf("Startup graph: %.2f ms, %.2f ms of tasks (%.2fx overlap)\n", graph->end_ms, task_ms, graph->end_ms > 0.0 ? task_ms / graph->end_ms : 0.0);
+}
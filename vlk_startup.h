@@ -0,0 +1,32 @@
+#ifndef VLK_STARTUP_H
+#define VLK_STARTUP_H
+
+#include <stdint.h>
+
+#include "vlk_threads.h"
+
+// Initialization as a graph of tasks. A task is handed to the thread pool as soon as
+// everything it depends on has finished, so independent steps overlap. Tasks marked
+// main thread (window and surface creation) run on the thread calling startup_graph_run.
+
+#define STARTUP_MAX_TASKS 32
+#define STARTUP_MAX_DEPENDENCIES 4
+
+typedef void (*StartupTaskFn)(void *user_data);
+
+typedef struct StartupGraph StartupGraph;
+
+StartupGraph *startup_graph_create(void);
+void startup_graph_destroy(StartupGraph *graph);
+
+// Returns the task index to depend on
+uint32_t startup_graph_add(StartupGraph *graph, const char *name, StartupTaskFn fn, void *user_data, char main_thread);
+void startup_graph_depend(StartupGraph *graph, uint32_t task, uint32_t dependency);
+
+// Blocks until every task has run
+void startup_graph_run(StartupGraph *graph, ThreadPool *pool);
+
+// Start, duration and thread of every task, plus the wall time against the summed task time
+void startup_graph_print_trace(const StartupGraph *graph);
+
+#endif // VLK_STARTUP_H
@@ -0,0 +1,497 @@
+#define _POSIX_C_SOURCE 200809L // mmap, fstat
+
+#include "vlk_streaming.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define KTX2_HEADER_SIZE 80 // Header plus the index, the level index follows
+#define KTX2_LEVEL_ENTRY_SIZE 24
+#define STREAM_MAX_LEVELS 16
+#define STREAM_TAIL_SIZE 64 // Levels up to this size are uploaded at load time and never evicted
+#define STREAM_UPLOAD_LIMIT (16ull * 1024 * 1024) // Bytes streamed in per update
+#define STREAM_BUDGET_INTERVAL 30 // Updates between memory budget queries
+
+static const uint8_t ktx2_identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+typedef struct StreamLevel {
+    VkDeviceSize offset; // Into the mapping
+    VkDeviceSize size;
+} StreamLevel;
+
+// The resident levels of a texture, base_level and up
+typedef struct StreamImage {
+    VkImage image;
+    VkImageView view;
+    MemoryAllocation allocation;
+    BindlessHandle handle;
+    uint32_t base_level;
+} StreamImage;
+
+typedef struct StreamTexture {
+    void *mapping;
+    size_t mapping_size;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t tail_level;
+    uint32_t block_height; // Texels, 4 for BC formats
+    StreamLevel levels[STREAM_MAX_LEVELS];
+    StreamImage current;
+    uint32_t requested_level;
+    uint64_t last_used; // Frame of the last request, 0 if never
+} StreamTexture;
+
+typedef struct RetiredImage {
+    StreamImage image;
+    uint64_t frame; // Freed once this many frames have completed
+} RetiredImage;
+
+typedef struct StreamOrder {
+    uint64_t last_used;
+    uint32_t index;
+} StreamOrder;
+
+struct TextureStreamer {
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    MemoryAllocator *allocator;
+    UploadQueue *uploads;
+    BindlessTable *bindless;
+    char memory_budget;
+    uint32_t heap; // Largest device local heap
+    VkDeviceSize budget_cap;
+    VkDeviceSize budget;
+    VkDeviceSize resident_bytes; // Current images only, retired ones are on their way out
+
+    StreamTexture *textures;
+    uint32_t texture_count;
+    uint32_t texture_capacity;
+    RetiredImage *retired;
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    uint32_t *targets;
+    StreamOrder *order;
+
+    uint64_t frame;
+    uint32_t updates;
+    uint64_t streamed_bytes;
+    uint32_t stream_ins;
+    uint32_t evictions;
+    uint32_t deferred; // Stream ins pushed to a later update by STREAM_UPLOAD_LIMIT
+};
+
+static uint32_t read_u32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(const uint8_t *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t level_extent(uint32_t size, uint32_t level) {
+    return size >> level ? size >> level : 1;
+}
+
+// Bytes per texel block and its size in texels, for the formats the streamer supports. 0 for the rest.
+static uint32_t format_block(VkFormat format, uint32_t *block_size) {
+    *block_size = 1;
+    switch(format) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        return 1;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+    case VK_FORMAT_R16_SFLOAT:
+        return 2;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+        return 4;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    default:
+        break;
+    }
+    *block_size = 4;
+    switch(format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+// Bytes of the levels from base down to the smallest
+static VkDeviceSize chain_size(const StreamTexture *texture, uint32_t base) {
+    VkDeviceSize size = 0;
+    for(uint32_t i = base; i < texture->level_count; ++i)
+        size += texture->levels[i].size;
+    return size;
+}
+
+static void query_budget(TextureStreamer *streamer) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = { 0 };
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = { 0 };
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = streamer->memory_budget ? &budget_properties : NULL;
+    vkGetPhysicalDeviceMemoryProperties2(streamer->physical_device, &properties);
+
+    VkDeviceSize budget;
+    if(streamer->memory_budget) {
+        // Usage includes our own textures. Leave a quarter of what is left to everything else.
+        VkDeviceSize heap_budget = budget_properties.heapBudget[streamer->heap];
+        VkDeviceSize heap_usage = budget_properties.heapUsage[streamer->heap];
+        if(heap_usage > heap_budget)
+            budget = streamer->resident_bytes > heap_usage - heap_budget ? streamer->resident_bytes - (heap_usage - heap_budget) : 0;
+        else
+            budget = streamer->resident_bytes + (heap_budget - heap_usage) / 4 * 3;
+    } else {
+        budget = properties.memoryProperties.memoryHeaps[streamer->heap].size / 2;
+    }
+    if(streamer->budget_cap && budget > streamer->budget_cap)
+        budget = streamer->budget_cap;
+    streamer->budget = budget;
+}
+
+TextureStreamer *texture_streamer_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, UploadQueue *uploads, BindlessTable *bindless, char memory_budget, VkDeviceSize budget) {
+    TextureStreamer *streamer = calloc(1, sizeof(TextureStreamer));
+    streamer->device = device;
+    streamer->physical_device = physical_device;
+    streamer->allocator = allocator;
+    streamer->uploads = uploads;
+    streamer->bindless = bindless;
+    streamer->memory_budget = memory_budget;
+    streamer->budget_cap = budget;
+
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &properties);
+    for(uint32_t i = 0; i < properties.memoryHeapCount; ++i) {
+        if((properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && properties.memoryHeaps[i].size > properties.memoryHeaps[streamer->heap].size)
+            streamer->heap = i;
+    }
+    query_budget(streamer);
+    return streamer;
+}
+
+static StreamImage create_stream_image(TextureStreamer *streamer, const StreamTexture *texture, uint32_t base_level) {
+    StreamImage image = { 0 };
+    image.base_level = base_level;
+
+    VkImageCreateInfo image_info = { 0 };
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = texture->format;
+    image_info.extent.width = level_extent(texture->width, base_level);
+    image_info.extent.height = level_extent(texture->height, base_level);
+    image_info.extent.depth = 1;
+    image_info.mipLevels = texture->level_count - base_level;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image.image = memory_create_image(streamer->allocator, &image_info, MEMORY_USAGE_GPU_ONLY, &image.allocation);
+
+    VkImageViewCreateInfo view_info = { 0 };
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = texture->format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = image_info.mipLevels;
+    view_info.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(streamer->device, &view_info, NULL, &image.view) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan image view.\n");
+        exit(1);
+    }
+
+    // Every level comes straight from the mapped file, including the ones the previous image already had
+    for(uint32_t i = 0; i < image_info.mipLevels; ++i) {
+        uint32_t level = base_level + i;
+        VkExtent3D extent = { level_extent(texture->width, level), level_extent(texture->height, level), 1 };
+        upload_image(streamer->uploads, image.image, i, extent, texture->block_height, (const char *)texture->mapping + texture->levels[level].offset, texture->levels[level].size,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    image.handle = bindless_register_view(streamer->bindless, image.view);
+    streamer->resident_bytes += image.allocation.size;
+    return image;
+}
+
+static void free_stream_image(TextureStreamer *streamer, StreamImage *image) {
+    bindless_release(streamer->bindless, image->handle);
+    vkDestroyImageView(streamer->device, image->view, NULL);
+    vkDestroyImage(streamer->device, image->image, NULL);
+    memory_free(streamer->allocator, &image->allocation);
+}
+
+// The frames submitted so far may still sample the old image
+static void rebuild_texture(TextureStreamer *streamer, StreamTexture *texture, uint32_t base_level) {
+    if(streamer->retired_count == streamer->retired_capacity) {
+        streamer->retired_capacity = streamer->retired_capacity ? streamer->retired_capacity * 2 : 16;
+        streamer->retired = realloc(streamer->retired, sizeof(RetiredImage) * streamer->retired_capacity);
+    }
+    streamer->retired[streamer->retired_count++] = (RetiredImage){ texture->current, streamer->frame };
+    streamer->resident_bytes -= texture->current.allocation.size;
+    texture->current = create_stream_image(streamer, texture, base_level);
+}
+
+void texture_streamer_destroy(TextureStreamer *streamer) {
+    for(uint32_t i = 0; i < streamer->retired_count; ++i)
+        free_stream_image(streamer, &streamer->retired[i].image);
+    for(uint32_t i = 0; i < streamer->texture_count; ++i) {
+        free_stream_image(streamer, &streamer->textures[i].current);
+        munmap(streamer->textures[i].mapping, streamer->textures[i].mapping_size);
+    }
+    free(streamer->retired);
+    free(streamer->textures);
+    free(streamer->targets);
+    free(streamer->order);
+    free(streamer);
+}
+
+static void parse_ktx2(TextureStreamer *streamer, StreamTexture *texture, const char *path) {
+    const uint8_t *data = texture->mapping;
+    if(texture->mapping_size < KTX2_HEADER_SIZE || memcmp(data, ktx2_identifier, sizeof(ktx2_identifier)) != 0) {
+        fprintf(stderr, "%s is not a KTX2 file.\n", path);
+        exit(1);
+    }
+    texture->format = (VkFormat)read_u32(data + 12);
+    texture->width = read_u32(data + 20);
+    texture->height = read_u32(data + 24);
+    uint32_t depth = read_u32(data + 28);
+    uint32_t layer_count = read_u32(data + 32);
+    uint32_t face_count = read_u32(data + 36);
+    texture->level_count = read_u32(data + 40) ? read_u32(data + 40) : 1;
+    uint32_t supercompression = read_u32(data + 44);
+    if(texture->format == VK_FORMAT_UNDEFINED || supercompression != 0) {
+        fprintf(stderr, "%s is supercompressed, only plain Vulkan formats are supported.\n", path);
+        exit(1);
+    }
+    if(!texture->width || !texture->height || depth > 1 || layer_count > 1 || face_count != 1) {
+        fprintf(stderr, "%s is not a single 2D texture.\n", path);
+        exit(1);
+    }
+    uint32_t block_size;
+    uint32_t block_bytes = format_block(texture->format, &block_size);
+    if(!block_bytes) {
+        fprintf(stderr, "%s uses format %d, which the streamer does not support.\n", path, (int)texture->format);
+        exit(1);
+    }
+    texture->block_height = block_size;
+    uint32_t max_level_count = 1;
+    while((texture->width | texture->height) >> max_level_count)
+        ++max_level_count;
+    if(texture->level_count > max_level_count) {
+        fprintf(stderr, "%s has %u levels, a %ux%u texture has at most %u.\n", path, texture->level_count, texture->width, texture->height, max_level_count);
+        exit(1);
+    }
+    if(texture->level_count > STREAM_MAX_LEVELS || KTX2_HEADER_SIZE + (size_t)texture->level_count * KTX2_LEVEL_ENTRY_SIZE > texture->mapping_size) {
+        fprintf(stderr, "%s has an invalid level index.\n", path);
+        exit(1);
+    }
+    for(uint32_t i = 0; i < texture->level_count; ++i) {
+        const uint8_t *entry = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+        texture->levels[i].offset = read_u64(entry);
+        texture->levels[i].size = read_u64(entry + 8);
+        if(!texture->levels[i].size || texture->levels[i].offset > texture->mapping_size || texture->levels[i].size > texture->mapping_size - texture->levels[i].offset) {
+            fprintf(stderr, "%s level %u lies outside the file.\n", path, i);
+            exit(1);
+        }
+        // Copies read exactly this many bytes from the level
+        VkDeviceSize expected = (VkDeviceSize)((level_extent(texture->width, i) + block_size - 1) / block_size)
+            * ((level_extent(texture->height, i) + block_size - 1) / block_size) * block_bytes;
+        if(texture->levels[i].size != expected) {
+            fprintf(stderr, "%s level %u has %llu bytes instead of %llu.\n", path, i, (unsigned long long)texture->levels[i].size, (unsigned long long)expected);
+            exit(1);
+        }
+    }
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(streamer->physical_device, texture->format, &format_properties);
+    if(!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        fprintf(stderr, "%s uses format %d, which this device cannot sample.\n", path, (int)texture->format);
+        exit(1);
+    }
+}
+
+StreamedTexture texture_streamer_load(TextureStreamer *streamer, const char *path) {
+    StreamTexture texture = { 0 };
+    int file = open(path, O_RDONLY);
+    if(file < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        exit(1);
+    }
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size <= 0) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        exit(1);
+    }
+    texture.mapping_size = (size_t)info.st_size;
+    texture.mapping = mmap(NULL, texture.mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(texture.mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s.\n", path);
+        exit(1);
+    }
+    parse_ktx2(streamer, &texture, path);
+
+    texture.tail_level = texture.level_count - 1;
+    for(uint32_t i = 0; i < texture.level_count; ++i) {
+        if(level_extent(texture.width, i) <= STREAM_TAIL_SIZE && level_extent(texture.height, i) <= STREAM_TAIL_SIZE) {
+            texture.tail_level = i;
+            break;
+        }
+    }
+    texture.requested_level = texture.tail_level;
+    texture.current = create_stream_image(streamer, &texture, texture.tail_level);
+    upload_flush(streamer->uploads);
+
+    if(streamer->texture_count == streamer->texture_capacity) {
+        streamer->texture_capacity = streamer->texture_capacity ? streamer->texture_capacity * 2 : 16;
+        streamer->textures = realloc(streamer->textures, sizeof(StreamTexture) * streamer->texture_capacity);
+        streamer->targets = realloc(streamer->targets, sizeof(uint32_t) * streamer->texture_capacity);
+        streamer->order = realloc(streamer->order, sizeof(StreamOrder) * streamer->texture_capacity);
+    }
+    streamer->textures[streamer->texture_count] = texture;
+    return streamer->texture_count++;
+}
+
+BindlessHandle texture_streamer_handle(const TextureStreamer *streamer, StreamedTexture texture) {
+    return streamer->textures[texture].current.handle;
+}
+
+void texture_streamer_request(TextureStreamer *streamer, StreamedTexture index, float screen_pixels) {
+    StreamTexture *texture = &streamer->textures[index];
+    // The smallest level that still has a texel per covered pixel
+    double texels = (double)texture->width * texture->height;
+    uint32_t level = 0;
+    while(level < texture->tail_level && texels / 4.0 >= screen_pixels) {
+        texels /= 4.0;
+        ++level;
+    }
+    texture->requested_level = level;
+    texture->last_used = streamer->frame + 1;
+}
+
+static int compare_recent_first(const void *a, const void *b) {
+    const StreamOrder *x = a;
+    const StreamOrder *y = b;
+    return (x->last_used < y->last_used) - (x->last_used > y->last_used);
+}
+
+void texture_streamer_update(TextureStreamer *streamer, uint64_t frames_submitted, uint64_t frames_completed) {
+    streamer->frame = frames_submitted;
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < streamer->retired_count; ++i) {
+        if(streamer->retired[i].frame <= frames_completed)
+            free_stream_image(streamer, &streamer->retired[i].image);
+        else
+            streamer->retired[kept++] = streamer->retired[i];
+    }
+    streamer->retired_count = kept;
+    if(streamer->updates++ % STREAM_BUDGET_INTERVAL == 0)
+        query_budget(streamer);
+
+    // What every texture asked for, then the top mips of the least recently used go until it fits
+    uint32_t *targets = streamer->targets;
+    VkDeviceSize total = 0;
+    for(uint32_t i = 0; i < streamer->texture_count; ++i) {
+        targets[i] = streamer->textures[i].requested_level;
+        total += chain_size(&streamer->textures[i], targets[i]);
+    }
+    while(total > streamer->budget) {
+        uint32_t victim = UINT32_MAX;
+        for(uint32_t i = 0; i < streamer->texture_count; ++i) {
+            const StreamTexture *texture = &streamer->textures[i];
+            if(targets[i] >= texture->tail_level)
+                continue;
+            if(victim == UINT32_MAX || texture->last_used < streamer->textures[victim].last_used
+                || (texture->last_used == streamer->textures[victim].last_used && texture->levels[targets[i]].size > streamer->textures[victim].levels[targets[victim]].size))
+                victim = i;
+        }
+        if(victim == UINT32_MAX)
+            break; // Only mip tails left
+        total -= streamer->textures[victim].levels[targets[victim]].size;
+        ++targets[victim];
+    }
+
+    // Shrink first to free memory, then stream in with the most recently used first
+    char rebuilt = 0;
+    for(uint32_t i = 0; i < streamer->texture_count; ++i) {
+        if(targets[i] > streamer->textures[i].current.base_level) {
+            rebuild_texture(streamer, &streamer->textures[i], targets[i]);
+            ++streamer->evictions;
+            rebuilt = 1;
+        }
+    }
+    uint32_t grow_count = 0;
+    for(uint32_t i = 0; i < streamer->texture_count; ++i) {
+        if(targets[i] < streamer->textures[i].current.base_level)
+            streamer->order[grow_count++] = (StreamOrder){ streamer->textures[i].last_used, i };
+    }
+    qsort(streamer->order, grow_count, sizeof(StreamOrder), compare_recent_first);
+    VkDeviceSize uploaded = 0;
+    for(uint32_t i = 0; i < grow_count; ++i) {
+        StreamTexture *texture = &streamer->textures[streamer->order[i].index];
+        VkDeviceSize size = chain_size(texture, targets[streamer->order[i].index]);
+        if(uploaded && uploaded + size > STREAM_UPLOAD_LIMIT) {
+            ++streamer->deferred;
+            continue;
+        }
+        rebuild_texture(streamer, texture, targets[streamer->order[i].index]);
+        uploaded += size;
+        ++streamer->stream_ins;
+        rebuilt = 1;
+    }
+    streamer->streamed_bytes += uploaded;
+    if(rebuilt)
+        upload_flush(streamer->uploads);
+}
+
+void texture_streamer_print_stats(const TextureStreamer *streamer) {
+    uint32_t full = 0;
+    for(uint32_t i = 0; i < streamer->texture_count; ++i)
+        full += streamer->textures[i].current.base_level == 0;
+    printf("Texture streaming: %u textures, %u at full resolution, %.1f MB resident of a %.1f MB budget%s\n", streamer->texture_count, full,
+        streamer->resident_bytes / (1024.0 * 1024.0), streamer->budget / (1024.0 * 1024.0), streamer->memory_budget ? " (VK_EXT_memory_budget)" : "");
+    printf("Streamed in %.1f MB in %u rebuilds, %u evictions, %u deferred by the upload limit\n", streamer->streamed_bytes / (1024.0 * 1024.0),
+        streamer->stream_ins, streamer->evictions, streamer->deferred);
+}
@@ -0,0 +1,44 @@
+#ifndef VLK_STREAMING_H
+#define VLK_STREAMING_H
+
+#include <volk.h>
+
+#include "vlk_bindless.h"
+#include "vlk_memory.h"
+#include "vlk_upload.h"
+
+// Mip level streaming for KTX2 textures. Files are memory mapped and only the mip tail is
+// uploaded at load time. Larger mips are streamed in when the app requests them, under a
+// VRAM budget taken from VK_EXT_memory_budget, and the least recently used textures lose
+// their top mips again when the budget is exceeded.
+//
+// A texture is rebuilt as a new image holding the resident levels rather than with sparse
+// residency, so it gets a new bindless handle whenever residency changes. Fetch the handle
+// with texture_streamer_handle while recording; the old image is freed once the frames
+// that used it have completed.
+
+typedef uint32_t StreamedTexture;
+
+typedef struct TextureStreamer TextureStreamer;
+
+// budget 0 uses what VK_EXT_memory_budget reports (or half the heap without the
+// extension), otherwise it caps that
+TextureStreamer *texture_streamer_create(VkDevice device, VkPhysicalDevice physical_device, MemoryAllocator *allocator, UploadQueue *uploads, BindlessTable *bindless, char memory_budget, VkDeviceSize budget);
+void texture_streamer_destroy(TextureStreamer *streamer);
+
+// Maps a KTX2 file (one layer and face, no supercompression) and uploads its mip tail.
+// Exits when the file is missing or not a supported KTX2 file.
+StreamedTexture texture_streamer_load(TextureStreamer *streamer, const char *path);
+BindlessHandle texture_streamer_handle(const TextureStreamer *streamer, StreamedTexture texture);
+
+// Marks the texture as used this frame and asks for the mip that matches screen_pixels,
+// the number of pixels it covers on screen
+void texture_streamer_request(TextureStreamer *streamer, StreamedTexture texture, float screen_pixels);
+
+// Call once per frame before recording. frames_submitted and frames_completed come from
+// the frame timeline and decide when replaced images can be freed.
+void texture_streamer_update(TextureStreamer *streamer, uint64_t frames_submitted, uint64_t frames_completed);
+
+void texture_streamer_print_stats(const TextureStreamer *streamer);
+
+#endif // VLK_STREAMING_H
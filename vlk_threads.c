@@ -0,0 +1,119 @@
+#include "vlk_threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct ThreadTask {
+    ThreadTaskFn task;
+    void *user_data;
+} ThreadTask;
+
+typedef struct ThreadWorker {
+    ThreadPool *pool;
+    uint32_t index;
+    pthread_t thread;
+} ThreadWorker;
+
+struct ThreadPool {
+    pthread_mutex_t mutex;
+    pthread_cond_t task_available;
+    pthread_cond_t tasks_done;
+    ThreadTask *tasks; // Ring buffer
+    uint32_t task_capacity;
+    uint32_t task_head;
+    uint32_t task_count;
+    uint32_t pending; // Queued plus running
+    char stopping;
+    uint32_t worker_count;
+    ThreadWorker *workers;
+};
+
+static void *thread_pool_worker(void *arg) {
+    ThreadWorker *worker = arg;
+    ThreadPool *pool = worker->pool;
+    pthread_mutex_lock(&pool->mutex);
+    for(;;) {
+        while(!pool->task_count && !pool->stopping)
+            pthread_cond_wait(&pool->task_available, &pool->mutex);
+        if(!pool->task_count && pool->stopping)
+            break;
+        ThreadTask task = pool->tasks[pool->task_head];
+        pool->task_head = (pool->task_head + 1) % pool->task_capacity;
+        --pool->task_count;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task.task(task.user_data, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->pending == 0)
+            pthread_cond_broadcast(&pool->tasks_done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+ThreadPool *thread_pool_create(uint32_t worker_count) {
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->task_available, NULL);
+    pthread_cond_init(&pool->tasks_done, NULL);
+    pool->task_capacity = 64;
+    pool->tasks = malloc(sizeof(ThreadTask) * pool->task_capacity);
+    pool->worker_count = worker_count;
+    pool->workers = calloc(worker_count, sizeof(ThreadWorker));
+    for(uint32_t i = 0; i < worker_count; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if(pthread_create(&pool->workers[i].thread, NULL, thread_pool_worker, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Failed to create worker thread.\n");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->task_available);
+    pthread_mutex_unlock(&pool->mutex);
+    for(uint32_t i = 0; i < pool->worker_count; ++i)
+        pthread_join(pool->workers[i].thread, NULL);
+    pthread_cond_destroy(&pool->tasks_done);
+    pthread_cond_destroy(&pool->task_available);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool->tasks);
+    free(pool);
+}
+
+uint32_t thread_pool_worker_count(const ThreadPool *pool) {
+    return pool->worker_count;
+}
+
+void thread_pool_submit(ThreadPool *pool, ThreadTaskFn task, void *user_data) {
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->task_count == pool->task_capacity) {
+        // Unroll the ring into a larger buffer
+        ThreadTask *tasks = malloc(sizeof(ThreadTask) * pool->task_capacity * 2);
+        for(uint32_t i = 0; i < pool->task_count; ++i)
+            tasks[i] = pool->tasks[(pool->task_head + i) % pool->task_capacity];
+        free(pool->tasks);
+        pool->tasks = tasks;
+        pool->task_head = 0;
+        pool->task_capacity *= 2;
+    }
+    pool->tasks[(pool->task_head + pool->task_count) % pool->task_capacity] = (ThreadTask){ task, user_data };
+    ++pool->task_count;
+    ++pool->pending;
+    pthread_cond_signal(&pool->task_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->pending)
+        pthread_cond_wait(&pool->tasks_done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,19 @@
+#ifndef VLK_THREADS_H
+#define VLK_THREADS_H
+
+#include <stdint.h>
+
+// Fixed set of worker threads fed from a shared FIFO. worker_index identifies the
+// thread running the task, so callers can keep per-thread state without locking.
+typedef void (*ThreadTaskFn)(void *user_data, uint32_t worker_index);
+
+typedef struct ThreadPool ThreadPool;
+
+ThreadPool *thread_pool_create(uint32_t worker_count);
+void thread_pool_destroy(ThreadPool *pool);
+uint32_t thread_pool_worker_count(const ThreadPool *pool);
+void thread_pool_submit(ThreadPool *pool, ThreadTaskFn task, void *user_data);
+// Blocks until every task submitted so far has finished
+void thread_pool_wait(ThreadPool *pool);
+
+#endif // VLK_THREADS_H
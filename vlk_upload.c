@@ -0,0 +1,437 @@
+#include "vlk_upload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+
+#define UPLOAD_BATCH_COUNT 8
+
+typedef struct UploadBatch {
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    char recording;
+    uint64_t value; // Timeline value signaled when the batch completes
+    VkDeviceSize ring_bytes; // Ring space to give back once it has
+    VkDeviceSize bytes; // Payload, for the bandwidth numbers
+    // Release barriers, recorded at the end of the batch
+    VkBufferMemoryBarrier *buffer_barriers;
+    uint32_t buffer_barrier_count, buffer_barrier_capacity;
+    VkImageMemoryBarrier *image_barriers;
+    uint32_t image_barrier_count, image_barrier_capacity;
+    VkPipelineStageFlags dst_stages;
+} UploadBatch;
+
+struct UploadQueue {
+    VkDevice device;
+    MemoryAllocator *allocator;
+    VkQueue queue;
+    uint32_t transfer_family;
+    uint32_t graphics_family;
+
+    VkBuffer staging_buffer;
+    MemoryAllocation staging_allocation;
+    VkDeviceSize ring_size;
+    VkDeviceSize ring_head;
+    VkDeviceSize ring_used;
+    VkDeviceSize copy_alignment;
+
+    VkSemaphore timeline;
+    uint64_t submitted_value;
+    UploadBatch batches[UPLOAD_BATCH_COUNT];
+    uint32_t current; // Batch being recorded
+    uint32_t oldest; // Oldest batch still in flight
+    uint32_t in_flight;
+
+    // Acquire side of the ownership transfers flushed since the last upload_record_acquire
+    VkBufferMemoryBarrier *acquire_buffer_barriers;
+    uint32_t acquire_buffer_count, acquire_buffer_capacity;
+    VkImageMemoryBarrier *acquire_image_barriers;
+    uint32_t acquire_image_count, acquire_image_capacity;
+    VkPipelineStageFlags acquire_stages;
+    VkPipelineStageFlags wait_stages;
+
+    uint64_t bytes_uploaded;
+    uint32_t batches_submitted;
+    uint32_t ring_stalls;
+    double stall_ms;
+};
+
+static double upload_time_ms(void) {
+    return (double)SDL_GetPerformanceCounter() * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void *grow_array(void *array, uint32_t count, uint32_t *capacity, size_t element_size) {
+    if(count < *capacity)
+        return array;
+    *capacity = *capacity ? *capacity * 2 : 16;
+    array = realloc(array, element_size * *capacity);
+    if(!array) {
+        fprintf(stderr, "Failed to grow upload barrier list.\n");
+        exit(1);
+    }
+    return array;
+}
+
+UploadQueue *upload_queue_create(VkDevice device, MemoryAllocator *allocator, VkQueue transfer_queue, uint32_t transfer_family, uint32_t graphics_family, VkDeviceSize ring_size) {
+    UploadQueue *queue = calloc(1, sizeof(UploadQueue));
+    queue->device = device;
+    queue->allocator = allocator;
+    queue->queue = transfer_queue;
+    queue->transfer_family = transfer_family;
+    queue->graphics_family = graphics_family;
+    queue->ring_size = ring_size;
+    // Covers texel block sizes up to 16 bytes and the 4 byte rule for buffer copies
+    queue->copy_alignment = 16;
+
+    queue->staging_buffer = memory_create_buffer(allocator, ring_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEMORY_USAGE_CPU_TO_GPU, &queue->staging_allocation);
+    assert(queue->staging_allocation.mapped);
+
+    VkSemaphoreTypeCreateInfo type_info = { 0 };
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo semaphore_info = { 0 };
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    if(vkCreateSemaphore(device, &semaphore_info, NULL, &queue->timeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create Vulkan timeline semaphore.\n");
+        exit(1);
+    }
+
+    for(uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i) {
+        VkCommandPoolCreateInfo pool_info = { 0 };
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = transfer_family;
+        if(vkCreateCommandPool(device, &pool_info, NULL, &queue->batches[i].command_pool) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create Vulkan upload command pool.\n");
+            exit(1);
+        }
+
+        VkCommandBufferAllocateInfo alloc_info = { 0 };
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = queue->batches[i].command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        if(vkAllocateCommandBuffers(device, &alloc_info, &queue->batches[i].command_buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate Vulkan upload command buffer.\n");
+            exit(1);
+        }
+    }
+    return queue;
+}
+
+void upload_queue_destroy(UploadQueue *queue) {
+    upload_wait_idle(queue);
+    for(uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i) {
+        vkDestroyCommandPool(queue->device, queue->batches[i].command_pool, NULL);
+        free(queue->batches[i].buffer_barriers);
+        free(queue->batches[i].image_barriers);
+    }
+    free(queue->acquire_buffer_barriers);
+    free(queue->acquire_image_barriers);
+    vkDestroySemaphore(queue->device, queue->timeline, NULL);
+    vkDestroyBuffer(queue->device, queue->staging_buffer, NULL);
+    memory_free(queue->allocator, &queue->staging_allocation);
+    free(queue);
+}
+
+static void retire_batch(UploadQueue *queue) {
+    UploadBatch *batch = &queue->batches[queue->oldest];
+    queue->ring_used -= batch->ring_bytes;
+    batch->ring_bytes = 0;
+    queue->oldest = (queue->oldest + 1) % UPLOAD_BATCH_COUNT;
+    --queue->in_flight;
+}
+
+// Gives back the ring space of every batch the transfer queue has finished
+static void reclaim_batches(UploadQueue *queue) {
+    if(!queue->in_flight)
+        return;
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(queue->device, queue->timeline, &completed);
+    while(queue->in_flight && queue->batches[queue->oldest].value <= completed)
+        retire_batch(queue);
+}
+
+static void wait_oldest_batch(UploadQueue *queue) {
+    VkSemaphoreWaitInfo wait_info = { 0 };
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &queue->timeline;
+    wait_info.pValues = &queue->batches[queue->oldest].value;
+    vkWaitSemaphores(queue->device, &wait_info, UINT64_MAX);
+    reclaim_batches(queue);
+}
+
+// Waiting because the ring or the batch slots ran out, which is time lost by the caller
+static void stall_for_oldest_batch(UploadQueue *queue) {
+    double start = upload_time_ms();
+    wait_oldest_batch(queue);
+    queue->stall_ms += upload_time_ms() - start;
+    ++queue->ring_stalls;
+}
+
+static UploadBatch *current_batch(UploadQueue *queue) {
+    UploadBatch *batch = &queue->batches[queue->current];
+    if(batch->recording)
+        return batch;
+
+    // Every batch slot is in flight, the oldest has to finish before its pool can be reused
+    if(queue->in_flight == UPLOAD_BATCH_COUNT)
+        stall_for_oldest_batch(queue);
+
+    vkResetCommandPool(queue->device, batch->command_pool, 0);
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if(vkBeginCommandBuffer(batch->command_buffer, &begin_info) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to begin recording to Vulkan upload command buffer.\n");
+        exit(1);
+    }
+    batch->recording = 1;
+    batch->bytes = 0;
+    batch->buffer_barrier_count = 0;
+    batch->image_barrier_count = 0;
+    batch->dst_stages = 0;
+    return batch;
+}
+
+// Returns the ring offset for size bytes, flushing and waiting for older batches when full
+static VkDeviceSize ring_allocate(UploadQueue *queue, VkDeviceSize size) {
+    if(size > queue->ring_size) {
+        fprintf(stderr, "Upload of %llu bytes does not fit the %llu byte staging ring.\n", (unsigned long long)size, (unsigned long long)queue->ring_size);
+        exit(1);
+    }
+    reclaim_batches(queue);
+    for(;;) {
+        VkDeviceSize offset = (queue->ring_head + queue->copy_alignment - 1) & ~(queue->copy_alignment - 1);
+        // Wrapping leaves the end of the ring unused, it is freed together with this batch
+        if(offset + size > queue->ring_size)
+            offset = 0;
+        VkDeviceSize consumed = offset >= queue->ring_head ? offset + size - queue->ring_head : queue->ring_size - queue->ring_head + size;
+        if(queue->ring_used + consumed <= queue->ring_size) {
+            queue->ring_head = (offset + size) % queue->ring_size;
+            queue->ring_used += consumed;
+            queue->batches[queue->current].ring_bytes += consumed;
+            return offset;
+        }
+        if(queue->in_flight)
+            stall_for_oldest_batch(queue);
+        else
+            upload_flush(queue); // Only the batch being recorded holds ring space
+    }
+}
+
+void upload_buffer(UploadQueue *queue, VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+    // Large uploads are split so the ring keeps room for the batch in flight
+    VkDeviceSize max_chunk = queue->ring_size / 2;
+    while(size) {
+        VkDeviceSize chunk = size < max_chunk ? size : max_chunk;
+        current_batch(queue);
+        VkDeviceSize ring_offset = ring_allocate(queue, chunk);
+        UploadBatch *batch = current_batch(queue); // ring_allocate may have flushed the previous one
+        memcpy((char*)queue->staging_allocation.mapped + ring_offset, data, chunk);
+
+        VkBufferCopy region = { 0 };
+        region.srcOffset = ring_offset;
+        region.dstOffset = offset;
+        region.size = chunk;
+        vkCmdCopyBuffer(batch->command_buffer, queue->staging_buffer, buffer, 1, &region);
+
+        if(queue->transfer_family != queue->graphics_family) {
+            batch->buffer_barriers = grow_array(batch->buffer_barriers, batch->buffer_barrier_count, &batch->buffer_barrier_capacity, sizeof(VkBufferMemoryBarrier));
+            VkBufferMemoryBarrier *barrier = &batch->buffer_barriers[batch->buffer_barrier_count++];
+            *barrier = (VkBufferMemoryBarrier){ 0 };
+            barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier->dstAccessMask = dst_access;
+            barrier->srcQueueFamilyIndex = queue->transfer_family;
+            barrier->dstQueueFamilyIndex = queue->graphics_family;
+            barrier->buffer = buffer;
+            barrier->offset = offset;
+            barrier->size = chunk;
+        }
+        batch->dst_stages |= dst_stages;
+        batch->bytes += chunk;
+
+        data = (const char*)data + chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+void upload_image(UploadQueue *queue, VkImage image, uint32_t mip_level, VkExtent3D extent, uint32_t block_height, const void *data, VkDeviceSize size, VkImageLayout final_layout, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+    // Split into bands of whole block rows like upload_buffer, so levels larger than the ring still fit
+    uint32_t block_rows = (extent.height + block_height - 1) / block_height;
+    VkDeviceSize row_size = size / block_rows;
+    VkDeviceSize max_chunk = queue->ring_size / 2;
+    uint32_t band_rows = row_size < max_chunk ? (uint32_t)(max_chunk / row_size) : 1;
+
+    VkImageMemoryBarrier to_transfer = { 0 };
+    to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    to_transfer.image = image;
+    to_transfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    to_transfer.subresourceRange.baseMipLevel = mip_level;
+    to_transfer.subresourceRange.levelCount = 1;
+    to_transfer.subresourceRange.baseArrayLayer = 0;
+    to_transfer.subresourceRange.layerCount = 1;
+
+    UploadBatch *batch = NULL;
+    uint64_t batch_value = 0; // submitted_value while batch was recorded, it changes with every flush
+    for(uint32_t first_row = 0; first_row < block_rows; first_row += band_rows) {
+        uint32_t rows = block_rows - first_row < band_rows ? block_rows - first_row : band_rows;
+        VkDeviceSize chunk = row_size * rows;
+        current_batch(queue);
+        VkDeviceSize ring_offset = ring_allocate(queue, chunk);
+        UploadBatch *chunk_batch = current_batch(queue);
+        char new_batch = !batch || batch_value != queue->submitted_value;
+        memcpy((char*)queue->staging_allocation.mapped + ring_offset, (const char*)data + row_size * first_row, chunk);
+
+        // The first band moves the level to TRANSFER_DST. When a band lands in a later batch, it
+        // waits for the copies and the transition submitted before it.
+        if(new_batch) {
+            to_transfer.srcAccessMask = batch ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+            to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            to_transfer.oldLayout = batch ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+            to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            vkCmdPipelineBarrier(chunk_batch->command_buffer, batch ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 0, NULL, 0, NULL, 1, &to_transfer);
+            batch = chunk_batch;
+            batch_value = queue->submitted_value;
+        }
+
+        VkBufferImageCopy region = { 0 };
+        region.bufferOffset = ring_offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = mip_level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset.y = (int32_t)(first_row * block_height);
+        region.imageExtent = extent;
+        region.imageExtent.height = (first_row + rows) * block_height < extent.height ? rows * block_height : extent.height - first_row * block_height;
+        vkCmdCopyBufferToImage(batch->command_buffer, queue->staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        batch->bytes += chunk;
+    }
+
+    // The layout change happens in the release barrier, the acquire repeats it as the spec requires
+    batch->image_barriers = grow_array(batch->image_barriers, batch->image_barrier_count, &batch->image_barrier_capacity, sizeof(VkImageMemoryBarrier));
+    VkImageMemoryBarrier *barrier = &batch->image_barriers[batch->image_barrier_count++];
+    *barrier = to_transfer;
+    barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier->dstAccessMask = dst_access;
+    barrier->oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier->newLayout = final_layout;
+    if(queue->transfer_family != queue->graphics_family) {
+        barrier->srcQueueFamilyIndex = queue->transfer_family;
+        barrier->dstQueueFamilyIndex = queue->graphics_family;
+    }
+    batch->dst_stages |= dst_stages;
+}
+
+uint64_t upload_flush(UploadQueue *queue) {
+    UploadBatch *batch = &queue->batches[queue->current];
+    if(!batch->recording)
+        return queue->submitted_value;
+
+    // The graphics queue has to record matching acquires before it touches the resources
+    for(uint32_t i = 0; i < batch->buffer_barrier_count; ++i) {
+        queue->acquire_buffer_barriers = grow_array(queue->acquire_buffer_barriers, queue->acquire_buffer_count, &queue->acquire_buffer_capacity, sizeof(VkBufferMemoryBarrier));
+        queue->acquire_buffer_barriers[queue->acquire_buffer_count++] = batch->buffer_barriers[i];
+    }
+    if(queue->transfer_family != queue->graphics_family) {
+        for(uint32_t i = 0; i < batch->image_barrier_count; ++i) {
+            queue->acquire_image_barriers = grow_array(queue->acquire_image_barriers, queue->acquire_image_count, &queue->acquire_image_capacity, sizeof(VkImageMemoryBarrier));
+            queue->acquire_image_barriers[queue->acquire_image_count++] = batch->image_barriers[i];
+        }
+    }
+    // Release barriers. dstAccessMask is ignored for a release and in the same family case the
+    // semaphore wait makes the writes visible, so it is cleared once the acquires are queued.
+    for(uint32_t i = 0; i < batch->buffer_barrier_count; ++i)
+        batch->buffer_barriers[i].dstAccessMask = 0;
+    for(uint32_t i = 0; i < batch->image_barrier_count; ++i)
+        batch->image_barriers[i].dstAccessMask = 0;
+    if(batch->buffer_barrier_count || batch->image_barrier_count)
+        vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL,
+            batch->buffer_barrier_count, batch->buffer_barriers, batch->image_barrier_count, batch->image_barriers);
+    if(vkEndCommandBuffer(batch->command_buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to record to Vulkan upload command buffer.\n");
+        exit(1);
+    }
+    batch->recording = 0;
+    batch->value = ++queue->submitted_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &batch->value;
+
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &queue->timeline;
+    if(vkQueueSubmit(queue->queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to submit Vulkan upload batch.\n");
+        exit(1);
+    }
+
+    queue->acquire_stages |= batch->dst_stages;
+    queue->wait_stages |= batch->dst_stages;
+
+    queue->bytes_uploaded += batch->bytes;
+    ++queue->batches_submitted;
+    ++queue->in_flight;
+    queue->current = (queue->current + 1) % UPLOAD_BATCH_COUNT;
+    return batch->value;
+}
+
+char upload_is_complete(UploadQueue *queue, uint64_t value) {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(queue->device, queue->timeline, &completed);
+    reclaim_batches(queue);
+    return completed >= value;
+}
+
+void upload_wait_idle(UploadQueue *queue) {
+    while(queue->in_flight)
+        wait_oldest_batch(queue);
+}
+
+UploadWait upload_record_acquire(UploadQueue *queue, VkCommandBuffer command_buffer) {
+    UploadWait wait = { 0 };
+    if(!queue->submitted_value)
+        return wait;
+
+    if(queue->acquire_buffer_count || queue->acquire_image_count) {
+        // srcAccessMask is ignored for acquires, the semaphore wait already orders the copy
+        for(uint32_t i = 0; i < queue->acquire_buffer_count; ++i)
+            queue->acquire_buffer_barriers[i].srcAccessMask = 0;
+        for(uint32_t i = 0; i < queue->acquire_image_count; ++i)
+            queue->acquire_image_barriers[i].srcAccessMask = 0;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queue->acquire_stages, 0, 0, NULL,
+            queue->acquire_buffer_count, queue->acquire_buffer_barriers, queue->acquire_image_count, queue->acquire_image_barriers);
+        queue->acquire_buffer_count = 0;
+        queue->acquire_image_count = 0;
+        queue->acquire_stages = 0;
+    }
+
+    // Waiting on the latest value is free once it has signaled, and keeps later frames ordered too
+    wait.semaphore = queue->timeline;
+    wait.value = queue->submitted_value;
+    wait.stages = queue->wait_stages ? queue->wait_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    return wait;
+}
+
+void upload_print_stats(UploadQueue *queue) {
+    printf("Uploads: %.1f MB in %u batches on %s queue family %u\n", queue->bytes_uploaded / (1024.0 * 1024.0), queue->batches_submitted,
+        queue->transfer_family != queue->graphics_family ? "transfer" : "graphics", queue->transfer_family);
+    printf("Staging ring: %llu KB, %u stalls waiting for space totalling %.2f ms\n", (unsigned long long)(queue->ring_size / 1024), queue->ring_stalls, queue->stall_ms);
+}
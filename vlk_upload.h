@@ -0,0 +1,43 @@
+#ifndef VLK_UPLOAD_H
+#define VLK_UPLOAD_H
+
+#include <volk.h>
+
+#include "vlk_memory.h"
+
+// Streams data to device local resources through a persistently mapped staging ring.
+// Copies are batched and submitted on the transfer queue, ownership is handed to the
+// graphics queue and completion is tracked with a timeline semaphore, so uploads never
+// block the graphics queue unless the ring runs full.
+
+typedef struct UploadQueue UploadQueue;
+
+// What the next graphics submit has to wait for, value 0 means nothing to wait on
+typedef struct UploadWait {
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stages;
+} UploadWait;
+
+UploadQueue *upload_queue_create(VkDevice device, MemoryAllocator *allocator, VkQueue transfer_queue, uint32_t transfer_family, uint32_t graphics_family, VkDeviceSize ring_size);
+void upload_queue_destroy(UploadQueue *queue);
+
+// Data is copied into the ring right away, the copy itself runs once the batch is flushed.
+// dst_stages/dst_access describe how the graphics queue will use the resource.
+void upload_buffer(UploadQueue *queue, VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access);
+// Uploads one whole mip level of a color image and leaves it in final_layout. data holds
+// tightly packed rows of blocks, block_height is 1 for uncompressed formats and 4 for BC.
+// Levels larger than the ring are copied in bands of rows.
+void upload_image(UploadQueue *queue, VkImage image, uint32_t mip_level, VkExtent3D extent, uint32_t block_height, const void *data, VkDeviceSize size, VkImageLayout final_layout, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access);
+
+// Submits the current batch, returns the timeline value that signals its completion
+uint64_t upload_flush(UploadQueue *queue);
+char upload_is_complete(UploadQueue *queue, uint64_t value);
+void upload_wait_idle(UploadQueue *queue);
+
+// Records the graphics side of the ownership transfer for everything flushed so far
+UploadWait upload_record_acquire(UploadQueue *queue, VkCommandBuffer command_buffer);
+
+void upload_print_stats(UploadQueue *queue);
+
+#endif // VLK_UPLOAD_H